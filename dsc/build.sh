@@ -2,8 +2,9 @@
 
 set -e;
 
-if [ $# -ne 1 ]; then
-    echo "Usage: $0 path/to/dyld-src";
+if [ $# -gt 1 ]; then
+    echo "Usage: $0 [path/to/dyld-src]";
+    echo 'Without a dyld source folder, only the standalone tools are built.';
     exit 1;
 fi;
 
@@ -19,8 +20,89 @@ out="$(dirname "$0")";
 if [ -z "$GXX" ]; then
     GXX=clang++;
 fi;
+SFLAGS=("-std=${std}" '-Wall' '-O3' '-flto' '-pthread');
 GXXFLAGS=("-std=${std}" '-Wall' '-O3' '-flto' '-DSUPPORT_ARCH_arm64e=1' '-DSUPPORT_ARCH_arm64_32=1' '-D__API_AVAILABLE_PLATFORM_bridgeos(x)=watchos,introduced=x' '-D__API_UNAVAILABLE_PLATFORM_bridgeos=bridgeos,unavailable' "-I${out}/inc" "-I${in}" "-I${base}/include" "-I${base}/dyld3" "-I${base}/dyld3/shared-cache" "-I${base}/interlinked-dylibs");
 
+# Our own cache reader, shared by the tools below. Version-independent, so it
+# never sees the include paths from the dyld source: tools that also link dyld
+# code get it as objects from srcs_objs instead of compiling it with GXXFLAGS.
+# profile_new.cpp replaces the global operator new and delete to count
+# allocations, so it only goes into the tools that can turn profiling on.
+srcs=();
+for f in "$out"/src/*.cpp; do
+    if [ "$(basename "$f")" != 'profile_new.cpp' ]; then
+        srcs+=("$f");
+    fi;
+done;
+prof=("$out/src/profile_new.cpp");
+tool_srcs=();
+
+# Compiles srcs, tool_srcs and tools/<tool>.cpp with SFLAGS and any extra
+# arguments into objects, and sets objs to them.
+srcs_objs()
+{
+    local tool="$1" f o;
+    shift;
+    if [ -z "$objdir" ]; then
+        objdir="$(mktemp -d)";
+        trap 'rm -rf "$objdir"' EXIT;
+    fi;
+    mkdir -p "$objdir/$tool";
+    objs=();
+    for f in "${srcs[@]}" "${tool_srcs[@]}" "$out/tools/$tool.cpp"; do
+        o="$objdir/$tool/$(basename "$f" .cpp).o";
+        echo "$GXX" "${SFLAGS[@]}" "$@" -c -o "$o" "$f";
+        "$GXX" "${SFLAGS[@]}" "$@" -c -o "$o" "$f";
+        objs+=("$o");
+    done;
+}
+
+# libzstd is optional, for packed output
+zstd=();
+if pkg-config --exists libzstd 2>/dev/null; then
+    zstd=('-DDSC_HAVE_ZSTD=1' $(pkg-config --cflags --libs libzstd));
+else
+    echo '[!] libzstd not found, building without packs';
+fi;
+
+printf "\x1b[1;95m===== dsc_extract =====\x1b[0m\n";
+
+echo "$GXX" "${SFLAGS[@]}" -o "$out/dsc_extract" "${srcs[@]}" "${prof[@]}" "$out/tools/dsc_extract.cpp" "${zstd[@]}";
+"$GXX" "${SFLAGS[@]}" -o "$out/dsc_extract" "${srcs[@]}" "${prof[@]}" "$out/tools/dsc_extract.cpp" "${zstd[@]}";
+
+printf "\x1b[1;95m===== dsc_bench =====\x1b[0m\n";
+
+echo "$GXX" "${SFLAGS[@]}" -o "$out/dsc_bench" "${srcs[@]}" "$out/tools/dsc_bench.cpp" "${zstd[@]}";
+"$GXX" "${SFLAGS[@]}" -o "$out/dsc_bench" "${srcs[@]}" "$out/tools/dsc_bench.cpp" "${zstd[@]}";
+
+printf "\x1b[1;95m===== dsc_synth =====\x1b[0m\n";
+
+echo "$GXX" "${SFLAGS[@]}" -o "$out/dsc_synth" "${srcs[@]}" "$out/tools/dsc_synth.cpp";
+"$GXX" "${SFLAGS[@]}" -o "$out/dsc_synth" "${srcs[@]}" "$out/tools/dsc_synth.cpp";
+
+if [ "${#zstd[@]}" -gt 0 ]; then
+    printf "\x1b[1;95m===== dsc_unpack =====\x1b[0m\n";
+
+    echo "$GXX" "${SFLAGS[@]}" -o "$out/dsc_unpack" "${srcs[@]}" "$out/tools/dsc_unpack.cpp" "${zstd[@]}";
+    "$GXX" "${SFLAGS[@]}" -o "$out/dsc_unpack" "${srcs[@]}" "$out/tools/dsc_unpack.cpp" "${zstd[@]}";
+fi;
+
+if pkg-config --exists fuse3 2>/dev/null; then
+    printf "\x1b[1;95m===== dsc_mount =====\x1b[0m\n";
+
+    fuse=($(pkg-config --cflags --libs fuse3));
+    echo "$GXX" "${SFLAGS[@]}" -o "$out/dsc_mount" "${srcs[@]}" "$out/tools/dsc_mount.cpp" "${fuse[@]}";
+    "$GXX" "${SFLAGS[@]}" -o "$out/dsc_mount" "${srcs[@]}" "$out/tools/dsc_mount.cpp" "${fuse[@]}";
+else
+    echo '[!] fuse3 not found, skipping dsc_mount';
+fi;
+
+if [ -z "$base" ]; then
+    echo;
+    echo '[*] Success';
+    exit 0;
+fi;
+
 printf "\x1b[1;95m===== dsc_extractor =====\x1b[0m\n";
 
 found=false;
@@ -74,7 +156,8 @@ EOF
 printf "\x1b[1;95m===== dsc_util =====\x1b[0m\n";
 
 found=false;
-data='extern "C" int dyld_shared_cache_extract_dylibs(const char*, const char*);';
+data='#define main siguza_dsc_util_main'$'\n';
+data+='extern "C" int dyld_shared_cache_extract_dylibs(const char*, const char*);';
 while read -r; do
     data+="$REPLY"$'\n';
     if egrep -q '^\s*else if \( options\.mode == modeExtract \) \{$' <<<"$REPLY"; then
@@ -93,8 +176,18 @@ for f in 'Closure.cpp' 'ClosureFileSystemPhysical.cpp' 'Diagnostics.cpp' 'MachOA
         files+=("$file");
     fi;
 done;
-echo "$GXX" "${GXXFLAGS[@]}" -o "$out/dsc_util" "$in/dsc_extractor.cpp" "$in/dsc_iterator.cpp" "${files[@]}" -xobjective-c++ ...;
-"$GXX" "${GXXFLAGS[@]}" -o "$out/dsc_util" "$in/dsc_extractor.cpp" "$in/dsc_iterator.cpp" "${files[@]}" -xobjective-c++ <(echo "$data");
+# libcurl is optional, for the remote mode
+curl=();
+curl_libs=();
+if hash curl-config &>/dev/null; then
+    curl=('-DDSC_HAVE_CURL=1' $(curl-config --cflags));
+    curl_libs=($(curl-config --libs));
+fi;
+tool_srcs=("${prof[@]}");
+srcs_objs dsc_util "${curl[@]}";
+tool_srcs=();
+echo "$GXX" "${GXXFLAGS[@]}" -o "$out/dsc_util" "${objs[@]}" "$in/dsc_extractor.cpp" "$in/dsc_iterator.cpp" "${files[@]}" "${curl_libs[@]}" -xobjective-c++ ...;
+"$GXX" "${GXXFLAGS[@]}" -o "$out/dsc_util" "${objs[@]}" "$in/dsc_extractor.cpp" "$in/dsc_iterator.cpp" "${files[@]}" "${curl_libs[@]}" -xobjective-c++ <(echo "$data");
 
 if [ -e "$base/dyld3/shared-cache/dyld_closure_util.cpp" ]; then
     printf "\x1b[1;95m===== dsc_closure =====\x1b[0m\n";
@@ -106,8 +199,11 @@ if [ -e "$base/dyld3/shared-cache/dyld_closure_util.cpp" ]; then
             files+=("$file");
         fi;
     done;
-    echo "$GXX" "${GXXFLAGS[@]}" -o "$out/dsc_closure" "$base/dyld3/shared-cache/dyld_closure_util.cpp" "${files[@]}";
-    "$GXX" "${GXXFLAGS[@]}" -o "$out/dsc_closure" "$base/dyld3/shared-cache/dyld_closure_util.cpp" "${files[@]}";
+    data='#define main siguza_dsc_closure_main'$'\n';
+    data+="$(cat "$base/dyld3/shared-cache/dyld_closure_util.cpp")";
+    srcs_objs dsc_closure;
+    echo "$GXX" "${GXXFLAGS[@]}" -o "$out/dsc_closure" "${objs[@]}" "${files[@]}" -xc++ ...;
+    "$GXX" "${GXXFLAGS[@]}" -o "$out/dsc_closure" "${objs[@]}" "${files[@]}" -xc++ <(echo "$data");
 fi;
 
 echo;
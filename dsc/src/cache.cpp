@@ -0,0 +1,523 @@
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "common.h"
+#include "headers.h"
+#include "locals.h"
+#include "stubs.h"
+#include "pointer.h"
+
+namespace dsc
+{
+    cache_t::cache_t() = default;
+
+    cache_t::~cache_t()
+    {
+        if(this->base)
+        {
+            munmap((void*)this->base, this->size);
+        }
+        if(this->fd != -1)
+        {
+            close(this->fd);
+        }
+        for(const subcache_t &sc : this->subcaches)
+        {
+            if(sc.base)
+            {
+                munmap((void*)sc.base, sc.size);
+            }
+            if(sc.fd != -1)
+            {
+                close(sc.fd);
+            }
+        }
+        for(const std::pair<const uint8_t*, size_t> &h : this->hot)
+        {
+            paging_unmap(h.first, h.second);
+        }
+    }
+
+    static bool cache_map(const char *file, const paging_t &paging, const uint8_t *&base, size_t &size, int &outfd)
+    {
+        int fd = ::open(file, O_RDONLY | O_CLOEXEC);
+        if(fd == -1)
+        {
+            ERR("open(%s): %s", file, strerror(errno));
+            return false;
+        }
+        struct stat s;
+        if(fstat(fd, &s) != 0)
+        {
+            ERR("fstat(%s): %s", file, strerror(errno));
+            close(fd);
+            return false;
+        }
+        if((size_t)s.st_size < sizeof(dyld_cache_mapping_info) + offsetof(dyld_cache_header, imagesOffsetOld))
+        {
+            ERR("%s: file too short", file);
+            close(fd);
+            return false;
+        }
+        void *mem = paging_map(fd, (size_t)s.st_size, paging);
+        if(mem == MAP_FAILED)
+        {
+            ERR("mmap(%s): %s", file, strerror(errno));
+            close(fd);
+            return false;
+        }
+        base = (const uint8_t*)mem;
+        size = (size_t)s.st_size;
+        outfd = fd;
+        return true;
+    }
+
+    // Mappings of one cache file, with the slide info that covers them. Main cache and subcaches share the layout.
+    static bool cache_mappings(const char *file, const uint8_t *base, size_t size, uint32_t idx, std::vector<mapping_t> &out)
+    {
+        const dyld_cache_header *hdr = (const dyld_cache_header*)base;
+        if(hdr->mappingOffset > size || (size - hdr->mappingOffset) / sizeof(dyld_cache_mapping_info) < hdr->mappingCount)
+        {
+            ERR("%s: mappings out of bounds", file);
+            return false;
+        }
+        const dyld_cache_mapping_info *map = (const dyld_cache_mapping_info*)(base + hdr->mappingOffset);
+        size_t first = out.size();
+        out.reserve(first + hdr->mappingCount);
+        for(uint32_t i = 0; i < hdr->mappingCount; ++i)
+        {
+            if(map[i].fileOffset > size || size - map[i].fileOffset < map[i].size)
+            {
+                ERR("%s: mapping %u out of bounds", file, i);
+                return false;
+            }
+            out.push_back({ map[i].address, map[i].size, map[i].fileOffset, idx, map[i].maxProt, map[i].initProt, base + map[i].fileOffset, nullptr, 0 });
+        }
+
+        auto set_slide = [&](mapping_t &m, uint64_t off, uint64_t len)
+        {
+            if(len >= sizeof(uint32_t) && off <= size && size - off >= len)
+            {
+                m.slide = base + off;
+                m.slide_size = len;
+            }
+        };
+        if(DSC_HAS_FIELD(hdr, mappingWithSlideCount) && hdr->mappingWithSlideCount != 0)
+        {
+            if(hdr->mappingWithSlideOffset > size || (size - hdr->mappingWithSlideOffset) / sizeof(dyld_cache_mapping_and_slide_info) < hdr->mappingWithSlideCount)
+            {
+                ERR("%s: slide mappings out of bounds", file);
+                return false;
+            }
+            const dyld_cache_mapping_and_slide_info *smap = (const dyld_cache_mapping_and_slide_info*)(base + hdr->mappingWithSlideOffset);
+            for(uint32_t i = 0; i < hdr->mappingWithSlideCount && i < hdr->mappingCount; ++i)
+            {
+                if(smap[i].slideInfoFileSize != 0)
+                {
+                    set_slide(out[first + i], smap[i].slideInfoFileOffset, smap[i].slideInfoFileSize);
+                }
+            }
+        }
+        else if(hdr->mappingCount > 1)
+        {
+            // Old caches have a single slide info for the DATA mapping
+            set_slide(out[first + 1], hdr->slideInfoOffsetUnused, hdr->slideInfoSizeUnused);
+        }
+        return true;
+    }
+
+    bool cache_t::open(const char *file, const paging_t &paging)
+    {
+        this->path = file;
+        this->paging = paging;
+        if(!cache_map(file, paging, this->base, this->size, this->fd) || !this->load(true))
+        {
+            return false;
+        }
+        // After every file is mapped, so populating doesn't run on threads of its own inside load_subcaches
+        paging_prefetch(this->base, this->size, paging);
+        for(const subcache_t &sc : this->subcaches)
+        {
+            paging_prefetch(sc.base, sc.size, paging);
+        }
+        this->load_hot();
+        return true;
+    }
+
+    // Read-only mappings in address order, as many as fit in the budget. A copy
+    // that can't be made isn't fatal, the mapping just keeps pointing at the file.
+    void cache_t::load_hot(void)
+    {
+        if(!(this->paging.flags & (PAGING_HOT | PAGING_HUGETLB)))
+        {
+            return;
+        }
+        for(mapping_t &m : this->mappings)
+        {
+            // VM_PROT_READ only, which is LINKEDIT and nothing else in practice
+            if(m.maxprot != 1 || m.size == 0 || (this->paging.hot_max && this->paging.hot_max - this->hot_bytes < m.size))
+            {
+                continue;
+            }
+            bool hugetlb;
+            const uint8_t *copy = paging_copy(m.data, (size_t)m.size, (this->paging.flags & PAGING_HUGETLB) != 0, &hugetlb);
+            if(!copy)
+            {
+                WRN("%s: can't copy the mapping at 0x%llx: %s", this->path, (unsigned long long)m.addr, strerror(errno));
+                return;
+            }
+            this->hot.push_back({ copy, (size_t)m.size });
+            m.data = copy;
+            this->hot_bytes += m.size;
+            this->hugetlb_bytes += hugetlb ? m.size : 0;
+        }
+        if((this->paging.flags & PAGING_HUGETLB) && this->hugetlb_bytes < this->hot_bytes)
+        {
+            WRN("%s: hugetlb pool too small, %.1f of %.1f MiB went to transparent huge pages", this->path, (this->hot_bytes - this->hugetlb_bytes) / 1048576.0, this->hot_bytes / 1048576.0);
+        }
+    }
+
+    bool cache_t::adopt(const char *name, const uint8_t *mem, size_t len, std::vector<subcache_t> subs)
+    {
+        this->path = name;
+        this->base = mem;
+        this->size = len;
+        this->subcaches = std::move(subs);
+        if(len < sizeof(dyld_cache_mapping_info) + offsetof(dyld_cache_header, imagesOffsetOld))
+        {
+            ERR("%s: file too short", name);
+            return false;
+        }
+        for(const subcache_t &sc : this->subcaches)
+        {
+            if(sc.size < sizeof(dyld_cache_mapping_info) + offsetof(dyld_cache_header, imagesOffsetOld))
+            {
+                ERR("%s: file too short", sc.path.c_str());
+                return false;
+            }
+        }
+        return this->load(!this->subcaches.empty());
+    }
+
+    bool subcache_suffixes(const char *file, const uint8_t *base, size_t size, std::vector<std::string> &out)
+    {
+        const dyld_cache_header *hdr = (const dyld_cache_header*)base;
+        out.clear();
+        if(!DSC_HAS_FIELD(hdr, subCacheArrayCount) || hdr->subCacheArrayCount == 0)
+        {
+            return true;
+        }
+        bool v1 = !DSC_HAS_FIELD(hdr, cacheSubType);
+        size_t entsize = v1 ? sizeof(dyld_subcache_entry_v1) : sizeof(dyld_subcache_entry);
+        if(hdr->subCacheArrayOffset > size || (size - hdr->subCacheArrayOffset) / entsize < hdr->subCacheArrayCount)
+        {
+            ERR("%s: subcache array out of bounds", file);
+            return false;
+        }
+        for(uint32_t i = 0; i < hdr->subCacheArrayCount; ++i)
+        {
+            if(v1)
+            {
+                out.push_back("." + std::to_string(i + 1));
+            }
+            else
+            {
+                const char *suffix = ((const dyld_subcache_entry*)(base + hdr->subCacheArrayOffset + i * entsize))->fileSuffix;
+                out.push_back(std::string(suffix, strnlen(suffix, sizeof(dyld_subcache_entry::fileSuffix))));
+            }
+        }
+        return true;
+    }
+
+    // Subcaches are independent files, so they're mapped and checked in parallel.
+    // Each one's mappings land in their own list and are merged in header order afterwards.
+    // Adopted caches come with their subcaches already in memory and only get the checks.
+    bool cache_t::load_subcaches(void)
+    {
+        const char *file = this->path;
+        const dyld_cache_header *hdr = this->header();
+        std::vector<std::string> suffixes;
+        if(!subcache_suffixes(file, this->base, this->size, suffixes))
+        {
+            return false;
+        }
+        bool adopted = !this->subcaches.empty();
+        if(adopted && this->subcaches.size() != suffixes.size())
+        {
+            ERR("%s: %zu subcaches given, the header lists %zu", file, this->subcaches.size(), suffixes.size());
+            return false;
+        }
+        if(suffixes.empty())
+        {
+            return true;
+        }
+        bool v1 = !DSC_HAS_FIELD(hdr, cacheSubType);
+        this->subcache_layout = v1 ? 1 : 2;
+        size_t entsize = v1 ? sizeof(dyld_subcache_entry_v1) : sizeof(dyld_subcache_entry);
+        uint32_t count = (uint32_t)suffixes.size();
+
+        if(!adopted)
+        {
+            this->subcaches.resize(count, { std::string(), nullptr, 0, -1 });
+        }
+        std::vector<std::vector<mapping_t>> maps(count);
+        std::atomic<bool> ok(true);
+        parallel_for(count, [&](size_t i, size_t)
+        {
+            const uint8_t *ent = this->base + hdr->subCacheArrayOffset + i * entsize;
+            subcache_t &sc = this->subcaches[i];
+            if(!adopted)
+            {
+                sc.path = file + suffixes[i];
+            }
+            if(!adopted && !cache_map(sc.path.c_str(), this->paging, sc.base, sc.size, sc.fd))
+            {
+                ok = false;
+                return;
+            }
+            const dyld_cache_header *sub = (const dyld_cache_header*)sc.base;
+            if(memcmp(sub->magic, hdr->magic, sizeof(hdr->magic)) != 0)
+            {
+                ERR("%s: magic doesn't match the main cache", sc.path.c_str());
+                ok = false;
+                return;
+            }
+            if(!cache_mappings(sc.path.c_str(), sc.base, sc.size, (uint32_t)i + 1, maps[i]))
+            {
+                ok = false;
+                return;
+            }
+            // Entry layouts differ only after the UUID
+            if(!DSC_HAS_FIELD(sub, uuid) || memcmp(sub->uuid, ((const dyld_subcache_entry_v1*)ent)->uuid, sizeof(sub->uuid)) != 0)
+            {
+                ERR("%s: UUID doesn't match the main cache's subcache table", sc.path.c_str());
+                ok = false;
+            }
+        });
+        if(!ok)
+        {
+            return false;
+        }
+        for(const std::vector<mapping_t> &m : maps)
+        {
+            this->mappings.insert(this->mappings.end(), m.begin(), m.end());
+        }
+        return true;
+    }
+
+    bool cache_t::load(bool subcaches)
+    {
+        const char *file = this->path;
+        const dyld_cache_header *hdr = this->header();
+        if(strncmp(hdr->magic, "dyld_v1", 7) != 0)
+        {
+            ERR("%s: bad magic", file);
+            return false;
+        }
+        const char *arch = hdr->magic + 7;
+        while(arch < hdr->magic + sizeof(hdr->magic) && *arch == ' ')
+        {
+            ++arch;
+        }
+        this->ptrsize = (strncmp(arch, "i386", 4) == 0 || strncmp(arch, "armv", 4) == 0 || strncmp(arch, "arm64_32", 8) == 0) ? 4 : 8;
+        this->header_size = hdr->mappingOffset;
+
+        if(!cache_mappings(file, this->base, this->size, 0, this->mappings))
+        {
+            return false;
+        }
+        if(subcaches)
+        {
+            if(!this->load_subcaches())
+            {
+                return false;
+            }
+        }
+        else if(DSC_HAS_FIELD(hdr, subCacheArrayCount) && hdr->subCacheArrayCount != 0)
+        {
+            WRN("%s: ignoring %u subcaches, only the main cache file is available", file, hdr->subCacheArrayCount);
+        }
+
+        // All files share one pointer format, the first slide info found describes it
+        for(const mapping_t &m : this->mappings)
+        {
+            if(!m.slide)
+            {
+                continue;
+            }
+            const dyld_cache_slide_info2 *si = (const dyld_cache_slide_info2*)m.slide;
+            this->slide_version = si->version;
+            if((si->version == 2 || si->version == 4) && m.slide_size >= sizeof(dyld_cache_slide_info2))
+            {
+                this->slide_mask = si->delta_mask;
+                this->slide_add = si->value_add;
+            }
+            else if((si->version == 3 || si->version == 5) && m.slide_size >= sizeof(dyld_cache_slide_info3))
+            {
+                this->slide_add = ((const dyld_cache_slide_info3*)si)->auth_value_add;
+            }
+            else if(si->version != 1)
+            {
+                WRN("%s: unknown slide info version %u", file, si->version);
+            }
+            break;
+        }
+
+        // One flat table for every lookup, so address resolution is a binary search no matter how many files there are
+        std::sort(this->mappings.begin(), this->mappings.end(), [](const mapping_t &a, const mapping_t &b)
+        {
+            return a.addr < b.addr;
+        });
+        for(size_t i = 1; i < this->mappings.size(); ++i)
+        {
+            const mapping_t &prev = this->mappings[i - 1];
+            if(this->mappings[i].addr - prev.addr < prev.size)
+            {
+                ERR("%s: mappings at 0x%llx and 0x%llx overlap", file, (unsigned long long)prev.addr, (unsigned long long)this->mappings[i].addr);
+                return false;
+            }
+        }
+
+        uint32_t imgoff = hdr->imagesOffsetOld,
+                 imgcnt = hdr->imagesCountOld;
+        if(DSC_HAS_FIELD(hdr, imagesCount) && hdr->imagesOffset != 0)
+        {
+            imgoff = hdr->imagesOffset;
+            imgcnt = hdr->imagesCount;
+        }
+        if(imgoff > this->size || (this->size - imgoff) / sizeof(dyld_cache_image_info) < imgcnt)
+        {
+            ERR("%s: image table out of bounds", file);
+            return false;
+        }
+        const dyld_cache_image_info *img = (const dyld_cache_image_info*)(this->base + imgoff);
+        this->images.reserve(imgcnt);
+        for(uint32_t i = 0; i < imgcnt; ++i)
+        {
+            const char *p = (const char*)this->base + img[i].pathFileOffset;
+            if(img[i].pathFileOffset >= this->size || !memchr(p, '\0', this->size - img[i].pathFileOffset))
+            {
+                ERR("%s: image %u has a bad path", file, i);
+                return false;
+            }
+            this->images.push_back({ img[i].address, p });
+        }
+        return true;
+    }
+
+    std::string cache_t::describe(void) const
+    {
+        const dyld_cache_header *hdr = this->header();
+        const char *arch = hdr->magic + 7;
+        while(arch < hdr->magic + sizeof(hdr->magic) && *arch == ' ')
+        {
+            ++arch;
+        }
+        char buf[256];
+        int len = snprintf(buf, sizeof(buf), "%.*s, %u-bit, header 0x%x, slide info v%u, %zu images, %zu mappings",
+                           (int)strnlen(arch, hdr->magic + sizeof(hdr->magic) - arch), arch, this->ptrsize * 8, this->header_size,
+                           this->slide_version, this->images.size(), this->mappings.size());
+        if(!this->subcaches.empty() && len > 0 && (size_t)len < sizeof(buf))
+        {
+            len += snprintf(buf + len, sizeof(buf) - len, ", %zu subcaches (%s)", this->subcaches.size(), this->subcache_layout == 1 ? "numbered" : "named");
+        }
+        if((this->paging.flags || this->paging.prefetch) && len > 0 && (size_t)len < sizeof(buf))
+        {
+            snprintf(buf + len, sizeof(buf) - len, ", paging %s, %.1f MiB in huge page copies", paging_describe(this->paging).c_str(), this->hot_bytes / 1048576.0);
+        }
+        return buf;
+    }
+
+    const mapping_t* cache_t::mapping(uint64_t addr) const
+    {
+        auto it = std::upper_bound(this->mappings.begin(), this->mappings.end(), addr, [](uint64_t a, const mapping_t &m)
+        {
+            return a < m.addr;
+        });
+        if(it != this->mappings.begin())
+        {
+            const mapping_t &m = *--it;
+            if(addr - m.addr < m.size)
+            {
+                return &m;
+            }
+        }
+        return nullptr;
+    }
+
+    const uint8_t* cache_t::span(uint64_t addr, uint64_t *avail) const
+    {
+        const mapping_t *m = this->mapping(addr);
+        if(!m)
+        {
+            *avail = 0;
+            return nullptr;
+        }
+        *avail = m->size - (addr - m->addr);
+        return m->data + (addr - m->addr);
+    }
+
+    const uint8_t* cache_t::ptr(uint64_t addr, uint64_t len) const
+    {
+        uint64_t avail;
+        const uint8_t *p = this->span(addr, &avail);
+        return p && avail >= len ? p : nullptr;
+    }
+
+    const char* cache_t::str(uint64_t addr) const
+    {
+        uint64_t avail;
+        const uint8_t *p = this->span(addr, &avail);
+        return p && memchr(p, '\0', avail) ? (const char*)p : nullptr;
+    }
+
+    uint64_t cache_t::decode_ptr(uint64_t raw) const
+    {
+        return ptr_dispatch(*this, [&](const auto &fmt) -> uint64_t
+        {
+            return fmt.decode((typename std::decay<decltype(fmt)>::type::raw_t)raw);
+        });
+    }
+
+    bool cache_t::read_ptr(uint64_t addr, uint64_t &out) const
+    {
+        const uint8_t *p = this->ptr(addr, this->ptrsize);
+        if(!p)
+        {
+            return false;
+        }
+        // A zero word is a null pointer that nothing rebases, not an offset of 0 from value_add
+        if(this->ptrsize == 8)
+        {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            out = v ? this->decode_ptr(v) : 0;
+        }
+        else
+        {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            out = v ? this->decode_ptr(v) : 0;
+        }
+        return true;
+    }
+
+    bool cache_t::pointers(uint64_t start, uint64_t end, std::vector<uint64_t> &out) const
+    {
+        return ptr_dispatch(*this, [&](const auto &fmt)
+        {
+            return ptr_walk(*this, fmt, start, end, [&](uint64_t addr, auto)
+            {
+                out.push_back(addr);
+            });
+        });
+    }
+}
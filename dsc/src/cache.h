@@ -0,0 +1,138 @@
+#ifndef DSC_CACHE_H
+#define DSC_CACHE_H
+
+#include <stddef.h>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "format.h"
+#include "paging.h"
+
+namespace dsc
+{
+    struct headers_t;
+    struct locals_t;
+    struct stubs_t;
+
+    struct mapping_t
+    {
+        uint64_t addr;
+        uint64_t size;
+        uint64_t fileoff;       // Within the file the mapping comes from
+        uint32_t file;          // 0 for the main cache file, i + 1 for subcaches[i]
+        uint32_t maxprot;
+        uint32_t initprot;
+        const uint8_t *data;
+        const uint8_t *slide;   // Slide info covering this mapping, or NULL
+        uint64_t slide_size;
+    };
+
+    struct image_t
+    {
+        uint64_t addr;
+        const char *path;
+    };
+
+    struct subcache_t
+    {
+        std::string path;
+        const uint8_t *base;
+        size_t size;
+        int fd;
+    };
+
+    // File name suffixes of the subcaches listed in a main cache file's header, in order: ".N" in the
+    // first layout, the recorded fileSuffix in the second. Empty if there are none, false if the table is out of bounds.
+    bool subcache_suffixes(const char *file, const uint8_t *base, size_t size, std::vector<std::string> &out);
+
+    // A read-only mapped shared cache. Pointers handed out stay valid for the lifetime of the object.
+    struct cache_t
+    {
+        const char *path = nullptr;
+        const uint8_t *base = nullptr;
+        size_t size = 0;
+        int fd = -1;                    // Kept open for in-kernel copies out of the file, -1 for adopted caches
+        uint32_t ptrsize = 0;
+        uint32_t slide_version = 0;     // Pointer encoding in DATA mappings, from the slide info
+        uint64_t slide_mask = 0;        // v2/v4: delta mask
+        uint64_t slide_add = 0;         // v2/v4: value add, v3: auth value add, v5: value add
+        uint32_t header_size = 0;       // mappingOffset, which tells header revisions apart
+        uint32_t subcache_layout = 0;   // 0: none, 1: entries without a suffix (".N"), 2: entries with fileSuffix
+        std::vector<subcache_t> subcaches;
+        std::vector<mapping_t> mappings;    // Across all files, sorted by address
+        std::vector<image_t> images;
+        paging_t paging;                // Policy the files were opened with
+        uint64_t hot_bytes = 0;         // Of the mappings, copied into huge pages by the policy
+        uint64_t hugetlb_bytes = 0;     // Of those, from the hugetlb pool
+
+        cache_t();
+        cache_t(const cache_t&) = delete;
+        cache_t& operator=(const cache_t&) = delete;
+        ~cache_t();
+
+        // Maps the main cache file and every subcache listed in its header, as the paging policy says (see paging.h).
+        bool open(const char *file, const paging_t &paging = paging_env());
+        // Takes ownership of an mmapped region holding a cache file, for caches that don't come from a local file,
+        // and of the regions in subs holding its subcaches, in header order (path, base and size set, fd -1).
+        // Only the header, mapping, slide and image tables need to be populated at this point. Without subs,
+        // subcaches listed in the header are ignored.
+        bool adopt(const char *name, const uint8_t *mem, size_t len, std::vector<subcache_t> subs = {});
+
+        const dyld_cache_header* header(void) const
+        {
+            return (const dyld_cache_header*)this->base;
+        }
+
+        // One-line summary of the detected format: architecture, header revision, pointer format and file layout.
+        std::string describe(void) const;
+
+        // Mapping containing addr, or NULL.
+        const mapping_t* mapping(uint64_t addr) const;
+        // Descriptor of the file a mapping comes from, -1 if there is none.
+        int file_fd(const mapping_t &m) const
+        {
+            return m.file == 0 ? this->fd : this->subcaches[m.file - 1].fd;
+        }
+
+        // Host pointer for an unslid VM address, or NULL if [addr, addr+len) is not backed by file data.
+        const uint8_t* ptr(uint64_t addr, uint64_t len = 1) const;
+        // Like ptr(), but reports how many bytes are readable from addr on.
+        const uint8_t* span(uint64_t addr, uint64_t *avail) const;
+        // NUL-terminated string at addr, or NULL if it runs off its mapping.
+        const char* str(uint64_t addr) const;
+
+        // Turns a pointer as stored on disk into the unslid address it refers to.
+        uint64_t decode_ptr(uint64_t raw) const;
+        // Reads and decodes the pointer stored at addr, false if unmapped.
+        bool read_ptr(uint64_t addr, uint64_t &out) const;
+        // Appends the address of every slid pointer in [start, end), found by walking the slide info chains.
+        // Returns false if the slide info can't be walked (v1 or malformed).
+        bool pointers(uint64_t start, uint64_t end, std::vector<uint64_t> &out) const;
+
+        // Parsed headers of all images (see headers.h), built on first use and shared by all callers and threads.
+        const headers_t& headers(void) const;
+        // Local symbols of all images (see locals.h), loaded on first use like headers().
+        const locals_t& locals(void) const;
+        // Stubs and branch islands of all images (see stubs.h), decoded on first use like headers().
+        const stubs_t& stubs(void) const;
+
+    private:
+        mutable std::once_flag headers_once;
+        mutable std::unique_ptr<headers_t> headers_data;
+        mutable std::once_flag locals_once;
+        mutable std::unique_ptr<locals_t> locals_data;
+        mutable std::once_flag stubs_once;
+        mutable std::unique_ptr<stubs_t> stubs_data;
+        std::vector<std::pair<const uint8_t*, size_t>> hot;    // Copies made by load_hot()
+
+        bool load(bool subcaches);
+        bool load_subcaches(void);
+        void load_hot(void);
+    };
+}
+
+#endif
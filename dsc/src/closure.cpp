@@ -0,0 +1,525 @@
+#include <atomic>
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <map>
+#include <mutex>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+
+#include "cache.h"
+#include "common.h"
+#include "modes.h"
+#include "rootfs.h"
+
+// Closures for every main executable on a root filesystem. The scan and the
+// dependency check run on our own reader: the cache is parsed once and shared
+// by all workers, and rootfs_t parses each file on disk at most once. The
+// closures themselves are built by dyld's code, which keeps global state
+// (argument parsing, caches it mapped, whatever it allocated), prints to
+// stdout and may exit() on errors, so it never runs twice in one process.
+// Each worker slot starts a helper (the same binary, in rootfs-worker mode)
+// and keeps feeding it executables over a pipe. The helper forks once per
+// executable and the child runs dyld's main with stdout and stderr on the
+// closure and log files, so exec, dynamic loading and static init are paid
+// once per slot, while every closure starts from the helper's untouched
+// state and nothing it leaves behind outlives it. The helper answers with
+// the child's exit status; one that dies anyway is replaced for the next
+// executable.
+//
+// With --reuse, built closures are also kept in a store keyed by everything
+// that goes into them: the cache UUID, the extra arguments, and the path,
+// size, mtime and code directory of the executable and every dylib it pulls
+// in from disk. A later run over a slightly changed filesystem only rebuilds
+// the closures whose inputs changed.
+
+#define CLOSURE_STORE_MAGIC     0x43435344 // "DSCC"
+#define CLOSURE_STORE_VERSION   1
+
+extern char **environ;
+
+namespace dsc
+{
+    struct closure_store_hdr_t
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t build_ns;      // What it took to build, reported as saved on a hit
+    };
+
+    struct closure_job_t
+    {
+        std::string path;
+        const char *missing;    // First dependent found neither in the cache nor on disk
+        uint64_t key;
+    };
+
+    // Walks the dependents that come from disk rather than the cache and returns the first one missing,
+    // or NULL if all were found. @-relative paths can't be resolved statically and are let through.
+    // The key covers the executable and everything found.
+    static const char* closure_inputs(rootfs_t &fs, const std::unordered_set<std::string> &incache, const std::string &exe,
+                                      const std::shared_ptr<const rootfs_macho_t> &mo, const std::string &seed, uint64_t &key)
+    {
+        std::map<std::string, std::shared_ptr<const rootfs_macho_t>> inputs;
+        std::vector<const rootfs_macho_t*> todo(1, mo.get());
+        inputs.emplace(exe, mo);
+        while(!todo.empty())
+        {
+            const rootfs_macho_t *cur = todo.back();
+            todo.pop_back();
+            for(const std::string &dep : cur->deps)
+            {
+                if(dep[0] == '@' || incache.count(dep) || inputs.count(dep))
+                {
+                    continue;
+                }
+                std::shared_ptr<const rootfs_macho_t> lib = fs.get(dep);
+                if(!lib || lib->filetype != MH_DYLIB)
+                {
+                    return dep.c_str();
+                }
+                inputs.emplace(dep, lib);
+                todo.push_back(lib.get());
+            }
+        }
+        std::string buf = seed;
+        for(const auto &kv : inputs)
+        {
+            const rootfs_macho_t &in = *kv.second;
+            uint64_t id[3] = { in.size, (uint64_t)in.mtime, in.cdhash };
+            buf.append(kv.first.c_str(), kv.first.size() + 1);
+            buf.append((const char*)id, sizeof(id));
+        }
+        key = hash64(buf.data(), buf.size());
+        return nullptr;
+    }
+
+    // One rootfs-worker process and the two pipes to it
+    struct closure_worker_t
+    {
+        pid_t pid = -1;
+        int req = -1;           // We write "exe\0out\0log\0"
+        int resp = -1;          // It answers a single byte, 0 on success
+    };
+
+    static bool closure_write(int fd, const void *buf, size_t size)
+    {
+        const uint8_t *p = (const uint8_t*)buf;
+        while(size > 0)
+        {
+            ssize_t n = write(fd, p, size);
+            if(n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if(n <= 0)
+            {
+                return false;
+            }
+            p += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+    static void closure_stop(closure_worker_t &w)
+    {
+        if(w.pid == -1)
+        {
+            return;
+        }
+        close(w.req);
+        close(w.resp);
+        while(waitpid(w.pid, NULL, 0) == -1 && errno == EINTR);
+        w = closure_worker_t();
+    }
+
+    static bool closure_start(closure_worker_t &w, const char *self, const std::vector<const char*> &args)
+    {
+        // Serialised, so no other helper inherits our ends of these pipes and keeps them open past this one's death
+        static std::mutex lock;
+        std::lock_guard<std::mutex> guard(lock);
+        int req[2], resp[2];
+        if(pipe(req) != 0)
+        {
+            ERR("pipe: %s", strerror(errno));
+            return false;
+        }
+        if(pipe(resp) != 0)
+        {
+            ERR("pipe: %s", strerror(errno));
+            close(req[0]);
+            close(req[1]);
+            return false;
+        }
+        fcntl(req[1], F_SETFD, FD_CLOEXEC);
+        fcntl(resp[0], F_SETFD, FD_CLOEXEC);
+        posix_spawn_file_actions_t fa;
+        posix_spawn_file_actions_init(&fa);
+        posix_spawn_file_actions_adddup2(&fa, req[0], 0);
+        posix_spawn_file_actions_adddup2(&fa, resp[1], 3);
+        posix_spawn_file_actions_addclose(&fa, req[0]);
+        posix_spawn_file_actions_addclose(&fa, resp[1]);
+        pid_t pid;
+        int err = posix_spawnp(&pid, self, &fa, NULL, (char* const*)args.data(), environ);
+        posix_spawn_file_actions_destroy(&fa);
+        close(req[0]);
+        close(resp[1]);
+        if(err != 0)
+        {
+            ERR("posix_spawn(%s): %s", self, strerror(err));
+            close(req[1]);
+            close(resp[0]);
+            return false;
+        }
+        w.pid = pid;
+        w.req = req[1];
+        w.resp = resp[0];
+        return true;
+    }
+
+    // Has the slot's helper build one closure, starting a helper first if there is none or the last one died.
+    static bool closure_build(closure_worker_t &w, const char *self, const std::vector<const char*> &args,
+                              const std::string &exe, const std::string &out, const std::string &log)
+    {
+        std::string msg = exe;
+        msg.push_back('\0');
+        msg += out;
+        msg.push_back('\0');
+        msg += log;
+        msg.push_back('\0');
+        // A helper that exited after its last answer only shows on the next write, so that one gets a second try
+        for(int attempt = 0; attempt < 2; ++attempt)
+        {
+            if(w.pid == -1 && !closure_start(w, self, args))
+            {
+                return false;
+            }
+            if(!closure_write(w.req, msg.data(), msg.size()))
+            {
+                closure_stop(w);
+                continue;
+            }
+            uint8_t status;
+            ssize_t n;
+            while((n = read(w.resp, &status, 1)) == -1 && errno == EINTR);
+            if(n != 1)
+            {
+                // Died on this one, most likely dyld's code calling exit()
+                closure_stop(w);
+                return false;
+            }
+            return status == 0;
+        }
+        return false;
+    }
+
+    static bool closure_slurp(const std::string &path, std::vector<uint8_t> &out)
+    {
+        FILE *f = fopen(path.c_str(), "rb");
+        if(!f)
+        {
+            return false;
+        }
+        out.clear();
+        uint8_t buf[0x4000];
+        for(size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0; )
+        {
+            out.insert(out.end(), buf, buf + n);
+        }
+        bool ok = !ferror(f);
+        fclose(f);
+        return ok;
+    }
+
+    static bool closure_dump(const std::string &path, const void *hdr, size_t hdrsize, const uint8_t *data, size_t size)
+    {
+        FILE *f = fopen(path.c_str(), "wb");
+        if(!f)
+        {
+            ERR("fopen(%s): %s", path.c_str(), strerror(errno));
+            return false;
+        }
+        bool ok = (!hdrsize || fwrite(hdr, 1, hdrsize, f) == hdrsize) && (!size || fwrite(data, 1, size, f) == size);
+        if(fclose(f) != 0 || !ok)
+        {
+            ERR("Failed to write %s", path.c_str());
+            unlink(path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    int mode_rootfs(const char *self, int argc, const char **argv)
+    {
+        int arg = 1;
+        const char *reuse = nullptr;
+        if(arg + 1 < argc && strcmp(argv[arg], "--reuse") == 0)
+        {
+            reuse = argv[arg + 1];
+            arg += 2;
+        }
+        int extra = argc;
+        for(int i = arg; i < argc; ++i)
+        {
+            if(strcmp(argv[i], "--") == 0)
+            {
+                extra = i;
+                break;
+            }
+        }
+        if(extra - arg != 3)
+        {
+            fprintf(stderr, "Usage: dsc_closure rootfs [--reuse <store-dir>] <path-to-root> <path-to-cache> <path-to-dir> [-- dsc_closure-args...]\n");
+            return 1;
+        }
+        const char *root = argv[arg],
+                   *cachepath = argv[arg + 1],
+                   *dir = argv[arg + 2];
+        auto t0 = std::chrono::steady_clock::now();
+
+        cache_t cache;
+        if(!cache.open(cachepath))
+        {
+            return 1;
+        }
+        rootfs_t fs;
+        fs.root = root;
+        while(!fs.root.empty() && fs.root.back() == '/')
+        {
+            fs.root.pop_back();
+        }
+        const mach_header *mh = cache.images.empty() ? nullptr : (const mach_header*)cache.ptr(cache.images[0].addr, sizeof(mach_header));
+        if(!mh)
+        {
+            ERR("%s: can't tell the cache's architecture", cachepath);
+            return 1;
+        }
+        fs.cputype = mh->cputype;
+        fs.cpusubtype = mh->cpusubtype;
+        std::unordered_set<std::string> incache;
+        for(const image_t &img : cache.images)
+        {
+            incache.insert(img.path);
+        }
+        if(reuse && !mkdirs(std::string(reuse) + "/"))
+        {
+            return 1;
+        }
+        std::string seed((const char*)cache.header()->uuid, sizeof(cache.header()->uuid));
+        for(int j = extra + 1; j < argc; ++j)
+        {
+            seed.append(argv[j], strlen(argv[j]) + 1);
+        }
+
+        std::vector<std::string> files;
+        if(!fs.scan(files))
+        {
+            return 1;
+        }
+        std::vector<std::vector<closure_job_t>> found(jobs());
+        parallel_for(files.size(), [&](size_t i, size_t worker)
+        {
+            std::shared_ptr<const rootfs_macho_t> mo = fs.get(files[i]);
+            if(mo && mo->filetype == MH_EXECUTE)
+            {
+                closure_job_t job = { files[i], nullptr, 0 };
+                job.missing = closure_inputs(fs, incache, files[i], mo, seed, job.key);
+                found[worker].push_back(std::move(job));
+            }
+        });
+        std::vector<closure_job_t> todo;
+        size_t skipped = 0;
+        for(std::vector<closure_job_t> &v : found)
+        {
+            for(closure_job_t &job : v)
+            {
+                if(job.missing)
+                {
+                    WRN("Skipping %s, %s not found", job.path.c_str(), job.missing);
+                    ++skipped;
+                    continue;
+                }
+                todo.push_back(std::move(job));
+            }
+        }
+        LOG("%zu files, %zu executables, %zu skipped", files.size(), todo.size() + skipped, skipped);
+
+        // Requests go over pipes to helpers that may die, which must not take us down with them
+        signal(SIGPIPE, SIG_IGN);
+        std::vector<const char*> wargs = { self, "rootfs-worker", "-cache_file", cachepath, "-fs_root", fs.root.c_str() };
+        for(int j = extra + 1; j < argc; ++j)
+        {
+            wargs.push_back(argv[j]);
+        }
+        wargs.push_back(nullptr);
+        std::vector<closure_worker_t> workers(jobs());
+
+        std::atomic<size_t> built(0),
+                            reused(0),
+                            failed(0);
+        std::atomic<uint64_t> saved_ns(0),
+                              build_ns(0);
+        parallel_for(todo.size(), [&](size_t i, size_t worker)
+        {
+            const closure_job_t &job = todo[i];
+            std::string out = std::string(dir) + job.path + ".closure",
+                        log = std::string(dir) + job.path + ".log";
+            if(!mkdirs(out))
+            {
+                ++failed;
+                return;
+            }
+            std::vector<uint8_t> data;
+            std::string stored;
+            if(reuse)
+            {
+                char name[32];
+                snprintf(name, sizeof(name), "/%016llx.closure", (unsigned long long)job.key);
+                stored = std::string(reuse) + name;
+                closure_store_hdr_t hdr;
+                if(closure_slurp(stored, data) && data.size() >= sizeof(hdr))
+                {
+                    memcpy(&hdr, data.data(), sizeof(hdr));
+                    if(hdr.magic == CLOSURE_STORE_MAGIC && hdr.version == CLOSURE_STORE_VERSION &&
+                       closure_dump(out, nullptr, 0, data.data() + sizeof(hdr), data.size() - sizeof(hdr)))
+                    {
+                        unlink(log.c_str());
+                        saved_ns += hdr.build_ns;
+                        ++reused;
+                        return;
+                    }
+                }
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            if(!closure_build(workers[worker], self, wargs, job.path, out, log))
+            {
+                ERR("Failed to build closure for %s, see %s", job.path.c_str(), log.c_str());
+                ++failed;
+                return;
+            }
+            uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            build_ns += ns;
+            struct stat s;
+            if(stat(log.c_str(), &s) == 0 && s.st_size == 0)
+            {
+                unlink(log.c_str());
+            }
+            ++built;
+
+            // Written under a unique name and renamed, so concurrent runs sharing a store never see partial entries
+            if(reuse && closure_slurp(out, data))
+            {
+                closure_store_hdr_t hdr = { CLOSURE_STORE_MAGIC, CLOSURE_STORE_VERSION, ns };
+                std::string tmp = stored + "." + std::to_string(getpid()) + "." + std::to_string(i);
+                if(closure_dump(tmp, &hdr, sizeof(hdr), data.data(), data.size()) && rename(tmp.c_str(), stored.c_str()) != 0)
+                {
+                    WRN("rename(%s): %s", stored.c_str(), strerror(errno));
+                    unlink(tmp.c_str());
+                }
+            }
+        });
+        for(closure_worker_t &w : workers)
+        {
+            closure_stop(w);
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        LOG("%zu closures built, %zu reused, %zu failed, %zu skipped in %.1fs", built.load(), reused.load(), failed.load(), skipped, secs);
+        if(reuse)
+        {
+            size_t lookups = todo.size();
+            LOG("Store: %zu/%zu hits (%.1f%%), %.1fs of building saved, %.1fs spent building", reused.load(), lookups,
+                lookups ? 100.0 * reused.load() / lookups : 0.0, saved_ns.load() / 1e9, build_ns.load() / 1e9);
+        }
+        return failed != 0;
+    }
+
+    int mode_rootfs_worker(int (*closure_main)(int, const char**), const char *self, int argc, const char **argv)
+    {
+        // Requests on stdin, answers on fd 3
+        int answers = 3;
+        if(fcntl(answers, F_GETFD) == -1)
+        {
+            fprintf(stderr, "dsc_closure rootfs-worker is started by dsc_closure rootfs only\n");
+            return 1;
+        }
+        char *fields[3] = { nullptr, nullptr, nullptr };
+        size_t sizes[3] = { 0, 0, 0 };
+        while(true)
+        {
+            bool eof = false;
+            for(int i = 0; i < 3 && !eof; ++i)
+            {
+                eof = getdelim(&fields[i], &sizes[i], '\0', stdin) == -1;
+            }
+            if(eof)
+            {
+                break;
+            }
+            std::vector<const char*> args = { self };
+            for(int i = 1; i < argc; ++i)
+            {
+                args.push_back(argv[i]);
+            }
+            args.push_back("-create_closure");
+            args.push_back(fields[0]);
+            args.push_back(nullptr);
+
+            uint8_t status = 1;
+            int out = open(fields[1], O_WRONLY | O_CREAT | O_TRUNC, 0644),
+                log = open(fields[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if(out != -1 && log != -1)
+            {
+                fflush(NULL);
+                pid_t pid = fork();
+                if(pid == 0)
+                {
+                    // Nothing of the request pipe or the answer channel for dyld's code
+                    int null = open("/dev/null", O_RDONLY);
+                    dup2(null, 0);
+                    dup2(out, 1);
+                    dup2(log, 2);
+                    close(answers);
+                    int r = closure_main((int)args.size() - 1, args.data());
+                    fflush(NULL);
+                    _exit(r == 0 ? 0 : 1);
+                }
+                int ws;
+                if(pid == -1)
+                {
+                    ERR("fork: %s", strerror(errno));
+                }
+                else
+                {
+                    while(waitpid(pid, &ws, 0) == -1 && errno == EINTR);
+                    status = WIFEXITED(ws) && WEXITSTATUS(ws) == 0 ? 0 : 1;
+                }
+            }
+            if(out != -1)
+            {
+                close(out);
+            }
+            if(log != -1)
+            {
+                close(log);
+            }
+            if(!closure_write(answers, &status, 1))
+            {
+                break;
+            }
+        }
+        free(fields[0]);
+        free(fields[1]);
+        free(fields[2]);
+        return 0;
+    }
+}
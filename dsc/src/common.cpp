@@ -0,0 +1,136 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "common.h"
+
+#define P64_1 0x9e3779b185ebca87ULL
+#define P64_2 0xc2b2ae3d27d4eb4fULL
+#define P64_3 0x165667b19e3779f9ULL
+#define P64_4 0x85ebca77c2b2ae63ULL
+#define P64_5 0x27d4eb2f165667c5ULL
+
+namespace dsc
+{
+    static inline uint64_t rotl64(uint64_t v, unsigned r)
+    {
+        return (v << r) | (v >> (64 - r));
+    }
+
+    static inline uint64_t read64(const uint8_t *p)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static inline uint32_t read32(const uint8_t *p)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    static inline uint64_t xxh_round(uint64_t acc, uint64_t in)
+    {
+        return rotl64(acc + in * P64_2, 31) * P64_1;
+    }
+
+    static inline uint64_t xxh_merge(uint64_t acc, uint64_t v)
+    {
+        return (acc ^ xxh_round(0, v)) * P64_1 + P64_4;
+    }
+
+    uint64_t hash64(const void *data, size_t len, uint64_t seed)
+    {
+        const uint8_t *p = (const uint8_t*)data,
+                      *end = p + len;
+        uint64_t h;
+        if(len >= 32)
+        {
+            uint64_t v1 = seed + P64_1 + P64_2,
+                     v2 = seed + P64_2,
+                     v3 = seed,
+                     v4 = seed - P64_1;
+            const uint8_t *limit = end - 32;
+            do
+            {
+                v1 = xxh_round(v1, read64(p));
+                v2 = xxh_round(v2, read64(p + 8));
+                v3 = xxh_round(v3, read64(p + 16));
+                v4 = xxh_round(v4, read64(p + 24));
+                p += 32;
+            } while(p <= limit);
+            h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+            h = xxh_merge(h, v1);
+            h = xxh_merge(h, v2);
+            h = xxh_merge(h, v3);
+            h = xxh_merge(h, v4);
+        }
+        else
+        {
+            h = seed + P64_5;
+        }
+        h += (uint64_t)len;
+        for(; end - p >= 8; p += 8)
+        {
+            h = rotl64(h ^ xxh_round(0, read64(p)), 27) * P64_1 + P64_4;
+        }
+        if(end - p >= 4)
+        {
+            h = rotl64(h ^ (read32(p) * P64_1), 23) * P64_2 + P64_3;
+            p += 4;
+        }
+        for(; p < end; ++p)
+        {
+            h = rotl64(h ^ (*p * P64_5), 11) * P64_1;
+        }
+        h ^= h >> 33;
+        h *= P64_2;
+        h ^= h >> 29;
+        h *= P64_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    bool mkdirs(const std::string &path)
+    {
+        std::string dir = path;
+        for(size_t i = 1; i < dir.size(); ++i)
+        {
+            if(dir[i] != '/')
+            {
+                continue;
+            }
+            dir[i] = '\0';
+            int rv = mkdir(dir.c_str(), 0755);
+            dir[i] = '/';
+            if(rv != 0 && errno != EEXIST)
+            {
+                ERR("mkdir(%s): %s", dir.substr(0, i).c_str(), strerror(errno));
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t jobs(void)
+    {
+        static size_t n = []
+        {
+            const char *env = getenv("DSC_JOBS");
+            if(env)
+            {
+                unsigned long v = strtoul(env, NULL, 0);
+                if(v > 0)
+                {
+                    return (size_t)v;
+                }
+            }
+            unsigned hw = std::thread::hardware_concurrency();
+            return (size_t)(hw ? hw : 1);
+        }();
+        return n;
+    }
+}
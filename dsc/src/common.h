@@ -0,0 +1,100 @@
+#ifndef DSC_COMMON_H
+#define DSC_COMMON_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#define LOG(str, ...) do { fprintf(stderr, str "\n", ##__VA_ARGS__); } while(0)
+#define ERR(str, ...) LOG("\x1b[1;91m[!] " str "\x1b[0m", ##__VA_ARGS__)
+#define WRN(str, ...) LOG("\x1b[1;93m[W] " str "\x1b[0m", ##__VA_ARGS__)
+
+namespace dsc
+{
+    // XXH64 of a buffer, used for content comparisons.
+    uint64_t hash64(const void *data, size_t len, uint64_t seed = 0);
+
+    // Creates every missing parent directory of path.
+    bool mkdirs(const std::string &path);
+
+    // Number of worker threads, DSC_JOBS or the number of cores.
+    size_t jobs(void);
+
+    // Calls fn(index, worker) for every index in [0, n) on up to jobs() threads.
+    // Worker ids are dense in [0, jobs()), so they can index per-thread state.
+    // Each worker then calls done(worker) on its own thread before it exits,
+    // for per-thread state that has to be settled by the thread that owns it.
+    template<typename F, typename D>
+    void parallel_for(size_t n, F &&fn, D &&done)
+    {
+        size_t nthreads = jobs();
+        if(nthreads > n)
+        {
+            nthreads = n;
+        }
+        if(nthreads <= 1)
+        {
+            for(size_t i = 0; i < n; ++i)
+            {
+                fn(i, (size_t)0);
+            }
+            done((size_t)0);
+            return;
+        }
+        std::atomic<size_t> next(0);
+        auto work = [&](size_t worker)
+        {
+            for(size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n; )
+            {
+                fn(i, worker);
+            }
+            done(worker);
+        };
+        std::vector<std::thread> threads;
+        threads.reserve(nthreads - 1);
+        for(size_t t = 1; t < nthreads; ++t)
+        {
+            threads.emplace_back(work, t);
+        }
+        work(0);
+        for(std::thread &t : threads)
+        {
+            t.join();
+        }
+    }
+
+    template<typename F>
+    void parallel_for(size_t n, F &&fn)
+    {
+        parallel_for(n, std::forward<F>(fn), [](size_t) {});
+    }
+
+    // Bounds-checked ULEB128 decoding, returns false on overrun.
+    static inline bool read_uleb(const uint8_t *&p, const uint8_t *end, uint64_t &out)
+    {
+        uint64_t val = 0;
+        unsigned shift = 0;
+        while(p < end)
+        {
+            uint8_t b = *p++;
+            if(shift < 64)
+            {
+                val |= (uint64_t)(b & 0x7f) << shift;
+            }
+            shift += 7;
+            if(!(b & 0x80))
+            {
+                out = val;
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+#endif
@@ -0,0 +1,499 @@
+#include <algorithm>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cache.h"
+#include "common.h"
+#include "headers.h"
+#include "macho.h"
+#include "modes.h"
+
+// Raw segment bytes change whenever the cache builder moves an image, even if
+// its code doesn't: load commands, ADRP pages, the page offsets used with them,
+// branches into other images and every slid pointer encode absolute layout. So
+// segments are normalized before hashing:
+//
+//   - in load commands, segment addresses and all file offsets are cleared,
+//     section addresses made relative to their segment, and the __LINKEDIT
+//     segment, which spans the shared LINKEDIT, is cleared entirely
+//   - in instruction sections of arm64 and arm64_32 images, the immediate of
+//     every ADRP is cleared, as is the imm12 of an ADD or unsigned-offset
+//     load/store based on a register an ADRP set within DIFF_ADRP_WINDOW
+//     instructions, and the target of a B/BL that leaves the image
+//   - every slid pointer (found through the slide info) is replaced by a hash
+//     of the install name of the image it points into plus the offset in it,
+//     or its offset from the cache base if it points into no image
+//
+// What remains is what the image actually contains. v1 slide info can't be
+// walked, so pointers in v1 caches are compared as stored.
+
+#define DIFF_ADRP_WINDOW    8
+
+namespace dsc
+{
+    // Address ranges of every image's segments but __LINKEDIT, sorted, to tell which image an address is in.
+    struct diff_where_t
+    {
+        struct range_t
+        {
+            uint64_t start;
+            uint64_t end;
+            uint32_t img;
+        };
+        std::vector<range_t> ranges;
+        std::vector<uint64_t> names;    // Hash of each image's install name
+
+        void build(const cache_t &cache)
+        {
+            const headers_t &hdrs = cache.headers();
+            for(uint32_t i = 0; i < cache.images.size(); ++i)
+            {
+                this->names.push_back(hash64(cache.images[i].path, strlen(cache.images[i].path)));
+                for(const segment_t &seg : hdrs.segments(i))
+                {
+                    if(strcmp(seg.name, "__LINKEDIT") != 0 && seg.vmsize != 0)
+                    {
+                        this->ranges.push_back({ seg.vmaddr, seg.vmaddr + seg.vmsize, i });
+                    }
+                }
+            }
+            std::sort(this->ranges.begin(), this->ranges.end(), [](const range_t &a, const range_t &b)
+            {
+                return a.start < b.start;
+            });
+        }
+
+        // Image containing addr, UINT32_MAX if none.
+        uint32_t find(uint64_t addr) const
+        {
+            auto it = std::upper_bound(this->ranges.begin(), this->ranges.end(), addr, [](uint64_t a, const range_t &r)
+            {
+                return a < r.start;
+            });
+            return it != this->ranges.begin() && addr < (it - 1)->end ? (it - 1)->img : UINT32_MAX;
+        }
+    };
+
+    struct diff_seg_t
+    {
+        segment_t seg;
+        uint64_t hash;
+        bool hashed;
+    };
+
+    struct diff_img_t
+    {
+        uint8_t uuid[16];
+        bool has_uuid;
+        bool ok;                // Both the header and, for those that were hashed, all segments could be read
+        uint64_t vmsize;
+        std::vector<diff_seg_t> segs;
+    };
+
+    // Clears what depends on layout in the header and load commands at the start of p, see the top of the file.
+    template<bool W64>
+    static void diff_cmds(uint8_t *p, uint64_t size)
+    {
+        typedef macho_fmt_t<W64> fmt;
+        typename fmt::header mh;
+        if(size < sizeof(mh))
+        {
+            return;
+        }
+        memcpy(&mh, p, sizeof(mh));
+        uint64_t end = std::min<uint64_t>(size, sizeof(mh) + (uint64_t)mh.sizeofcmds);
+        load_command lc;
+        for(uint64_t off = sizeof(mh), i = 0; i < mh.ncmds && off + sizeof(lc) <= end; off += lc.cmdsize, ++i)
+        {
+            memcpy(&lc, p + off, sizeof(lc));
+            if(lc.cmdsize < sizeof(lc) || lc.cmdsize > end - off)
+            {
+                return;
+            }
+            uint8_t *c = p + off;
+            if(lc.cmd == fmt::segment_cmd && lc.cmdsize >= sizeof(typename fmt::segment))
+            {
+                typename fmt::segment seg;
+                memcpy(&seg, c, sizeof(seg));
+                bool linkedit = strncmp(seg.segname, "__LINKEDIT", sizeof(seg.segname)) == 0;
+                for(uint32_t j = 0; j < seg.nsects && sizeof(seg) + (j + 1) * sizeof(typename fmt::section) <= lc.cmdsize; ++j)
+                {
+                    typename fmt::section sect;
+                    uint8_t *sp = c + sizeof(seg) + j * sizeof(sect);
+                    memcpy(&sect, sp, sizeof(sect));
+                    sect.addr -= seg.vmaddr;
+                    sect.offset = 0;
+                    memcpy(sp, &sect, sizeof(sect));
+                }
+                seg.vmaddr = 0;
+                seg.fileoff = 0;
+                if(linkedit)
+                {
+                    seg.vmsize = 0;
+                    seg.filesize = 0;
+                }
+                memcpy(c, &seg, sizeof(seg));
+            }
+            else if(lc.cmd == LC_SYMTAB && lc.cmdsize >= sizeof(symtab_command))
+            {
+                symtab_command st;
+                memcpy(&st, c, sizeof(st));
+                st.symoff = st.stroff = st.strsize = 0;
+                memcpy(c, &st, sizeof(st));
+            }
+            else if(lc.cmd == LC_DYSYMTAB && lc.cmdsize >= sizeof(dysymtab_command))
+            {
+                dysymtab_command ds;
+                memcpy(&ds, c, sizeof(ds));
+                ds.tocoff = ds.modtaboff = ds.extrefsymoff = ds.indirectsymoff = ds.extreloff = ds.locreloff = 0;
+                memcpy(c, &ds, sizeof(ds));
+            }
+            else if((lc.cmd == LC_DYLD_INFO || lc.cmd == LC_DYLD_INFO_ONLY) && lc.cmdsize >= sizeof(dyld_info_command))
+            {
+                dyld_info_command di;
+                memcpy(&di, c, sizeof(di));
+                di.rebase_off = di.bind_off = di.weak_bind_off = di.lazy_bind_off = di.export_off = 0;
+                memcpy(c, &di, sizeof(di));
+            }
+            else if((lc.cmd == LC_CODE_SIGNATURE || lc.cmd == LC_SEGMENT_SPLIT_INFO || lc.cmd == LC_FUNCTION_STARTS || lc.cmd == LC_DATA_IN_CODE ||
+                     lc.cmd == LC_DYLIB_CODE_SIGN_DRS || lc.cmd == LC_LINKER_OPTIMIZATION_HINT || lc.cmd == LC_DYLD_EXPORTS_TRIE ||
+                     lc.cmd == LC_DYLD_CHAINED_FIXUPS) && lc.cmdsize >= sizeof(linkedit_data_command))
+            {
+                linkedit_data_command ld;
+                memcpy(&ld, c, sizeof(ld));
+                ld.dataoff = 0;
+                memcpy(c, &ld, sizeof(ld));
+            }
+        }
+    }
+
+    // Clears what depends on layout in one instruction section, see the top of the file.
+    static void diff_code(const diff_where_t &where, uint32_t idx, uint64_t addr, uint8_t *p, uint64_t size)
+    {
+        int64_t adrp[32];      // Index of the last ADRP into each register
+        for(int64_t &a : adrp)
+        {
+            a = -DIFF_ADRP_WINDOW - 1;
+        }
+        for(uint64_t off = 0; off + 4 <= size; off += 4)
+        {
+            int64_t n = (int64_t)(off / 4);
+            uint32_t ins;
+            memcpy(&ins, p + off, sizeof(ins));
+            uint32_t rn = (ins >> 5) & 0x1f;
+            if((ins & 0x9f000000) == 0x90000000)
+            {
+                adrp[ins & 0x1f] = n;
+                ins &= 0x9f00001f;
+            }
+            else if(((ins & 0x7f000000) == 0x11000000 || (ins & 0x3b000000) == 0x39000000) && n - adrp[rn] <= DIFF_ADRP_WINDOW)
+            {
+                ins &= ~(0xfffu << 10);
+            }
+            else if((ins & 0x7c000000) == 0x14000000)
+            {
+                int64_t imm = (int64_t)((uint64_t)(ins & 0x03ffffff) << 38) >> 36;
+                if(where.find(addr + off + imm) != idx)
+                {
+                    ins &= 0xfc000000;
+                }
+            }
+            else
+            {
+                continue;
+            }
+            memcpy(p + off, &ins, sizeof(ins));
+        }
+    }
+
+    // Replaces every slid pointer in [addr, addr+size) by what it points to, see the top of the file.
+    static void diff_ptrs(const cache_t &cache, const diff_where_t &where, uint64_t addr, uint8_t *p, uint64_t size)
+    {
+        std::vector<uint64_t> locs;
+        if(!cache.pointers(addr, addr + size, locs))
+        {
+            return;
+        }
+        for(uint64_t loc : locs)
+        {
+            uint64_t target;
+            if(loc < addr || loc - addr + cache.ptrsize > size || !cache.read_ptr(loc, target))
+            {
+                continue;
+            }
+            uint32_t img = where.find(target);
+            uint64_t v = img != UINT32_MAX ? where.names[img] + (target - cache.images[img].addr) : target - cache.mappings[0].addr;
+            memcpy(p + (loc - addr), &v, cache.ptrsize);
+        }
+    }
+
+    // __LINKEDIT is shared by every image in the cache, so for it only the
+    // image's own export trie is hashed, and its size stands in for the
+    // segment size. Everything else is hashed after normalizing.
+    static void diff_load(const cache_t &cache, const diff_where_t &where, uint32_t idx, diff_img_t &out)
+    {
+        const headers_t &hdrs = cache.headers();
+        const image_hdr_t &h = hdrs.images[idx];
+        out.ok = h.hdr != nullptr;
+        if(!out.ok)
+        {
+            WRN("%s: %s: bad Mach-O header", cache.path, cache.images[idx].path);
+            return;
+        }
+        out.has_uuid = h.has_uuid;
+        memcpy(out.uuid, h.uuid, sizeof(out.uuid));
+        out.vmsize = 0;
+        // arm64 and arm64_32, not armv7
+        uint32_t cpu = (uint32_t)((const mach_header*)h.hdr)->cputype;
+        bool a64 = (cpu & 0xff) == 12 && (cpu & 0x03000000) != 0;
+        std::vector<uint8_t> buf;
+        for(const segment_t &seg : hdrs.segments(idx))
+        {
+            diff_seg_t ds = { seg, 0, false };
+            if(strcmp(seg.name, "__LINKEDIT") == 0)
+            {
+                macho_t mo;
+                const uint8_t *trie;
+                size_t size = 0;
+                if(mo.init(cache, cache.images[idx].addr) && mo.export_trie(cache, trie, size))
+                {
+                    ds.hash = hash64(trie, size);
+                    ds.hashed = true;
+                }
+                ds.seg.vmsize = size;
+            }
+            else
+            {
+                const uint8_t *p = cache.ptr(seg.vmaddr, seg.filesize);
+                if(p)
+                {
+                    buf.assign(p, p + seg.filesize);
+                    if(seg.vmaddr == cache.images[idx].addr)
+                    {
+                        if(h.is64)
+                        {
+                            diff_cmds<true>(buf.data(), buf.size());
+                        }
+                        else
+                        {
+                            diff_cmds<false>(buf.data(), buf.size());
+                        }
+                    }
+                    for(const section_t &sect : hdrs.sections(idx))
+                    {
+                        if(a64 && strcmp(sect.seg, seg.name) == 0 && (sect.flags & (S_ATTR_PURE_INSTRUCTIONS | S_ATTR_SOME_INSTRUCTIONS)) &&
+                           sect.addr >= seg.vmaddr && sect.addr - seg.vmaddr <= buf.size() && sect.size <= buf.size() - (sect.addr - seg.vmaddr))
+                        {
+                            diff_code(where, idx, sect.addr, buf.data() + (sect.addr - seg.vmaddr), sect.size);
+                        }
+                    }
+                    diff_ptrs(cache, where, seg.vmaddr, buf.data(), buf.size());
+                    ds.hash = hash64(buf.data(), buf.size());
+                    ds.hashed = true;
+                }
+                else
+                {
+                    out.ok = false;
+                    WRN("%s: %s: segment %s out of bounds", cache.path, cache.images[idx].path, seg.name);
+                }
+                out.vmsize += seg.vmsize;
+            }
+            out.segs.push_back(ds);
+        }
+    }
+
+    static void print_uuid(const uint8_t *u)
+    {
+        printf("%02X%02X%02X%02X-%02X%02X-%02X%02X-%02X%02X-%02X%02X%02X%02X%02X%02X",
+               u[0], u[1], u[2], u[3], u[4], u[5], u[6], u[7], u[8], u[9], u[10], u[11], u[12], u[13], u[14], u[15]);
+    }
+
+    static void print_delta(int64_t d)
+    {
+        if(d != 0)
+        {
+            printf(" (%c0x%llx)", d < 0 ? '-' : '+', (unsigned long long)(d < 0 ? -d : d));
+        }
+    }
+
+    int mode_diff(int argc, const char **argv)
+    {
+        if(argc != 3)
+        {
+            fprintf(stderr, "Usage: dsc_util diff <path-to-cache-a> <path-to-cache-b>\n");
+            fprintf(stderr, "    Segments are compared with ADRP pages and offsets, branches out of the image and slid pointers\n");
+            fprintf(stderr, "    normalized, so images that only moved count as unchanged. v1 caches compare pointers as stored.\n");
+            return 2;
+        }
+        cache_t a, b;
+        if(!a.open(argv[1]) || !b.open(argv[2]))
+        {
+            return 2;
+        }
+
+        std::unordered_map<std::string, uint32_t> byname;
+        byname.reserve(a.images.size());
+        for(uint32_t i = 0; i < a.images.size(); ++i)
+        {
+            byname.emplace(a.images[i].path, i);
+        }
+        // (index in a, index in b), with UINT32_MAX for "not present"
+        std::vector<std::pair<uint32_t, uint32_t>> pairs;
+        std::vector<bool> seen(a.images.size(), false);
+        pairs.reserve(a.images.size() + b.images.size());
+        for(uint32_t i = 0; i < b.images.size(); ++i)
+        {
+            auto it = byname.find(b.images[i].path);
+            if(it != byname.end())
+            {
+                seen[it->second] = true;
+                pairs.push_back({ it->second, i });
+            }
+            else
+            {
+                pairs.push_back({ UINT32_MAX, i });
+            }
+        }
+        for(uint32_t i = 0; i < a.images.size(); ++i)
+        {
+            if(!seen[i])
+            {
+                pairs.push_back({ i, UINT32_MAX });
+            }
+        }
+        auto name = [&](const std::pair<uint32_t, uint32_t> &p)
+        {
+            return p.second != UINT32_MAX ? b.images[p.second].path : a.images[p.first].path;
+        };
+        std::sort(pairs.begin(), pairs.end(), [&](const std::pair<uint32_t, uint32_t> &x, const std::pair<uint32_t, uint32_t> &y)
+        {
+            return strcmp(name(x), name(y)) < 0;
+        });
+
+        // Only images present on both sides need hashing, and each side is
+        // an independent job so the two caches are read concurrently.
+        diff_where_t wa, wb;
+        wa.build(a);
+        wb.build(b);
+        std::vector<diff_img_t> da(pairs.size()), db(pairs.size());
+        parallel_for(pairs.size() * 2, [&](size_t i, size_t)
+        {
+            const std::pair<uint32_t, uint32_t> &p = pairs[i / 2];
+            if(p.first == UINT32_MAX || p.second == UINT32_MAX)
+            {
+                return;
+            }
+            if(i & 1)
+            {
+                diff_load(b, wb, p.second, db[i / 2]);
+            }
+            else
+            {
+                diff_load(a, wa, p.first, da[i / 2]);
+            }
+        });
+
+        size_t added = 0,
+               removed = 0,
+               changed = 0,
+               same = 0,
+               unreadable = 0;
+        for(size_t i = 0; i < pairs.size(); ++i)
+        {
+            const std::pair<uint32_t, uint32_t> &p = pairs[i];
+            if(p.first == UINT32_MAX)
+            {
+                printf("+ %s\n", b.images[p.second].path);
+                ++added;
+                continue;
+            }
+            if(p.second == UINT32_MAX)
+            {
+                printf("- %s\n", a.images[p.first].path);
+                ++removed;
+                continue;
+            }
+            const diff_img_t &x = da[i],
+                             &y = db[i];
+            if(!x.ok || !y.ok)
+            {
+                printf("? %s\n", b.images[p.second].path);
+                ++unreadable;
+                continue;
+            }
+            bool uuid_changed = x.has_uuid != y.has_uuid || (x.has_uuid && memcmp(x.uuid, y.uuid, 16) != 0);
+            bool seg_changed = x.segs.size() != y.segs.size();
+            for(size_t j = 0; !seg_changed && j < x.segs.size(); ++j)
+            {
+                seg_changed = strcmp(x.segs[j].seg.name, y.segs[j].seg.name) != 0 || x.segs[j].seg.vmsize != y.segs[j].seg.vmsize ||
+                              x.segs[j].hashed != y.segs[j].hashed || x.segs[j].hash != y.segs[j].hash;
+            }
+            if(!uuid_changed && !seg_changed)
+            {
+                ++same;
+                continue;
+            }
+            ++changed;
+            printf("~ %s", b.images[p.second].path);
+            print_delta((int64_t)(y.vmsize - x.vmsize));
+            printf("\n");
+            if(uuid_changed)
+            {
+                printf("    uuid ");
+                if(x.has_uuid) print_uuid(x.uuid); else printf("none");
+                printf(" -> ");
+                if(y.has_uuid) print_uuid(y.uuid); else printf("none");
+                printf("\n");
+            }
+            for(const diff_seg_t &sy : y.segs)
+            {
+                const diff_seg_t *sx = nullptr;
+                for(const diff_seg_t &s : x.segs)
+                {
+                    if(strcmp(s.seg.name, sy.seg.name) == 0)
+                    {
+                        sx = &s;
+                        break;
+                    }
+                }
+                if(!sx)
+                {
+                    printf("    + %-16s 0x%llx\n", sy.seg.name, (unsigned long long)sy.seg.vmsize);
+                }
+                else if(sx->seg.vmsize != sy.seg.vmsize || sx->hashed != sy.hashed || sx->hash != sy.hash)
+                {
+                    if(sx->seg.vmsize == sy.seg.vmsize)
+                    {
+                        printf("    ~ %-16s 0x%llx\n", sy.seg.name, (unsigned long long)sy.seg.vmsize);
+                    }
+                    else
+                    {
+                        printf("    ~ %-16s 0x%llx -> 0x%llx", sy.seg.name, (unsigned long long)sx->seg.vmsize, (unsigned long long)sy.seg.vmsize);
+                        print_delta((int64_t)(sy.seg.vmsize - sx->seg.vmsize));
+                        printf("\n");
+                    }
+                }
+            }
+            for(const diff_seg_t &sx : x.segs)
+            {
+                bool found = false;
+                for(const diff_seg_t &s : y.segs)
+                {
+                    if(strcmp(s.seg.name, sx.seg.name) == 0)
+                    {
+                        found = true;
+                        break;
+                    }
+                }
+                if(!found)
+                {
+                    printf("    - %-16s 0x%llx\n", sx.seg.name, (unsigned long long)sx.seg.vmsize);
+                }
+            }
+        }
+        printf("%zu added, %zu removed, %zu changed, %zu unchanged, %zu unreadable\n", added, removed, changed, same, unreadable);
+        return added || removed || changed || unreadable ? 1 : 0;
+    }
+}
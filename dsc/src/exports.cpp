@@ -0,0 +1,119 @@
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "cache.h"
+#include "common.h"
+#include "macho.h"
+#include "modes.h"
+#include "profile.h"
+#include "trie.h"
+
+namespace dsc
+{
+    static void append_hex(std::string &s, uint64_t v)
+    {
+        char buf[19];
+        char *p = buf + sizeof(buf);
+        do
+        {
+            *--p = "0123456789abcdef"[v & 0xf];
+            v >>= 4;
+        } while(v);
+        *--p = 'x';
+        *--p = '0';
+        s.append(p, buf + sizeof(buf) - p);
+    }
+
+    int mode_exports(int argc, const char **argv)
+    {
+        if(argc < 2 || argc > 3)
+        {
+            fprintf(stderr, "Usage: dsc_util exports <path-to-cache> [library-name]\n");
+            return 1;
+        }
+        const char *filter = argc >= 3 ? argv[2] : NULL;
+
+        cache_t cache;
+        if(!cache.open(argv[1]))
+        {
+            return 1;
+        }
+        std::vector<uint32_t> sel;
+        std::vector<const char*> names;
+        for(uint32_t i = 0; i < cache.images.size(); ++i)
+        {
+            if(!filter || strstr(cache.images[i].path, filter))
+            {
+                sel.push_back(i);
+            }
+            names.push_back(cache.images[i].path);
+        }
+        profile_images(names);
+        profile_phase("walk");
+
+        // Images are processed in batches so that output stays in cache order
+        // while the buffers and walkers are reused rather than reallocated.
+        size_t batch = jobs() * 8;
+        std::vector<std::string> out(batch);
+        std::vector<trie_walker_t> walkers(jobs());
+        int ret = 0;
+        for(size_t base = 0; base < sel.size(); base += batch)
+        {
+            size_t n = sel.size() - base < batch ? sel.size() - base : batch;
+            parallel_for(n, [&](size_t i, size_t worker)
+            {
+                profile_image_t scope(sel[base + i]);
+                const image_t &img = cache.images[sel[base + i]];
+                std::string &s = out[i];
+                s.clear();
+                macho_t mo;
+                const uint8_t *trie;
+                size_t size;
+                if(!mo.init(cache, img.addr) || !mo.export_trie(cache, trie, size))
+                {
+                    WRN("%s: cannot locate export trie", img.path);
+                    return;
+                }
+                size_t plen = strlen(img.path);
+                bool ok = trie_each(walkers[worker], trie, size, [&](const export_t &e)
+                {
+                    s.append(img.path, plen);
+                    s.push_back('\t');
+                    if(e.flags & EXPORT_SYMBOL_FLAGS_REEXPORT)
+                    {
+                        s.append("->");
+                    }
+                    else if((e.flags & EXPORT_SYMBOL_FLAGS_KIND_MASK) == EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE)
+                    {
+                        append_hex(s, e.addr);
+                    }
+                    else
+                    {
+                        append_hex(s, img.addr + e.addr);
+                    }
+                    s.push_back('\t');
+                    s.append(e.name, e.namelen);
+                    if(e.import[0] != '\0')
+                    {
+                        s.push_back('\t');
+                        s.append(e.import);
+                    }
+                    s.push_back('\n');
+                });
+                if(!ok)
+                {
+                    WRN("%s: malformed export trie", img.path);
+                }
+            });
+            for(size_t i = 0; i < n; ++i)
+            {
+                if(fwrite(out[i].data(), 1, out[i].size(), stdout) != out[i].size())
+                {
+                    ret = 1;
+                }
+            }
+        }
+        return ret;
+    }
+}
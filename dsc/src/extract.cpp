@@ -0,0 +1,683 @@
+#include <algorithm>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include "common.h"
+#include "extract.h"
+#include "locals.h"
+#include "pointer.h"
+#include "stubs.h"
+
+// Segments are laid out back to back in load command order, page aligned,
+// with __LINKEDIT last. Of the shared LINKEDIT only what belongs to the image
+// is kept: bind info, exports, function starts, data in code, its own slice
+// of the symbol table with a string pool rebuilt for it, and its indirect
+// symbols. Split seg info, code signatures and rebase info are dropped, as
+// they don't describe the rebuilt file anymore, and slid pointers in DATA are
+// written back as plain unslid addresses.
+//
+// Local symbols from the cache's local symbols region go in front of the
+// image's own symbols when asked for, replacing its local range (a single
+// "<redacted>" in caches that have them), and the dysymtab ranges and indirect
+// symbol indices move along. The merged string pool stores each name once:
+// compiler-generated locals repeat a lot within an image.
+//
+// Calls can be pointed back at the image's own stubs, where the cache builder
+// sent them straight to the callee or through a branch island. Patched
+// instructions are recorded at planning time, and the blocks holding them are
+// left out of the verbatim copies.
+#define EXTRACT_PAGE 0x4000
+#define EXTRACT_BLOCK 0x1000    // Alignment of verbatim copies, the filesystem block size clones need
+
+#define S_ZEROFILL                  0x1
+#define S_GB_ZEROFILL               0xc
+#define S_THREAD_LOCAL_ZEROFILL     0x12
+
+namespace dsc
+{
+    static inline uint64_t extract_align(uint64_t v, uint64_t a)
+    {
+        return (v + a - 1) & ~(a - 1);
+    }
+
+    // Name of an nlist in pool, or NULL (counted as no name) if it's empty or runs off the pool.
+    static inline const char* extract_name(const uint8_t *nl, const char *pool, uint64_t size, size_t *len)
+    {
+        uint32_t strx;
+        memcpy(&strx, nl, sizeof(strx));
+        const char *s = strx < size ? pool + strx : nullptr;
+        const void *nul = s ? memchr(s, '\0', size - strx) : nullptr;
+        if(!nul || nul == s)
+        {
+            return nullptr;
+        }
+        *len = (const char*)nul - s;
+        return s;
+    }
+
+    // Calls that leave the image, directly or through an island, and end up where one of its own stubs
+    // does, retargeted at that stub. Only code the image's segments carry over is looked at.
+    static void extract_calls(const cache_t &cache, extract_layout_t &out)
+    {
+        const extract_layout_t::seg_t *text = nullptr;
+        for(const extract_layout_t::seg_t &s : out.segs)
+        {
+            if(strcmp(s.seg.name, "__TEXT") == 0)
+            {
+                text = &s;
+            }
+        }
+        if(!text)
+        {
+            return;
+        }
+        uint64_t lo = text->seg.vmaddr,
+                 hi = text->seg.vmaddr + text->seg.vmsize;
+        const stubs_t &stubs = cache.stubs();
+        std::pair<size_t, size_t> r = stubs.range(lo, hi);
+        std::vector<std::pair<uint64_t, uint64_t>> own;     // Final target, stub
+        for(size_t i = r.first; i < r.second; ++i)
+        {
+            const stubs_t::entry_t &e = stubs.entries[i];
+            if(e.kind != STUB_ISLAND && e.target != 0)
+            {
+                own.push_back({ e.target, e.addr });
+            }
+        }
+        if(own.empty())
+        {
+            return;
+        }
+        std::sort(own.begin(), own.end());
+        out.mo.each_section([&](const section_t &sec) -> bool
+        {
+            if(!(sec.flags & S_ATTR_PURE_INSTRUCTIONS) || (sec.flags & SECTION_TYPE) == S_SYMBOL_STUBS)
+            {
+                return true;
+            }
+            for(const extract_layout_t::seg_t &s : out.segs)
+            {
+                if(sec.addr < s.seg.vmaddr || sec.addr - s.seg.vmaddr >= s.filesize)
+                {
+                    continue;
+                }
+                uint64_t size = std::min(sec.size, s.filesize - (sec.addr - s.seg.vmaddr));
+                const uint8_t *p = cache.ptr(sec.addr, size);
+                for(uint64_t off = 0; p && off + 4 <= size; off += 4)
+                {
+                    uint32_t insn;
+                    uint64_t pc = sec.addr + off,
+                             target;
+                    memcpy(&insn, p + off, sizeof(insn));
+                    if(!stub_branch(insn, pc, target) || (target >= lo && target < hi))
+                    {
+                        continue;
+                    }
+                    auto it = std::lower_bound(own.begin(), own.end(), std::make_pair(stubs.resolve(target), (uint64_t)0));
+                    if(it != own.end() && it->first == stubs.resolve(target))
+                    {
+                        uint32_t imm = (uint32_t)(((int64_t)(it->second - pc) >> 2) & 0x3ffffff);
+                        out.patches.push_back({ s.fileoff + (pc - s.seg.vmaddr), (insn & 0xfc000000) | imm });
+                    }
+                }
+                break;
+            }
+            return true;
+        });
+        std::sort(out.patches.begin(), out.patches.end());
+    }
+
+    bool extract_plan(const cache_t &cache, const image_t &img, extract_layout_t &out, uint32_t flags)
+    {
+        out = extract_layout_t();
+        out.img = &img;
+        if(!out.mo.init(cache, img.addr))
+        {
+            WRN("%s: bad Mach-O header", img.path);
+            return false;
+        }
+        const macho_t &mo = out.mo;
+        bool ok = true;
+        uint64_t off = 0;
+        mo.each_segment([&](const segment_t &seg) -> bool
+        {
+            if(strcmp(seg.name, "__LINKEDIT") == 0)
+            {
+                out.segs.push_back({ seg, 0, 0 });
+                return true;
+            }
+            uint64_t size = std::min(seg.filesize, seg.vmsize);
+            if(size != 0 && !cache.ptr(seg.vmaddr, size))
+            {
+                WRN("%s: segment %s not backed by the cache", img.path, seg.name);
+                ok = false;
+                return false;
+            }
+            off = extract_align(off, EXTRACT_PAGE);
+            out.segs.push_back({ seg, size != 0 ? off : 0, size });
+            off += size;
+            return true;
+        });
+        if(!ok)
+        {
+            return false;
+        }
+
+        uint32_t nlsize = mo.dispatch([](auto fmt) -> uint32_t { return sizeof(typename decltype(fmt)::nlist); });
+        const dyld_info_command *info = nullptr;
+        const symtab_command *symtab = nullptr;
+        const dysymtab_command *dysymtab = nullptr;
+        const linkedit_data_command *exports = nullptr,
+                                    *fstarts = nullptr,
+                                    *dic = nullptr;
+        mo.each_cmd([&](const load_command *lc) -> bool
+        {
+            if((lc->cmd == LC_DYLD_INFO || lc->cmd == LC_DYLD_INFO_ONLY) && lc->cmdsize >= sizeof(dyld_info_command))
+            {
+                info = (const dyld_info_command*)lc;
+            }
+            else if(lc->cmd == LC_SYMTAB && lc->cmdsize >= sizeof(symtab_command))
+            {
+                symtab = (const symtab_command*)lc;
+            }
+            else if(lc->cmd == LC_DYSYMTAB && lc->cmdsize >= sizeof(dysymtab_command))
+            {
+                dysymtab = (const dysymtab_command*)lc;
+            }
+            else if(lc->cmdsize >= sizeof(linkedit_data_command))
+            {
+                switch(lc->cmd)
+                {
+                    case LC_DYLD_EXPORTS_TRIE:  exports = (const linkedit_data_command*)lc; break;
+                    case LC_FUNCTION_STARTS:    fstarts = (const linkedit_data_command*)lc; break;
+                    case LC_DATA_IN_CODE:       dic     = (const linkedit_data_command*)lc; break;
+                }
+            }
+            return true;
+        });
+
+        uint64_t le = extract_align(off, EXTRACT_PAGE),
+                 cur = le;
+        auto piece = [&](const void *cmd, size_t field, uint64_t fileoff, uint64_t size)
+        {
+            if(!cmd)
+            {
+                return;
+            }
+            uint32_t cmdoff = (uint32_t)((const uint8_t*)cmd + field - mo.cmds);
+            const uint8_t *src = size != 0 ? mo.linkedit(cache, fileoff, size) : nullptr;
+            if(size != 0 && !src)
+            {
+                WRN("%s: LINKEDIT data at 0x%llx out of bounds, dropping it", img.path, (unsigned long long)fileoff);
+            }
+            cur = extract_align(cur, 8);
+            out.pieces.push_back({ cmdoff, src, src ? size : 0, src ? cur : 0 });
+            if(src)
+            {
+                cur += size;
+            }
+        };
+        if(info)
+        {
+            piece(info, offsetof(dyld_info_command, bind_off),      info->bind_off,      info->bind_size);
+            piece(info, offsetof(dyld_info_command, weak_bind_off), info->weak_bind_off, info->weak_bind_size);
+            piece(info, offsetof(dyld_info_command, lazy_bind_off), info->lazy_bind_off, info->lazy_bind_size);
+            piece(info, offsetof(dyld_info_command, export_off),    info->export_off,    info->export_size);
+        }
+        piece(exports, offsetof(linkedit_data_command, dataoff), exports ? exports->dataoff : 0, exports ? exports->datasize : 0);
+        piece(fstarts, offsetof(linkedit_data_command, dataoff), fstarts ? fstarts->dataoff : 0, fstarts ? fstarts->datasize : 0);
+        piece(dic,     offsetof(linkedit_data_command, dataoff), dic ? dic->dataoff : 0,         dic ? dic->datasize : 0);
+
+        if(symtab && symtab->nsyms != 0)
+        {
+            out.syms = mo.linkedit(cache, symtab->symoff, (uint64_t)symtab->nsyms * nlsize);
+            out.strs = (const char*)mo.linkedit(cache, symtab->stroff, symtab->strsize);
+            if(out.syms && out.strs)
+            {
+                out.nsyms = symtab->nsyms;
+                out.strs_size = symtab->strsize;
+            }
+            else
+            {
+                WRN("%s: symbol table out of bounds, dropping it", img.path);
+                out.syms = nullptr;
+                out.strs = nullptr;
+            }
+        }
+        if((flags & EXTRACT_LOCALS) && symtab)
+        {
+            const locals_t &all = cache.locals();
+            const locals_t::entry_t *e = all.find(img.addr);
+            if(e && e->count != 0)
+            {
+                if(dysymtab && dysymtab->ilocalsym != 0 && dysymtab->nlocalsym != 0)
+                {
+                    WRN("%s: own local symbols don't come first, not merging local symbols", img.path);
+                }
+                else
+                {
+                    out.dropped = dysymtab ? std::min(dysymtab->nlocalsym, out.nsyms) : 0;
+                    if(out.syms)
+                    {
+                        out.syms += (uint64_t)out.dropped * nlsize;
+                    }
+                    out.nsyms -= out.dropped;
+                    out.locals = e->nlists;
+                    out.nlocals = e->count;
+                    out.locals_strs = all.strs;
+                    out.locals_strs_size = all.strs_size;
+                }
+            }
+        }
+        cur = extract_align(cur, 8);
+        out.symoff = cur;
+        cur += ((uint64_t)out.nlocals + out.nsyms) * nlsize;
+        if(dysymtab)
+        {
+            piece(dysymtab, offsetof(dysymtab_command, indirectsymoff), dysymtab->indirectsymoff, (uint64_t)dysymtab->nindirectsyms * sizeof(uint32_t));
+            if(out.pieces.back().src)
+            {
+                out.indirectoff = out.pieces.back().fileoff;
+                out.nindirect = dysymtab->nindirectsyms;
+            }
+        }
+        out.strsize = 1;
+        if(out.nlocals != 0)
+        {
+            // Open addressing over the names seen so far, at most half full. Slots hold 1 + the index
+            // of a name's first use, whose length sits in the top bits to skip most compares.
+            size_t total = (size_t)out.nlocals + out.nsyms,
+                   mask = 1;
+            while(mask < 2 * total)
+            {
+                mask <<= 1;
+            }
+            --mask;
+            std::vector<uint64_t> table(mask + 1, 0);
+            std::vector<const char*> first(total);
+            out.strx.resize(total);
+            for(size_t i = 0; i < total; ++i)
+            {
+                bool local = i < out.nlocals;
+                size_t len;
+                const char *s = local ? extract_name(out.locals + i * nlsize, out.locals_strs, out.locals_strs_size, &len)
+                                      : extract_name(out.syms + (i - out.nlocals) * nlsize, out.strs, out.strs_size, &len);
+                out.strx[i] = 0;
+                if(!s)
+                {
+                    continue;
+                }
+                first[i] = s;
+                uint64_t key = (uint64_t)len << 32;
+                for(size_t h = hash64(s, len) & mask; ; h = (h + 1) & mask)
+                {
+                    uint64_t slot = table[h];
+                    if(slot == 0)
+                    {
+                        table[h] = key | (i + 1);
+                        out.strx[i] = (uint32_t)out.strsize;
+                        out.strsize += len + 1;
+                        break;
+                    }
+                    size_t j = (uint32_t)slot - 1;
+                    if((slot >> 32) == len && memcmp(first[j], s, len) == 0)
+                    {
+                        out.strx[i] = out.strx[j];
+                        break;
+                    }
+                }
+            }
+        }
+        else
+        {
+            for(uint32_t i = 0; i < out.nsyms; ++i)
+            {
+                size_t len;
+                if(extract_name(out.syms + (uint64_t)i * nlsize, out.strs, out.strs_size, &len))
+                {
+                    out.strsize += len + 1;
+                }
+            }
+        }
+        out.strsize = extract_align(out.strsize, 8);
+        out.stroff = extract_align(cur, 8);
+        cur = out.stroff + out.strsize;
+
+        for(extract_layout_t::seg_t &s : out.segs)
+        {
+            if(strcmp(s.seg.name, "__LINKEDIT") == 0)
+            {
+                s.fileoff = le;
+                s.filesize = cur - le;
+            }
+        }
+        out.size = cur;
+
+        if(flags & EXTRACT_STUBS)
+        {
+            extract_calls(cache, out);
+        }
+
+        // Segments from mappings without slide info come out verbatim, except for the load
+        // commands, which are rewritten. Adopted caches have no file to copy from.
+        uint64_t hdrend = (uint64_t)(mo.cmds_end - mo.hdr);
+        for(const extract_layout_t::seg_t &s : out.segs)
+        {
+            const mapping_t *m = s.filesize != 0 && strcmp(s.seg.name, "__LINKEDIT") != 0 ? cache.mapping(s.seg.vmaddr) : nullptr;
+            int fd = m && !m->slide ? cache.file_fd(*m) : -1;
+            if(fd == -1)
+            {
+                continue;
+            }
+            uint64_t start = s.fileoff,
+                     end = s.fileoff + s.filesize;
+            if(img.addr >= s.seg.vmaddr && img.addr - s.seg.vmaddr < s.filesize)
+            {
+                start = std::max(start, s.fileoff + (img.addr - s.seg.vmaddr) + hdrend);
+            }
+            start = extract_align(start, EXTRACT_BLOCK);
+            end &= ~(uint64_t)(EXTRACT_BLOCK - 1);
+            // Blocks with patched calls have to pass through the buffer
+            auto copy = [&](uint64_t from, uint64_t to)
+            {
+                if(to > from && to - from >= EXTRACT_PAGE)
+                {
+                    uint64_t delta = s.seg.vmaddr + (from - s.fileoff) - m->addr;
+                    out.copies.push_back({ from, to - from, fd, m->fileoff + delta, m->data + delta });
+                }
+            };
+            auto patch = std::lower_bound(out.patches.begin(), out.patches.end(), std::make_pair(start, (uint32_t)0));
+            for(; patch != out.patches.end() && patch->first < end; ++patch)
+            {
+                uint64_t block = patch->first & ~(uint64_t)(EXTRACT_BLOCK - 1);
+                if(block >= start)
+                {
+                    copy(start, block);
+                    start = block + EXTRACT_BLOCK;
+                }
+            }
+            copy(start, end);
+        }
+        return true;
+    }
+
+    template<typename T>
+    static inline void extract_put(uint8_t *p, T v)
+    {
+        memcpy(p, &v, sizeof(v));
+    }
+
+    // Everything past the segment contents: load commands, LINKEDIT pieces and the
+    // rebuilt symbol table. F is the macho_fmt_t for the image's width.
+    template<typename F>
+    static bool extract_cmds(const extract_layout_t &layout, uint64_t hdroff, uint8_t *out)
+    {
+        const macho_t &mo = layout.mo;
+        const image_t &img = *layout.img;
+        uint64_t hdrsize = sizeof(typename F::header);
+        uint64_t sizeofcmds = (uint64_t)(mo.cmds_end - mo.cmds);
+        if(hdroff + hdrsize + sizeofcmds > layout.size)
+        {
+            WRN("%s: load commands outside of the image", img.path);
+            return false;
+        }
+        mach_header *mh = (mach_header*)(out + hdroff);
+        mh->flags &= ~MH_DYLIB_IN_CACHE;
+
+        // Same walk as macho_t::each_cmd, but on the writable copy
+        uint8_t *cmds = out + hdroff + hdrsize,
+                *p = cmds;
+        size_t segidx = 0;
+        for(uint32_t i = 0; i < mo.ncmds && (uint64_t)(p - cmds) + sizeof(load_command) <= sizeofcmds; ++i)
+        {
+            load_command *lc = (load_command*)p;
+            if(lc->cmdsize < sizeof(load_command) || lc->cmdsize > sizeofcmds - (uint64_t)(p - cmds))
+            {
+                break;
+            }
+            if(lc->cmd == F::segment_cmd && lc->cmdsize >= sizeof(typename F::segment) && segidx < layout.segs.size())
+            {
+                typedef typename F::uptr uptr_t;
+                const extract_layout_t::seg_t &s = layout.segs[segidx++];
+                typename F::segment *sc = (typename F::segment*)lc;
+                sc->fileoff = (uptr_t)s.fileoff;
+                sc->filesize = (uptr_t)s.filesize;
+                if(strcmp(s.seg.name, "__LINKEDIT") == 0)
+                {
+                    sc->vmsize = (uptr_t)extract_align(s.filesize, EXTRACT_PAGE);
+                }
+                typename F::section *sec = (typename F::section*)(sc + 1);
+                for(uint32_t j = 0; j < sc->nsects && (j + 1) * sizeof(*sec) <= lc->cmdsize - sizeof(*sc); ++j)
+                {
+                    uint32_t type = sec[j].flags & 0xff;
+                    bool zf = type == S_ZEROFILL || type == S_GB_ZEROFILL || type == S_THREAD_LOCAL_ZEROFILL;
+                    sec[j].offset = zf ? 0 : (uint32_t)(s.fileoff + (sec[j].addr - s.seg.vmaddr));
+                    sec[j].reloff = 0;
+                    sec[j].nreloc = 0;
+                }
+            }
+            else if(lc->cmd == LC_SYMTAB && lc->cmdsize >= sizeof(symtab_command))
+            {
+                symtab_command *st = (symtab_command*)lc;
+                st->symoff = layout.nlocals + layout.nsyms ? (uint32_t)layout.symoff : 0;
+                st->nsyms = layout.nlocals + layout.nsyms;
+                st->stroff = (uint32_t)layout.stroff;
+                st->strsize = (uint32_t)layout.strsize;
+            }
+            else if(lc->cmd == LC_DYSYMTAB && lc->cmdsize >= sizeof(dysymtab_command))
+            {
+                dysymtab_command *ds = (dysymtab_command*)lc;
+                ds->tocoff = ds->ntoc = 0;
+                ds->modtaboff = ds->nmodtab = 0;
+                ds->extrefsymoff = ds->nextrefsyms = 0;
+                ds->extreloff = ds->nextrel = 0;
+                ds->locreloff = ds->nlocrel = 0;
+                if(layout.nlocals != 0)
+                {
+                    ds->ilocalsym = 0;
+                    ds->nlocalsym = layout.nlocals;
+                    ds->iextdefsym = ds->iextdefsym >= layout.dropped ? ds->iextdefsym - layout.dropped + layout.nlocals : layout.nlocals;
+                    ds->iundefsym = ds->iundefsym >= layout.dropped ? ds->iundefsym - layout.dropped + layout.nlocals : layout.nlocals;
+                }
+            }
+            else if((lc->cmd == LC_DYLD_INFO || lc->cmd == LC_DYLD_INFO_ONLY) && lc->cmdsize >= sizeof(dyld_info_command))
+            {
+                dyld_info_command *di = (dyld_info_command*)lc;
+                di->rebase_off = di->rebase_size = 0;
+            }
+            else if((lc->cmd == LC_SEGMENT_SPLIT_INFO || lc->cmd == LC_CODE_SIGNATURE || lc->cmd == LC_DYLIB_CODE_SIGN_DRS ||
+                     lc->cmd == LC_LINKER_OPTIMIZATION_HINT || lc->cmd == LC_DYLD_CHAINED_FIXUPS) && lc->cmdsize >= sizeof(linkedit_data_command))
+            {
+                linkedit_data_command *ld = (linkedit_data_command*)lc;
+                ld->dataoff = ld->datasize = 0;
+            }
+            p += lc->cmdsize;
+        }
+
+        for(const extract_layout_t::piece_t &pc : layout.pieces)
+        {
+            extract_put<uint32_t>(cmds + pc.cmdoff, (uint32_t)pc.fileoff);
+            if(!pc.src)
+            {
+                extract_put<uint32_t>(cmds + pc.cmdoff + 4, 0);
+                continue;
+            }
+            memcpy(out + pc.fileoff, pc.src, pc.size);
+        }
+
+        const uint32_t nlsize = sizeof(typename F::nlist);
+        uint8_t *syms = out + layout.symoff;
+        char *strs = (char*)out + layout.stroff;
+        if(layout.nlocals != 0)
+        {
+            memcpy(syms, layout.locals, (uint64_t)layout.nlocals * nlsize);
+            if(layout.nsyms != 0)
+            {
+                memcpy(syms + (uint64_t)layout.nlocals * nlsize, layout.syms, (uint64_t)layout.nsyms * nlsize);
+            }
+            // Names were numbered in order of first use, so a name is new exactly when its offset is the next free one
+            uint64_t next = 1;
+            for(size_t i = 0; i < layout.strx.size(); ++i)
+            {
+                uint8_t *nl = syms + i * nlsize;
+                uint32_t old;
+                memcpy(&old, nl, sizeof(old));
+                extract_put<uint32_t>(nl, layout.strx[i]);
+                if(layout.strx[i] == next)
+                {
+                    const char *s = i < layout.nlocals ? layout.locals_strs + old : layout.strs + old;
+                    size_t len = strlen(s) + 1;
+                    memcpy(strs + next, s, len);
+                    next += len;
+                }
+            }
+            for(uint32_t i = 0; i < layout.nindirect; ++i)
+            {
+                uint8_t *p = out + layout.indirectoff + (uint64_t)i * sizeof(uint32_t);
+                uint32_t idx;
+                memcpy(&idx, p, sizeof(idx));
+                if(!(idx & (INDIRECT_SYMBOL_LOCAL | INDIRECT_SYMBOL_ABS)) && idx >= layout.dropped)
+                {
+                    extract_put<uint32_t>(p, idx - layout.dropped + layout.nlocals);
+                }
+            }
+            return true;
+        }
+
+        uint64_t strx = 1;
+        if(layout.nsyms != 0)
+        {
+            memcpy(syms, layout.syms, (uint64_t)layout.nsyms * nlsize);
+        }
+        for(uint32_t i = 0; i < layout.nsyms; ++i)
+        {
+            uint8_t *nl = syms + (uint64_t)i * nlsize;
+            uint32_t old;
+            memcpy(&old, nl, sizeof(old));
+            const char *s = old < layout.strs_size ? layout.strs + old : nullptr;
+            const void *nul = s ? memchr(s, '\0', layout.strs_size - old) : nullptr;
+            if(!nul || nul == s)
+            {
+                extract_put<uint32_t>(nl, 0);
+                continue;
+            }
+            size_t len = (const char*)nul - s + 1;
+            memcpy(strs + strx, s, len);
+            extract_put<uint32_t>(nl, (uint32_t)strx);
+            strx += len;
+        }
+        return true;
+    }
+
+    // Copies segment contents and rewrites their slid pointers as plain addresses.
+    // P is the cache's pointer format, so the per-pointer loop has no format checks.
+    template<typename P>
+    static uint64_t extract_segments(const cache_t &cache, const extract_layout_t &layout, const P &fmt, uint8_t *out, bool skip_copies)
+    {
+        typedef typename P::raw_t raw_t;
+        const image_t &img = *layout.img;
+        uint64_t hdroff = 0;
+        for(const extract_layout_t::seg_t &s : layout.segs)
+        {
+            if(strcmp(s.seg.name, "__LINKEDIT") == 0 || s.filesize == 0)
+            {
+                continue;
+            }
+            uint8_t *dst = out + s.fileoff;
+            const uint8_t *src = cache.ptr(s.seg.vmaddr, s.filesize);
+            if(skip_copies)
+            {
+                extract_gaps(layout.copies, s.fileoff, s.filesize, [&](uint64_t off, uint64_t size)
+                {
+                    memcpy(out + off, src + (off - s.fileoff), size);
+                });
+            }
+            else
+            {
+                memcpy(dst, src, s.filesize);
+            }
+            if(img.addr >= s.seg.vmaddr && img.addr - s.seg.vmaddr < s.filesize)
+            {
+                hdroff = s.fileoff + (img.addr - s.seg.vmaddr);
+            }
+            // v1 and unslid caches store pointers as plain addresses already, nothing to rewrite
+            if(!P::chained)
+            {
+                continue;
+            }
+            uint64_t vmaddr = s.seg.vmaddr;
+            if(!ptr_walk(cache, fmt, vmaddr, vmaddr + s.filesize, [&](uint64_t addr, raw_t raw)
+            {
+                extract_put<raw_t>(dst + (addr - vmaddr), (raw_t)fmt.decode(raw));
+            }))
+            {
+                WRN("%s: can't walk slide info, %s pointers are left as stored", img.path, s.seg.name);
+            }
+        }
+        return hdroff;
+    }
+
+    bool extract_build(const cache_t &cache, const extract_layout_t &layout, uint8_t *out, bool skip_copies)
+    {
+        const macho_t &mo = layout.mo;
+        if(skip_copies)
+        {
+            extract_gaps(layout.copies, 0, layout.size, [&](uint64_t off, uint64_t size)
+            {
+                memset(out + off, 0, size);
+            });
+        }
+        else
+        {
+            memset(out, 0, layout.size);
+        }
+        uint64_t hdroff = ptr_dispatch(cache, [&](const auto &fmt)
+        {
+            return extract_segments(cache, layout, fmt, out, skip_copies);
+        });
+        for(const std::pair<uint64_t, uint32_t> &p : layout.patches)
+        {
+            extract_put<uint32_t>(out + p.first, p.second);
+        }
+        return mo.dispatch([&](auto fmt)
+        {
+            return extract_cmds<decltype(fmt)>(layout, hdroff, out);
+        });
+    }
+
+    bool extract_image(const cache_t &cache, const image_t &img, std::vector<uint8_t> &out, uint32_t flags)
+    {
+        extract_layout_t layout;
+        if(!extract_plan(cache, img, layout, flags))
+        {
+            return false;
+        }
+        out.resize(layout.size);
+        return extract_build(cache, layout, out.data());
+    }
+
+    bool extract_write(const char *dir, const char *path, const uint8_t *data, size_t size)
+    {
+        std::string file = std::string(dir) + "/" + path;
+        if(!mkdirs(file))
+        {
+            return false;
+        }
+        FILE *f = fopen(file.c_str(), "wb");
+        if(!f)
+        {
+            ERR("fopen(%s): %s", file.c_str(), strerror(errno));
+            return false;
+        }
+        bool ok = fwrite(data, 1, size, f) == size;
+        if(fclose(f) != 0 || !ok)
+        {
+            ERR("Failed to write %s", file.c_str());
+            return false;
+        }
+        return true;
+    }
+}
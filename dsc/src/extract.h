@@ -0,0 +1,119 @@
+#ifndef DSC_EXTRACT_H
+#define DSC_EXTRACT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "cache.h"
+#include "macho.h"
+
+// extract_plan flags
+#define EXTRACT_LOCALS  0x1     // Put back the local symbols the cache builder took out of the image (see locals.h)
+#define EXTRACT_STUBS   0x2     // Point calls that leave the image at its own stub for the same target (see stubs.h)
+
+namespace dsc
+{
+    // Where a cached image ends up in its standalone Mach-O. Planning doesn't
+    // touch segment contents, so it's cheap enough to report sizes up front.
+    struct extract_layout_t
+    {
+        struct seg_t
+        {
+            segment_t seg;
+            uint64_t fileoff;   // In the output
+            uint64_t filesize;
+        };
+
+        // A LINKEDIT blob copied verbatim, whose offset is patched into
+        // the load command at cmdoff (relative to the start of the commands).
+        struct piece_t
+        {
+            uint32_t cmdoff;
+            const uint8_t *src;
+            uint64_t size;
+            uint64_t fileoff;
+        };
+
+        // A block-aligned stretch of segment data that comes out exactly as it
+        // is in a cache file (no slid pointers, no load commands), so a writer
+        // can clone or copy it in the kernel instead of passing it through a buffer.
+        struct copy_t
+        {
+            uint64_t fileoff;   // In the output
+            uint64_t size;
+            int fd;             // Cache file holding it
+            uint64_t srcoff;    // In that file
+            const uint8_t *src; // The same bytes, mapped
+        };
+
+        const image_t *img = nullptr;
+        macho_t mo;
+        std::vector<seg_t> segs;
+        std::vector<piece_t> pieces;
+        std::vector<copy_t> copies;         // Sorted by fileoff
+        const uint8_t *syms = nullptr;      // Image's nlists
+        uint32_t nsyms = 0;
+        const char *strs = nullptr;         // Shared string pool the nlists index into
+        uint64_t strs_size = 0;
+        const uint8_t *locals = nullptr;    // Local nlists merged back in from the cache, ahead of syms
+        uint32_t nlocals = 0;
+        uint32_t dropped = 0;               // Leading nlists of the image's own left out for them
+        const char *locals_strs = nullptr;
+        uint64_t locals_strs_size = 0;
+        uint64_t indirectoff = 0;           // Output offset of the indirect symbols, to renumber after a merge
+        uint32_t nindirect = 0;
+        std::vector<uint32_t> strx;         // With locals: output string offset of every nlist, each name stored once
+        std::vector<std::pair<uint64_t, uint32_t>> patches;    // With stubs: output offset and new instruction of each call retargeted, sorted
+        uint64_t symoff = 0;                // Output offsets of the rebuilt symbol and string tables
+        uint64_t stroff = 0;
+        uint64_t strsize = 0;
+        uint64_t size = 0;                  // Total output size
+    };
+
+    // flags is a combination of EXTRACT_*. With EXTRACT_LOCALS, the local symbols replace whatever the
+    // image kept of its own. With EXTRACT_STUBS, calls straight into other images or through branch
+    // islands go to the image's own stub instead where it has one, so they resolve to a symbol in the
+    // standalone file. Stubs themselves are left as the cache builder optimized them.
+    bool extract_plan(const cache_t &cache, const image_t &img, extract_layout_t &out, uint32_t flags = 0);
+
+    // Writes the image to out, which must hold layout.size bytes. With skip_copies, the ranges in
+    // layout.copies are left untouched, for a writer that fills them in from the cache file.
+    bool extract_build(const cache_t &cache, const extract_layout_t &layout, uint8_t *out, bool skip_copies = false);
+
+    // Calls fn(off, size) for each part of [off, off + size) not covered by copies.
+    template<typename F>
+    void extract_gaps(const std::vector<extract_layout_t::copy_t> &copies, uint64_t off, uint64_t size, F &&fn)
+    {
+        uint64_t end = off + size;
+        for(const extract_layout_t::copy_t &c : copies)
+        {
+            if(c.fileoff >= end)
+            {
+                break;
+            }
+            if(c.fileoff + c.size <= off)
+            {
+                continue;
+            }
+            if(c.fileoff > off)
+            {
+                fn(off, c.fileoff - off);
+            }
+            off = c.fileoff + c.size;
+        }
+        if(off < end)
+        {
+            fn(off, end - off);
+        }
+    }
+
+    // Both of the above.
+    bool extract_image(const cache_t &cache, const image_t &img, std::vector<uint8_t> &out, uint32_t flags = 0);
+
+    // Writes data to dir/path, creating intermediate directories.
+    bool extract_write(const char *dir, const char *path, const uint8_t *data, size_t size);
+}
+
+#endif
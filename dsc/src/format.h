@@ -0,0 +1,627 @@
+#ifndef DSC_FORMAT_H
+#define DSC_FORMAT_H
+
+// On-disk structures of the dyld shared cache and Mach-O, declared here rather
+// than taken from the dyld source drop so that one build can read every cache
+// format. The cache header only ever grew at the end, so whether a field exists
+// is decided by comparing its offset against mappingOffset.
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace dsc
+{
+    struct dyld_cache_header
+    {
+        char     magic[16];
+        uint32_t mappingOffset;
+        uint32_t mappingCount;
+        uint32_t imagesOffsetOld;
+        uint32_t imagesCountOld;
+        uint64_t dyldBaseAddress;
+        uint64_t codeSignatureOffset;
+        uint64_t codeSignatureSize;
+        uint64_t slideInfoOffsetUnused;
+        uint64_t slideInfoSizeUnused;
+        uint64_t localSymbolsOffset;
+        uint64_t localSymbolsSize;
+        uint8_t  uuid[16];
+        uint64_t cacheType;
+        uint32_t branchPoolsOffset;
+        uint32_t branchPoolsCount;
+        uint64_t accelerateInfoAddr;
+        uint64_t accelerateInfoSize;
+        uint64_t imagesTextOffset;
+        uint64_t imagesTextCount;
+        uint64_t patchInfoAddr;
+        uint64_t patchInfoSize;
+        uint64_t otherImageGroupAddrUnused;
+        uint64_t otherImageGroupSizeUnused;
+        uint64_t progClosuresAddr;
+        uint64_t progClosuresSize;
+        uint64_t progClosuresTrieAddr;
+        uint64_t progClosuresTrieSize;
+        uint32_t platform;
+        uint32_t formatVersion;
+        uint64_t sharedRegionStart;
+        uint64_t sharedRegionSize;
+        uint64_t maxSlide;
+        uint64_t dylibsImageArrayAddr;
+        uint64_t dylibsImageArraySize;
+        uint64_t dylibsTrieAddr;
+        uint64_t dylibsTrieSize;
+        uint64_t otherImageArrayAddr;
+        uint64_t otherImageArraySize;
+        uint64_t otherTrieAddr;
+        uint64_t otherTrieSize;
+        uint32_t mappingWithSlideOffset;
+        uint32_t mappingWithSlideCount;
+        uint64_t dylibsPBLStateArrayAddrUnused;
+        uint64_t dylibsPBLSetAddr;
+        uint64_t programsPBLSetPoolAddr;
+        uint64_t programsPBLSetPoolSize;
+        uint64_t programTrieAddr;
+        uint32_t programTrieSize;
+        uint32_t osVersion;
+        uint32_t altPlatform;
+        uint32_t altOsVersion;
+        uint64_t swiftOptsOffset;
+        uint64_t swiftOptsSize;
+        uint32_t subCacheArrayOffset;
+        uint32_t subCacheArrayCount;
+        uint8_t  symbolFileUUID[16];
+        uint64_t rosettaReadOnlyAddr;
+        uint64_t rosettaReadOnlySize;
+        uint64_t rosettaReadWriteAddr;
+        uint64_t rosettaReadWriteSize;
+        uint32_t imagesOffset;
+        uint32_t imagesCount;
+        uint32_t cacheSubType;
+        uint32_t padding2;
+        uint64_t objcOptsOffset;
+        uint64_t objcOptsSize;
+        uint64_t cacheAtlasOffset;
+        uint64_t cacheAtlasSize;
+        uint64_t dynamicDataOffset;
+        uint64_t dynamicDataMaxSize;
+    };
+
+#define DSC_HAS_FIELD(hdr, field) ((hdr)->mappingOffset >= offsetof(dsc::dyld_cache_header, field) + sizeof(((dsc::dyld_cache_header*)0)->field))
+
+    struct dyld_cache_mapping_info
+    {
+        uint64_t address;
+        uint64_t size;
+        uint64_t fileOffset;
+        uint32_t maxProt;
+        uint32_t initProt;
+    };
+
+    struct dyld_cache_mapping_and_slide_info
+    {
+        uint64_t address;
+        uint64_t size;
+        uint64_t fileOffset;
+        uint64_t slideInfoFileOffset;
+        uint64_t slideInfoFileSize;
+        uint64_t flags;
+        uint32_t maxProt;
+        uint32_t initProt;
+    };
+
+    // Caches with no cacheSubType field use the first layout, with files named
+    // by their 1-based index
+    struct dyld_subcache_entry_v1
+    {
+        uint8_t  uuid[16];
+        uint64_t cacheVMOffset;
+    };
+
+    struct dyld_subcache_entry
+    {
+        uint8_t  uuid[16];
+        uint64_t cacheVMOffset;
+        char     fileSuffix[32];
+    };
+
+    struct dyld_cache_image_info
+    {
+        uint64_t address;
+        uint64_t modTime;
+        uint64_t inode;
+        uint32_t pathFileOffset;
+        uint32_t pad;
+    };
+
+    // Offsets are relative to the start of this struct
+    struct dyld_cache_local_symbols_info
+    {
+        uint32_t nlistOffset;
+        uint32_t nlistCount;
+        uint32_t stringsOffset;
+        uint32_t stringsSize;
+        uint32_t entriesOffset;
+        uint32_t entriesCount;
+    };
+
+    // Caches whose header predates symbolFileUUID, dylibOffset is the file offset of the image's header
+    struct dyld_cache_local_symbols_entry
+    {
+        uint32_t dylibOffset;
+        uint32_t nlistStartIndex;
+        uint32_t nlistCount;
+    };
+
+    // Later ones, dylibOffset is the VM offset of the image's header from the start of the cache
+    struct dyld_cache_local_symbols_entry_64
+    {
+        uint64_t dylibOffset;
+        uint32_t nlistStartIndex;
+        uint32_t nlistCount;
+    };
+
+    // Patch table, at patchInfoAddr. v1 has no version field, its first word
+    // is the low half of patchTableArrayAddr. Addresses are unslid VM
+    // addresses, counts are entries. The location bitfields are kept as plain
+    // words here and taken apart with the PATCH_LOC* macros below.
+    struct dyld_cache_patch_info_v1
+    {
+        uint64_t patchTableArrayAddr;       // dyld_cache_image_patches_v1[], one per image
+        uint64_t patchTableArrayCount;
+        uint64_t patchExportArrayAddr;      // dyld_cache_image_export_v1[]
+        uint64_t patchExportArrayCount;
+        uint64_t patchLocationArrayAddr;    // dyld_cache_patchable_location_v1[]
+        uint64_t patchLocationArrayCount;
+        uint64_t patchExportNamesAddr;
+        uint64_t patchExportNamesSize;
+    };
+
+    struct dyld_cache_image_patches_v1
+    {
+        uint32_t patchExportsStartIndex;
+        uint32_t patchExportsCount;
+    };
+
+    struct dyld_cache_image_export_v1
+    {
+        uint32_t cacheOffsetOfImpl;         // From the start of the cache
+        uint32_t patchLocationsStartIndex;
+        uint32_t patchLocationsCount;
+        uint32_t exportNameOffset;
+    };
+
+    struct dyld_cache_patchable_location_v1
+    {
+        uint64_t bits;                      // cacheOffset:32, high7:7, addend:5, authenticated:1, usesAddressDiversity:1, key:2, discriminator:16
+    };
+
+    // v2 and later, v3 and v4 append the GOT tables
+    struct dyld_cache_patch_info_v3
+    {
+        uint32_t patchTableVersion;
+        uint32_t patchLocationVersion;
+        uint64_t patchTableArrayAddr;       // dyld_cache_image_patches_v2[], one per image
+        uint64_t patchTableArrayCount;
+        uint64_t patchImageExportsArrayAddr;    // dyld_cache_image_export_v2[]
+        uint64_t patchImageExportsArrayCount;
+        uint64_t patchClientsArrayAddr;     // dyld_cache_image_clients_v2[]
+        uint64_t patchClientsArrayCount;
+        uint64_t patchClientExportsArrayAddr;   // dyld_cache_patchable_export_v2[]
+        uint64_t patchClientExportsArrayCount;
+        uint64_t patchLocationArrayAddr;    // dyld_cache_patchable_location_v2[]
+        uint64_t patchLocationArrayCount;
+        uint64_t patchExportNamesAddr;
+        uint64_t patchExportNamesSize;
+        uint64_t gotClientsArrayAddr;       // dyld_cache_image_got_clients_v3[], one per image
+        uint64_t gotClientsArrayCount;
+        uint64_t gotClientExportsArrayAddr; // dyld_cache_patchable_export_v2[]
+        uint64_t gotClientExportsArrayCount;
+        uint64_t gotLocationArrayAddr;      // dyld_cache_patchable_location_v3[]
+        uint64_t gotLocationArrayCount;
+    };
+
+    struct dyld_cache_image_patches_v2
+    {
+        uint32_t patchClientsStartIndex;
+        uint32_t patchClientsCount;
+        uint32_t patchExportsStartIndex;
+        uint32_t patchExportsCount;
+    };
+
+    struct dyld_cache_image_export_v2
+    {
+        uint32_t dylibOffsetOfImpl;         // From the exporting image's header
+        uint32_t bits;                      // exportNameOffset:28, patchKind:4
+    };
+
+    struct dyld_cache_image_clients_v2
+    {
+        uint32_t clientDylibIndex;
+        uint32_t patchExportsStartIndex;
+        uint32_t patchExportsCount;
+    };
+
+    struct dyld_cache_patchable_export_v2
+    {
+        uint32_t imageExportIndex;          // Into the whole dyld_cache_image_export_v2 array
+        uint32_t patchLocationsStartIndex;
+        uint32_t patchLocationsCount;
+    };
+
+    struct dyld_cache_patchable_location_v2
+    {
+        uint32_t dylibOffsetOfUse;          // From the client's header
+        uint32_t bits;                      // PATCH_LOC2_* before v4, PATCH_LOC4_* from v4 on
+    };
+
+    struct dyld_cache_image_got_clients_v3
+    {
+        uint32_t patchExportsStartIndex;
+        uint32_t patchExportsCount;
+    };
+
+    // v4's GOT locations have the same size, with the bits of v4 locations
+    struct dyld_cache_patchable_location_v3
+    {
+        uint64_t cacheOffsetOfUse;          // From the start of the cache
+        uint32_t bits;
+        uint32_t pad;
+    };
+
+// v2 and v3 location bits, v1's shifted down by 32
+#define PATCH_LOC2_HIGH7(b)     ((b) & 0x7f)
+#define PATCH_LOC2_ADDEND(b)    (((b) >> 7) & 0x1f)
+#define PATCH_LOC2_AUTH(b)      (((b) >> 12) & 1)
+#define PATCH_LOC2_DIVERSITY(b) (((b) >> 13) & 1)
+#define PATCH_LOC2_KEY(b)       (((b) >> 14) & 3)
+#define PATCH_LOC2_DISC(b)      (((b) >> 16) & 0xffff)
+// v4 location bits. Past the weak bit, authenticated ones have diversity, key and discriminator and no addend,
+// the others just the addend.
+#define PATCH_LOC4_AUTH(b)      ((b) & 1)
+#define PATCH_LOC4_HIGH7(b)     (((b) >> 1) & 0x7f)
+#define PATCH_LOC4_WEAK(b)      (((b) >> 8) & 1)
+#define PATCH_LOC4_ADDEND(b)    ((b) >> 9)
+#define PATCH_LOC4_DIVERSITY(b) (((b) >> 9) & 1)
+#define PATCH_LOC4_KEY_IS_D(b)  (((b) >> 10) & 1)
+#define PATCH_LOC4_DISC(b)      (((b) >> 11) & 0xffff)
+
+    // v2 and v4 share this layout, v1 only has the version in common
+    struct dyld_cache_slide_info2
+    {
+        uint32_t version;
+        uint32_t page_size;
+        uint32_t page_starts_offset;
+        uint32_t page_starts_count;
+        uint32_t page_extras_offset;
+        uint32_t page_extras_count;
+        uint64_t delta_mask;
+        uint64_t value_add;
+    };
+
+#define DYLD_CACHE_SLIDE_PAGE_ATTR_EXTRA        0x8000
+#define DYLD_CACHE_SLIDE_PAGE_ATTR_NO_REBASE    0x4000
+#define DYLD_CACHE_SLIDE_PAGE_ATTR_END          0x8000
+#define DYLD_CACHE_SLIDE4_PAGE_NO_REBASE        0xffff
+#define DYLD_CACHE_SLIDE4_PAGE_USE_EXTRA        0x8000
+#define DYLD_CACHE_SLIDE4_PAGE_EXTRA_END        0x8000
+#define DYLD_CACHE_SLIDE_V3_PAGE_ATTR_NO_REBASE 0xffff
+
+    // v5 has the same layout, with value_add in place of auth_value_add
+    struct dyld_cache_slide_info3
+    {
+        uint32_t version;
+        uint32_t page_size;
+        uint32_t page_starts_count;
+        uint32_t pad;
+        uint64_t auth_value_add;
+        // uint16_t page_starts[page_starts_count];
+    };
+
+#define MH_MAGIC                    0xfeedface
+#define MH_MAGIC_64                 0xfeedfacf
+#define FAT_MAGIC                   0xcafebabe  // Fat headers are big endian
+#define FAT_MAGIC_64                0xcafebabf
+
+#define CPU_SUBTYPE_MASK            0xff000000
+
+// Code signature blobs are big endian
+#define CSMAGIC_EMBEDDED_SIGNATURE  0xfade0cc0
+#define CSMAGIC_CODEDIRECTORY       0xfade0c02
+#define CSSLOT_CODEDIRECTORY        0
+
+#define MH_EXECUTE                  0x2
+#define MH_DYLIB                    0x6
+
+#define MH_DYLIB_IN_CACHE           0x80000000
+
+#define LC_REQ_DYLD                 0x80000000
+#define LC_SEGMENT                  0x1
+#define LC_SYMTAB                   0x2
+#define LC_DYSYMTAB                 0xb
+#define LC_LOAD_DYLIB               0xc
+#define LC_ID_DYLIB                 0xd
+#define LC_LOAD_WEAK_DYLIB          (0x18 | LC_REQ_DYLD)
+#define LC_SEGMENT_64               0x19
+#define LC_UUID                     0x1b
+#define LC_CODE_SIGNATURE           0x1d
+#define LC_SEGMENT_SPLIT_INFO       0x1e
+#define LC_REEXPORT_DYLIB           (0x1f | LC_REQ_DYLD)
+#define LC_DYLD_INFO                0x22
+#define LC_DYLD_INFO_ONLY           (0x22 | LC_REQ_DYLD)
+#define LC_LOAD_UPWARD_DYLIB        (0x23 | LC_REQ_DYLD)
+#define LC_VERSION_MIN_MACOSX       0x24
+#define LC_VERSION_MIN_IPHONEOS     0x25
+#define LC_FUNCTION_STARTS          0x26
+#define LC_MAIN                     (0x28 | LC_REQ_DYLD)
+#define LC_DATA_IN_CODE             0x29
+#define LC_DYLIB_CODE_SIGN_DRS      0x2b
+#define LC_LINKER_OPTIMIZATION_HINT 0x2e
+#define LC_VERSION_MIN_TVOS         0x2f
+#define LC_VERSION_MIN_WATCHOS      0x30
+#define LC_BUILD_VERSION            0x32
+#define LC_DYLD_EXPORTS_TRIE        (0x33 | LC_REQ_DYLD)
+#define LC_DYLD_CHAINED_FIXUPS      (0x34 | LC_REQ_DYLD)
+
+#define PLATFORM_MACOS              1
+#define PLATFORM_IOS                2
+#define PLATFORM_TVOS               3
+#define PLATFORM_WATCHOS            4
+
+    struct mach_header
+    {
+        uint32_t magic;
+        int32_t  cputype;
+        int32_t  cpusubtype;
+        uint32_t filetype;
+        uint32_t ncmds;
+        uint32_t sizeofcmds;
+        uint32_t flags;
+    };
+
+    struct mach_header_64
+    {
+        uint32_t magic;
+        int32_t  cputype;
+        int32_t  cpusubtype;
+        uint32_t filetype;
+        uint32_t ncmds;
+        uint32_t sizeofcmds;
+        uint32_t flags;
+        uint32_t reserved;
+    };
+
+    struct fat_header
+    {
+        uint32_t magic;
+        uint32_t nfat_arch;
+    };
+
+    struct fat_arch
+    {
+        int32_t  cputype;
+        int32_t  cpusubtype;
+        uint32_t offset;
+        uint32_t size;
+        uint32_t align;
+    };
+
+    struct fat_arch_64
+    {
+        int32_t  cputype;
+        int32_t  cpusubtype;
+        uint64_t offset;
+        uint64_t size;
+        uint32_t align;
+        uint32_t reserved;
+    };
+
+    struct cs_blob_index
+    {
+        uint32_t type;
+        uint32_t offset;
+    };
+
+    struct cs_superblob
+    {
+        uint32_t magic;
+        uint32_t length;
+        uint32_t count;
+        // cs_blob_index index[count];
+    };
+
+    struct load_command
+    {
+        uint32_t cmd;
+        uint32_t cmdsize;
+    };
+
+    struct segment_command
+    {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        char     segname[16];
+        uint32_t vmaddr;
+        uint32_t vmsize;
+        uint32_t fileoff;
+        uint32_t filesize;
+        int32_t  maxprot;
+        int32_t  initprot;
+        uint32_t nsects;
+        uint32_t flags;
+    };
+
+    struct segment_command_64
+    {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        char     segname[16];
+        uint64_t vmaddr;
+        uint64_t vmsize;
+        uint64_t fileoff;
+        uint64_t filesize;
+        int32_t  maxprot;
+        int32_t  initprot;
+        uint32_t nsects;
+        uint32_t flags;
+    };
+
+    struct dylib_command
+    {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        uint32_t name;
+        uint32_t timestamp;
+        uint32_t current_version;
+        uint32_t compatibility_version;
+    };
+
+#define SECTION_TYPE                0x000000ff
+#define S_SYMBOL_STUBS              0x8
+#define S_ATTR_PURE_INSTRUCTIONS    0x80000000
+#define S_ATTR_SOME_INSTRUCTIONS    0x00000400
+
+    struct section
+    {
+        char     sectname[16];
+        char     segname[16];
+        uint32_t addr;
+        uint32_t size;
+        uint32_t offset;
+        uint32_t align;
+        uint32_t reloff;
+        uint32_t nreloc;
+        uint32_t flags;
+        uint32_t reserved1;
+        uint32_t reserved2;
+    };
+
+    struct section_64
+    {
+        char     sectname[16];
+        char     segname[16];
+        uint64_t addr;
+        uint64_t size;
+        uint32_t offset;
+        uint32_t align;
+        uint32_t reloff;
+        uint32_t nreloc;
+        uint32_t flags;
+        uint32_t reserved1;
+        uint32_t reserved2;
+        uint32_t reserved3;
+    };
+
+    struct symtab_command
+    {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        uint32_t symoff;
+        uint32_t nsyms;
+        uint32_t stroff;
+        uint32_t strsize;
+    };
+
+    struct dysymtab_command
+    {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        uint32_t ilocalsym;
+        uint32_t nlocalsym;
+        uint32_t iextdefsym;
+        uint32_t nextdefsym;
+        uint32_t iundefsym;
+        uint32_t nundefsym;
+        uint32_t tocoff;
+        uint32_t ntoc;
+        uint32_t modtaboff;
+        uint32_t nmodtab;
+        uint32_t extrefsymoff;
+        uint32_t nextrefsyms;
+        uint32_t indirectsymoff;
+        uint32_t nindirectsyms;
+        uint32_t extreloff;
+        uint32_t nextrel;
+        uint32_t locreloff;
+        uint32_t nlocrel;
+    };
+
+#define INDIRECT_SYMBOL_LOCAL       0x80000000
+#define INDIRECT_SYMBOL_ABS         0x40000000
+
+    struct nlist
+    {
+        uint32_t n_strx;
+        uint8_t  n_type;
+        uint8_t  n_sect;
+        int16_t  n_desc;
+        uint32_t n_value;
+    };
+
+    struct nlist_64
+    {
+        uint32_t n_strx;
+        uint8_t  n_type;
+        uint8_t  n_sect;
+        uint16_t n_desc;
+        uint64_t n_value;
+    };
+
+    struct entry_point_command
+    {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        uint64_t entryoff;
+        uint64_t stacksize;
+    };
+
+    struct build_version_command
+    {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        uint32_t platform;
+        uint32_t minos;
+        uint32_t sdk;
+        uint32_t ntools;
+    };
+
+    struct uuid_command
+    {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        uint8_t  uuid[16];
+    };
+
+    struct dyld_info_command
+    {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        uint32_t rebase_off;
+        uint32_t rebase_size;
+        uint32_t bind_off;
+        uint32_t bind_size;
+        uint32_t weak_bind_off;
+        uint32_t weak_bind_size;
+        uint32_t lazy_bind_off;
+        uint32_t lazy_bind_size;
+        uint32_t export_off;
+        uint32_t export_size;
+    };
+
+    struct linkedit_data_command
+    {
+        uint32_t cmd;
+        uint32_t cmdsize;
+        uint32_t dataoff;
+        uint32_t datasize;
+    };
+
+#define EXPORT_SYMBOL_FLAGS_KIND_MASK           0x03
+#define EXPORT_SYMBOL_FLAGS_KIND_REGULAR        0x00
+#define EXPORT_SYMBOL_FLAGS_KIND_THREAD_LOCAL   0x01
+#define EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE       0x02
+#define EXPORT_SYMBOL_FLAGS_WEAK_DEFINITION     0x04
+#define EXPORT_SYMBOL_FLAGS_REEXPORT            0x08
+#define EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER   0x10
+}
+
+#endif
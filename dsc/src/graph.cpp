@@ -0,0 +1,480 @@
+#include <algorithm>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "cache.h"
+#include "common.h"
+#include "headers.h"
+#include "modes.h"
+
+#define EDGE_LOAD       0
+#define EDGE_WEAK       1
+#define EDGE_REEXPORT   2
+#define EDGE_UPWARD     3
+#define EDGE_KIND(e)    ((e) >> 30)
+#define EDGE_NODE(e)    ((e) & 0x3fffffff)
+
+// Binary export: all fields little endian uint32_t.
+//   "DSCG", version, nnodes, ncache, nedges, nscc, strsize
+//   nnodes * { name offset into string table, scc id }
+//   (nnodes + 1) * edge start index
+//   nedges * (target node | kind << 30)
+//   nnodes * node index, in topological order
+//   string table
+#define GRAPH_MAGIC     0x47435344
+#define GRAPH_VERSION   1
+
+namespace dsc
+{
+    struct graph_t
+    {
+        std::vector<const char*> names;     // Cache images first, then unresolved dependencies
+        uint32_t ncache;
+        std::vector<uint32_t> off;          // CSR offsets into edges, nnodes + 1
+        std::vector<uint32_t> edges;
+        std::vector<uint32_t> scc;          // Node to SCC id, ids are assigned dependencies first
+        std::vector<uint32_t> order;        // Nodes in topological order, dependencies first
+        std::vector<uint32_t> scc_off;      // SCC id to range in order
+        size_t words;                       // Bitset words per closure
+        std::vector<uint64_t> closure;      // Per SCC, all nodes transitively depended upon
+
+        uint32_t nnodes(void) const
+        {
+            return (uint32_t)this->names.size();
+        }
+
+        uint32_t nscc(void) const
+        {
+            return (uint32_t)this->scc_off.size() - 1;
+        }
+
+        const uint64_t* deps(uint32_t node) const
+        {
+            return &this->closure[this->scc[node] * this->words];
+        }
+    };
+
+    static bool graph_build(const cache_t &cache, graph_t &g)
+    {
+        std::unordered_map<std::string_view, uint32_t> byname;
+        std::unordered_map<uint64_t, uint32_t> byaddr;
+        std::vector<uint32_t> first;   // Image index of each cache node
+        for(uint32_t i = 0; i < cache.images.size(); ++i)
+        {
+            const image_t &img = cache.images[i];
+            // Aliases share the address of the image they point to
+            auto it = byaddr.find(img.addr);
+            uint32_t node;
+            if(it == byaddr.end())
+            {
+                node = (uint32_t)g.names.size();
+                byaddr.emplace(img.addr, node);
+                g.names.push_back(img.path);
+                first.push_back(i);
+            }
+            else
+            {
+                node = it->second;
+            }
+            byname.emplace(img.path, node);
+        }
+        g.ncache = (uint32_t)g.names.size();
+
+        const headers_t &hdrs = cache.headers();
+        g.off.resize(g.ncache + 1);
+        for(uint32_t i = 0; i < g.ncache; ++i)
+        {
+            g.off[i] = (uint32_t)g.edges.size();
+            for(const dep_t &d : hdrs.dependents(first[i]))
+            {
+                uint32_t kind = d.cmd == LC_LOAD_WEAK_DYLIB ? EDGE_WEAK : d.cmd == LC_REEXPORT_DYLIB ? EDGE_REEXPORT : d.cmd == LC_LOAD_UPWARD_DYLIB ? EDGE_UPWARD : EDGE_LOAD;
+                auto it = byname.find(d.path);
+                uint32_t node;
+                if(it == byname.end())
+                {
+                    node = (uint32_t)g.names.size();
+                    byname.emplace(d.path, node);
+                    g.names.push_back(d.path);
+                }
+                else
+                {
+                    node = it->second;
+                }
+                if(node > 0x3fffffff)
+                {
+                    ERR("Too many nodes");
+                    return false;
+                }
+                g.edges.push_back(node | (kind << 30));
+            }
+        }
+        g.off[g.ncache] = (uint32_t)g.edges.size();
+        g.off.resize(g.names.size() + 1, (uint32_t)g.edges.size());
+        return true;
+    }
+
+    // Iterative Tarjan. SCCs come out in reverse topological order of the
+    // "depends on" relation, i.e. dependencies first, which is the order we want.
+    static void graph_scc(graph_t &g)
+    {
+        uint32_t n = g.nnodes();
+        std::vector<uint32_t> index(n, UINT32_MAX), low(n, 0), stack, work;
+        std::vector<bool> onstack(n, false);
+        std::vector<uint32_t> cursor(n, 0);
+        uint32_t next = 0;
+        g.scc.assign(n, UINT32_MAX);
+        g.order.clear();
+        g.scc_off.assign(1, 0);
+        for(uint32_t root = 0; root < n; ++root)
+        {
+            if(index[root] != UINT32_MAX)
+            {
+                continue;
+            }
+            work.push_back(root);
+            while(!work.empty())
+            {
+                uint32_t v = work.back();
+                if(index[v] == UINT32_MAX)
+                {
+                    index[v] = low[v] = next++;
+                    cursor[v] = g.off[v];
+                    stack.push_back(v);
+                    onstack[v] = true;
+                }
+                if(cursor[v] < g.off[v + 1])
+                {
+                    uint32_t w = EDGE_NODE(g.edges[cursor[v]++]);
+                    if(index[w] == UINT32_MAX)
+                    {
+                        work.push_back(w);
+                    }
+                    else if(onstack[w])
+                    {
+                        low[v] = std::min(low[v], index[w]);
+                    }
+                    continue;
+                }
+                work.pop_back();
+                if(!work.empty())
+                {
+                    uint32_t parent = work.back();
+                    low[parent] = std::min(low[parent], low[v]);
+                }
+                if(low[v] == index[v])
+                {
+                    uint32_t id = g.nscc(),
+                             w;
+                    do
+                    {
+                        w = stack.back();
+                        stack.pop_back();
+                        onstack[w] = false;
+                        g.scc[w] = id;
+                        g.order.push_back(w);
+                    } while(w != v);
+                    g.scc_off.push_back((uint32_t)g.order.size());
+                }
+            }
+        }
+    }
+
+    // Transitive closure per SCC. Every SCC only depends on SCCs with lower
+    // ids, so SCCs are grouped by their height above the sinks and each group
+    // is computed in parallel once all lower groups are done.
+    static void graph_closure(graph_t &g)
+    {
+        uint32_t nscc = g.nscc();
+        g.words = (g.nnodes() + 63) / 64;
+        g.closure.assign((size_t)nscc * g.words, 0);
+        std::vector<uint32_t> level(nscc, 0);
+        uint32_t maxlevel = 0;
+        for(uint32_t s = 0; s < nscc; ++s)
+        {
+            for(uint32_t k = g.scc_off[s]; k < g.scc_off[s + 1]; ++k)
+            {
+                uint32_t v = g.order[k];
+                for(uint32_t e = g.off[v]; e < g.off[v + 1]; ++e)
+                {
+                    uint32_t t = g.scc[EDGE_NODE(g.edges[e])];
+                    if(t != s)
+                    {
+                        level[s] = std::max(level[s], level[t] + 1);
+                    }
+                }
+            }
+            maxlevel = std::max(maxlevel, level[s]);
+        }
+        std::vector<std::vector<uint32_t>> bylevel(maxlevel + 1);
+        for(uint32_t s = 0; s < nscc; ++s)
+        {
+            bylevel[level[s]].push_back(s);
+        }
+        for(const std::vector<uint32_t> &group : bylevel)
+        {
+            parallel_for(group.size(), [&](size_t i, size_t)
+            {
+                uint32_t s = group[i];
+                uint64_t *bits = &g.closure[(size_t)s * g.words];
+                bool cyclic = g.scc_off[s + 1] - g.scc_off[s] > 1;
+                for(uint32_t k = g.scc_off[s]; k < g.scc_off[s + 1]; ++k)
+                {
+                    uint32_t v = g.order[k];
+                    for(uint32_t e = g.off[v]; e < g.off[v + 1]; ++e)
+                    {
+                        uint32_t w = EDGE_NODE(g.edges[e]),
+                                 t = g.scc[w];
+                        bits[w / 64] |= 1ULL << (w % 64);
+                        if(t != s)
+                        {
+                            const uint64_t *other = &g.closure[(size_t)t * g.words];
+                            for(size_t j = 0; j < g.words; ++j)
+                            {
+                                bits[j] |= other[j];
+                            }
+                        }
+                        else
+                        {
+                            cyclic = true;
+                        }
+                    }
+                }
+                if(cyclic)
+                {
+                    for(uint32_t k = g.scc_off[s]; k < g.scc_off[s + 1]; ++k)
+                    {
+                        uint32_t v = g.order[k];
+                        bits[v / 64] |= 1ULL << (v % 64);
+                    }
+                }
+            });
+        }
+    }
+
+    static size_t graph_count(const graph_t &g, uint32_t node)
+    {
+        const uint64_t *bits = g.deps(node);
+        size_t n = 0;
+        for(size_t j = 0; j < g.words; ++j)
+        {
+            n += (size_t)__builtin_popcountll(bits[j]);
+        }
+        return n;
+    }
+
+    static void json_str(const char *s)
+    {
+        putchar('"');
+        for(; *s; ++s)
+        {
+            if(*s == '"' || *s == '\\')
+            {
+                putchar('\\');
+                putchar(*s);
+            }
+            else if((unsigned char)*s < 0x20)
+            {
+                printf("\\u%04x", *s);
+            }
+            else
+            {
+                putchar(*s);
+            }
+        }
+        putchar('"');
+    }
+
+    static void graph_dot(const graph_t &g)
+    {
+        static const char *style[] = { "", " [style=dashed]", " [color=blue]", " [style=dotted]" };
+        printf("digraph dyld_shared_cache\n{\n    node [shape=box];\n");
+        for(uint32_t v = 0; v < g.nnodes(); ++v)
+        {
+            printf("    n%u [label=", v);
+            json_str(g.names[v]);
+            printf("%s];\n", v < g.ncache ? "" : ", style=dashed");
+        }
+        for(uint32_t v = 0; v < g.nnodes(); ++v)
+        {
+            for(uint32_t e = g.off[v]; e < g.off[v + 1]; ++e)
+            {
+                printf("    n%u -> n%u%s;\n", v, EDGE_NODE(g.edges[e]), style[EDGE_KIND(g.edges[e])]);
+            }
+        }
+        for(uint32_t s = 0; s < g.nscc(); ++s)
+        {
+            if(g.scc_off[s + 1] - g.scc_off[s] > 1)
+            {
+                printf("    subgraph cluster_scc%u\n    {\n        label=\"scc %u\";\n", s, s);
+                for(uint32_t k = g.scc_off[s]; k < g.scc_off[s + 1]; ++k)
+                {
+                    printf("        n%u;\n", g.order[k]);
+                }
+                printf("    }\n");
+            }
+        }
+        printf("}\n");
+    }
+
+    static void graph_json(const graph_t &g)
+    {
+        static const char *kind[] = { "load", "weak", "reexport", "upward" };
+        printf("{\n    \"nodes\":\n    [\n");
+        for(uint32_t v = 0; v < g.nnodes(); ++v)
+        {
+            printf("        { \"name\": ");
+            json_str(g.names[v]);
+            printf(", \"cached\": %s, \"scc\": %u, \"closure\": %zu, \"deps\": [", v < g.ncache ? "true" : "false", g.scc[v], graph_count(g, v));
+            for(uint32_t e = g.off[v]; e < g.off[v + 1]; ++e)
+            {
+                printf("%s{ \"node\": %u, \"kind\": \"%s\" }", e == g.off[v] ? " " : ", ", EDGE_NODE(g.edges[e]), kind[EDGE_KIND(g.edges[e])]);
+            }
+            printf("%s] }%s\n", g.off[v + 1] > g.off[v] ? " " : "", v + 1 < g.nnodes() ? "," : "");
+        }
+        printf("    ],\n    \"topo\": [");
+        for(size_t k = 0; k < g.order.size(); ++k)
+        {
+            printf("%s%u", k ? ", " : " ", g.order[k]);
+        }
+        printf(" ],\n    \"sccs\":\n    [\n");
+        bool first = true;
+        for(uint32_t s = 0; s < g.nscc(); ++s)
+        {
+            if(g.scc_off[s + 1] - g.scc_off[s] > 1)
+            {
+                printf("%s        [", first ? "" : ",\n");
+                for(uint32_t k = g.scc_off[s]; k < g.scc_off[s + 1]; ++k)
+                {
+                    printf("%s%u", k == g.scc_off[s] ? " " : ", ", g.order[k]);
+                }
+                printf(" ]");
+                first = false;
+            }
+        }
+        printf("%s    ]\n}\n", first ? "" : "\n");
+    }
+
+    static bool graph_bin(const graph_t &g)
+    {
+        std::vector<uint32_t> out;
+        std::string strtab;
+        std::vector<uint32_t> nameoff;
+        for(const char *name : g.names)
+        {
+            nameoff.push_back((uint32_t)strtab.size());
+            strtab.append(name);
+            strtab.push_back('\0');
+        }
+        out.insert(out.end(), { GRAPH_MAGIC, GRAPH_VERSION, g.nnodes(), g.ncache, (uint32_t)g.edges.size(), g.nscc(), (uint32_t)strtab.size() });
+        for(uint32_t v = 0; v < g.nnodes(); ++v)
+        {
+            out.push_back(nameoff[v]);
+            out.push_back(g.scc[v]);
+        }
+        out.insert(out.end(), g.off.begin(), g.off.end());
+        out.insert(out.end(), g.edges.begin(), g.edges.end());
+        out.insert(out.end(), g.order.begin(), g.order.end());
+        return fwrite(out.data(), sizeof(uint32_t), out.size(), stdout) == out.size() &&
+               fwrite(strtab.data(), 1, strtab.size(), stdout) == strtab.size();
+    }
+
+    int mode_graph(int argc, const char **argv)
+    {
+        if(argc < 3 || (strcmp(argv[2], "closure") == 0 ? argc != 4 : argc != 3))
+        {
+            fprintf(stderr, "Usage: dsc_util graph <path-to-cache> dot|json|bin|topo|scc\n"
+                            "       dsc_util graph <path-to-cache> closure <library-name>\n");
+            return 1;
+        }
+        const char *what = argv[2];
+        cache_t cache;
+        if(!cache.open(argv[1]))
+        {
+            return 1;
+        }
+        graph_t g;
+        if(!graph_build(cache, g))
+        {
+            return 1;
+        }
+        graph_scc(g);
+        graph_closure(g);
+
+        size_t cyclic = 0;
+        for(uint32_t s = 0; s < g.nscc(); ++s)
+        {
+            if(g.scc_off[s + 1] - g.scc_off[s] > 1)
+            {
+                ++cyclic;
+            }
+        }
+        LOG("%u images, %u external, %zu edges, %zu cycles", g.ncache, g.nnodes() - g.ncache, g.edges.size(), cyclic);
+
+        if(strcmp(what, "dot") == 0)
+        {
+            graph_dot(g);
+        }
+        else if(strcmp(what, "json") == 0)
+        {
+            graph_json(g);
+        }
+        else if(strcmp(what, "bin") == 0)
+        {
+            if(!graph_bin(g))
+            {
+                ERR("Failed to write graph");
+                return 1;
+            }
+        }
+        else if(strcmp(what, "topo") == 0)
+        {
+            for(uint32_t v : g.order)
+            {
+                printf("%u\t%s\n", g.scc[v], g.names[v]);
+            }
+        }
+        else if(strcmp(what, "scc") == 0)
+        {
+            for(uint32_t s = 0; s < g.nscc(); ++s)
+            {
+                if(g.scc_off[s + 1] - g.scc_off[s] > 1)
+                {
+                    printf("scc %u (%u images)\n", s, g.scc_off[s + 1] - g.scc_off[s]);
+                    for(uint32_t k = g.scc_off[s]; k < g.scc_off[s + 1]; ++k)
+                    {
+                        printf("    %s\n", g.names[g.order[k]]);
+                    }
+                }
+            }
+        }
+        else if(strcmp(what, "closure") == 0)
+        {
+            for(uint32_t v = 0; v < g.ncache; ++v)
+            {
+                if(!strstr(g.names[v], argv[3]))
+                {
+                    continue;
+                }
+                const uint64_t *bits = g.deps(v);
+                printf("%s (%zu)\n", g.names[v], graph_count(g, v));
+                for(uint32_t w : g.order)
+                {
+                    if(bits[w / 64] & (1ULL << (w % 64)))
+                    {
+                        printf("    %s\n", g.names[w]);
+                    }
+                }
+            }
+        }
+        else
+        {
+            ERR("Unknown graph output: %s", what);
+            return 1;
+        }
+        return 0;
+    }
+}
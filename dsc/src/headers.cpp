@@ -0,0 +1,124 @@
+#include <string.h>
+
+#include "common.h"
+#include "headers.h"
+
+namespace dsc
+{
+    struct headers_tmp_t
+    {
+        std::vector<segment_t> segs;
+        std::vector<section_t> sects;
+        std::vector<dep_t> deps;
+    };
+
+    static void headers_parse(const cache_t &cache, const image_t &img, image_hdr_t &out, headers_tmp_t &tmp)
+    {
+        memset(&out, 0, sizeof(out));
+        macho_t mo;
+        if(!mo.init(cache, img.addr))
+        {
+            WRN("%s: bad Mach-O header", img.path);
+            return;
+        }
+        out.hdr = mo.hdr;
+        out.is64 = mo.is64;
+        out.filetype = mo.filetype;
+        mo.each_segment([&](const segment_t &seg) -> bool
+        {
+            tmp.segs.push_back(seg);
+            return true;
+        });
+        mo.each_section([&](const section_t &sec) -> bool
+        {
+            tmp.sects.push_back(sec);
+            return true;
+        });
+        mo.each_dependent([&](const char *path, uint32_t cmd)
+        {
+            tmp.deps.push_back({ path, cmd });
+        });
+        mo.each_cmd([&](const load_command *lc) -> bool
+        {
+            switch(lc->cmd)
+            {
+                case LC_UUID:
+                    if(lc->cmdsize >= sizeof(uuid_command))
+                    {
+                        memcpy(out.uuid, ((const uuid_command*)lc)->uuid, sizeof(out.uuid));
+                        out.has_uuid = true;
+                    }
+                    break;
+                case LC_MAIN:
+                    if(lc->cmdsize >= sizeof(entry_point_command))
+                    {
+                        out.entry = ((const entry_point_command*)lc)->entryoff;
+                    }
+                    break;
+                case LC_BUILD_VERSION:
+                    if(lc->cmdsize >= sizeof(build_version_command))
+                    {
+                        out.platform = ((const build_version_command*)lc)->platform;
+                    }
+                    break;
+                case LC_VERSION_MIN_MACOSX:     out.platform = PLATFORM_MACOS;     break;
+                case LC_VERSION_MIN_IPHONEOS:   out.platform = PLATFORM_IOS;       break;
+                case LC_VERSION_MIN_TVOS:       out.platform = PLATFORM_TVOS;      break;
+                case LC_VERSION_MIN_WATCHOS:    out.platform = PLATFORM_WATCHOS;   break;
+            }
+            return true;
+        });
+        if(tmp.segs.size() > UINT16_MAX || tmp.sects.size() > UINT16_MAX || tmp.deps.size() > UINT16_MAX)
+        {
+            WRN("%s: too many load commands", img.path);
+            out.hdr = nullptr;
+            tmp = headers_tmp_t();
+        }
+    }
+
+    void headers_t::build(const cache_t &cache)
+    {
+        size_t n = cache.images.size();
+        this->images.resize(n);
+        std::vector<headers_tmp_t> tmp(n);
+        parallel_for(n, [&](size_t i, size_t)
+        {
+            headers_parse(cache, cache.images[i], this->images[i], tmp[i]);
+        });
+        size_t nsegs = 0,
+               nsects = 0,
+               ndeps = 0;
+        for(const headers_tmp_t &t : tmp)
+        {
+            nsegs += t.segs.size();
+            nsects += t.sects.size();
+            ndeps += t.deps.size();
+        }
+        this->segs.reserve(nsegs);
+        this->sects.reserve(nsects);
+        this->deps.reserve(ndeps);
+        for(size_t i = 0; i < n; ++i)
+        {
+            image_hdr_t &h = this->images[i];
+            h.segs = (uint32_t)this->segs.size();
+            h.sects = (uint32_t)this->sects.size();
+            h.deps = (uint32_t)this->deps.size();
+            h.nsegs = (uint16_t)tmp[i].segs.size();
+            h.nsects = (uint16_t)tmp[i].sects.size();
+            h.ndeps = (uint16_t)tmp[i].deps.size();
+            this->segs.insert(this->segs.end(), tmp[i].segs.begin(), tmp[i].segs.end());
+            this->sects.insert(this->sects.end(), tmp[i].sects.begin(), tmp[i].sects.end());
+            this->deps.insert(this->deps.end(), tmp[i].deps.begin(), tmp[i].deps.end());
+        }
+    }
+
+    const headers_t& cache_t::headers(void) const
+    {
+        std::call_once(this->headers_once, [this]
+        {
+            this->headers_data.reset(new headers_t());
+            this->headers_data->build(*this);
+        });
+        return *this->headers_data;
+    }
+}
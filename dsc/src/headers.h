@@ -0,0 +1,106 @@
+#ifndef DSC_HEADERS_H
+#define DSC_HEADERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "cache.h"
+#include "macho.h"
+
+namespace dsc
+{
+    // What the modes keep asking about an image, pulled out of its load
+    // commands once. Exactly one cache line per image; segments, sections and
+    // dependents live in flat arrays shared by all images, indexed from here.
+    struct alignas(64) image_hdr_t
+    {
+        const uint8_t *hdr;     // Mach header in the cache, NULL if it didn't parse
+        uint64_t entry;         // LC_MAIN entryoff, 0 if none
+        uint8_t uuid[16];
+        uint32_t segs;          // First index into headers_t::segs, sects and deps
+        uint32_t sects;
+        uint32_t deps;
+        uint16_t nsegs;
+        uint16_t nsects;
+        uint16_t ndeps;
+        bool has_uuid;
+        bool is64;
+        uint32_t filetype;
+        uint32_t platform;      // PLATFORM_*, from LC_BUILD_VERSION or LC_VERSION_MIN_*, 0 if neither
+    };
+    static_assert(sizeof(image_hdr_t) == 64, "image_hdr_t should fill one cache line");
+
+    struct dep_t
+    {
+        const char *path;       // Points into the cache
+        uint32_t cmd;           // LC_LOAD_DYLIB, LC_LOAD_WEAK_DYLIB, LC_REEXPORT_DYLIB or LC_LOAD_UPWARD_DYLIB
+    };
+
+    template<typename T>
+    struct range_t
+    {
+        const T *first;
+        const T *last;
+
+        const T* begin(void) const { return this->first; }
+        const T* end(void) const { return this->last; }
+        size_t size(void) const { return (size_t)(this->last - this->first); }
+    };
+
+    // Parsed headers of every image in a cache, indexed like cache_t::images.
+    // Built once (see cache_t::headers) and only read afterwards, so it can be
+    // shared by any number of threads.
+    struct headers_t
+    {
+        std::vector<image_hdr_t> images;
+        std::vector<segment_t> segs;
+        std::vector<section_t> sects;
+        std::vector<dep_t> deps;
+
+        void build(const cache_t &cache);
+
+        range_t<segment_t> segments(uint32_t img) const
+        {
+            const image_hdr_t &h = this->images[img];
+            return { this->segs.data() + h.segs, this->segs.data() + h.segs + h.nsegs };
+        }
+        range_t<section_t> sections(uint32_t img) const
+        {
+            const image_hdr_t &h = this->images[img];
+            return { this->sects.data() + h.sects, this->sects.data() + h.sects + h.nsects };
+        }
+        range_t<dep_t> dependents(uint32_t img) const
+        {
+            const image_hdr_t &h = this->images[img];
+            return { this->deps.data() + h.deps, this->deps.data() + h.deps + h.ndeps };
+        }
+
+        const segment_t* segment(uint32_t img, const char *name) const
+        {
+            for(const segment_t &seg : this->segments(img))
+            {
+                if(strcmp(seg.name, name) == 0)
+                {
+                    return &seg;
+                }
+            }
+            return nullptr;
+        }
+        // Finds a section by name in any segment if seg is NULL.
+        const section_t* section(uint32_t img, const char *seg, const char *name) const
+        {
+            for(const section_t &sec : this->sections(img))
+            {
+                if(strcmp(sec.name, name) == 0 && (!seg || strcmp(sec.seg, seg) == 0))
+                {
+                    return &sec;
+                }
+            }
+            return nullptr;
+        }
+    };
+}
+
+#endif
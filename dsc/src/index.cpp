@@ -0,0 +1,53 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "index.h"
+
+namespace dsc
+{
+    mapped_file_t::~mapped_file_t()
+    {
+        if(this->base)
+        {
+            munmap((void*)this->base, this->size);
+        }
+    }
+
+    bool mapped_file_t::open(const char *path, size_t minsize)
+    {
+        int fd = ::open(path, O_RDONLY);
+        if(fd == -1)
+        {
+            ERR("open(%s): %s", path, strerror(errno));
+            return false;
+        }
+        struct stat s;
+        if(fstat(fd, &s) != 0)
+        {
+            ERR("fstat(%s): %s", path, strerror(errno));
+            close(fd);
+            return false;
+        }
+        if((size_t)s.st_size < minsize)
+        {
+            ERR("%s: file too short", path);
+            close(fd);
+            return false;
+        }
+        void *mem = mmap(NULL, (size_t)s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(mem == MAP_FAILED)
+        {
+            ERR("mmap(%s): %s", path, strerror(errno));
+            return false;
+        }
+        this->base = (const uint8_t*)mem;
+        this->size = (size_t)s.st_size;
+        return true;
+    }
+}
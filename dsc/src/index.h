@@ -0,0 +1,76 @@
+#ifndef DSC_INDEX_H
+#define DSC_INDEX_H
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// Helpers shared by the on-disk indexes (objc-index, swift-index).
+// Those are flat files of 4-byte aligned arrays plus a string table, used straight from mmap.
+
+namespace dsc
+{
+    // Interning string table, names in the arrays are offsets into data.
+    struct strtab_t
+    {
+        std::string data;
+        std::unordered_map<std::string, uint32_t> map;
+
+        uint32_t add(const char *s)
+        {
+            auto it = this->map.find(s);
+            if(it != this->map.end())
+            {
+                return it->second;
+            }
+            uint32_t off = (uint32_t)this->data.size();
+            this->data.append(s);
+            this->data.push_back('\0');
+            this->map.emplace(s, off);
+            return off;
+        }
+    };
+
+    struct mapped_file_t
+    {
+        const uint8_t *base = nullptr;
+        size_t size = 0;
+
+        mapped_file_t() = default;
+        mapped_file_t(const mapped_file_t&) = delete;
+        mapped_file_t& operator=(const mapped_file_t&) = delete;
+        ~mapped_file_t();
+
+        // Maps path read-only, failing if it's shorter than minsize.
+        bool open(const char *path, size_t minsize);
+
+        // Array of count T at off, or NULL if it doesn't fit.
+        template<typename T>
+        const T* arr(uint32_t off, uint32_t count) const
+        {
+            return off <= this->size && (this->size - off) / sizeof(T) >= count ? (const T*)(this->base + off) : nullptr;
+        }
+
+        // Whether a string table of size bytes at off is in bounds and terminated.
+        bool strtab(uint32_t off, uint32_t size) const
+        {
+            return size != 0 && this->arr<char>(off, size) && this->base[off + size - 1] == '\0';
+        }
+    };
+
+    // [first, last) range of entries called name in an array sorted by the name member.
+    template<typename T>
+    std::pair<const T*, const T*> sorted_range(const T *begin, uint32_t count, const char *strs, const char *name)
+    {
+        const T *end = begin + count;
+        auto lo = [&](const T &e, const char *s) { return strcmp(strs + e.name, s) < 0; };
+        auto hi = [&](const char *s, const T &e) { return strcmp(s, strs + e.name) < 0; };
+        return { std::lower_bound(begin, end, name, lo), std::upper_bound(begin, end, name, hi) };
+    }
+}
+
+#endif
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <atomic>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+
+#include "common.h"
+#include "locals.h"
+
+// Caches whose header has symbolFileUUID keep their local symbols in
+// <cache>.symbols when it's set, and in the main file otherwise. Either way the
+// region is a dyld_cache_local_symbols_info followed by one entry per image,
+// pointing at a run of nlists that all share one string pool. Nothing in the
+// region is mapped at runtime, so it's only read from the files here.
+
+namespace dsc
+{
+    void locals_t::build(const cache_t &cache)
+    {
+        // Adopted caches only have their tables populated
+        if(cache.fd == -1)
+        {
+            return;
+        }
+        const dyld_cache_header *hdr = cache.header();
+        const uint8_t *base = cache.base;
+        size_t size = cache.size;
+        std::string source = cache.path;
+        static const uint8_t nouuid[16] = {};
+        if(DSC_HAS_FIELD(hdr, symbolFileUUID) && memcmp(hdr->symbolFileUUID, nouuid, sizeof(nouuid)) != 0)
+        {
+            source += ".symbols";
+            if(!this->file.open(source.c_str(), offsetof(dyld_cache_header, localSymbolsSize) + sizeof(uint64_t)))
+            {
+                return;
+            }
+            const dyld_cache_header *sym = (const dyld_cache_header*)this->file.base;
+            if(!DSC_HAS_FIELD(sym, uuid) || memcmp(sym->uuid, hdr->symbolFileUUID, sizeof(sym->uuid)) != 0)
+            {
+                WRN("%s: UUID doesn't match the main cache's symbolFileUUID, ignoring it", source.c_str());
+                return;
+            }
+            hdr = sym;
+            base = this->file.base;
+            size = this->file.size;
+        }
+        if(hdr->localSymbolsSize < sizeof(dyld_cache_local_symbols_info) || hdr->localSymbolsOffset > size || size - hdr->localSymbolsOffset < hdr->localSymbolsSize)
+        {
+            return;
+        }
+        const uint8_t *region = base + hdr->localSymbolsOffset;
+        uint64_t rsize = hdr->localSymbolsSize;
+        const dyld_cache_local_symbols_info *info = (const dyld_cache_local_symbols_info*)region;
+        uint64_t nlsize = cache.ptrsize == 8 ? sizeof(nlist_64) : sizeof(nlist);
+        // Whether entries are 64-bit goes by the main cache's header, even when they come from .symbols
+        bool wide = cache.header()->mappingOffset >= offsetof(dyld_cache_header, symbolFileUUID);
+        uint64_t entsize = wide ? sizeof(dyld_cache_local_symbols_entry_64) : sizeof(dyld_cache_local_symbols_entry);
+        if(info->nlistOffset > rsize || (rsize - info->nlistOffset) / nlsize < info->nlistCount ||
+           info->stringsOffset > rsize || rsize - info->stringsOffset < info->stringsSize ||
+           info->entriesOffset > rsize || (rsize - info->entriesOffset) / entsize < info->entriesCount)
+        {
+            WRN("%s: local symbols out of bounds, ignoring them", source.c_str());
+            return;
+        }
+
+        // New entries are VM offsets from the cache's base address, old ones offsets into the main file
+        const dyld_cache_header *main = cache.header();
+        const dyld_cache_mapping_info *maps = (const dyld_cache_mapping_info*)(cache.base + main->mappingOffset);
+        uint64_t vmbase = maps[0].address;
+        const uint8_t *entries = region + info->entriesOffset,
+                      *nlists = region + info->nlistOffset;
+        size_t n = info->entriesCount;
+        this->entries.resize(n);
+        std::atomic<size_t> bad(0);
+        parallel_for(n, [&](size_t i, size_t)
+        {
+            entry_t &e = this->entries[i];
+            uint64_t off;
+            uint32_t start,
+                     count;
+            if(wide)
+            {
+                const dyld_cache_local_symbols_entry_64 *ent = (const dyld_cache_local_symbols_entry_64*)(entries + i * entsize);
+                off = ent->dylibOffset;
+                start = ent->nlistStartIndex;
+                count = ent->nlistCount;
+                e.addr = vmbase + off;
+            }
+            else
+            {
+                const dyld_cache_local_symbols_entry *ent = (const dyld_cache_local_symbols_entry*)(entries + i * entsize);
+                off = ent->dylibOffset;
+                start = ent->nlistStartIndex;
+                count = ent->nlistCount;
+                e.addr = 0;
+                for(uint32_t m = 0; m < main->mappingCount; ++m)
+                {
+                    if(off >= maps[m].fileOffset && off - maps[m].fileOffset < maps[m].size)
+                    {
+                        e.addr = maps[m].address + (off - maps[m].fileOffset);
+                        break;
+                    }
+                }
+            }
+            if(e.addr == 0 || start > info->nlistCount || info->nlistCount - start < count)
+            {
+                e.addr = 0;
+                e.nlists = nullptr;
+                e.count = 0;
+                ++bad;
+                return;
+            }
+            e.nlists = nlists + start * nlsize;
+            e.count = count;
+        });
+        if(bad)
+        {
+            WRN("%s: %zu local symbols entries out of bounds, skipping them", source.c_str(), bad.load());
+            this->entries.erase(std::remove_if(this->entries.begin(), this->entries.end(), [](const entry_t &e) { return e.addr == 0; }), this->entries.end());
+        }
+        std::sort(this->entries.begin(), this->entries.end(), [](const entry_t &a, const entry_t &b)
+        {
+            return a.addr < b.addr;
+        });
+        this->strs = (const char*)region + info->stringsOffset;
+        this->strs_size = info->stringsSize;
+        this->source = source;
+    }
+
+    const locals_t::entry_t* locals_t::find(uint64_t addr) const
+    {
+        auto it = std::lower_bound(this->entries.begin(), this->entries.end(), addr, [](const entry_t &e, uint64_t a)
+        {
+            return e.addr < a;
+        });
+        return it != this->entries.end() && it->addr == addr ? &*it : nullptr;
+    }
+
+    const locals_t& cache_t::locals(void) const
+    {
+        std::call_once(this->locals_once, [this]
+        {
+            this->locals_data.reset(new locals_t());
+            this->locals_data->build(*this);
+        });
+        return *this->locals_data;
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef DSC_LOCALS_H
+#define DSC_LOCALS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "cache.h"
+#include "index.h"
+
+namespace dsc
+{
+    // Local (non-exported) symbols the cache builder took out of the images,
+    // from the cache's local symbols region, which newer caches keep in a
+    // separate .symbols file next to the main one. Built once (see
+    // cache_t::locals) and only read afterwards, so it can be shared by any
+    // number of threads.
+    struct locals_t
+    {
+        struct entry_t
+        {
+            uint64_t addr;          // Of the image's header
+            const uint8_t *nlists;  // nlist or nlist_64, by the cache's pointer size
+            uint32_t count;
+        };
+
+        std::vector<entry_t> entries;   // Sorted by addr
+        const char *strs = nullptr;     // The nlists' string pool
+        uint64_t strs_size = 0;
+        std::string source;             // File they came from, empty if the cache has none
+
+        void build(const cache_t &cache);
+
+        // Local symbols of the image whose header is at addr, or NULL.
+        const entry_t* find(uint64_t addr) const;
+
+    private:
+        mapped_file_t file;
+    };
+}
+
+#endif
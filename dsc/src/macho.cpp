@@ -0,0 +1,131 @@
+#include <string.h>
+
+#include "macho.h"
+
+namespace dsc
+{
+    bool macho_t::init(const cache_t &cache, uint64_t addr)
+    {
+        uint64_t avail;
+        const uint8_t *p = cache.span(addr, &avail);
+        if(!p || avail < sizeof(mach_header))
+        {
+            return false;
+        }
+        const mach_header *mh = (const mach_header*)p;
+        size_t hdrsize;
+        if(mh->magic == MH_MAGIC_64)
+        {
+            hdrsize = sizeof(mach_header_64);
+            this->is64 = true;
+        }
+        else if(mh->magic == MH_MAGIC)
+        {
+            hdrsize = sizeof(mach_header);
+            this->is64 = false;
+        }
+        else
+        {
+            return false;
+        }
+        if(avail < hdrsize || avail - hdrsize < mh->sizeofcmds)
+        {
+            return false;
+        }
+        this->hdr = p;
+        this->cmds = p + hdrsize;
+        this->cmds_end = this->cmds + mh->sizeofcmds;
+        this->ncmds = mh->ncmds;
+        this->filetype = mh->filetype;
+        return true;
+    }
+
+    bool macho_t::segment(const char *name, segment_t &out) const
+    {
+        bool found = false;
+        this->each_segment([&](const segment_t &seg) -> bool
+        {
+            if(strcmp(seg.name, name) == 0)
+            {
+                out = seg;
+                found = true;
+                return false;
+            }
+            return true;
+        });
+        return found;
+    }
+
+    bool macho_t::section(const char *seg, const char *name, section_t &out) const
+    {
+        bool found = false;
+        this->each_section([&](const section_t &sec) -> bool
+        {
+            if(strcmp(sec.name, name) == 0 && (!seg || strcmp(sec.seg, seg) == 0))
+            {
+                out = sec;
+                found = true;
+                return false;
+            }
+            return true;
+        });
+        return found;
+    }
+
+    bool macho_t::uuid(uint8_t out[16]) const
+    {
+        bool found = false;
+        this->each_cmd([&](const load_command *lc) -> bool
+        {
+            if(lc->cmd == LC_UUID && lc->cmdsize >= sizeof(uuid_command))
+            {
+                memcpy(out, ((const uuid_command*)lc)->uuid, 16);
+                found = true;
+                return false;
+            }
+            return true;
+        });
+        return found;
+    }
+
+    const uint8_t* macho_t::linkedit(const cache_t &cache, uint64_t fileoff, uint64_t size) const
+    {
+        segment_t le;
+        if(!this->segment("__LINKEDIT", le) || fileoff < le.fileoff || fileoff - le.fileoff > le.filesize || le.filesize - (fileoff - le.fileoff) < size)
+        {
+            return nullptr;
+        }
+        return cache.ptr(le.vmaddr + (fileoff - le.fileoff), size);
+    }
+
+    bool macho_t::export_trie(const cache_t &cache, const uint8_t *&start, size_t &size) const
+    {
+        uint64_t off = 0,
+                 len = 0;
+        this->each_cmd([&](const load_command *lc) -> bool
+        {
+            if(lc->cmd == LC_DYLD_EXPORTS_TRIE && lc->cmdsize >= sizeof(linkedit_data_command))
+            {
+                off = ((const linkedit_data_command*)lc)->dataoff;
+                len = ((const linkedit_data_command*)lc)->datasize;
+                return false;
+            }
+            if((lc->cmd == LC_DYLD_INFO || lc->cmd == LC_DYLD_INFO_ONLY) && lc->cmdsize >= sizeof(dyld_info_command))
+            {
+                off = ((const dyld_info_command*)lc)->export_off;
+                len = ((const dyld_info_command*)lc)->export_size;
+                return false;
+            }
+            return true;
+        });
+        if(len == 0)
+        {
+            start = nullptr;
+            size = 0;
+            return true;
+        }
+        start = this->linkedit(cache, off, len);
+        size = (size_t)len;
+        return start != nullptr;
+    }
+}
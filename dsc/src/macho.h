@@ -0,0 +1,188 @@
+#ifndef DSC_MACHO_H
+#define DSC_MACHO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cache.h"
+#include "format.h"
+
+namespace dsc
+{
+    struct segment_t
+    {
+        char name[17];
+        uint64_t vmaddr;
+        uint64_t vmsize;
+        uint64_t fileoff;
+        uint64_t filesize;
+    };
+
+    struct section_t
+    {
+        char seg[17];
+        char name[17];
+        uint64_t addr;
+        uint64_t size;
+        uint32_t flags;
+        uint32_t reserved1;     // S_SYMBOL_STUBS: first index into the indirect symbol table
+        uint32_t reserved2;     // S_SYMBOL_STUBS: size of one stub
+    };
+
+    // Structures that differ between 32- and 64-bit images. Code walking them is
+    // written once against these and instantiated for both widths.
+    template<bool W64>
+    struct macho_fmt_t;
+
+    template<>
+    struct macho_fmt_t<true>
+    {
+        typedef mach_header_64      header;
+        typedef segment_command_64  segment;
+        typedef section_64          section;
+        typedef nlist_64            nlist;
+        typedef uint64_t            uptr;
+        static const uint32_t segment_cmd = LC_SEGMENT_64;
+    };
+
+    template<>
+    struct macho_fmt_t<false>
+    {
+        typedef dsc::mach_header        header;
+        typedef dsc::segment_command    segment;
+        typedef dsc::section            section;
+        typedef dsc::nlist              nlist;
+        typedef uint32_t                uptr;
+        static const uint32_t segment_cmd = LC_SEGMENT;
+    };
+
+    // View onto the load commands of an image mapped in a cache.
+    struct macho_t
+    {
+        const uint8_t *hdr = nullptr;
+        const uint8_t *cmds = nullptr;
+        const uint8_t *cmds_end = nullptr;
+        uint32_t ncmds = 0;
+        uint32_t filetype = 0;
+        bool is64 = false;
+
+        bool init(const cache_t &cache, uint64_t addr);
+
+        // Calls fn(const load_command*) until it returns false. Commands are size-checked against sizeofcmds.
+        template<typename F>
+        void each_cmd(F &&fn) const
+        {
+            const uint8_t *p = this->cmds;
+            for(uint32_t i = 0; i < this->ncmds; ++i)
+            {
+                if((size_t)(this->cmds_end - p) < sizeof(load_command))
+                {
+                    return;
+                }
+                const load_command *lc = (const load_command*)p;
+                if(lc->cmdsize < sizeof(load_command) || lc->cmdsize > (size_t)(this->cmds_end - p))
+                {
+                    return;
+                }
+                if(!fn(lc))
+                {
+                    return;
+                }
+                p += lc->cmdsize;
+            }
+        }
+
+        // Calls fn(macho_fmt_t<W64>()) with the structures matching the image's width.
+        template<typename F>
+        auto dispatch(F &&fn) const -> decltype(fn(macho_fmt_t<true>()))
+        {
+            return this->is64 ? fn(macho_fmt_t<true>()) : fn(macho_fmt_t<false>());
+        }
+
+        // Calls fn(const segment_t&) for every LC_SEGMENT(_64) until it returns false.
+        template<typename F>
+        void each_segment(F &&fn) const
+        {
+            this->dispatch([&](auto fmt)
+            {
+                typedef typename decltype(fmt)::segment segment_cmd_t;
+                this->each_cmd([&](const load_command *lc) -> bool
+                {
+                    if(lc->cmd != decltype(fmt)::segment_cmd || lc->cmdsize < sizeof(segment_cmd_t))
+                    {
+                        return true;
+                    }
+                    const segment_cmd_t *sc = (const segment_cmd_t*)lc;
+                    segment_t seg = { {}, sc->vmaddr, sc->vmsize, sc->fileoff, sc->filesize };
+                    memcpy(seg.name, sc->segname, 16);
+                    seg.name[16] = '\0';
+                    return fn(seg);
+                });
+            });
+        }
+
+        // Calls fn(const char *path, uint32_t cmd) for every LC_LOAD_*DYLIB and LC_REEXPORT_DYLIB.
+        template<typename F>
+        void each_dependent(F &&fn) const
+        {
+            this->each_cmd([&](const load_command *lc) -> bool
+            {
+                if((lc->cmd == LC_LOAD_DYLIB || lc->cmd == LC_LOAD_WEAK_DYLIB || lc->cmd == LC_REEXPORT_DYLIB || lc->cmd == LC_LOAD_UPWARD_DYLIB) && lc->cmdsize >= sizeof(dylib_command))
+                {
+                    uint32_t off = ((const dylib_command*)lc)->name;
+                    if(off < lc->cmdsize && memchr((const char*)lc + off, '\0', lc->cmdsize - off))
+                    {
+                        fn((const char*)lc + off, lc->cmd);
+                    }
+                }
+                return true;
+            });
+        }
+
+        // Calls fn(const section_t&) for every section until it returns false.
+        template<typename F>
+        void each_section(F &&fn) const
+        {
+            this->dispatch([&](auto fmt)
+            {
+                typedef typename decltype(fmt)::segment segment_cmd_t;
+                typedef typename decltype(fmt)::section section_cmd_t;
+                this->each_cmd([&](const load_command *lc) -> bool
+                {
+                    if(lc->cmd != decltype(fmt)::segment_cmd || lc->cmdsize < sizeof(segment_cmd_t))
+                    {
+                        return true;
+                    }
+                    const segment_cmd_t *sc = (const segment_cmd_t*)lc;
+                    const section_cmd_t *sec = (const section_cmd_t*)(sc + 1);
+                    for(uint32_t i = 0; i < sc->nsects && (i + 1) * sizeof(*sec) <= lc->cmdsize - sizeof(*sc); ++i)
+                    {
+                        section_t s = { {}, {}, sec[i].addr, sec[i].size, sec[i].flags, sec[i].reserved1, sec[i].reserved2 };
+                        memcpy(s.seg, sec[i].segname, 16);
+                        memcpy(s.name, sec[i].sectname, 16);
+                        s.seg[16] = s.name[16] = '\0';
+                        if(!fn(s))
+                        {
+                            return false;
+                        }
+                    }
+                    return true;
+                });
+            });
+        }
+
+        bool segment(const char *name, segment_t &out) const;
+        // Finds a section by name in any segment if seg is NULL.
+        bool section(const char *seg, const char *name, section_t &out) const;
+        bool uuid(uint8_t out[16]) const;
+
+        // Resolves a LINKEDIT file offset (as stored in load commands) to a host pointer.
+        const uint8_t* linkedit(const cache_t &cache, uint64_t fileoff, uint64_t size) const;
+
+        // Locates the export trie via LC_DYLD_EXPORTS_TRIE or LC_DYLD_INFO(_ONLY).
+        bool export_trie(const cache_t &cache, const uint8_t *&start, size_t &size) const;
+    };
+}
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef DSC_MODES_H
+#define DSC_MODES_H
+
+// Entry points of the dsc_util modes implemented here rather than in dyld.
+// Each gets argv starting at the mode name.
+
+namespace dsc
+{
+    int mode_exports(int argc, const char **argv);
+    int mode_diff(int argc, const char **argv);
+    int mode_graph(int argc, const char **argv);
+    int mode_objc_index(int argc, const char **argv);
+    int mode_objc_query(int argc, const char **argv);
+    int mode_swift_index(int argc, const char **argv);
+    int mode_swift_query(int argc, const char **argv);
+    int mode_stubs_index(int argc, const char **argv);
+    int mode_stubs_query(int argc, const char **argv);
+    int mode_patches_index(int argc, const char **argv);
+    int mode_patches_query(int argc, const char **argv);
+    int mode_remote(int argc, const char **argv);
+
+    // dsc_closure, which also needs the path it was invoked as to run itself
+    int mode_rootfs(const char *self, int argc, const char **argv);
+    // The long-lived process mode_rootfs keeps per worker slot, forking a child per request that runs dyld's main() once
+    int mode_rootfs_worker(int (*closure_main)(int, const char**), const char *self, int argc, const char **argv);
+}
+
+#endif
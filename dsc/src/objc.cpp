@@ -0,0 +1,727 @@
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cache.h"
+#include "common.h"
+#include "headers.h"
+#include "index.h"
+#include "modes.h"
+#include "objc.h"
+
+// Index file, everything little endian and 4-byte aligned so it can be used straight from mmap:
+//
+//   objc_index_header_t
+//   uint32_t            images[nimages]     install names
+//   objc_index_class_t  classes[nclasses]
+//   objc_index_list_t   sels[nsels]         each a range in impls
+//   objc_index_list_t   protos[nprotos]     each a range in confs
+//   objc_index_ref_t    impls[nimpls]
+//   objc_index_ref_t    confs[nconfs]
+//   char                strings[strsize]
+//
+// All names are offsets into the string table, classes, sels and protos are
+// sorted by name so lookups are a binary search.
+#define OBJC_INDEX_MAGIC    0x4f435344 // "DSCO"
+#define OBJC_INDEX_VERSION  1
+#define OBJC_NONE           0xffffffff
+#define OBJC_META           0x80000000
+
+// method_list_t flags
+#define METHOD_LIST_SMALL           0x80000000
+#define METHOD_LIST_DIRECT_SELS     0x40000000
+#define METHOD_LIST_FLAGS_MASK      0xffff0003
+
+namespace dsc
+{
+    struct objc_index_header_t
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t nimages;
+        uint32_t nclasses;
+        uint32_t nsels;
+        uint32_t nprotos;
+        uint32_t nimpls;
+        uint32_t nconfs;
+        uint32_t strsize;
+        uint32_t off_images;    // uint32_t name[nimages]
+        uint32_t off_classes;   // objc_index_class_t[nclasses]
+        uint32_t off_sels;      // objc_index_list_t[nsels], into impls
+        uint32_t off_protos;    // objc_index_list_t[nprotos], into confs
+        uint32_t off_impls;     // objc_index_ref_t[nimpls], image has OBJC_META for class methods
+        uint32_t off_confs;     // objc_index_ref_t[nconfs]
+        uint32_t off_str;
+    };
+
+    struct objc_index_class_t
+    {
+        uint32_t name;
+        uint32_t image;         // OBJC_NONE if only known from the shared class table
+        uint32_t super;         // OBJC_NONE for root classes
+    };
+
+    struct objc_index_list_t
+    {
+        uint32_t name;
+        uint32_t image;         // Defining image for protocols, OBJC_NONE otherwise
+        uint32_t start;
+        uint32_t count;
+    };
+
+    struct objc_index_ref_t
+    {
+        uint32_t cls;
+        uint32_t image;
+    };
+
+    struct objc_cls_t
+    {
+        const char *name;
+        const char *super;
+        const char *category;   // NULL for classes
+        std::vector<std::pair<const char*, bool>> methods; // (selector, is class method)
+        std::vector<const char*> protocols;
+    };
+
+    struct objc_img_t
+    {
+        std::vector<objc_cls_t> classes;    // Classes and categories
+        std::vector<const char*> protocols; // Protocols defined here
+    };
+
+    struct objc_ctx_t
+    {
+        const cache_t &cache;
+        uint64_t relbase;       // Base for direct relative method selectors, 0 if none
+        std::vector<const char*> sels;
+        std::vector<const char*> clsnames;
+        std::vector<const char*> protonames;
+    };
+
+    // Shared cache string hash tables (selectors, and the keys of the class and
+    // protocol tables) share one header. Rather than reimplementing the perfect
+    // hash, every occupied slot is enumerated through the offsets array.
+    static void objc_strtab(const cache_t &cache, uint64_t addr, std::vector<const char*> &out)
+    {
+        struct
+        {
+            uint32_t capacity;
+            uint32_t occupied;
+            uint32_t shift;
+            uint32_t mask;
+            uint32_t roundedTabSize;        // zero before dyld-940
+            uint32_t roundedCheckBytesSize; // zero before dyld-940
+            uint64_t salt;
+            uint32_t scramble[256];
+        } hdr;
+        const uint8_t *p = cache.ptr(addr, sizeof(hdr));
+        if(!p)
+        {
+            return;
+        }
+        memcpy(&hdr, p, sizeof(hdr));
+        uint64_t tab = hdr.roundedTabSize ? hdr.roundedTabSize : (uint64_t)hdr.mask + 1,
+                 chk = hdr.roundedCheckBytesSize ? hdr.roundedCheckBytesSize : hdr.capacity;
+        const uint8_t *offs = cache.ptr(addr + sizeof(hdr) + tab + chk, (uint64_t)hdr.capacity * sizeof(int32_t));
+        if(!offs)
+        {
+            WRN("objc string table at 0x%llx out of bounds", (unsigned long long)addr);
+            return;
+        }
+        // Offsets are relative to the table, except for tables that are relative to the cache base.
+        uint64_t bases[] = { addr, cache.mappings[0].addr };
+        for(uint64_t base : bases)
+        {
+            size_t good = 0,
+                   bad = 0;
+            for(uint32_t i = 0; i < hdr.capacity && good + bad < 16; ++i)
+            {
+                int32_t off;
+                memcpy(&off, offs + i * sizeof(off), sizeof(off));
+                if(off == 0)
+                {
+                    continue;
+                }
+                const char *s = cache.str(base + (int64_t)off);
+                if(s && *s > 0x20 && *s < 0x7f)
+                {
+                    ++good;
+                }
+                else
+                {
+                    ++bad;
+                }
+            }
+            if(good <= bad)
+            {
+                continue;
+            }
+            out.reserve(out.size() + hdr.occupied);
+            for(uint32_t i = 0; i < hdr.capacity; ++i)
+            {
+                int32_t off;
+                memcpy(&off, offs + i * sizeof(off), sizeof(off));
+                const char *s = off ? cache.str(base + (int64_t)off) : nullptr;
+                if(s)
+                {
+                    out.push_back(s);
+                }
+            }
+            return;
+        }
+        WRN("Cannot make sense of objc string table at 0x%llx", (unsigned long long)addr);
+    }
+
+    static void objc_opt(objc_ctx_t &ctx)
+    {
+        const cache_t &cache = ctx.cache;
+        const dyld_cache_header *hdr = cache.header();
+        uint64_t base = cache.mappings[0].addr,
+                 sel = 0,
+                 cls = 0,
+                 proto = 0;
+        if(DSC_HAS_FIELD(hdr, objcOptsSize) && hdr->objcOptsOffset != 0)
+        {
+            struct
+            {
+                uint32_t version;
+                uint32_t flags;
+                uint64_t headerInfoROCacheOffset;
+                uint64_t headerInfoRWCacheOffset;
+                uint64_t selectorHashTableCacheOffset;
+                uint64_t classHashTableCacheOffset;
+                uint64_t protocolHashTableCacheOffset;
+                uint64_t relativeMethodSelectorBaseAddressOffset;
+            } opt;
+            const uint8_t *p = cache.ptr(base + hdr->objcOptsOffset, sizeof(opt));
+            if(!p)
+            {
+                WRN("objc optimization header out of bounds");
+                return;
+            }
+            memcpy(&opt, p, sizeof(opt));
+            sel = opt.selectorHashTableCacheOffset ? base + opt.selectorHashTableCacheOffset : 0;
+            cls = opt.classHashTableCacheOffset ? base + opt.classHashTableCacheOffset : 0;
+            proto = opt.protocolHashTableCacheOffset ? base + opt.protocolHashTableCacheOffset : 0;
+            ctx.relbase = opt.relativeMethodSelectorBaseAddressOffset ? base + opt.relativeMethodSelectorBaseAddressOffset : 0;
+        }
+        else
+        {
+            // Older caches keep objc_opt_t in libobjc's __TEXT,__objc_opt_ro
+            const section_t *opt_ro = nullptr;
+            for(uint32_t i = 0; i < cache.images.size() && !opt_ro; ++i)
+            {
+                if(strstr(cache.images[i].path, "/libobjc."))
+                {
+                    opt_ro = cache.headers().section(i, "__TEXT", "__objc_opt_ro");
+                }
+            }
+            if(!opt_ro)
+            {
+                WRN("No objc optimization header found");
+                return;
+            }
+            const section_t &sec = *opt_ro;
+            int32_t f[10] = {};
+            const uint8_t *p = cache.ptr(sec.addr, std::min<uint64_t>(sec.size, sizeof(f)));
+            if(!p || sec.size < 5 * sizeof(int32_t))
+            {
+                WRN("__objc_opt_ro out of bounds");
+                return;
+            }
+            memcpy(f, p, std::min<uint64_t>(sec.size, sizeof(f)));
+            uint32_t version = (uint32_t)f[0];
+            int32_t selopt, clsopt, protoopt;
+            if(version == 12)
+            {
+                selopt = f[1];
+                clsopt = f[3];
+                protoopt = f[4];
+            }
+            else if(version >= 13 && version <= 16)
+            {
+                // v16 left the old class and protocol offsets unused and added the large shared cache ones after them
+                selopt = f[2];
+                clsopt = version >= 16 ? f[8] : f[4];
+                protoopt = version >= 16 ? f[9] : version >= 15 ? f[7] : f[5];
+                if(version >= 16 && sec.size >= 48)
+                {
+                    int64_t rel;
+                    memcpy(&rel, p + 40, sizeof(rel));
+                    ctx.relbase = rel ? sec.addr + rel : 0;
+                }
+            }
+            else
+            {
+                WRN("Unknown objc_opt_t version %u", version);
+                return;
+            }
+            sel = selopt ? sec.addr + selopt : 0;
+            cls = clsopt ? sec.addr + clsopt : 0;
+            proto = protoopt ? sec.addr + protoopt : 0;
+        }
+        if(sel)
+        {
+            objc_strtab(cache, sel, ctx.sels);
+        }
+        if(cls)
+        {
+            objc_strtab(cache, cls, ctx.clsnames);
+        }
+        if(proto)
+        {
+            objc_strtab(cache, proto, ctx.protonames);
+        }
+    }
+
+    static void objc_methods(const objc_ctx_t &ctx, uint64_t list, bool meta, objc_cls_t &out)
+    {
+        const cache_t &cache = ctx.cache;
+        const uint8_t *p = cache.ptr(list, 8);
+        if(!list || !p)
+        {
+            return;
+        }
+        uint32_t flags, count;
+        memcpy(&flags, p, sizeof(flags));
+        memcpy(&count, p + 4, sizeof(count));
+        uint32_t entsize = flags & ~METHOD_LIST_FLAGS_MASK;
+        if(entsize == 0)
+        {
+            return;
+        }
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            uint64_t ent = list + 8 + (uint64_t)i * entsize;
+            uint64_t seladdr;
+            if(flags & METHOD_LIST_SMALL)
+            {
+                const uint8_t *e = cache.ptr(ent, sizeof(int32_t));
+                if(!e)
+                {
+                    return;
+                }
+                int32_t nameoff;
+                memcpy(&nameoff, e, sizeof(nameoff));
+                if(flags & METHOD_LIST_DIRECT_SELS)
+                {
+                    seladdr = ctx.relbase + (int64_t)nameoff;
+                }
+                else if(!cache.read_ptr(ent + (int64_t)nameoff, seladdr))
+                {
+                    continue;
+                }
+            }
+            else if(!cache.read_ptr(ent, seladdr))
+            {
+                return;
+            }
+            const char *sel = cache.str(seladdr);
+            if(sel)
+            {
+                out.methods.push_back({ sel, meta });
+            }
+        }
+    }
+
+    static void objc_protocols(const objc_ctx_t &ctx, uint64_t list, std::vector<const char*> &out)
+    {
+        const cache_t &cache = ctx.cache;
+        uint32_t ps = cache.ptrsize;
+        // The count is a plain word, not a pointer, so it must not go through read_ptr
+        const uint8_t *p = list ? cache.ptr(list, ps) : nullptr;
+        if(!p)
+        {
+            return;
+        }
+        uint64_t count = 0;
+        memcpy(&count, p, ps);
+        for(uint64_t i = 0; i < count && i < 0x10000; ++i)
+        {
+            uint64_t proto, name;
+            if(!cache.read_ptr(list + ps * (i + 1), proto) || !cache.read_ptr(proto + ps, name))
+            {
+                return;
+            }
+            const char *s = cache.str(name);
+            if(s)
+            {
+                out.push_back(s);
+            }
+        }
+    }
+
+    const char* objc_class_name(const cache_t &cache, uint64_t cls, uint64_t *ro)
+    {
+        uint32_t ps = cache.ptrsize;
+        uint64_t data, name;
+        // class_t { isa, superclass, cache, vtable, data }, class_ro_t name after
+        // flags, instanceStart, instanceSize, (reserved on 64-bit), ivarLayout
+        if(!cls || !cache.read_ptr(cls + 4 * ps, data))
+        {
+            return nullptr;
+        }
+        data &= ps == 8 ? ~7ULL : ~3ULL;
+        if(!cache.read_ptr(data + (ps == 8 ? 24 : 16), name))
+        {
+            return nullptr;
+        }
+        if(ro)
+        {
+            *ro = data;
+        }
+        return cache.str(name);
+    }
+
+    static void objc_image(const objc_ctx_t &ctx, uint32_t idx, objc_img_t &out)
+    {
+        const cache_t &cache = ctx.cache;
+        uint32_t ps = cache.ptrsize;
+        uint64_t ro_methods = ps == 8 ? 32 : 20,
+                 ro_protos  = ps == 8 ? 40 : 24;
+        for(const section_t &sec : cache.headers().sections(idx))
+        {
+            bool classes = strcmp(sec.name, "__objc_classlist") == 0,
+                 cats = strcmp(sec.name, "__objc_catlist") == 0 || strcmp(sec.name, "__objc_catlist2") == 0,
+                 protos = strcmp(sec.name, "__objc_protolist") == 0;
+            for(uint64_t off = 0; (classes || cats || protos) && off + ps <= sec.size; off += ps)
+            {
+                uint64_t obj;
+                if(!cache.read_ptr(sec.addr + off, obj) || !obj)
+                {
+                    continue;
+                }
+                if(protos)
+                {
+                    uint64_t name;
+                    const char *s = cache.read_ptr(obj + ps, name) ? cache.str(name) : nullptr;
+                    if(s)
+                    {
+                        out.protocols.push_back(s);
+                    }
+                    continue;
+                }
+                objc_cls_t c = {};
+                if(classes)
+                {
+                    uint64_t ro, isa, super, metaro;
+                    c.name = objc_class_name(cache, obj, &ro);
+                    if(!c.name)
+                    {
+                        continue;
+                    }
+                    c.super = cache.read_ptr(obj + ps, super) ? objc_class_name(cache, super, nullptr) : nullptr;
+                    uint64_t list;
+                    if(cache.read_ptr(ro + ro_methods, list))
+                    {
+                        objc_methods(ctx, list, false, c);
+                    }
+                    if(cache.read_ptr(ro + ro_protos, list))
+                    {
+                        objc_protocols(ctx, list, c.protocols);
+                    }
+                    if(cache.read_ptr(obj, isa) && objc_class_name(cache, isa, &metaro) && cache.read_ptr(metaro + ro_methods, list))
+                    {
+                        objc_methods(ctx, list, true, c);
+                    }
+                }
+                else
+                {
+                    // category_t { name, cls, instanceMethods, classMethods, protocols }
+                    uint64_t name, cls, list;
+                    c.category = cache.read_ptr(obj, name) ? cache.str(name) : nullptr;
+                    c.name = cache.read_ptr(obj + ps, cls) ? objc_class_name(cache, cls, nullptr) : nullptr;
+                    if(!c.category || !c.name)
+                    {
+                        continue;
+                    }
+                    if(cache.read_ptr(obj + 2 * ps, list))
+                    {
+                        objc_methods(ctx, list, false, c);
+                    }
+                    if(cache.read_ptr(obj + 3 * ps, list))
+                    {
+                        objc_methods(ctx, list, true, c);
+                    }
+                    if(cache.read_ptr(obj + 4 * ps, list))
+                    {
+                        objc_protocols(ctx, list, c.protocols);
+                    }
+                }
+                out.classes.push_back(std::move(c));
+            }
+        }
+    }
+
+    int mode_objc_index(int argc, const char **argv)
+    {
+        if(argc != 3)
+        {
+            fprintf(stderr, "Usage: dsc_util objc-index <path-to-cache> <index-file>\n");
+            return 1;
+        }
+        cache_t cache;
+        if(!cache.open(argv[1]))
+        {
+            return 1;
+        }
+        objc_ctx_t ctx = { cache, 0, {}, {}, {} };
+        objc_opt(ctx);
+        std::vector<objc_img_t> imgs(cache.images.size());
+        parallel_for(cache.images.size(), [&](size_t i, size_t)
+        {
+            objc_image(ctx, (uint32_t)i, imgs[i]);
+        });
+
+        strtab_t str;
+        str.data.push_back('\0');
+        const char *strbase = nullptr;
+        std::vector<uint32_t> images;
+        std::vector<objc_index_class_t> classes;
+        std::unordered_map<uint32_t, std::vector<objc_index_ref_t>> impls, confs;
+        std::unordered_map<uint32_t, uint32_t> protoimg;
+        for(uint32_t i = 0; i < cache.images.size(); ++i)
+        {
+            images.push_back(str.add(cache.images[i].path));
+            for(const objc_cls_t &c : imgs[i].classes)
+            {
+                // Categories show up as "Class(Category)" in implementations and conformances
+                uint32_t name = c.category ? str.add((std::string(c.name) + "(" + c.category + ")").c_str()) : str.add(c.name);
+                if(!c.category)
+                {
+                    classes.push_back({ name, i, c.super ? str.add(c.super) : OBJC_NONE });
+                }
+                for(const std::pair<const char*, bool> &m : c.methods)
+                {
+                    impls[str.add(m.first)].push_back({ name, i | (m.second ? OBJC_META : 0) });
+                }
+                for(const char *p : c.protocols)
+                {
+                    confs[str.add(p)].push_back({ name, i });
+                }
+            }
+            for(const char *p : imgs[i].protocols)
+            {
+                uint32_t name = str.add(p);
+                protoimg.emplace(name, i);
+                confs[name];
+            }
+        }
+        // Names only known from the shared tables still go into the index
+        for(const char *s : ctx.sels)
+        {
+            impls[str.add(s)];
+        }
+        for(const char *s : ctx.protonames)
+        {
+            confs[str.add(s)];
+        }
+        std::unordered_map<uint32_t, bool> known;
+        for(const objc_index_class_t &c : classes)
+        {
+            known[c.name] = true;
+        }
+        for(const char *s : ctx.clsnames)
+        {
+            uint32_t name = str.add(s);
+            if(!known[name])
+            {
+                known[name] = true;
+                classes.push_back({ name, OBJC_NONE, OBJC_NONE });
+            }
+        }
+        strbase = str.data.c_str();
+        auto less = [&](uint32_t a, uint32_t b)
+        {
+            return strcmp(strbase + a, strbase + b) < 0;
+        };
+        std::sort(classes.begin(), classes.end(), [&](const objc_index_class_t &a, const objc_index_class_t &b)
+        {
+            int r = strcmp(strbase + a.name, strbase + b.name);
+            return r != 0 ? r < 0 : a.image < b.image;
+        });
+
+        auto flatten = [&](std::unordered_map<uint32_t, std::vector<objc_index_ref_t>> &map, std::vector<objc_index_list_t> &lists, std::vector<objc_index_ref_t> &refs, bool withimg)
+        {
+            std::vector<uint32_t> keys;
+            keys.reserve(map.size());
+            for(const auto &kv : map)
+            {
+                keys.push_back(kv.first);
+            }
+            std::sort(keys.begin(), keys.end(), less);
+            for(uint32_t k : keys)
+            {
+                std::vector<objc_index_ref_t> &v = map[k];
+                auto it = withimg ? protoimg.find(k) : protoimg.end();
+                lists.push_back({ k, it != protoimg.end() ? it->second : OBJC_NONE, (uint32_t)refs.size(), (uint32_t)v.size() });
+                refs.insert(refs.end(), v.begin(), v.end());
+            }
+        };
+        std::vector<objc_index_list_t> sels, protos;
+        std::vector<objc_index_ref_t> implrefs, confrefs;
+        flatten(impls, sels, implrefs, false);
+        flatten(confs, protos, confrefs, true);
+
+        while(str.data.size() % 4)
+        {
+            str.data.push_back('\0');
+        }
+        objc_index_header_t hdr = {};
+        hdr.magic = OBJC_INDEX_MAGIC;
+        hdr.version = OBJC_INDEX_VERSION;
+        hdr.nimages = (uint32_t)images.size();
+        hdr.nclasses = (uint32_t)classes.size();
+        hdr.nsels = (uint32_t)sels.size();
+        hdr.nprotos = (uint32_t)protos.size();
+        hdr.nimpls = (uint32_t)implrefs.size();
+        hdr.nconfs = (uint32_t)confrefs.size();
+        hdr.strsize = (uint32_t)str.data.size();
+        hdr.off_images = sizeof(hdr);
+        hdr.off_classes = hdr.off_images + hdr.nimages * sizeof(uint32_t);
+        hdr.off_sels = hdr.off_classes + hdr.nclasses * sizeof(objc_index_class_t);
+        hdr.off_protos = hdr.off_sels + hdr.nsels * sizeof(objc_index_list_t);
+        hdr.off_impls = hdr.off_protos + hdr.nprotos * sizeof(objc_index_list_t);
+        hdr.off_confs = hdr.off_impls + hdr.nimpls * sizeof(objc_index_ref_t);
+        hdr.off_str = hdr.off_confs + hdr.nconfs * sizeof(objc_index_ref_t);
+
+        FILE *f = fopen(argv[2], "wb");
+        if(!f)
+        {
+            ERR("fopen(%s): %s", argv[2], strerror(errno));
+            return 1;
+        }
+        bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+                  fwrite(images.data(), sizeof(uint32_t), images.size(), f) == images.size() &&
+                  fwrite(classes.data(), sizeof(objc_index_class_t), classes.size(), f) == classes.size() &&
+                  fwrite(sels.data(), sizeof(objc_index_list_t), sels.size(), f) == sels.size() &&
+                  fwrite(protos.data(), sizeof(objc_index_list_t), protos.size(), f) == protos.size() &&
+                  fwrite(implrefs.data(), sizeof(objc_index_ref_t), implrefs.size(), f) == implrefs.size() &&
+                  fwrite(confrefs.data(), sizeof(objc_index_ref_t), confrefs.size(), f) == confrefs.size() &&
+                  fwrite(str.data.data(), 1, str.data.size(), f) == str.data.size();
+        if(fclose(f) != 0 || !ok)
+        {
+            ERR("Failed to write %s", argv[2]);
+            return 1;
+        }
+        LOG("%u classes, %u selectors, %u protocols, %u implementations, %u conformances", hdr.nclasses, hdr.nsels, hdr.nprotos, hdr.nimpls, hdr.nconfs);
+        return 0;
+    }
+
+    struct objc_index_t
+    {
+        mapped_file_t file;
+        const objc_index_header_t *hdr = nullptr;
+
+        template<typename T>
+        const T* arr(uint32_t off, uint32_t count) const
+        {
+            return this->file.arr<T>(off, count);
+        }
+
+        const char* str(uint32_t off) const
+        {
+            return off < this->hdr->strsize ? (const char*)this->file.base + this->hdr->off_str + off : "?";
+        }
+
+        const char* image(uint32_t idx) const
+        {
+            idx &= ~OBJC_META;
+            return idx < this->hdr->nimages ? this->str(this->arr<uint32_t>(this->hdr->off_images, this->hdr->nimages)[idx]) : "?";
+        }
+
+        bool open(const char *path)
+        {
+            if(!this->file.open(path, sizeof(objc_index_header_t)))
+            {
+                return false;
+            }
+            this->hdr = (const objc_index_header_t*)this->file.base;
+            if(this->hdr->magic != OBJC_INDEX_MAGIC || this->hdr->version != OBJC_INDEX_VERSION ||
+               !this->arr<uint32_t>(this->hdr->off_images, this->hdr->nimages) ||
+               !this->arr<objc_index_class_t>(this->hdr->off_classes, this->hdr->nclasses) ||
+               !this->arr<objc_index_list_t>(this->hdr->off_sels, this->hdr->nsels) ||
+               !this->arr<objc_index_list_t>(this->hdr->off_protos, this->hdr->nprotos) ||
+               !this->arr<objc_index_ref_t>(this->hdr->off_impls, this->hdr->nimpls) ||
+               !this->arr<objc_index_ref_t>(this->hdr->off_confs, this->hdr->nconfs) ||
+               !this->file.strtab(this->hdr->off_str, this->hdr->strsize))
+            {
+                ERR("%s: bad objc index", path);
+                return false;
+            }
+            return true;
+        }
+
+        template<typename T>
+        std::pair<const T*, const T*> find(uint32_t off, uint32_t count, const char *name) const
+        {
+            return sorted_range(this->arr<T>(off, count), count, (const char*)this->file.base + this->hdr->off_str, name);
+        }
+    };
+
+    int mode_objc_query(int argc, const char **argv)
+    {
+        if(argc != 4)
+        {
+            fprintf(stderr, "Usage: dsc_util objc-query <index-file> class|selector|protocol <name>\n");
+            return 1;
+        }
+        objc_index_t idx;
+        if(!idx.open(argv[1]))
+        {
+            return 1;
+        }
+        const objc_index_header_t *hdr = idx.hdr;
+        const char *what = argv[2],
+                   *name = argv[3];
+        size_t found = 0;
+        if(strcmp(what, "class") == 0)
+        {
+            auto r = idx.find<objc_index_class_t>(hdr->off_classes, hdr->nclasses, name);
+            for(const objc_index_class_t *c = r.first; c != r.second; ++c, ++found)
+            {
+                printf("%s : %s\t%s\n", name, c->super == OBJC_NONE ? "-" : idx.str(c->super), c->image == OBJC_NONE ? "?" : idx.image(c->image));
+            }
+        }
+        else if(strcmp(what, "selector") == 0 || strcmp(what, "protocol") == 0)
+        {
+            bool sel = what[0] == 's';
+            auto r = sel ? idx.find<objc_index_list_t>(hdr->off_sels, hdr->nsels, name) : idx.find<objc_index_list_t>(hdr->off_protos, hdr->nprotos, name);
+            const objc_index_ref_t *refs = sel ? idx.arr<objc_index_ref_t>(hdr->off_impls, hdr->nimpls) : idx.arr<objc_index_ref_t>(hdr->off_confs, hdr->nconfs);
+            uint32_t nrefs = sel ? hdr->nimpls : hdr->nconfs;
+            for(const objc_index_list_t *l = r.first; l != r.second; ++l)
+            {
+                if(!sel && l->image != OBJC_NONE)
+                {
+                    printf("@protocol %s\t%s\n", name, idx.image(l->image));
+                }
+                for(uint32_t i = l->start; i < l->start + l->count && i < nrefs; ++i, ++found)
+                {
+                    if(sel)
+                    {
+                        printf("%c[%s %s]\t%s\n", (refs[i].image & OBJC_META) ? '+' : '-', idx.str(refs[i].cls), name, idx.image(refs[i].image));
+                    }
+                    else
+                    {
+                        printf("%s <%s>\t%s\n", idx.str(refs[i].cls), name, idx.image(refs[i].image));
+                    }
+                }
+                if(l->count == 0 && (sel || l->image == OBJC_NONE))
+                {
+                    printf("%s%s (no %s)\n", sel ? "" : "@protocol ", name, sel ? "implementations" : "conformers");
+                    ++found;
+                }
+            }
+        }
+        else
+        {
+            ERR("Unknown query: %s", what);
+            return 1;
+        }
+        return found ? 0 : 1;
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef DSC_OBJC_H
+#define DSC_OBJC_H
+
+#include <stdint.h>
+
+#include "cache.h"
+
+namespace dsc
+{
+    // Name of the ObjC class object at cls, or NULL. If ro is given, it receives the class_ro_t address.
+    const char* objc_class_name(const cache_t &cache, uint64_t cls, uint64_t *ro);
+}
+
+#endif
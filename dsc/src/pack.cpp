@@ -0,0 +1,492 @@
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef DSC_HAVE_ZSTD
+#   include <zstd.h>
+#endif
+
+#include "common.h"
+#include "pack.h"
+
+// Pack file, everything little endian. Frames are standard zstd frames, the
+// rest are zstd skippable frames, so plain zstd skips them:
+//
+//   zstd frame          images[nframes]     one per image, in sequence order
+//   skippable frame     PACK_INDEX_MAGIC:
+//     pack_index_header_t
+//     pack_index_entry_t  entries[count]    sorted by name
+//     char                strings[strsize]
+//   skippable frame     PACK_SEEK_MAGIC, the zstd seekable format's seek table:
+//     { uint32_t csize, dsize, checksum }[nframes]
+//     uint32_t nframes, uint8_t descriptor (checksums present), uint32_t PACK_SEEK_FOOTER
+//
+// Frame offsets aren't stored, they are the running sum of compressed sizes,
+// which also puts the index frame right after the last image. Checksums are
+// the low 32 bits of the XXH64 of each image, as the seekable format has them.
+#define PACK_SKIPPABLE_HDR  8
+#define PACK_INDEX_MAGIC    0x184d2a5d  // Skippable frame, any of 0x184d2a50-5f
+#define PACK_SEEK_MAGIC     0x184d2a5e
+#define PACK_SEEK_FOOTER    0x8f92eab1
+#define PACK_SEEK_CHECKSUM  0x80
+#define PACK_SEEK_RESERVED  0x7c
+#define PACK_FOOTER_SIZE    9
+#define PACK_MAGIC          0x50435344 // "DSCP"
+#define PACK_VERSION        1
+
+namespace dsc
+{
+#ifdef DSC_HAVE_ZSTD
+    struct pack_index_header_t
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t count;
+        uint32_t strsize;
+    };
+
+    struct pack_index_entry_t
+    {
+        uint32_t frame;
+        uint32_t name;      // Offset into the strings
+    };
+
+    static inline uint32_t pack_rd32(const uint8_t *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+    static inline void pack_wr32(std::vector<uint8_t> &out, uint32_t v) { out.insert(out.end(), (const uint8_t*)&v, (const uint8_t*)&v + sizeof(v)); }
+
+    static bool pack_pwrite(int fd, const void *data, size_t size, uint64_t off)
+    {
+        const uint8_t *p = (const uint8_t*)data;
+        while(size)
+        {
+            ssize_t r = pwrite(fd, p, size, (off_t)off);
+            if(r <= 0)
+            {
+                if(r < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            p += r;
+            off += (uint64_t)r;
+            size -= (size_t)r;
+        }
+        return true;
+    }
+
+    static bool pack_pread(int fd, void *data, size_t size, uint64_t off)
+    {
+        uint8_t *p = (uint8_t*)data;
+        while(size)
+        {
+            ssize_t r = pread(fd, p, size, (off_t)off);
+            if(r <= 0)
+            {
+                if(r < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            p += r;
+            off += (uint64_t)r;
+            size -= (size_t)r;
+        }
+        return true;
+    }
+
+    struct pack_worker_t
+    {
+        ZSTD_CCtx *ctx = nullptr;
+        std::vector<uint8_t> buf;
+
+        ~pack_worker_t()
+        {
+            ZSTD_freeCCtx(this->ctx);
+        }
+    };
+#else
+    struct pack_worker_t {};
+#endif
+
+    pack_writer_t::pack_writer_t() = default;
+
+    pack_writer_t::~pack_writer_t()
+    {
+        if(this->fd != -1)
+        {
+            close(this->fd);
+        }
+    }
+
+    pack_t::pack_t() = default;
+
+    pack_t::~pack_t()
+    {
+        if(this->fd != -1)
+        {
+            close(this->fd);
+        }
+    }
+
+    const pack_t::entry_t* pack_t::find(const char *name) const
+    {
+        auto it = std::lower_bound(this->entries.begin(), this->entries.end(), name, [](const entry_t &e, const char *n)
+        {
+            return strcmp(e.name, n) < 0;
+        });
+        return it != this->entries.end() && strcmp(it->name, name) == 0 ? &*it : nullptr;
+    }
+
+#ifdef DSC_HAVE_ZSTD
+    bool pack_writer_t::open(const char *file, size_t nworkers, int level)
+    {
+        if(level < ZSTD_minCLevel() || level > ZSTD_maxCLevel())
+        {
+            ERR("zstd level must be between %d and %d", ZSTD_minCLevel(), ZSTD_maxCLevel());
+            return false;
+        }
+        this->path = file;
+        if(!mkdirs(this->path))
+        {
+            return false;
+        }
+        this->fd = ::open(file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(this->fd == -1)
+        {
+            ERR("open(%s): %s", file, strerror(errno));
+            return false;
+        }
+        this->workers.resize(nworkers);
+        for(std::unique_ptr<pack_worker_t> &w : this->workers)
+        {
+            w.reset(new pack_worker_t());
+            w->ctx = ZSTD_createCCtx();
+            if(!w->ctx)
+            {
+                ERR("ZSTD_createCCtx failed");
+                return false;
+            }
+            ZSTD_CCtx_setParameter(w->ctx, ZSTD_c_compressionLevel, level);
+        }
+        return true;
+    }
+
+    bool pack_writer_t::add(size_t worker, size_t seq, const char *name, const uint8_t *data, size_t size)
+    {
+        if(size > UINT32_MAX)
+        {
+            ERR("%s: too large for a pack frame", name);
+            this->skip(seq);
+            return false;
+        }
+        pack_worker_t &w = *this->workers[worker];
+        size_t bound = ZSTD_compressBound(size);
+        if(w.buf.size() < bound)
+        {
+            w.buf.resize(bound);
+        }
+        size_t csize = ZSTD_compress2(w.ctx, w.buf.data(), w.buf.size(), data, size);
+        if(ZSTD_isError(csize))
+        {
+            ERR("%s: compression failed: %s", name, ZSTD_getErrorName(csize));
+            this->skip(seq);
+            return false;
+        }
+        pending_t p;
+        p.frame = { (uint32_t)csize, (uint32_t)size, (uint32_t)hash64(data, size) };
+        p.name = name;
+        p.data.swap(w.buf);
+        return this->push(seq, p, &w.buf);
+    }
+
+    void pack_writer_t::skip(size_t seq)
+    {
+        pending_t p = {};
+        this->push(seq, p, nullptr);
+    }
+
+    bool pack_writer_t::push(size_t seq, pending_t &p, std::vector<uint8_t> *buf)
+    {
+        std::vector<std::pair<uint64_t, pending_t>> ready;
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->pending.emplace(seq, std::move(p));
+            if(buf && !this->spare.empty())
+            {
+                buf->swap(this->spare.back());
+                this->spare.pop_back();
+            }
+            for(auto it = this->pending.begin(); it != this->pending.end() && it->first == this->next; it = this->pending.erase(it), ++this->next)
+            {
+                pending_t &f = it->second;
+                if(f.name.empty())
+                {
+                    continue;
+                }
+                this->frames.push_back(f.frame);
+                this->names.push_back(f.name);
+                this->off += f.frame.csize;
+                ready.push_back({ this->off - f.frame.csize, std::move(f) });
+            }
+        }
+        bool ok = true;
+        for(const std::pair<uint64_t, pending_t> &r : ready)
+        {
+            ok = ok && pack_pwrite(this->fd, r.second.data.data(), r.second.frame.csize, r.first);
+        }
+        if(!ok)
+        {
+            // The frames' space is claimed either way, so the pack can't be finished
+            ERR("%s: write failed: %s", this->path.c_str(), strerror(errno));
+        }
+        if(!ready.empty())
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            for(std::pair<uint64_t, pending_t> &r : ready)
+            {
+                this->spare.push_back(std::move(r.second.data));
+            }
+            this->failed = this->failed || !ok;
+        }
+        return ok;
+    }
+
+    bool pack_writer_t::finish(void)
+    {
+        if(!this->pending.empty())
+        {
+            ERR("%s: frame %zu was never added", this->path.c_str(), this->next);
+            return false;
+        }
+        if(this->failed)
+        {
+            return false;
+        }
+        size_t n = this->frames.size();
+        std::vector<uint32_t> order(n);
+        std::vector<uint8_t> strs;
+        for(size_t i = 0; i < n; ++i)
+        {
+            order[i] = (uint32_t)i;
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+        {
+            return this->names[a] < this->names[b];
+        });
+
+        std::vector<uint8_t> tail;
+        std::vector<uint8_t> index;
+        pack_wr32(index, PACK_MAGIC);
+        pack_wr32(index, PACK_VERSION);
+        pack_wr32(index, (uint32_t)n);
+        pack_wr32(index, 0); // strsize, patched below
+        for(uint32_t i : order)
+        {
+            pack_wr32(index, i);
+            pack_wr32(index, (uint32_t)strs.size());
+            const std::string &name = this->names[i];
+            strs.insert(strs.end(), name.c_str(), name.c_str() + name.size() + 1);
+        }
+        uint32_t strsize = (uint32_t)strs.size();
+        memcpy(index.data() + offsetof(pack_index_header_t, strsize), &strsize, sizeof(strsize));
+        index.insert(index.end(), strs.begin(), strs.end());
+        pack_wr32(tail, PACK_INDEX_MAGIC);
+        pack_wr32(tail, (uint32_t)index.size());
+        tail.insert(tail.end(), index.begin(), index.end());
+
+        pack_wr32(tail, PACK_SEEK_MAGIC);
+        pack_wr32(tail, (uint32_t)(n * sizeof(frame_t) + PACK_FOOTER_SIZE));
+        this->in = 0;
+        for(const frame_t &f : this->frames)
+        {
+            pack_wr32(tail, f.csize);
+            pack_wr32(tail, f.dsize);
+            pack_wr32(tail, f.checksum);
+            this->in += f.dsize;
+        }
+        pack_wr32(tail, (uint32_t)n);
+        tail.push_back(PACK_SEEK_CHECKSUM);
+        pack_wr32(tail, PACK_SEEK_FOOTER);
+
+        bool ok = pack_pwrite(this->fd, tail.data(), tail.size(), this->off);
+        if(!ok)
+        {
+            ERR("%s: write failed: %s", this->path.c_str(), strerror(errno));
+        }
+        if(close(this->fd) != 0 && ok)
+        {
+            ERR("close(%s): %s", this->path.c_str(), strerror(errno));
+            ok = false;
+        }
+        this->fd = -1;
+        this->out = this->off + tail.size();
+        return ok;
+    }
+
+    bool pack_t::open(const char *file)
+    {
+        this->path = file;
+        this->fd = ::open(file, O_RDONLY | O_CLOEXEC);
+        if(this->fd == -1)
+        {
+            ERR("open(%s): %s", file, strerror(errno));
+            return false;
+        }
+        struct stat st;
+        uint8_t footer[PACK_FOOTER_SIZE];
+        if(fstat(this->fd, &st) != 0 || (uint64_t)st.st_size < PACK_SKIPPABLE_HDR + PACK_FOOTER_SIZE || !pack_pread(this->fd, footer, sizeof(footer), (uint64_t)st.st_size - sizeof(footer)))
+        {
+            ERR("%s: can't read seek table footer", file);
+            return false;
+        }
+        uint64_t size = (uint64_t)st.st_size;
+        uint32_t n = pack_rd32(footer);
+        uint8_t desc = footer[4];
+        if(pack_rd32(footer + 5) != PACK_SEEK_FOOTER || (desc & PACK_SEEK_RESERVED))
+        {
+            ERR("%s: not a seekable zstd file", file);
+            return false;
+        }
+        // The seekable format allows tables without checksums, but we never write those
+        if(!(desc & PACK_SEEK_CHECKSUM))
+        {
+            ERR("%s: seek table has no checksums, not a pack", file);
+            return false;
+        }
+        uint64_t esize = 12,
+                 tsize = PACK_SKIPPABLE_HDR + n * esize + PACK_FOOTER_SIZE;
+        if(tsize > size)
+        {
+            ERR("%s: seek table runs past the start of the file", file);
+            return false;
+        }
+        std::vector<uint8_t> table(tsize);
+        if(!pack_pread(this->fd, table.data(), tsize, size - tsize) || pack_rd32(table.data()) != PACK_SEEK_MAGIC || pack_rd32(table.data() + 4) != tsize - PACK_SKIPPABLE_HDR)
+        {
+            ERR("%s: bad seek table", file);
+            return false;
+        }
+        std::vector<entry_t> frames(n);
+        uint64_t off = 0;
+        for(uint32_t i = 0; i < n; ++i)
+        {
+            const uint8_t *e = table.data() + PACK_SKIPPABLE_HDR + i * esize;
+            frames[i] = { nullptr, off, pack_rd32(e), pack_rd32(e + 4), pack_rd32(e + 8) };
+            off += frames[i].csize;
+        }
+
+        uint8_t hdr[PACK_SKIPPABLE_HDR + sizeof(pack_index_header_t)];
+        if(off + sizeof(hdr) > size - tsize || !pack_pread(this->fd, hdr, sizeof(hdr), off) || pack_rd32(hdr) != PACK_INDEX_MAGIC)
+        {
+            ERR("%s: no image index, not a pack", file);
+            return false;
+        }
+        pack_index_header_t ih;
+        memcpy(&ih, hdr + PACK_SKIPPABLE_HDR, sizeof(ih));
+        uint64_t isize = pack_rd32(hdr + 4);
+        if(ih.magic != PACK_MAGIC || ih.version != PACK_VERSION)
+        {
+            ERR("%s: unsupported pack index (version %u)", file, ih.version);
+            return false;
+        }
+        if(off + PACK_SKIPPABLE_HDR + isize != size - tsize || isize != sizeof(ih) + (uint64_t)ih.count * sizeof(pack_index_entry_t) + ih.strsize || ih.count > n)
+        {
+            ERR("%s: bad pack index", file);
+            return false;
+        }
+        std::vector<pack_index_entry_t> ents(ih.count);
+        this->strs.resize((size_t)ih.strsize + 1); // Terminated even if the file isn't
+        off += sizeof(hdr);
+        if(!pack_pread(this->fd, ents.data(), ents.size() * sizeof(pack_index_entry_t), off) || !pack_pread(this->fd, this->strs.data(), ih.strsize, off + ents.size() * sizeof(pack_index_entry_t)))
+        {
+            ERR("%s: can't read pack index", file);
+            return false;
+        }
+        this->entries.reserve(ih.count);
+        for(const pack_index_entry_t &e : ents)
+        {
+            if(e.frame >= n || e.name >= ih.strsize)
+            {
+                ERR("%s: bad pack index entry", file);
+                return false;
+            }
+            entry_t ent = frames[e.frame];
+            ent.name = this->strs.data() + e.name;
+            this->entries.push_back(ent);
+        }
+        return true;
+    }
+
+    bool pack_t::read(const entry_t &e, std::vector<uint8_t> &out) const
+    {
+        std::vector<uint8_t> src(e.csize);
+        if(!pack_pread(this->fd, src.data(), src.size(), e.off))
+        {
+            ERR("%s: read failed: %s", this->path.c_str(), strerror(errno));
+            return false;
+        }
+        out.resize(e.size);
+        size_t r = ZSTD_decompress(out.data(), out.size(), src.data(), src.size());
+        if(ZSTD_isError(r) || r != e.size)
+        {
+            ERR("%s: %s: %s", this->path.c_str(), e.name, ZSTD_isError(r) ? ZSTD_getErrorName(r) : "size mismatch");
+            return false;
+        }
+        if((uint32_t)hash64(out.data(), out.size()) != e.checksum)
+        {
+            ERR("%s: %s: checksum mismatch", this->path.c_str(), e.name);
+            return false;
+        }
+        return true;
+    }
+#else
+    bool pack_writer_t::open(const char *file, size_t nworkers, int level)
+    {
+        (void)file;
+        (void)nworkers;
+        (void)level;
+        ERR("Built without libzstd, packs are unavailable");
+        return false;
+    }
+
+    bool pack_writer_t::add(size_t worker, size_t seq, const char *name, const uint8_t *data, size_t size)
+    {
+        (void)worker;
+        (void)seq;
+        (void)name;
+        (void)data;
+        (void)size;
+        return false;
+    }
+
+    void pack_writer_t::skip(size_t seq)
+    {
+        (void)seq;
+    }
+
+    bool pack_writer_t::finish(void)
+    {
+        return false;
+    }
+
+    bool pack_t::open(const char *file)
+    {
+        (void)file;
+        ERR("Built without libzstd, packs are unavailable");
+        return false;
+    }
+
+    bool pack_t::read(const entry_t &e, std::vector<uint8_t> &out) const
+    {
+        (void)e;
+        (void)out;
+        return false;
+    }
+#endif
+}
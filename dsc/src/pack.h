@@ -0,0 +1,119 @@
+#ifndef DSC_PACK_H
+#define DSC_PACK_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace dsc
+{
+    struct pack_worker_t;
+
+    // Every image extracted from one cache, in a single file in the zstd
+    // seekable format: one zstd frame per image, then a skippable frame with
+    // the name index, then the standard seek table. Any zstd decompresses the
+    // whole thing (to the images back to back), and anything that speaks the
+    // seekable format can seek in it. Needs libzstd (DSC_HAVE_ZSTD), the layout
+    // is documented at the top of src/pack.cpp.
+    //
+    // Images are compressed by the worker that built them, each with its own
+    // context, and appended under a lock only long enough to claim an offset.
+    // Frames go into the file in sequence order whatever order workers finish
+    // them in, so the same images always give the same bytes: a frame that's
+    // early waits in memory for the ones before it, and whichever worker adds
+    // the last missing one writes out the run.
+    struct pack_writer_t
+    {
+        pack_writer_t();
+        pack_writer_t(const pack_writer_t&) = delete;
+        pack_writer_t& operator=(const pack_writer_t&) = delete;
+        ~pack_writer_t();
+
+        // Creates path (replacing it), for workers [0, n) compressing at level.
+        bool open(const char *path, size_t workers, int level);
+
+        // Compresses size bytes at data into frame number seq for name, and appends it once frames [0, seq) are in.
+        // Every seq in [0, n) has to be either added or skipped once. Safe to call concurrently from distinct workers.
+        bool add(size_t worker, size_t seq, const char *name, const uint8_t *data, size_t size);
+        // Leaves frame seq out, for an image that couldn't be built.
+        void skip(size_t seq);
+
+        // Writes the index and seek table, and closes the file. Nothing can be added afterwards.
+        bool finish(void);
+
+        uint64_t in = 0;    // Uncompressed bytes added, valid after finish()
+        uint64_t out = 0;   // Size of the file, valid after finish()
+
+    private:
+        struct frame_t
+        {
+            uint32_t csize;
+            uint32_t dsize;
+            uint32_t checksum;
+        };
+
+        // A frame that's done but not written yet, skipped if name is empty.
+        struct pending_t
+        {
+            frame_t frame;
+            std::string name;
+            std::vector<uint8_t> data;
+        };
+
+        int fd = -1;
+        std::string path;
+        std::mutex lock;
+        uint64_t off = 0;                           // End of the frames written so far
+        size_t next = 0;                            // Sequence number of the frame whose turn it is
+        std::map<size_t, pending_t> pending;        // Done ahead of their turn
+        std::vector<std::vector<uint8_t>> spare;    // Buffers of written frames, for workers whose buffer went into pending
+        bool failed = false;                        // A frame couldn't be written
+        std::vector<frame_t> frames;                // In file order
+        std::vector<std::string> names;             // Same order
+        std::vector<std::unique_ptr<pack_worker_t>> workers;
+
+        // Queues frame seq and writes every frame whose turn has come, refilling buf from spare if given.
+        bool push(size_t seq, pending_t &p, std::vector<uint8_t> *buf);
+    };
+
+    // Random access to a pack. Only the index and seek table are read when
+    // opening, an image is then one read of its frame and one decompression,
+    // whatever its position. Read-only after open(), so it can be shared by threads.
+    struct pack_t
+    {
+        struct entry_t
+        {
+            const char *name;   // Points into the index
+            uint64_t off;       // Of the frame in the file
+            uint32_t csize;
+            uint32_t size;      // Decompressed
+            uint32_t checksum;  // Low 32 bits of the XXH64 of the image
+        };
+
+        std::vector<entry_t> entries;   // Sorted by name
+
+        pack_t();
+        pack_t(const pack_t&) = delete;
+        pack_t& operator=(const pack_t&) = delete;
+        ~pack_t();
+
+        bool open(const char *path);
+
+        // Entry with exactly this name, or NULL.
+        const entry_t* find(const char *name) const;
+
+        // Decompresses an entry into out (resized to fit) and verifies its checksum.
+        bool read(const entry_t &e, std::vector<uint8_t> &out) const;
+
+    private:
+        int fd = -1;
+        std::string path;
+        std::vector<char> strs;
+    };
+}
+
+#endif
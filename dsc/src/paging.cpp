@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "paging.h"
+
+// Huge pages need their virtual address aligned to their size, and for file
+// mappings the file offset too, so both kinds of mapping are made by
+// reserving 2 MiB more than needed and trimming the ends off around an
+// aligned start. Everything past mmap itself is a hint: a kernel without THP
+// or MADV_POPULATE_READ (5.14) still gets a working mapping, just with small
+// pages or populated by touching every page.
+
+#define PAGING_HUGE         0x200000    // Huge page size everything is aligned to
+#define PAGING_CHUNK        PAGING_HUGE // Unit of work when copying or populating on several threads
+
+#ifdef __linux__
+#   ifndef MADV_POPULATE_READ
+#       define MADV_POPULATE_READ 22
+#   endif
+#   ifndef MAP_HUGE_SHIFT
+#       define MAP_HUGE_SHIFT 26
+#   endif
+#   ifndef MAP_HUGE_2MB
+#       define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#   endif
+#endif
+
+namespace dsc
+{
+    static const struct
+    {
+        const char *name;
+        uint32_t flag;
+    } paging_flags[] =
+    {
+        { "thp",     PAGING_THP     },
+        { "hot",     PAGING_HOT     },
+        { "hugetlb", PAGING_HUGETLB },
+    };
+
+    static const char *const paging_prefetches[] =
+    {
+        "none", "willneed", "populate", "random", "sequential",
+    };
+
+    bool paging_parse(const char *spec, paging_t &out)
+    {
+        paging_t p;
+        const char *s = spec;
+        while(*s)
+        {
+            const char *end = strchr(s, ',');
+            size_t len = end ? (size_t)(end - s) : strlen(s);
+            std::string word(s, len);
+            bool known = word.empty() || word == "none";
+            for(const auto &f : paging_flags)
+            {
+                if(word == f.name)
+                {
+                    p.flags |= f.flag;
+                    known = true;
+                }
+            }
+            for(uint32_t i = 1; i < sizeof(paging_prefetches)/sizeof(paging_prefetches[0]); ++i)
+            {
+                if(word == paging_prefetches[i])
+                {
+                    p.prefetch = i;
+                    known = true;
+                }
+            }
+            if(word.compare(0, 4, "hot=") == 0)
+            {
+                char *e;
+                unsigned long long mib = strtoull(word.c_str() + 4, &e, 0);
+                known = *e == '\0' && mib != 0 && e != word.c_str() + 4;
+                p.flags |= PAGING_HOT;
+                p.hot_max = (uint64_t)mib << 20;
+            }
+            if(!known)
+            {
+                ERR("Bad paging policy in %s: %s", spec, word.c_str());
+                return false;
+            }
+            s += len + (end ? 1 : 0);
+        }
+        out = p;
+        return true;
+    }
+
+    const paging_t& paging_env(void)
+    {
+        static paging_t p = []
+        {
+            paging_t v;
+            const char *env = getenv("DSC_PAGING");
+            if(env && !paging_parse(env, v))
+            {
+                WRN("Ignoring DSC_PAGING");
+            }
+            return v;
+        }();
+        return p;
+    }
+
+    std::string paging_describe(const paging_t &p)
+    {
+        std::string s;
+        for(const auto &f : paging_flags)
+        {
+            if((p.flags & f.flag) && !(f.flag == PAGING_HOT && p.hot_max))
+            {
+                s += s.empty() ? "" : ",";
+                s += f.name;
+            }
+        }
+        if(p.hot_max)
+        {
+            s += s.empty() ? "" : ",";
+            s += "hot=" + std::to_string(p.hot_max >> 20);
+        }
+        if(p.prefetch != PREFETCH_NONE && p.prefetch < sizeof(paging_prefetches)/sizeof(paging_prefetches[0]))
+        {
+            s += s.empty() ? "" : ",";
+            s += paging_prefetches[p.prefetch];
+        }
+        return s.empty() ? "none" : s;
+    }
+
+    // Reserves size bytes of address space starting on a huge page boundary.
+    static uint8_t* paging_reserve(size_t size, int prot)
+    {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE),
+               len = size + PAGING_HUGE;
+        void *res = mmap(NULL, len, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(res == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        uintptr_t lo = (uintptr_t)res,
+                  at = (lo + PAGING_HUGE - 1) & ~(uintptr_t)(PAGING_HUGE - 1),
+                  tail = at + ((size + page - 1) & ~(page - 1)),
+                  hi = lo + ((len + page - 1) & ~(page - 1));
+        if(at > lo)
+        {
+            munmap(res, at - lo);
+        }
+        if(hi > tail)
+        {
+            munmap((void*)tail, hi - tail);
+        }
+        return (uint8_t*)at;
+    }
+
+    static void paging_populate(const uint8_t *mem, size_t size)
+    {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        parallel_for((size + PAGING_CHUNK - 1) / PAGING_CHUNK, [&](size_t i, size_t)
+        {
+            const uint8_t *p = mem + i * PAGING_CHUNK;
+            size_t len = std::min((size_t)PAGING_CHUNK, size - i * PAGING_CHUNK);
+#ifdef __linux__
+            if(madvise((void*)p, len, MADV_POPULATE_READ) == 0)
+            {
+                return;
+            }
+#endif
+            uint8_t sum = 0;
+            for(size_t off = 0; off < len; off += page)
+            {
+                sum += ((const volatile uint8_t*)p)[off];
+            }
+            (void)sum;
+        });
+    }
+
+    void* paging_map(int fd, size_t size, const paging_t &p)
+    {
+#ifdef MADV_HUGEPAGE
+        if(p.flags & PAGING_THP)
+        {
+            uint8_t *at = paging_reserve(size, PROT_NONE);
+            if(!at)
+            {
+                return MAP_FAILED;
+            }
+            void *mem = mmap(at, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+            if(mem == MAP_FAILED)
+            {
+                int err = errno;
+                munmap(at, size);
+                errno = err;
+                return MAP_FAILED;
+            }
+            madvise(mem, size, MADV_HUGEPAGE);
+            return mem;
+        }
+#else
+        (void)p;
+#endif
+        return mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    void paging_prefetch(const uint8_t *mem, size_t size, const paging_t &p)
+    {
+        switch(p.prefetch)
+        {
+            case PREFETCH_WILLNEED:
+                madvise((void*)mem, size, MADV_WILLNEED);
+                break;
+            case PREFETCH_POPULATE:
+                paging_populate(mem, size);
+                break;
+            case PREFETCH_RANDOM:
+                madvise((void*)mem, size, MADV_RANDOM);
+                break;
+            case PREFETCH_SEQUENTIAL:
+                madvise((void*)mem, size, MADV_SEQUENTIAL);
+                break;
+        }
+    }
+
+    const uint8_t* paging_copy(const uint8_t *src, size_t size, bool want_hugetlb, bool *hugetlb)
+    {
+        size_t len = (size + PAGING_HUGE - 1) & ~(size_t)(PAGING_HUGE - 1);
+        uint8_t *mem = nullptr;
+        *hugetlb = false;
+#ifdef MAP_HUGETLB
+        if(want_hugetlb)
+        {
+            // Pages are reserved at mmap time, so a short pool fails here rather than on a fault later
+            void *m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+            if(m != MAP_FAILED)
+            {
+                mem = (uint8_t*)m;
+                *hugetlb = true;
+            }
+        }
+#else
+        (void)want_hugetlb;
+#endif
+        if(!mem)
+        {
+            mem = paging_reserve(len, PROT_READ | PROT_WRITE);
+            if(!mem)
+            {
+                return nullptr;
+            }
+#ifdef MADV_HUGEPAGE
+            madvise(mem, len, MADV_HUGEPAGE);
+#endif
+        }
+        parallel_for(len / PAGING_CHUNK, [&](size_t i, size_t)
+        {
+            size_t off = i * PAGING_CHUNK;
+            if(off < size)
+            {
+                memcpy(mem + off, src + off, std::min((size_t)PAGING_CHUNK, size - off));
+            }
+        });
+        mprotect(mem, len, PROT_READ);
+        return mem;
+    }
+
+    void paging_unmap(const uint8_t *mem, size_t size)
+    {
+        munmap((void*)mem, (size + PAGING_HUGE - 1) & ~(size_t)(PAGING_HUGE - 1));
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef DSC_PAGING_H
+#define DSC_PAGING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// paging_t flags
+#define PAGING_THP          0x1     // Map cache files 2 MiB aligned, with MADV_HUGEPAGE
+#define PAGING_HOT          0x2     // Copy read-only mappings (LINKEDIT) into anonymous memory backed by transparent huge pages
+#define PAGING_HUGETLB      0x4     // Same, from the hugetlb pool, falling back to PAGING_HOT when it runs dry
+
+// paging_t::prefetch
+#define PREFETCH_NONE       0       // Leave it to the kernel
+#define PREFETCH_WILLNEED   1       // MADV_WILLNEED: start reading the files in the background
+#define PREFETCH_POPULATE   2       // Fault in the page tables for the files up front (MADV_POPULATE_READ)
+#define PREFETCH_RANDOM     3       // MADV_RANDOM: no readahead around faults
+#define PREFETCH_SEQUENTIAL 4       // MADV_SEQUENTIAL: aggressive readahead, pages dropped early
+
+namespace dsc
+{
+    // How a cache's files are mapped and paged in. Lookups jump all over a
+    // multi-GB cache, so with 4 KiB pages nearly every one of them misses the
+    // TLB. Huge pages cover the same data with 512x fewer entries: either the
+    // file mapping itself (which needs a filesystem and kernel that can put
+    // file data in huge pages), or a private copy of the read-only mappings,
+    // which hold the export tries, symbol tables and strings everything looks
+    // up. Copies only replace what cache_t::ptr() and span() hand out; the
+    // file stays mapped and its bytes are identical, so nothing else changes.
+    //
+    // Set with DSC_PAGING, a comma-separated list of: none, thp, hot, hugetlb,
+    // hot=<MiB> (copy at most that much), willneed, populate, random,
+    // sequential. Linux only, everywhere else copies are plain memory and the
+    // hints that don't exist are skipped.
+    struct paging_t
+    {
+        uint32_t flags = 0;         // PAGING_*
+        uint32_t prefetch = PREFETCH_NONE;
+        uint64_t hot_max = 0;       // Bytes to copy at most, 0 for all of them
+    };
+
+    // Parses a DSC_PAGING list, false (and a message) on anything it doesn't know.
+    bool paging_parse(const char *spec, paging_t &out);
+    // DSC_PAGING, parsed once. Unset or malformed means the default, no policy.
+    const paging_t& paging_env(void);
+    // Canonical form of a policy, as paging_parse takes it.
+    std::string paging_describe(const paging_t &p);
+
+    // Maps size bytes of fd read-only, 2 MiB aligned with PAGING_THP. MAP_FAILED on error.
+    void* paging_map(int fd, size_t size, const paging_t &p);
+    // Applies the prefetch hint to a mapping made by paging_map. Populating is spread over jobs() threads.
+    void paging_prefetch(const uint8_t *mem, size_t size, const paging_t &p);
+
+    // Read-only copy of size bytes at src in huge page memory, made on jobs() threads. Unmap with paging_unmap.
+    // *hugetlb says whether it came from the hugetlb pool. NULL on error.
+    const uint8_t* paging_copy(const uint8_t *src, size_t size, bool want_hugetlb, bool *hugetlb);
+    void paging_unmap(const uint8_t *mem, size_t size);
+}
+
+#endif
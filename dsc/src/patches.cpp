@@ -0,0 +1,580 @@
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+#include "headers.h"
+#include "index.h"
+#include "modes.h"
+#include "patches.h"
+
+// The patch table lists, for every image, the exports other images bind to
+// and where those binds ended up, so dyld can repoint them when a root
+// replaces the image. v1 keeps a flat list of locations per export. v2 went
+// client-major (exporting image, then client, then export, then locations)
+// with offsets relative to the images involved, v3 added uniqued GOT slots,
+// which belong to no single client, and v4 widened the addend. Each exporting
+// image's part is decoded on its own, in parallel, and everything comes out
+// as one list of exports with their uses. Clients are read from the table
+// where it has them and looked up by address otherwise.
+//
+// Index file, everything little endian and 8-byte aligned so it can be used straight from mmap:
+//
+//   patches_index_header_t
+//   patches_index_image_t  images[nimages]
+//   patches_index_export_t exports[nexports]   sorted by name, then exporting image
+//   patches_t::use_t       uses[nuses]         each export's together, sorted by address
+//   char                   strings[strsize]
+#define PATCHES_INDEX_MAGIC     0x42435344 // "DSCB"
+#define PATCHES_INDEX_VERSION   1
+
+namespace dsc
+{
+    struct patch_span_t
+    {
+        uint64_t lo;
+        uint64_t hi;
+        uint32_t image;
+    };
+
+    // Image whose segments (LINKEDIT aside, which they all share) hold addr, PATCH_NONE if none does.
+    static uint32_t patch_owner(const std::vector<patch_span_t> &spans, uint64_t addr)
+    {
+        auto it = std::upper_bound(spans.begin(), spans.end(), addr, [](uint64_t a, const patch_span_t &s)
+        {
+            return a < s.lo;
+        });
+        return it != spans.begin() && addr < (it - 1)->hi ? (it - 1)->image : PATCH_NONE;
+    }
+
+    // count entries of T at addr, false if they aren't all mapped.
+    template<typename T>
+    static bool patch_arr(const cache_t &cache, uint64_t addr, uint64_t count, const T *&out)
+    {
+        out = nullptr;
+        if(count == 0)
+        {
+            return true;
+        }
+        if(count > UINT64_MAX / sizeof(T))
+        {
+            return false;
+        }
+        out = (const T*)cache.ptr(addr, count * sizeof(T));
+        return out != nullptr;
+    }
+
+    // Location bits of version v (v1's shifted down by 32) into a use.
+    static patches_t::use_t patch_use(uint32_t v, uint64_t addr, uint32_t image, uint32_t bits)
+    {
+        patches_t::use_t u = { addr, image, 0, 0, 0, 0, 0 };
+        if(v >= 4)
+        {
+            u.high7 = (uint8_t)PATCH_LOC4_HIGH7(bits);
+            u.flags = (PATCH_LOC4_WEAK(bits) ? PATCH_WEAK : 0);
+            if(PATCH_LOC4_AUTH(bits))
+            {
+                u.flags |= PATCH_AUTH | (PATCH_LOC4_DIVERSITY(bits) ? PATCH_DIVERSITY : 0);
+                u.key = PATCH_LOC4_KEY_IS_D(bits) ? 2 : 0;
+                u.disc = (uint16_t)PATCH_LOC4_DISC(bits);
+            }
+            else
+            {
+                u.addend = PATCH_LOC4_ADDEND(bits);
+            }
+        }
+        else
+        {
+            u.addend = PATCH_LOC2_ADDEND(bits);
+            u.high7 = (uint8_t)PATCH_LOC2_HIGH7(bits);
+            if(PATCH_LOC2_AUTH(bits))
+            {
+                u.flags = PATCH_AUTH | (PATCH_LOC2_DIVERSITY(bits) ? PATCH_DIVERSITY : 0);
+                u.key = (uint8_t)PATCH_LOC2_KEY(bits);
+                u.disc = (uint16_t)PATCH_LOC2_DISC(bits);
+            }
+        }
+        return u;
+    }
+
+    // Export name at off in the names blob, empty if it runs off the end.
+    static const char* patch_name(const char *names, uint64_t size, uint32_t off)
+    {
+        return off < size && memchr(names + off, '\0', size - off) ? names + off : "";
+    }
+
+    // One exporting image's part of the table.
+    struct patch_part_t
+    {
+        std::vector<patches_t::export_t> exports;   // first is relative to uses
+        std::vector<patches_t::use_t> uses;
+    };
+
+    // Groups uses tagged with the index of their export in part.exports and sets the exports' ranges.
+    static void patch_group(patch_part_t &part, std::vector<std::pair<uint32_t, patches_t::use_t>> &tagged)
+    {
+        std::sort(tagged.begin(), tagged.end(), [](const std::pair<uint32_t, patches_t::use_t> &a, const std::pair<uint32_t, patches_t::use_t> &b)
+        {
+            return a.first != b.first ? a.first < b.first : a.second.addr < b.second.addr;
+        });
+        part.uses.reserve(tagged.size());
+        for(const std::pair<uint32_t, patches_t::use_t> &t : tagged)
+        {
+            patches_t::export_t &e = part.exports[t.first];
+            if(e.count == 0)
+            {
+                e.first = (uint32_t)part.uses.size();
+            }
+            ++e.count;
+            part.uses.push_back(t.second);
+        }
+    }
+
+    static bool patch_v1(const cache_t &cache, const std::vector<patch_span_t> &spans, std::vector<patch_part_t> &parts)
+    {
+        const dyld_cache_patch_info_v1 *info = (const dyld_cache_patch_info_v1*)cache.ptr(cache.header()->patchInfoAddr, sizeof(dyld_cache_patch_info_v1));
+        const dyld_cache_image_patches_v1 *images;
+        const dyld_cache_image_export_v1 *exports;
+        const dyld_cache_patchable_location_v1 *locs;
+        const char *names;
+        if(!info ||
+           !patch_arr(cache, info->patchTableArrayAddr, info->patchTableArrayCount, images) ||
+           !patch_arr(cache, info->patchExportArrayAddr, info->patchExportArrayCount, exports) ||
+           !patch_arr(cache, info->patchLocationArrayAddr, info->patchLocationArrayCount, locs) ||
+           !patch_arr(cache, info->patchExportNamesAddr, info->patchExportNamesSize, names))
+        {
+            return false;
+        }
+        uint64_t base = cache.mappings[0].addr;
+        parts.resize(std::min<uint64_t>(info->patchTableArrayCount, cache.images.size()));
+        std::atomic<bool> bad(false);
+        parallel_for(parts.size(), [&](size_t i, size_t)
+        {
+            const dyld_cache_image_patches_v1 &ip = images[i];
+            if((uint64_t)ip.patchExportsStartIndex + ip.patchExportsCount > info->patchExportArrayCount)
+            {
+                bad = true;
+                return;
+            }
+            patch_part_t &part = parts[i];
+            for(uint32_t j = 0; j < ip.patchExportsCount; ++j)
+            {
+                const dyld_cache_image_export_v1 &e = exports[ip.patchExportsStartIndex + j];
+                if((uint64_t)e.patchLocationsStartIndex + e.patchLocationsCount > info->patchLocationArrayCount)
+                {
+                    bad = true;
+                    return;
+                }
+                part.exports.push_back({ base + e.cacheOffsetOfImpl, patch_name(names, info->patchExportNamesSize, e.exportNameOffset), (uint32_t)i, 0,
+                                         (uint32_t)part.uses.size(), e.patchLocationsCount });
+                size_t first = part.uses.size();
+                for(uint32_t k = 0; k < e.patchLocationsCount; ++k)
+                {
+                    uint64_t bits = locs[e.patchLocationsStartIndex + k].bits;
+                    uint64_t addr = base + (bits & 0xffffffff);
+                    part.uses.push_back(patch_use(1, addr, patch_owner(spans, addr), (uint32_t)(bits >> 32)));
+                }
+                std::sort(part.uses.begin() + first, part.uses.end(), [](const patches_t::use_t &a, const patches_t::use_t &b) { return a.addr < b.addr; });
+            }
+        });
+        return !bad;
+    }
+
+    static bool patch_v2(const cache_t &cache, uint32_t version, const std::vector<patch_span_t> &spans, std::vector<patch_part_t> &parts)
+    {
+        size_t isize = version >= 3 ? sizeof(dyld_cache_patch_info_v3) : offsetof(dyld_cache_patch_info_v3, gotClientsArrayAddr);
+        const dyld_cache_patch_info_v3 *info = (const dyld_cache_patch_info_v3*)cache.ptr(cache.header()->patchInfoAddr, isize);
+        const dyld_cache_image_patches_v2 *images;
+        const dyld_cache_image_export_v2 *exports;
+        const dyld_cache_image_clients_v2 *clients;
+        const dyld_cache_patchable_export_v2 *cexports,
+                                             *gexports = nullptr;
+        const dyld_cache_patchable_location_v2 *locs;
+        const dyld_cache_image_got_clients_v3 *gclients = nullptr;
+        const dyld_cache_patchable_location_v3 *glocs = nullptr;
+        const char *names;
+        if(!info ||
+           !patch_arr(cache, info->patchTableArrayAddr, info->patchTableArrayCount, images) ||
+           !patch_arr(cache, info->patchImageExportsArrayAddr, info->patchImageExportsArrayCount, exports) ||
+           !patch_arr(cache, info->patchClientsArrayAddr, info->patchClientsArrayCount, clients) ||
+           !patch_arr(cache, info->patchClientExportsArrayAddr, info->patchClientExportsArrayCount, cexports) ||
+           !patch_arr(cache, info->patchLocationArrayAddr, info->patchLocationArrayCount, locs) ||
+           !patch_arr(cache, info->patchExportNamesAddr, info->patchExportNamesSize, names))
+        {
+            return false;
+        }
+        uint64_t ngclients = 0,
+                 ngexports = 0,
+                 nglocs = 0;
+        if(version >= 3)
+        {
+            ngclients = info->gotClientsArrayCount;
+            ngexports = info->gotClientExportsArrayCount;
+            nglocs = info->gotLocationArrayCount;
+            if(!patch_arr(cache, info->gotClientsArrayAddr, ngclients, gclients) ||
+               !patch_arr(cache, info->gotClientExportsArrayAddr, ngexports, gexports) ||
+               !patch_arr(cache, info->gotLocationArrayAddr, nglocs, glocs))
+            {
+                return false;
+            }
+        }
+        uint64_t base = cache.mappings[0].addr;
+        size_t nimages = cache.images.size();
+        parts.resize(std::min<uint64_t>(info->patchTableArrayCount, nimages));
+        std::atomic<bool> bad(false);
+        parallel_for(parts.size(), [&](size_t i, size_t)
+        {
+            const dyld_cache_image_patches_v2 &ip = images[i];
+            uint64_t start = ip.patchExportsStartIndex;
+            if(start + ip.patchExportsCount > info->patchImageExportsArrayCount ||
+               (uint64_t)ip.patchClientsStartIndex + ip.patchClientsCount > info->patchClientsArrayCount)
+            {
+                bad = true;
+                return;
+            }
+            patch_part_t &part = parts[i];
+            uint64_t impl = cache.images[i].addr;
+            for(uint32_t j = 0; j < ip.patchExportsCount; ++j)
+            {
+                const dyld_cache_image_export_v2 &e = exports[start + j];
+                part.exports.push_back({ impl + e.dylibOffsetOfImpl, patch_name(names, info->patchExportNamesSize, e.bits & 0x0fffffff), (uint32_t)i, e.bits >> 28, 0, 0 });
+            }
+            // Export indices are into the whole array, but always within the image's own exports
+            auto local = [&](uint32_t idx, uint32_t &out)
+            {
+                out = (uint32_t)(idx - start);
+                return idx >= start && out < ip.patchExportsCount;
+            };
+            std::vector<std::pair<uint32_t, patches_t::use_t>> tagged;
+            for(uint32_t c = 0; c < ip.patchClientsCount; ++c)
+            {
+                const dyld_cache_image_clients_v2 &client = clients[ip.patchClientsStartIndex + c];
+                if(client.clientDylibIndex >= nimages || (uint64_t)client.patchExportsStartIndex + client.patchExportsCount > info->patchClientExportsArrayCount)
+                {
+                    bad = true;
+                    return;
+                }
+                uint64_t user = cache.images[client.clientDylibIndex].addr;
+                for(uint32_t j = 0; j < client.patchExportsCount; ++j)
+                {
+                    const dyld_cache_patchable_export_v2 &pe = cexports[client.patchExportsStartIndex + j];
+                    uint32_t idx;
+                    if(!local(pe.imageExportIndex, idx) || (uint64_t)pe.patchLocationsStartIndex + pe.patchLocationsCount > info->patchLocationArrayCount)
+                    {
+                        bad = true;
+                        return;
+                    }
+                    for(uint32_t k = 0; k < pe.patchLocationsCount; ++k)
+                    {
+                        const dyld_cache_patchable_location_v2 &loc = locs[pe.patchLocationsStartIndex + k];
+                        tagged.push_back({ idx, patch_use(version, user + loc.dylibOffsetOfUse, client.clientDylibIndex, loc.bits) });
+                    }
+                }
+            }
+            if(version >= 3 && i < ngclients)
+            {
+                const dyld_cache_image_got_clients_v3 &got = gclients[i];
+                if((uint64_t)got.patchExportsStartIndex + got.patchExportsCount > ngexports)
+                {
+                    bad = true;
+                    return;
+                }
+                for(uint32_t j = 0; j < got.patchExportsCount; ++j)
+                {
+                    const dyld_cache_patchable_export_v2 &pe = gexports[got.patchExportsStartIndex + j];
+                    uint32_t idx;
+                    if(!local(pe.imageExportIndex, idx) || (uint64_t)pe.patchLocationsStartIndex + pe.patchLocationsCount > nglocs)
+                    {
+                        bad = true;
+                        return;
+                    }
+                    for(uint32_t k = 0; k < pe.patchLocationsCount; ++k)
+                    {
+                        const dyld_cache_patchable_location_v3 &loc = glocs[pe.patchLocationsStartIndex + k];
+                        uint64_t addr = base + loc.cacheOffsetOfUse;
+                        patches_t::use_t u = patch_use(version, addr, patch_owner(spans, addr), loc.bits);
+                        u.flags |= PATCH_GOT;
+                        tagged.push_back({ idx, u });
+                    }
+                }
+            }
+            patch_group(part, tagged);
+        });
+        return !bad;
+    }
+
+    bool patches_t::build(const cache_t &cache)
+    {
+        const dyld_cache_header *hdr = cache.header();
+        if(!DSC_HAS_FIELD(hdr, patchInfoSize) || hdr->patchInfoAddr == 0)
+        {
+            return true;
+        }
+        const uint8_t *info = cache.ptr(hdr->patchInfoAddr, sizeof(uint32_t));
+        if(!info)
+        {
+            ERR("Patch table at 0x%llx is not mapped", (unsigned long long)hdr->patchInfoAddr);
+            return false;
+        }
+        // v1 starts with an address, whose low half is never this small
+        uint32_t v;
+        memcpy(&v, info, sizeof(v));
+        this->version = v >= 2 && v <= 4 ? v : 1;
+
+        const headers_t &hdrs = cache.headers();
+        std::vector<patch_span_t> spans;
+        for(uint32_t i = 0; i < cache.images.size(); ++i)
+        {
+            for(const segment_t &seg : hdrs.segments(i))
+            {
+                if(strcmp(seg.name, "__LINKEDIT") != 0 && seg.vmsize != 0)
+                {
+                    spans.push_back({ seg.vmaddr, seg.vmaddr + seg.vmsize, i });
+                }
+            }
+        }
+        std::sort(spans.begin(), spans.end(), [](const patch_span_t &a, const patch_span_t &b) { return a.lo < b.lo; });
+
+        std::vector<patch_part_t> parts;
+        if(!(this->version == 1 ? patch_v1(cache, spans, parts) : patch_v2(cache, this->version, spans, parts)))
+        {
+            ERR("Patch table v%u is malformed", this->version);
+            return false;
+        }
+        size_t nexports = 0,
+               nuses = 0;
+        for(const patch_part_t &p : parts)
+        {
+            nexports += p.exports.size();
+            nuses += p.uses.size();
+        }
+        if(nuses > UINT32_MAX)
+        {
+            ERR("Too many patch locations: %zu", nuses);
+            return false;
+        }
+        this->exports.reserve(nexports);
+        this->uses.reserve(nuses);
+        for(patch_part_t &p : parts)
+        {
+            uint32_t first = (uint32_t)this->uses.size();
+            for(export_t &e : p.exports)
+            {
+                e.first += first;
+                this->exports.push_back(e);
+            }
+            this->uses.insert(this->uses.end(), p.uses.begin(), p.uses.end());
+            p = patch_part_t();
+        }
+        return true;
+    }
+
+    bool patches_index_write(const cache_t &cache, const patches_t &patches, const char *path)
+    {
+        strtab_t str;
+        str.add("");
+        std::vector<patches_index_image_t> images;
+        for(const image_t &img : cache.images)
+        {
+            images.push_back({ img.addr, str.add(img.path), 0 });
+        }
+        std::vector<uint32_t> order(patches.exports.size());
+        for(uint32_t i = 0; i < order.size(); ++i)
+        {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+        {
+            const patches_t::export_t &x = patches.exports[a],
+                                      &y = patches.exports[b];
+            int c = strcmp(x.name, y.name);
+            return c != 0 ? c < 0 : x.image < y.image;
+        });
+        std::vector<patches_index_export_t> exports;
+        std::vector<patches_t::use_t> uses;
+        exports.reserve(order.size());
+        uses.reserve(patches.uses.size());
+        for(uint32_t i : order)
+        {
+            const patches_t::export_t &e = patches.exports[i];
+            exports.push_back({ e.addr, str.add(e.name), e.image, e.kind, (uint32_t)uses.size(), e.count, 0 });
+            uses.insert(uses.end(), patches.uses.begin() + e.first, patches.uses.begin() + e.first + e.count);
+        }
+        while(str.data.size() % 8)
+        {
+            str.data.push_back('\0');
+        }
+        patches_index_header_t hdr = {};
+        hdr.magic = PATCHES_INDEX_MAGIC;
+        hdr.version = PATCHES_INDEX_VERSION;
+        hdr.table = patches.version;
+        hdr.nimages = (uint32_t)images.size();
+        hdr.nexports = (uint32_t)exports.size();
+        hdr.nuses = (uint32_t)uses.size();
+        hdr.strsize = (uint32_t)str.data.size();
+        hdr.off_images = sizeof(hdr);
+        hdr.off_exports = hdr.off_images + hdr.nimages * (uint32_t)sizeof(patches_index_image_t);
+        hdr.off_uses = hdr.off_exports + hdr.nexports * (uint32_t)sizeof(patches_index_export_t);
+        hdr.off_str = hdr.off_uses + hdr.nuses * (uint32_t)sizeof(patches_t::use_t);
+        if((uint64_t)hdr.off_uses + (uint64_t)hdr.nuses * sizeof(patches_t::use_t) + hdr.strsize > UINT32_MAX)
+        {
+            ERR("Patch index would be larger than 4 GiB");
+            return false;
+        }
+
+        FILE *f = fopen(path, "wb");
+        if(!f)
+        {
+            ERR("fopen(%s): %s", path, strerror(errno));
+            return false;
+        }
+        bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+                  fwrite(images.data(), sizeof(patches_index_image_t), images.size(), f) == images.size() &&
+                  fwrite(exports.data(), sizeof(patches_index_export_t), exports.size(), f) == exports.size() &&
+                  fwrite(uses.data(), sizeof(patches_t::use_t), uses.size(), f) == uses.size() &&
+                  fwrite(str.data.data(), 1, str.data.size(), f) == str.data.size();
+        if(fclose(f) != 0 || !ok)
+        {
+            ERR("Failed to write %s", path);
+            return false;
+        }
+        return true;
+    }
+
+    bool patches_index_t::open(const char *path)
+    {
+        if(!this->file.open(path, sizeof(patches_index_header_t)))
+        {
+            return false;
+        }
+        this->hdr = (const patches_index_header_t*)this->file.base;
+        this->images = this->file.arr<patches_index_image_t>(this->hdr->off_images, this->hdr->nimages);
+        this->exports = this->file.arr<patches_index_export_t>(this->hdr->off_exports, this->hdr->nexports);
+        this->uses = this->file.arr<patches_t::use_t>(this->hdr->off_uses, this->hdr->nuses);
+        if(this->hdr->magic != PATCHES_INDEX_MAGIC || this->hdr->version != PATCHES_INDEX_VERSION || !this->images || !this->exports || !this->uses ||
+           (this->hdr->off_images | this->hdr->off_exports | this->hdr->off_uses) % 8 != 0 || !this->file.strtab(this->hdr->off_str, this->hdr->strsize))
+        {
+            ERR("%s: bad patch index", path);
+            return false;
+        }
+        return true;
+    }
+
+    int mode_patches_index(int argc, const char **argv)
+    {
+        if(argc != 3)
+        {
+            fprintf(stderr, "Usage: dsc_util patches-index <path-to-cache> <index-file>\n");
+            return 1;
+        }
+        cache_t cache;
+        if(!cache.open(argv[1]))
+        {
+            return 1;
+        }
+        patches_t patches;
+        if(!patches.build(cache))
+        {
+            return 1;
+        }
+        if(patches.version == 0)
+        {
+            ERR("%s has no patch table", argv[1]);
+            return 1;
+        }
+        if(!patches_index_write(cache, patches, argv[2]))
+        {
+            return 1;
+        }
+        size_t got = 0;
+        for(const patches_t::use_t &u : patches.uses)
+        {
+            got += (u.flags & PATCH_GOT) != 0;
+        }
+        LOG("Patch table v%u: %zu exports, %zu uses, %zu of them in GOTs", patches.version, patches.exports.size(), patches.uses.size(), got);
+        return 0;
+    }
+
+    static const char* patch_kind_name(uint32_t kind)
+    {
+        return kind == 0 ? "" : kind == 1 ? " cfobj2" : kind == 2 ? " objc_class" : " ?";
+    }
+
+    int mode_patches_query(int argc, const char **argv)
+    {
+        if(argc != 3)
+        {
+            fprintf(stderr, "Usage: dsc_util patches-query <index-file> <symbol>|<install-name>\n");
+            return 1;
+        }
+        patches_index_t idx;
+        if(!idx.open(argv[1]))
+        {
+            return 1;
+        }
+        const char *name = argv[2];
+        size_t found = 0;
+        if(name[0] == '/')
+        {
+            // Every export of the image that something binds to, with how many uses and clients
+            uint32_t img = 0;
+            while(img < idx.hdr->nimages && strcmp(idx.image(img), name) != 0)
+            {
+                ++img;
+            }
+            for(uint32_t i = 0; img < idx.hdr->nimages && i < idx.hdr->nexports; ++i)
+            {
+                const patches_index_export_t &e = idx.exports[i];
+                if(e.image != img)
+                {
+                    continue;
+                }
+                auto uses = idx.uses_of(e);
+                std::vector<uint32_t> clients;
+                for(const patches_t::use_t *u = uses.first; u != uses.second; ++u)
+                {
+                    clients.push_back(u->image);
+                }
+                std::sort(clients.begin(), clients.end());
+                size_t nclients = std::unique(clients.begin(), clients.end()) - clients.begin();
+                printf("%s\t0x%llx%s\t%zu uses\t%zu clients\n", idx.str(e.name), (unsigned long long)e.addr, patch_kind_name(e.kind), (size_t)(uses.second - uses.first), nclients);
+                ++found;
+            }
+            return found ? 0 : 1;
+        }
+        auto range = idx.find(name);
+        for(const patches_index_export_t *e = range.first; e != range.second; ++e)
+        {
+            auto uses = idx.uses_of(*e);
+            printf("%s\t0x%llx%s\t%s\t%zu uses\n", idx.str(e->name), (unsigned long long)e->addr, patch_kind_name(e->kind), idx.image(e->image), (size_t)(uses.second - uses.first));
+            for(const patches_t::use_t *u = uses.first; u != uses.second; ++u)
+            {
+                if(u->image < idx.hdr->nimages)
+                {
+                    printf("\t%s\t+0x%llx", idx.image(u->image), (unsigned long long)(u->addr - idx.images[u->image].addr));
+                }
+                else
+                {
+                    printf("\t-\t0x%llx", (unsigned long long)u->addr);
+                }
+                if(u->addend)
+                {
+                    printf("\t+%u", u->addend);
+                }
+                if(u->flags & PATCH_AUTH)
+                {
+                    printf("\tauth(%s, 0x%04x%s)", u->key == 0 ? "IA" : u->key == 1 ? "IB" : u->key == 2 ? "DA" : "DB", u->disc, u->flags & PATCH_DIVERSITY ? ", addr" : "");
+                }
+                printf("%s%s\n", u->flags & PATCH_GOT ? "\tgot" : "", u->flags & PATCH_WEAK ? "\tweak" : "");
+                ++found;
+            }
+            found += uses.first == uses.second;
+        }
+        return found ? 0 : 1;
+    }
+}
@@ -0,0 +1,132 @@
+#ifndef DSC_PATCHES_H
+#define DSC_PATCHES_H
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "cache.h"
+#include "index.h"
+
+#define PATCH_NONE          0xffffffff
+// patches_t::use_t flags
+#define PATCH_AUTH          0x1     // Signed pointer, see key and disc
+#define PATCH_DIVERSITY     0x2     // Signed with address diversity
+#define PATCH_WEAK          0x4     // Weak import (v4 only)
+#define PATCH_GOT           0x8     // Uniqued GOT slot (v3 on), shared by every client of the export
+
+namespace dsc
+{
+    // The cache's patch table turned inside out: every export other images
+    // bind to, with every location that holds a pointer to it. Decoded from
+    // any patch table version into the same shape.
+    struct patches_t
+    {
+        struct export_t
+        {
+            uint64_t addr;          // Of the implementation
+            const char *name;       // Points into the cache
+            uint32_t image;         // Exporting image
+            uint32_t kind;          // v2 on: 0 regular, 1 CF object, 2 ObjC class
+            uint32_t first;         // Range in uses
+            uint32_t count;
+        };
+
+        // Also the index file's use record, written as is.
+        struct use_t
+        {
+            uint64_t addr;          // Of the pointer
+            uint32_t image;         // Client holding it, PATCH_NONE if none does
+            uint32_t addend;
+            uint16_t disc;
+            uint8_t key;            // ptrauth key, 0-3 (IA, IB, DA, DB)
+            uint8_t high7;          // Top bits of tagged pointers
+            uint32_t flags;         // PATCH_*
+        };
+
+        uint32_t version = 0;           // Of the cache's patch table, 0 if it has none
+        std::vector<export_t> exports;  // By exporting image, then in table order
+        std::vector<use_t> uses;        // Each export's sorted by address
+
+        // False if there is a patch table and it doesn't decode.
+        bool build(const cache_t &cache);
+    };
+    static_assert(sizeof(patches_t::use_t) == 24, "use_t is written to the index as is");
+
+    struct patches_index_header_t
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t table;         // Patch table version it was built from
+        uint32_t nimages;
+        uint32_t nexports;
+        uint32_t nuses;
+        uint32_t strsize;
+        uint32_t off_images;    // patches_index_image_t[nimages]
+        uint32_t off_exports;   // patches_index_export_t[nexports], sorted by name
+        uint32_t off_uses;      // patches_t::use_t[nuses]
+        uint32_t off_str;
+        uint32_t pad;
+    };
+
+    struct patches_index_image_t
+    {
+        uint64_t addr;
+        uint32_t name;
+        uint32_t pad;
+    };
+
+    struct patches_index_export_t
+    {
+        uint64_t addr;
+        uint32_t name;
+        uint32_t image;
+        uint32_t kind;
+        uint32_t first;         // Range in uses
+        uint32_t count;
+        uint32_t pad;
+    };
+
+    // Writes the inverted index of patches to path.
+    bool patches_index_write(const cache_t &cache, const patches_t &patches, const char *path);
+
+    // An index file written by patches_index_write, used straight from mmap.
+    struct patches_index_t
+    {
+        mapped_file_t file;
+        const patches_index_header_t *hdr = nullptr;
+        const patches_index_image_t *images = nullptr;
+        const patches_index_export_t *exports = nullptr;
+        const patches_t::use_t *uses = nullptr;
+
+        bool open(const char *path);
+
+        const char* str(uint32_t off) const
+        {
+            return off < this->hdr->strsize ? (const char*)this->file.base + this->hdr->off_str + off : "?";
+        }
+
+        // Every export called name, one per image exporting it.
+        std::pair<const patches_index_export_t*, const patches_index_export_t*> find(const char *name) const
+        {
+            return sorted_range(this->exports, this->hdr->nexports, (const char*)this->file.base + this->hdr->off_str, name);
+        }
+
+        // Uses of an export, clamped to the array.
+        std::pair<const patches_t::use_t*, const patches_t::use_t*> uses_of(const patches_index_export_t &e) const
+        {
+            uint32_t n = this->hdr->nuses,
+                     first = std::min(e.first, n);
+            return { this->uses + first, this->uses + first + std::min(e.count, n - first) };
+        }
+
+        const char* image(uint32_t idx) const
+        {
+            return idx < this->hdr->nimages ? this->str(this->images[idx].name) : "-";
+        }
+    };
+}
+
+#endif
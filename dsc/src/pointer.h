@@ -0,0 +1,276 @@
+#ifndef DSC_POINTER_H
+#define DSC_POINTER_H
+
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+#include "cache.h"
+#include "format.h"
+
+// Pointer encodings in DATA mappings, one type per format. The format is
+// picked once per cache by ptr_dispatch, and everything that touches pointers
+// in bulk is instantiated per type, so the per-pointer work (load width,
+// decoding, chain stepping) compiles down to straight-line code.
+//
+//   ptr_plain_t  No slide info or v1: pointers are stored as plain addresses
+//   ptr_v2_t     x86_64 and arm64
+//   ptr_v3_t     arm64e
+//   ptr_v4_t     armv7k and arm64_32
+//   ptr_v5_t     arm64e, since the split cache
+
+namespace dsc
+{
+    template<typename T>
+    struct ptr_plain_t
+    {
+        typedef T raw_t;
+        static const bool chained = false;
+        static const bool paged4 = false;   // Page starts are in 4-byte units and may use extras
+
+        uint64_t decode(raw_t raw) const { return raw; }
+        uint64_t next(raw_t) const { return 0; }
+    };
+
+    struct ptr_v2_t
+    {
+        typedef uint64_t raw_t;
+        static const bool chained = true;
+        static const bool paged4 = true;
+        uint64_t mask;
+        uint64_t add;
+        unsigned shift;
+
+        uint64_t decode(raw_t raw) const
+        {
+            uint64_t v = raw & ~this->mask;
+            return v ? v + this->add : 0;
+        }
+        uint64_t next(raw_t raw) const { return (raw & this->mask) >> this->shift; }
+    };
+
+    struct ptr_v3_t
+    {
+        typedef uint64_t raw_t;
+        static const bool chained = true;
+        static const bool paged4 = false;
+        uint64_t add;   // auth_value_add
+
+        uint64_t decode(raw_t raw) const
+        {
+            if(raw >> 63)
+            {
+                return (raw & 0xffffffffULL) + this->add;
+            }
+            return ((raw & 0x0007f80000000000ULL) << 13) | (raw & 0x000007ffffffffffULL);
+        }
+        uint64_t next(raw_t raw) const { return ((raw >> 51) & 0x7ff) * 8; }
+    };
+
+    struct ptr_v4_t
+    {
+        typedef uint32_t raw_t;
+        static const bool chained = true;
+        static const bool paged4 = true;
+        uint64_t mask;
+        uint64_t add;
+        unsigned shift;
+
+        uint64_t decode(raw_t raw) const
+        {
+            uint32_t v = (uint32_t)(raw & ~this->mask);
+            // Small values are stored as-is and must not be rebased
+            if((v & 0xffff8000) == 0)
+            {
+                return v;
+            }
+            if((v & 0x3fff8000) == 0x3fff8000)
+            {
+                return v | 0xc0000000;
+            }
+            return (uint32_t)(v + this->add);
+        }
+        uint64_t next(raw_t raw) const { return (raw & this->mask) >> this->shift; }
+    };
+
+    struct ptr_v5_t
+    {
+        typedef uint64_t raw_t;
+        static const bool chained = true;
+        static const bool paged4 = false;
+        uint64_t add;   // value_add
+
+        uint64_t decode(raw_t raw) const
+        {
+            uint64_t v = (raw & 0x3ffffffffULL) + this->add;
+            if(!(raw >> 63))
+            {
+                v |= ((raw >> 34) & 0xff) << 56;
+            }
+            return v;
+        }
+        uint64_t next(raw_t raw) const { return ((raw >> 52) & 0x7ff) * 8; }
+    };
+
+    // Calls fn(fmt) with the format object for the cache's pointers and returns its result.
+    template<typename F>
+    auto ptr_dispatch(const cache_t &cache, F &&fn) -> decltype(fn(ptr_plain_t<uint64_t>()))
+    {
+        unsigned shift = cache.slide_mask ? __builtin_ctzll(cache.slide_mask) - 2 : 0;
+        switch(cache.slide_version)
+        {
+            case 2: return fn(ptr_v2_t{ cache.slide_mask, cache.slide_add, shift });
+            case 3: return fn(ptr_v3_t{ cache.slide_add });
+            case 4: return fn(ptr_v4_t{ cache.slide_mask, cache.slide_add, shift });
+            case 5: return fn(ptr_v5_t{ cache.slide_add });
+        }
+        if(cache.ptrsize == 8)
+        {
+            return fn(ptr_plain_t<uint64_t>());
+        }
+        return fn(ptr_plain_t<uint32_t>());
+    }
+
+    // Calls fn(addr, raw) for every slid pointer in [start, end) of mapping m,
+    // following the slide info chains. Returns false if m has no walkable slide info.
+    template<typename P, typename F>
+    bool ptr_walk(const mapping_t &m, const P &fmt, uint64_t start, uint64_t end, F &&fn)
+    {
+        typedef typename P::raw_t raw_t;
+        if(!P::chained || !m.slide || end <= m.addr || start >= m.addr + m.size)
+        {
+            return false;
+        }
+        uint64_t pagesize,
+                 npages;
+        const uint16_t *starts,
+                       *extras = nullptr;
+        uint64_t nextras = 0;
+        if constexpr(P::paged4)
+        {
+            const dyld_cache_slide_info2 *si = (const dyld_cache_slide_info2*)m.slide;
+            if(m.slide_size < sizeof(*si))
+            {
+                return false;
+            }
+            pagesize = si->page_size;
+            npages = si->page_starts_count;
+            if(si->page_starts_offset > m.slide_size || (m.slide_size - si->page_starts_offset) / sizeof(uint16_t) < npages ||
+               si->page_extras_offset > m.slide_size || (m.slide_size - si->page_extras_offset) / sizeof(uint16_t) < si->page_extras_count)
+            {
+                return false;
+            }
+            starts = (const uint16_t*)(m.slide + si->page_starts_offset);
+            extras = (const uint16_t*)(m.slide + si->page_extras_offset);
+            nextras = si->page_extras_count;
+            if(si->delta_mask == 0)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            const dyld_cache_slide_info3 *si = (const dyld_cache_slide_info3*)m.slide;
+            if(m.slide_size < sizeof(*si))
+            {
+                return false;
+            }
+            pagesize = si->page_size;
+            npages = si->page_starts_count;
+            if((m.slide_size - sizeof(*si)) / sizeof(uint16_t) < npages)
+            {
+                return false;
+            }
+            starts = (const uint16_t*)(si + 1);
+        }
+        if(pagesize == 0)
+        {
+            return false;
+        }
+
+        uint64_t first = start > m.addr ? (start - m.addr) / pagesize : 0,
+                 last = std::min<uint64_t>((std::min(end, m.addr + m.size) - m.addr + pagesize - 1) / pagesize, npages);
+        auto chain = [&](uint64_t page, uint64_t off)
+        {
+            while(off + sizeof(raw_t) <= pagesize && page + off + sizeof(raw_t) <= m.size)
+            {
+                raw_t raw;
+                memcpy(&raw, m.data + page + off, sizeof(raw));
+                uint64_t addr = m.addr + page + off;
+                if(addr >= start && addr < end)
+                {
+                    fn(addr, raw);
+                }
+                uint64_t delta = fmt.next(raw);
+                if(delta == 0)
+                {
+                    break;
+                }
+                off += delta;
+            }
+        };
+        for(uint64_t i = first; i < last; ++i)
+        {
+            uint16_t s = starts[i];
+            uint64_t page = i * pagesize;
+            if constexpr(P::paged4)
+            {
+                // v2 and v4 flag pages differently, the raw type tells them apart
+                const bool v4 = sizeof(raw_t) == 4;
+                if(v4 ? s == DYLD_CACHE_SLIDE4_PAGE_NO_REBASE : (s & DYLD_CACHE_SLIDE_PAGE_ATTR_NO_REBASE) != 0)
+                {
+                    continue;
+                }
+                const uint16_t idxmask = v4 ? 0x7fff : 0x3fff;
+                if(s & (v4 ? DYLD_CACHE_SLIDE4_PAGE_USE_EXTRA : DYLD_CACHE_SLIDE_PAGE_ATTR_EXTRA))
+                {
+                    for(uint64_t j = s & idxmask; j < nextras; ++j)
+                    {
+                        chain(page, (uint64_t)(extras[j] & idxmask) * 4);
+                        if(extras[j] & (v4 ? DYLD_CACHE_SLIDE4_PAGE_EXTRA_END : DYLD_CACHE_SLIDE_PAGE_ATTR_END))
+                        {
+                            break;
+                        }
+                    }
+                }
+                else
+                {
+                    chain(page, (uint64_t)s * 4);
+                }
+            }
+            else if(s != DYLD_CACHE_SLIDE_V3_PAGE_ATTR_NO_REBASE)
+            {
+                chain(page, s);
+            }
+        }
+        return true;
+    }
+
+    // ptr_walk over every mapping intersecting [start, end). False if one of them can't be walked.
+    template<typename P, typename F>
+    bool ptr_walk(const cache_t &cache, const P &fmt, uint64_t start, uint64_t end, F &&fn)
+    {
+        auto it = std::upper_bound(cache.mappings.begin(), cache.mappings.end(), start, [](uint64_t a, const mapping_t &m)
+        {
+            return a < m.addr;
+        });
+        if(it != cache.mappings.begin())
+        {
+            --it;
+        }
+        for(; it != cache.mappings.end() && it->addr < end; ++it)
+        {
+            if(start >= it->addr + it->size || !it->slide)
+            {
+                continue;
+            }
+            if(!ptr_walk(*it, fmt, start, end, fn))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+#endif
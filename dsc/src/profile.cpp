@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+
+#ifdef __APPLE__
+#   include <malloc/malloc.h>
+#else
+#   include <malloc.h>
+#endif
+
+#include "common.h"
+#include "profile.h"
+
+// Sizes are what the allocator actually handed out (malloc_usable_size), on
+// both sides, so frees balance allocations whatever size delete is told.
+// Each thread keeps its counts in a plain thread_local and adds them to the
+// current phase every PROFILE_BATCH events, when an image scope ends, and
+// when the thread exits (through a pthread key destructor, which runs before
+// join returns, so a phase is complete once parallel_for is). Heap in use is
+// bytes allocated minus bytes freed since profile_init, and its peak per phase
+// is sampled at those hand-overs, so it can be a batch per thread short.
+// Per-image cost is the highest the working thread's own heap got over what
+// it was when the image started, which is what an image adds to a worker.
+//
+// Peak RSS per phase is VmHWM, reset at the start of each phase by writing 5
+// to /proc/self/clear_refs. Where that's not possible (not Linux, or no
+// procfs) it's the peak since the process started.
+
+#define PROFILE_PHASES      32      // Phases past this many are counted into the last one
+#define PROFILE_BATCH       256     // Events a thread counts before handing them over
+
+namespace dsc
+{
+    // Zero-initialized and without a destructor, so it's safe to touch from operator new at any point in a thread's life.
+    struct profile_thread_t
+    {
+        uint64_t allocs;        // Not handed over yet
+        uint64_t frees;
+        uint64_t bytes;
+        uint64_t freed;
+        uint64_t total_allocs;  // Since the thread started, for image scopes
+        uint64_t total_bytes;
+        int64_t live;           // Allocated minus freed on this thread
+        int64_t peak;           // Highest live since the current image scope started
+        uint32_t pending;
+        bool registered;        // With the key that hands counts over on exit
+    };
+
+    struct profile_phase_t
+    {
+        const char *name;
+        std::atomic<uint64_t> allocs;
+        std::atomic<uint64_t> frees;
+        std::atomic<uint64_t> bytes;
+        std::atomic<int64_t> peak;      // Heap in use
+        double secs;
+        long rss;                       // Peak, KiB
+    };
+
+    struct profile_img_t
+    {
+        uint64_t allocs;
+        uint64_t bytes;
+        int64_t peak;
+        bool seen;
+    };
+
+    bool profile_on = false;
+    static size_t profile_top = 0;
+    static bool profile_hwm = false;    // Peak RSS can be reset per phase
+    static pthread_key_t profile_key;
+    static profile_phase_t profile_phases[PROFILE_PHASES];
+    static std::atomic<uint32_t> profile_cur(0);
+    static std::atomic<int64_t> profile_live(0);
+    static std::chrono::steady_clock::time_point profile_start;
+    static std::vector<profile_img_t> profile_imgs;
+    static std::vector<std::string> profile_names;   // Copied, the report usually comes after the cache is gone
+    static thread_local profile_thread_t profile_tls;
+
+    static size_t profile_size(void *p)
+    {
+#ifdef __APPLE__
+        return malloc_size(p);
+#else
+        return malloc_usable_size(p);
+#endif
+    }
+
+    static void profile_flush(profile_thread_t &t)
+    {
+        profile_phase_t &ph = profile_phases[profile_cur.load(std::memory_order_relaxed)];
+        ph.allocs.fetch_add(t.allocs, std::memory_order_relaxed);
+        ph.frees.fetch_add(t.frees, std::memory_order_relaxed);
+        ph.bytes.fetch_add(t.bytes, std::memory_order_relaxed);
+        int64_t delta = (int64_t)t.bytes - (int64_t)t.freed,
+                live = profile_live.fetch_add(delta, std::memory_order_relaxed) + delta,
+                peak = ph.peak.load(std::memory_order_relaxed);
+        while(live > peak && !ph.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+        {
+        }
+        t.allocs = 0;
+        t.frees = 0;
+        t.bytes = 0;
+        t.freed = 0;
+        t.pending = 0;
+    }
+
+    static void profile_exit(void *arg)
+    {
+        profile_flush(*(profile_thread_t*)arg);
+    }
+
+    static profile_thread_t& profile_thread(void)
+    {
+        profile_thread_t &t = profile_tls;
+        if(!t.registered)
+        {
+            t.registered = true;
+            pthread_setspecific(profile_key, &t);
+        }
+        return t;
+    }
+
+    void profile_alloc(void *p)
+    {
+        size_t n = profile_size(p);
+        profile_thread_t &t = profile_thread();
+        ++t.allocs;
+        ++t.total_allocs;
+        t.bytes += n;
+        t.total_bytes += n;
+        t.live += (int64_t)n;
+        t.peak = std::max(t.peak, t.live);
+        if(++t.pending >= PROFILE_BATCH)
+        {
+            profile_flush(t);
+        }
+    }
+
+    void profile_free(void *p)
+    {
+        size_t n = profile_size(p);
+        profile_thread_t &t = profile_thread();
+        ++t.frees;
+        t.freed += n;
+        t.live -= (int64_t)n;
+        if(++t.pending >= PROFILE_BATCH)
+        {
+            profile_flush(t);
+        }
+    }
+
+    // Peak RSS in KiB, since the last reset where there is one.
+    static long profile_rss(void)
+    {
+        long kib = -1;
+        FILE *f = fopen("/proc/self/status", "r");
+        if(f)
+        {
+            char line[256];
+            while(fgets(line, sizeof(line), f))
+            {
+                if(strncmp(line, "VmHWM:", 6) == 0)
+                {
+                    kib = strtol(line + 6, nullptr, 10);
+                    break;
+                }
+            }
+            fclose(f);
+        }
+        if(kib < 0)
+        {
+            struct rusage ru;
+            getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+            kib = ru.ru_maxrss / 1024;
+#else
+            kib = ru.ru_maxrss;
+#endif
+        }
+        return kib;
+    }
+
+    static bool profile_rss_reset(void)
+    {
+        FILE *f = fopen("/proc/self/clear_refs", "w");
+        if(!f)
+        {
+            return false;
+        }
+        bool ok = fputs("5", f) >= 0;
+        return fclose(f) == 0 && ok;
+    }
+
+    // Closes the current phase and opens the next one, if there's room for it.
+    static void profile_next(const char *name)
+    {
+        profile_flush(profile_thread());
+        uint32_t cur = profile_cur.load(std::memory_order_relaxed);
+        profile_phase_t &ph = profile_phases[cur];
+        auto now = std::chrono::steady_clock::now();
+        ph.secs += std::chrono::duration<double>(now - profile_start).count();
+        ph.rss = std::max(ph.rss, profile_rss());
+        profile_start = now;
+        if(!name)
+        {
+            return;
+        }
+        if(profile_hwm)
+        {
+            profile_rss_reset();
+        }
+        if(cur + 1 < PROFILE_PHASES)
+        {
+            profile_phase_t &next = profile_phases[cur + 1];
+            next.name = name;
+            next.peak.store(profile_live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            profile_cur.store(cur + 1, std::memory_order_relaxed);
+        }
+    }
+
+    bool profile_init(const char *name)
+    {
+        const char *env = getenv("DSC_PROFILE");
+        if(!env || strcmp(env, "0") == 0)
+        {
+            return false;
+        }
+        char *end;
+        unsigned long n = strtoul(env, &end, 0);
+        if(*end != '\0' || n == 0)
+        {
+            WRN("Ignoring DSC_PROFILE=%s, expected the number of images to report", env);
+            return false;
+        }
+        if(pthread_key_create(&profile_key, profile_exit) != 0)
+        {
+            WRN("Can't profile, no thread key");
+            return false;
+        }
+        profile_top = n;
+        profile_hwm = profile_rss_reset();
+        profile_phases[0].name = name;
+        profile_start = std::chrono::steady_clock::now();
+        profile_on = true;
+        return true;
+    }
+
+    void profile_phase(const char *name)
+    {
+        if(profile_on)
+        {
+            profile_next(name);
+        }
+    }
+
+    void profile_images(const std::vector<const char*> &names)
+    {
+        if(profile_on)
+        {
+            profile_names.assign(names.begin(), names.end());
+            profile_imgs.assign(names.size(), profile_img_t());
+        }
+    }
+
+    void profile_report(void)
+    {
+        if(!profile_on)
+        {
+            return;
+        }
+        profile_next(nullptr);
+        profile_on = false;
+
+        LOG("Profile (peak RSS %s):", profile_hwm ? "per phase" : "since start");
+        LOG("    %-16s %9s %10s %10s %10s %13s %12s", "phase", "seconds", "allocs", "frees", "alloc MiB", "peak heap MiB", "peak RSS MiB");
+        for(uint32_t i = 0; i <= profile_cur.load(std::memory_order_relaxed); ++i)
+        {
+            const profile_phase_t &ph = profile_phases[i];
+            LOG("    %-16s %9.3f %10llu %10llu %10.1f %13.1f %12.1f", ph.name, ph.secs, (unsigned long long)ph.allocs.load(), (unsigned long long)ph.frees.load(),
+                ph.bytes.load() / 1048576.0, ph.peak.load() / 1048576.0, ph.rss / 1024.0);
+        }
+
+        std::vector<size_t> order;
+        for(size_t i = 0; i < profile_imgs.size(); ++i)
+        {
+            if(profile_imgs[i].seen)
+            {
+                order.push_back(i);
+            }
+        }
+        if(order.empty())
+        {
+            return;
+        }
+        size_t n = std::min(order.size(), profile_top);
+        std::partial_sort(order.begin(), order.begin() + n, order.end(), [](size_t a, size_t b)
+        {
+            const profile_img_t &x = profile_imgs[a],
+                                &y = profile_imgs[b];
+            return x.peak != y.peak ? x.peak > y.peak : x.bytes > y.bytes;
+        });
+        LOG("Top %zu of %zu images by peak heap:", n, order.size());
+        LOG("    %12s %12s %10s  %s", "peak KiB", "alloc KiB", "allocs", "image");
+        for(size_t i = 0; i < n; ++i)
+        {
+            const profile_img_t &img = profile_imgs[order[i]];
+            LOG("    %12.1f %12.1f %10llu  %s", img.peak / 1024.0, img.bytes / 1024.0, (unsigned long long)img.allocs, profile_names[order[i]].c_str());
+        }
+    }
+
+    profile_image_t::profile_image_t(size_t i) : idx(i), allocs(0), bytes(0), live(0)
+    {
+        if(!profile_on)
+        {
+            return;
+        }
+        profile_thread_t &t = profile_thread();
+        this->allocs = t.total_allocs;
+        this->bytes = t.total_bytes;
+        this->live = t.live;
+        t.peak = t.live;
+    }
+
+    profile_image_t::~profile_image_t()
+    {
+        if(!profile_on || this->idx >= profile_imgs.size())
+        {
+            return;
+        }
+        profile_thread_t &t = profile_thread();
+        profile_img_t &img = profile_imgs[this->idx];
+        img.allocs += t.total_allocs - this->allocs;
+        img.bytes += t.total_bytes - this->bytes;
+        img.peak = std::max(img.peak, t.peak - this->live);
+        img.seen = true;
+        profile_flush(t);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef DSC_PROFILE_H
+#define DSC_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace dsc
+{
+    // Opt-in memory profiling, on with DSC_PROFILE=<n>. Tools that link
+    // profile_new.cpp get global operator new and delete replaced, so every
+    // C++ allocation in the process is counted (plain malloc, as in libzstd
+    // or libcurl, isn't, but shows up in RSS). Without it nothing is. Counts go to the current phase, which the main thread names
+    // between stages, and on worker threads also to the image being worked
+    // on. Each phase gets its time, allocations, bytes, peak heap and peak
+    // RSS, and the report ends with the n images that cost the most heap.
+    //
+    // Threads count into their own counters and hand them over in batches,
+    // so an allocation costs a few thread-local adds with profiling on and a
+    // single branch with it off.
+
+    // Turns profiling on if DSC_PROFILE asks for it and starts a phase called name. Before any worker threads exist.
+    bool profile_init(const char *name);
+    // Ends the current phase and starts one called name. Main thread only, between parallel stages.
+    void profile_phase(const char *name);
+    // Install names of the images that profile_image_t attributes to, by index. Before they're worked on.
+    void profile_images(const std::vector<const char*> &names);
+    // Ends the last phase and prints everything on stderr. Does nothing if profiling is off.
+    void profile_report(void);
+
+    // Attributes this thread's allocations to image idx for as long as it lives.
+    struct profile_image_t
+    {
+        explicit profile_image_t(size_t idx);
+        profile_image_t(const profile_image_t&) = delete;
+        profile_image_t& operator=(const profile_image_t&) = delete;
+        ~profile_image_t();
+
+    private:
+        size_t idx;
+        uint64_t allocs;    // Of the thread when the scope started
+        uint64_t bytes;
+        int64_t live;
+    };
+
+    // For the allocation functions in profile_new.cpp.
+    extern bool profile_on;
+    // Count a block the allocator just handed out or is about to take back. Only while profile_on.
+    void profile_alloc(void *p);
+    void profile_free(void *p);
+}
+
+#endif
@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <new>
+#include <stdlib.h>
+
+#include "profile.h"
+
+// The replaceable global allocation functions, counted when profiling is on.
+// Kept apart from profile.cpp so that build.sh only links them into the tools
+// that can turn profiling on (dsc_extract and dsc_util), and everything else
+// keeps the C++ runtime's own. Only operator new and delete are seen: memory
+// from plain malloc (libzstd, libcurl, dyld's code) isn't counted.
+//
+// Failed allocations go through the new handler as the standard asks, until
+// it makes room, throws, or there isn't one. The nothrow forms do the same
+// and turn bad_alloc into nullptr. The aligned ones (C++17) go through
+// posix_memalign so free() takes them back.
+
+static void* profile_new(size_t n)
+{
+    void *p;
+    while(!(p = malloc(n ? n : 1)))
+    {
+        std::new_handler h = std::get_new_handler();
+        if(!h)
+        {
+            throw std::bad_alloc();
+        }
+        h();
+    }
+    if(dsc::profile_on)
+    {
+        dsc::profile_alloc(p);
+    }
+    return p;
+}
+
+static void* profile_new_aligned(size_t n, std::align_val_t al)
+{
+    void *p = nullptr;
+    size_t a = std::max((size_t)al, sizeof(void*));
+    while(posix_memalign(&p, a, n ? n : 1) != 0)
+    {
+        std::new_handler h = std::get_new_handler();
+        if(!h)
+        {
+            throw std::bad_alloc();
+        }
+        h();
+    }
+    if(dsc::profile_on)
+    {
+        dsc::profile_alloc(p);
+    }
+    return p;
+}
+
+static void profile_delete(void *p) noexcept
+{
+    if(p)
+    {
+        if(dsc::profile_on)
+        {
+            dsc::profile_free(p);
+        }
+        free(p);
+    }
+}
+
+void* operator new(size_t n)
+{
+    return profile_new(n);
+}
+
+void* operator new[](size_t n)
+{
+    return profile_new(n);
+}
+
+void* operator new(size_t n, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return profile_new(n);
+    }
+    catch(const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t n, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return profile_new(n);
+    }
+    catch(const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new(size_t n, std::align_val_t al)
+{
+    return profile_new_aligned(n, al);
+}
+
+void* operator new[](size_t n, std::align_val_t al)
+{
+    return profile_new_aligned(n, al);
+}
+
+void* operator new(size_t n, std::align_val_t al, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return profile_new_aligned(n, al);
+    }
+    catch(const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t n, std::align_val_t al, const std::nothrow_t&) noexcept
+{
+    try
+    {
+        return profile_new_aligned(n, al);
+    }
+    catch(const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void operator delete(void *p) noexcept
+{
+    profile_delete(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    profile_delete(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    profile_delete(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    profile_delete(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) noexcept
+{
+    profile_delete(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept
+{
+    profile_delete(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept
+{
+    profile_delete(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+    profile_delete(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept
+{
+    profile_delete(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept
+{
+    profile_delete(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    profile_delete(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    profile_delete(p);
+}
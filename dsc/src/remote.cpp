@@ -0,0 +1,733 @@
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <vector>
+
+#ifdef DSC_HAVE_CURL
+#   include <curl/curl.h>
+#endif
+
+#include "cache.h"
+#include "common.h"
+#include "extract.h"
+#include "macho.h"
+#include "modes.h"
+
+// Extracts images from a cache that's only reachable over HTTP (or anything
+// else curl can do range requests on), either as a plain file or as a stored
+// member of a zip. Same idea as libfragmentzip's partial zip reading: the end
+// of central directory and the central directory are fetched to find the
+// member, but instead of downloading the member, the cache is backed by a
+// sparse anonymous mapping and only the byte ranges the reader actually
+// touches are fetched into it. Subcaches get a mapping each, from the URL or
+// member named like the main file plus their suffix, and are handed to
+// cache_t with it, so addresses resolve through all of them.
+//
+// Real IPSWs don't store the cache as a zip member: it sits inside the root
+// filesystem or a cryptex DMG (APFS, often compressed or encrypted), which
+// this doesn't try to read. Those have to be unpacked and the cache served.
+
+#define REMOTE_PAGE     0x1000
+#define REMOTE_GAP      0x10000     // Ranges closer than this are fetched in one request
+#define REMOTE_STRLEN   0x100       // Initial guess for symbol name lengths
+
+namespace dsc
+{
+#ifdef DSC_HAVE_CURL
+    struct http_t
+    {
+        CURL *curl = nullptr;
+        const char *url = nullptr;
+        size_t requests = 0;
+        uint64_t bytes = 0;
+
+        ~http_t()
+        {
+            if(this->curl)
+            {
+                curl_easy_cleanup(this->curl);
+            }
+        }
+
+        bool init(const char *u)
+        {
+            this->url = u;
+            this->curl = curl_easy_init();
+            if(!this->curl)
+            {
+                ERR("curl_easy_init failed");
+                return false;
+            }
+            curl_easy_setopt(this->curl, CURLOPT_URL, u);
+            curl_easy_setopt(this->curl, CURLOPT_FOLLOWLOCATION, 1L);
+            curl_easy_setopt(this->curl, CURLOPT_FAILONERROR, 1L);
+            return true;
+        }
+
+        bool size(uint64_t &out)
+        {
+            curl_easy_setopt(this->curl, CURLOPT_NOBODY, 1L);
+            CURLcode r = curl_easy_perform(this->curl);
+            curl_easy_setopt(this->curl, CURLOPT_NOBODY, 0L);
+            curl_off_t len = -1;
+            if(r != CURLE_OK || curl_easy_getinfo(this->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &len) != CURLE_OK || len < 0)
+            {
+                ERR("%s: can't get size: %s", this->url, r != CURLE_OK ? curl_easy_strerror(r) : "no Content-Length");
+                return false;
+            }
+            ++this->requests;
+            out = (uint64_t)len;
+            return true;
+        }
+
+        struct sink_t
+        {
+            uint8_t *dst;
+            uint64_t len;
+            uint64_t got;
+        };
+
+        static size_t write_cb(char *data, size_t size, size_t n, void *arg)
+        {
+            sink_t *s = (sink_t*)arg;
+            size_t len = size * n;
+            // More than asked for means the range was ignored, abort rather than download everything
+            if(len > s->len - s->got)
+            {
+                return 0;
+            }
+            memcpy(s->dst + s->got, data, len);
+            s->got += len;
+            return len;
+        }
+
+        bool get(uint64_t off, uint64_t len, uint8_t *out)
+        {
+            char range[64];
+            snprintf(range, sizeof(range), "%llu-%llu", (unsigned long long)off, (unsigned long long)(off + len - 1));
+            sink_t s = { out, len, 0 };
+            curl_easy_setopt(this->curl, CURLOPT_RANGE, range);
+            curl_easy_setopt(this->curl, CURLOPT_WRITEFUNCTION, write_cb);
+            curl_easy_setopt(this->curl, CURLOPT_WRITEDATA, &s);
+            CURLcode r = curl_easy_perform(this->curl);
+            curl_easy_setopt(this->curl, CURLOPT_RANGE, NULL);
+            ++this->requests;
+            this->bytes += s.got;
+            if(r == CURLE_WRITE_ERROR)
+            {
+                ERR("%s: server doesn't honour range requests", this->url);
+                return false;
+            }
+            if(r != CURLE_OK || s.got != len)
+            {
+                ERR("%s: range %s failed: %s", this->url, range, r != CURLE_OK ? curl_easy_strerror(r) : "short read");
+                return false;
+            }
+            return true;
+        }
+    };
+
+    static inline uint16_t rd16(const uint8_t *p) { uint16_t v; memcpy(&v, p, sizeof(v)); return v; }
+    static inline uint32_t rd32(const uint8_t *p) { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+    static inline uint64_t rd64(const uint8_t *p) { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+    struct zip_entry_t
+    {
+        std::string name;
+        uint16_t method;
+        uint64_t csize;
+        uint64_t usize;
+        uint64_t loff;          // Of the local header
+    };
+
+    // Reads the central directory. Returns true without entries and with iszip false
+    // if there's no end of central directory, i.e. this isn't a zip.
+    static bool zip_dir(http_t &http, uint64_t total, std::vector<zip_entry_t> &entries, bool &iszip)
+    {
+        iszip = false;
+        std::vector<uint8_t> tail(std::min<uint64_t>(total, 0xffff + 22));
+        if(tail.size() < 22 || !http.get(total - tail.size(), tail.size(), tail.data()))
+        {
+            return false;
+        }
+        size_t eocd = SIZE_MAX;
+        for(size_t i = tail.size() - 22 + 1; i-- > 0; )
+        {
+            if(rd32(&tail[i]) == 0x06054b50)
+            {
+                eocd = i;
+                break;
+            }
+        }
+        if(eocd == SIZE_MAX)
+        {
+            return true;
+        }
+        iszip = true;
+        uint64_t count = rd16(&tail[eocd + 10]),
+                 cdsize = rd32(&tail[eocd + 12]),
+                 cdoff = rd32(&tail[eocd + 16]);
+        if(count == 0xffff || cdsize == 0xffffffff || cdoff == 0xffffffff)
+        {
+            uint8_t z[56];
+            if(eocd < 20 || rd32(&tail[eocd - 20]) != 0x07064b50 || !http.get(rd64(&tail[eocd - 20 + 8]), sizeof(z), z) || rd32(z) != 0x06064b50)
+            {
+                ERR("%s: bad zip64 end of central directory", http.url);
+                return false;
+            }
+            count = rd64(z + 32);
+            cdsize = rd64(z + 40);
+            cdoff = rd64(z + 48);
+        }
+        if(cdoff > total || total - cdoff < cdsize)
+        {
+            ERR("%s: central directory out of bounds", http.url);
+            return false;
+        }
+        std::vector<uint8_t> cd(cdsize);
+        if(!http.get(cdoff, cdsize, cd.data()))
+        {
+            return false;
+        }
+        for(uint64_t i = 0, p = 0; i < count && p + 46 <= cd.size(); ++i)
+        {
+            const uint8_t *e = &cd[p];
+            if(rd32(e) != 0x02014b50)
+            {
+                break;
+            }
+            uint16_t nlen = rd16(e + 28),
+                     xlen = rd16(e + 30),
+                     clen = rd16(e + 32);
+            if(p + 46 + nlen + xlen > cd.size())
+            {
+                break;
+            }
+            zip_entry_t ent = { std::string((const char*)e + 46, nlen), rd16(e + 10), rd32(e + 20), rd32(e + 24), rd32(e + 42) };
+            // zip64 extra field, holding those of the above that are saturated, in this order
+            for(const uint8_t *x = e + 46 + nlen, *xend = x + xlen; x + 4 <= xend; x += 4 + rd16(x + 2))
+            {
+                if(rd16(x) == 0x0001)
+                {
+                    const uint8_t *v = x + 4, *vend = std::min(xend, x + 4 + rd16(x + 2));
+                    if(ent.usize == 0xffffffff && v + 8 <= vend) { ent.usize = rd64(v); v += 8; }
+                    if(ent.csize == 0xffffffff && v + 8 <= vend) { ent.csize = rd64(v); v += 8; }
+                    if(ent.loff == 0xffffffff && v + 8 <= vend)  { ent.loff = rd64(v); v += 8; }
+                }
+            }
+            p += 46 + nlen + xlen + clen;
+            entries.push_back(std::move(ent));
+        }
+        return true;
+    }
+
+    // Finds member (or the first dyld_shared_cache_* if NULL) in a zip, yielding its full name and the offset and size of its data.
+    static bool zip_member(http_t &http, uint64_t total, const std::vector<zip_entry_t> &entries, const char *member,
+                           std::string &name, uint64_t &off, uint64_t &len)
+    {
+        bool dmg = false;
+        for(const zip_entry_t &e : entries)
+        {
+            size_t slash = e.name.rfind('/');
+            std::string base = slash == std::string::npos ? e.name : e.name.substr(slash + 1);
+            dmg = dmg || (base.size() > 4 && base.compare(base.size() - 4, 4, ".dmg") == 0);
+            bool match = member ? (e.name == member || base == member)
+                                : (base.compare(0, 18, "dyld_shared_cache_") == 0 && base.find('.') == std::string::npos);
+            if(!match)
+            {
+                continue;
+            }
+            if(e.method != 0 || e.csize != e.usize)
+            {
+                ERR("%s: %s is compressed (method %u), only stored members can be read in place", http.url, e.name.c_str(), e.method);
+                return false;
+            }
+            uint8_t lh[30];
+            if(!http.get(e.loff, sizeof(lh), lh) || rd32(lh) != 0x04034b50)
+            {
+                ERR("%s: bad local header for %s", http.url, e.name.c_str());
+                return false;
+            }
+            off = e.loff + sizeof(lh) + rd16(lh + 26) + rd16(lh + 28);
+            len = e.usize;
+            if(off > total || total - off < len)
+            {
+                ERR("%s: %s out of bounds", http.url, e.name.c_str());
+                return false;
+            }
+            name = e.name;
+            LOG("Using %s (0x%llx bytes at 0x%llx)", e.name.c_str(), (unsigned long long)len, (unsigned long long)off);
+            return true;
+        }
+        ERR("%s: no %s in archive", http.url, member ? member : "dyld_shared_cache_*");
+        if(dmg)
+        {
+            ERR("The cache is probably inside one of its DMGs, which remote mode can't read. Extract it and serve it directly.");
+        }
+        return false;
+    }
+
+    // A cache file backed by a sparse mapping, filled a page at a time on demand.
+    struct remote_t
+    {
+        http_t http;
+        std::string name;           // URL, or member name in a zip
+        uint64_t dataoff = 0;       // Cache file offset within the remote resource
+        uint64_t size = 0;
+        uint8_t *mem = nullptr;
+        bool adopted = false;       // mem belongs to a cache_t now
+        std::vector<bool> present;  // Per REMOTE_PAGE
+        std::vector<std::pair<uint64_t, uint64_t>> pending;    // Ranges for the next fetch(pending)
+
+        ~remote_t()
+        {
+            if(this->mem && !this->adopted)
+            {
+                munmap(this->mem, this->size);
+            }
+        }
+
+        bool map(void)
+        {
+            void *m = mmap(NULL, this->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if(m == MAP_FAILED)
+            {
+                ERR("mmap(0x%llx): %s", (unsigned long long)this->size, strerror(errno));
+                return false;
+            }
+            this->mem = (uint8_t*)m;
+            this->present.assign((this->size + REMOTE_PAGE - 1) / REMOTE_PAGE, false);
+            return true;
+        }
+
+        bool fetch(uint64_t off, uint64_t len)
+        {
+            if(len == 0 || off >= this->size)
+            {
+                return true;
+            }
+            len = std::min(len, this->size - off);
+            uint64_t first = off / REMOTE_PAGE,
+                     last = (off + len + REMOTE_PAGE - 1) / REMOTE_PAGE;
+            for(uint64_t p = first; p < last; )
+            {
+                if(this->present[p])
+                {
+                    ++p;
+                    continue;
+                }
+                uint64_t q = p;
+                while(q < last && !this->present[q])
+                {
+                    ++q;
+                }
+                uint64_t start = p * REMOTE_PAGE,
+                         end = std::min(q * REMOTE_PAGE, this->size);
+                if(!this->http.get(this->dataoff + start, end - start, this->mem + start))
+                {
+                    return false;
+                }
+                for(; p < q; ++p)
+                {
+                    this->present[p] = true;
+                }
+            }
+            return true;
+        }
+
+        // Fetches a batch of ranges, merging close ones into one request.
+        bool fetch(std::vector<std::pair<uint64_t, uint64_t>> &ranges)
+        {
+            std::sort(ranges.begin(), ranges.end());
+            for(size_t i = 0; i < ranges.size(); )
+            {
+                uint64_t start = ranges[i].first,
+                         end = start + ranges[i].second;
+                for(++i; i < ranges.size() && ranges[i].first <= end + REMOTE_GAP; ++i)
+                {
+                    end = std::max(end, ranges[i].first + ranges[i].second);
+                }
+                if(!this->fetch(start, end - start))
+                {
+                    return false;
+                }
+            }
+            ranges.clear();
+            return true;
+        }
+
+        // NUL-terminated string at off, fetching further until the terminator shows up.
+        bool fetch_str(uint64_t off)
+        {
+            for(uint64_t len = REMOTE_STRLEN; off < this->size; len *= 2)
+            {
+                if(!this->fetch(off, len))
+                {
+                    return false;
+                }
+                if(memchr(this->mem + off, '\0', std::min(len, this->size - off)))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    typedef std::vector<std::unique_ptr<remote_t>> remote_files_t;     // Main cache file, then subcaches in header order
+
+    // File and offset an unslid address is stored at, NULL if no mapping covers it.
+    static remote_t* remote_vm2off(const cache_t &cache, remote_files_t &files, uint64_t addr, uint64_t &out)
+    {
+        const mapping_t *m = cache.mapping(addr);
+        if(!m || m->file >= files.size())
+        {
+            return nullptr;
+        }
+        out = m->fileoff + (addr - m->addr);
+        return files[m->file].get();
+    }
+
+    // Queues [addr, addr+size) on the file it lives in.
+    static void remote_want(const cache_t &cache, remote_files_t &files, uint64_t addr, uint64_t size)
+    {
+        uint64_t off;
+        remote_t *r = size != 0 ? remote_vm2off(cache, files, addr, off) : nullptr;
+        if(r)
+        {
+            r->pending.push_back({ off, size });
+        }
+    }
+
+    static bool remote_flush(remote_files_t &files)
+    {
+        for(const std::unique_ptr<remote_t> &r : files)
+        {
+            if(!r->fetch(r->pending))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Everything cache_t::load reads: header, mapping, slide, subcache and image tables, image paths.
+    static bool remote_tables(remote_t &r)
+    {
+        if(!r.fetch(0, REMOTE_PAGE))
+        {
+            return false;
+        }
+        const dyld_cache_header *hdr = (const dyld_cache_header*)r.mem;
+        std::vector<std::pair<uint64_t, uint64_t>> ranges;
+        ranges.push_back({ hdr->mappingOffset, (uint64_t)hdr->mappingCount * sizeof(dyld_cache_mapping_info) });
+        bool slidemaps = DSC_HAS_FIELD(hdr, mappingWithSlideCount) && hdr->mappingWithSlideCount != 0;
+        if(slidemaps)
+        {
+            ranges.push_back({ hdr->mappingWithSlideOffset, (uint64_t)hdr->mappingWithSlideCount * sizeof(dyld_cache_mapping_and_slide_info) });
+        }
+        else
+        {
+            ranges.push_back({ hdr->slideInfoOffsetUnused, hdr->slideInfoSizeUnused });
+        }
+        uint64_t imgoff = hdr->imagesOffsetOld,
+                 imgcnt = hdr->imagesCountOld;
+        if(DSC_HAS_FIELD(hdr, imagesCount) && hdr->imagesOffset != 0)
+        {
+            imgoff = hdr->imagesOffset;
+            imgcnt = hdr->imagesCount;
+        }
+        ranges.push_back({ imgoff, imgcnt * sizeof(dyld_cache_image_info) });
+        if(DSC_HAS_FIELD(hdr, subCacheArrayCount) && hdr->subCacheArrayCount != 0)
+        {
+            ranges.push_back({ hdr->subCacheArrayOffset, (uint64_t)hdr->subCacheArrayCount * sizeof(dyld_subcache_entry) });
+        }
+        if(!r.fetch(ranges))
+        {
+            return false;
+        }
+        if(slidemaps && hdr->mappingWithSlideOffset < r.size && (r.size - hdr->mappingWithSlideOffset) / sizeof(dyld_cache_mapping_and_slide_info) >= hdr->mappingWithSlideCount)
+        {
+            const dyld_cache_mapping_and_slide_info *smap = (const dyld_cache_mapping_and_slide_info*)(r.mem + hdr->mappingWithSlideOffset);
+            for(uint32_t i = 0; i < hdr->mappingWithSlideCount; ++i)
+            {
+                ranges.push_back({ smap[i].slideInfoFileOffset, smap[i].slideInfoFileSize });
+            }
+        }
+        if(imgoff < r.size && (r.size - imgoff) / sizeof(dyld_cache_image_info) >= imgcnt)
+        {
+            const dyld_cache_image_info *img = (const dyld_cache_image_info*)(r.mem + imgoff);
+            for(uint64_t i = 0; i < imgcnt; ++i)
+            {
+                ranges.push_back({ img[i].pathFileOffset, REMOTE_STRLEN });
+            }
+        }
+        if(!r.fetch(ranges))
+        {
+            return false;
+        }
+        if(imgoff < r.size && (r.size - imgoff) / sizeof(dyld_cache_image_info) >= imgcnt)
+        {
+            const dyld_cache_image_info *img = (const dyld_cache_image_info*)(r.mem + imgoff);
+            for(uint64_t i = 0; i < imgcnt; ++i)
+            {
+                if(!r.fetch_str(img[i].pathFileOffset))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Everything extract_plan and extract_build read for one image, from whichever files hold it.
+    static bool remote_image(remote_files_t &files, const cache_t &cache, const image_t &img)
+    {
+        uint64_t off;
+        remote_t *r = remote_vm2off(cache, files, img.addr, off);
+        if(!r || !r->fetch(off, REMOTE_PAGE))
+        {
+            return false;
+        }
+        const mach_header *mh = (const mach_header*)(r->mem + off);
+        if(!r->fetch(off, sizeof(mach_header_64) + mh->sizeofcmds))
+        {
+            return false;
+        }
+        macho_t mo;
+        if(!mo.init(cache, img.addr))
+        {
+            WRN("%s: bad Mach-O header", img.path);
+            return false;
+        }
+        segment_t le = {};
+        mo.each_segment([&](const segment_t &seg) -> bool
+        {
+            if(strcmp(seg.name, "__LINKEDIT") == 0)
+            {
+                le = seg;
+            }
+            else
+            {
+                remote_want(cache, files, seg.vmaddr, std::min(seg.filesize, seg.vmsize));
+            }
+            return true;
+        });
+        auto linkedit = [&](uint64_t fileoff, uint64_t size)
+        {
+            if(fileoff >= le.fileoff)
+            {
+                remote_want(cache, files, le.vmaddr + (fileoff - le.fileoff), size);
+            }
+        };
+        const symtab_command *symtab = nullptr;
+        mo.each_cmd([&](const load_command *lc) -> bool
+        {
+            if((lc->cmd == LC_DYLD_INFO || lc->cmd == LC_DYLD_INFO_ONLY) && lc->cmdsize >= sizeof(dyld_info_command))
+            {
+                const dyld_info_command *di = (const dyld_info_command*)lc;
+                linkedit(di->bind_off, di->bind_size);
+                linkedit(di->weak_bind_off, di->weak_bind_size);
+                linkedit(di->lazy_bind_off, di->lazy_bind_size);
+                linkedit(di->export_off, di->export_size);
+            }
+            else if(lc->cmd == LC_SYMTAB && lc->cmdsize >= sizeof(symtab_command))
+            {
+                symtab = (const symtab_command*)lc;
+                linkedit(symtab->symoff, (uint64_t)symtab->nsyms * (mo.is64 ? sizeof(nlist_64) : sizeof(nlist)));
+            }
+            else if(lc->cmd == LC_DYSYMTAB && lc->cmdsize >= sizeof(dysymtab_command))
+            {
+                const dysymtab_command *ds = (const dysymtab_command*)lc;
+                linkedit(ds->indirectsymoff, (uint64_t)ds->nindirectsyms * sizeof(uint32_t));
+            }
+            else if((lc->cmd == LC_DYLD_EXPORTS_TRIE || lc->cmd == LC_FUNCTION_STARTS || lc->cmd == LC_DATA_IN_CODE) && lc->cmdsize >= sizeof(linkedit_data_command))
+            {
+                const linkedit_data_command *ld = (const linkedit_data_command*)lc;
+                linkedit(ld->dataoff, ld->datasize);
+            }
+            return true;
+        });
+        if(!remote_flush(files))
+        {
+            return false;
+        }
+
+        // Symbol names live in the shared string pool, only fetch the ones this image uses
+        if(symtab && symtab->nsyms != 0 && symtab->symoff >= le.fileoff && symtab->stroff >= le.fileoff)
+        {
+            uint64_t symaddr = le.vmaddr + (symtab->symoff - le.fileoff),
+                     straddr = le.vmaddr + (symtab->stroff - le.fileoff);
+            size_t nlsize = mo.is64 ? sizeof(nlist_64) : sizeof(nlist);
+            const uint8_t *nl;
+            for(uint32_t i = 0; i < symtab->nsyms && (nl = cache.ptr(symaddr + i * nlsize, nlsize)); ++i)
+            {
+                uint32_t strx = rd32(nl);
+                if(strx < symtab->strsize)
+                {
+                    remote_want(cache, files, straddr + strx, std::min<uint64_t>(REMOTE_STRLEN, symtab->strsize - strx));
+                }
+            }
+            if(!remote_flush(files))
+            {
+                return false;
+            }
+            for(uint32_t i = 0; i < symtab->nsyms && (nl = cache.ptr(symaddr + i * nlsize, nlsize)); ++i)
+            {
+                uint32_t strx = rd32(nl);
+                remote_t *f = strx < symtab->strsize ? remote_vm2off(cache, files, straddr + strx, off) : nullptr;
+                if(f && !f->fetch_str(off))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // URL of a file next to the one at url, named like it plus suffix.
+    static std::string remote_sibling(const char *url, const std::string &suffix)
+    {
+        std::string s = url;
+        size_t end = s.find_first_of("?#");
+        return s.insert(end == std::string::npos ? s.size() : end, suffix);
+    }
+
+    int mode_remote(int argc, const char **argv)
+    {
+        if(argc < 4 || argc > 5)
+        {
+            fprintf(stderr, "Usage: dsc_util remote <url> <path-to-dir> <library-name> [zip-member]\n");
+            fprintf(stderr, "    <url> is the cache file or a zip storing it uncompressed. Subcaches are fetched next to it.\n");
+            fprintf(stderr, "    Caches inside a DMG, as in IPSWs, can't be read remotely: extract the cache and serve it.\n");
+            return 1;
+        }
+        const char *url = argv[1],
+                   *dir = argv[2],
+                   *filter = argv[3],
+                   *member = argc > 4 ? argv[4] : nullptr;
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        remote_files_t files;
+        files.emplace_back(new remote_t());
+        remote_t &r = *files[0];
+        r.name = url;
+        uint64_t total;
+        bool iszip;
+        std::vector<zip_entry_t> entries;
+        std::string name;
+        if(!r.http.init(url) || !r.http.size(total) || !zip_dir(r.http, total, entries, iszip))
+        {
+            return 1;
+        }
+        if(iszip)
+        {
+            if(!zip_member(r.http, total, entries, member, name, r.dataoff, r.size))
+            {
+                return 1;
+            }
+        }
+        else
+        {
+            if(member)
+            {
+                ERR("%s: not a zip", url);
+                return 1;
+            }
+            r.dataoff = 0;
+            r.size = total;
+        }
+        std::vector<std::string> suffixes;
+        if(!r.map() || !remote_tables(r) || !subcache_suffixes(url, r.mem, r.size, suffixes))
+        {
+            return 1;
+        }
+
+        // Subcaches sit next to the main file, as sibling URLs or members, and are set up the same way in parallel
+        for(const std::string &suffix : suffixes)
+        {
+            files.emplace_back(new remote_t());
+            files.back()->name = iszip ? name + suffix : remote_sibling(url, suffix);
+        }
+        std::atomic<bool> ok(true);
+        parallel_for(suffixes.size(), [&](size_t i, size_t)
+        {
+            remote_t &sub = *files[i + 1];
+            std::string found;
+            bool good = iszip ? sub.http.init(url) && zip_member(sub.http, total, entries, sub.name.c_str(), found, sub.dataoff, sub.size)
+                              : sub.http.init(sub.name.c_str()) && sub.http.size(sub.size);
+            if(!good || !sub.map() || !remote_tables(sub))
+            {
+                ok = false;
+            }
+        });
+        if(!ok)
+        {
+            return 1;
+        }
+        std::vector<subcache_t> subs;
+        uint64_t avail = iszip ? total : 0;
+        for(const std::unique_ptr<remote_t> &f : files)
+        {
+            if(f.get() != &r)
+            {
+                subs.push_back({ f->name, f->mem, (size_t)f->size, -1 });
+            }
+            avail += iszip ? 0 : f->size;
+            f->adopted = true;
+        }
+        cache_t cache;
+        if(!cache.adopt(url, r.mem, r.size, std::move(subs)))
+        {
+            return 1;
+        }
+
+        size_t done = 0;
+        std::vector<uint8_t> buf;
+        for(const image_t &img : cache.images)
+        {
+            if(!strstr(img.path, filter))
+            {
+                continue;
+            }
+            if(!remote_image(files, cache, img) || !extract_image(cache, img, buf))
+            {
+                ERR("Failed to extract %s", img.path);
+                return 1;
+            }
+            if(!extract_write(dir, img.path, buf.data(), buf.size()))
+            {
+                return 1;
+            }
+            printf("%s\n", img.path);
+            ++done;
+        }
+        if(!done)
+        {
+            ERR("No image matching %s", filter);
+            return 1;
+        }
+        size_t requests = 0;
+        uint64_t bytes = 0;
+        for(const std::unique_ptr<remote_t> &f : files)
+        {
+            requests += f->http.requests;
+            bytes += f->http.bytes;
+        }
+        LOG("%zu requests, %llu of %llu bytes fetched from %zu files", requests, (unsigned long long)bytes, (unsigned long long)avail, files.size());
+        return 0;
+    }
+#else
+    int mode_remote(int argc, const char **argv)
+    {
+        (void)argc;
+        (void)argv;
+        ERR("dsc_util was built without libcurl");
+        return 1;
+    }
+#endif
+}
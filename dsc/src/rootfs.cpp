@@ -0,0 +1,276 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "format.h"
+#include "rootfs.h"
+
+// Headers are read with pread rather than mapped: a scan touches tens of
+// thousands of files and only needs the first few pages of each.
+#define ROOTFS_MAX_CMDS     0x1000000
+
+namespace dsc
+{
+    bool rootfs_t::scan(std::vector<std::string> &out) const
+    {
+        std::vector<std::string> dirs(1, std::string());
+        while(!dirs.empty())
+        {
+            std::string rel = std::move(dirs.back());
+            dirs.pop_back();
+            std::string full = this->root + rel;
+            DIR *d = opendir(full.empty() ? "/" : full.c_str());
+            if(!d)
+            {
+                if(rel.empty())
+                {
+                    ERR("opendir(%s): %s", full.c_str(), strerror(errno));
+                    return false;
+                }
+                WRN("opendir(%s): %s", full.c_str(), strerror(errno));
+                continue;
+            }
+            for(struct dirent *ent; (ent = readdir(d)); )
+            {
+                if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+                {
+                    continue;
+                }
+                std::string path = rel + "/" + ent->d_name;
+                unsigned type = ent->d_type;
+                if(type == DT_UNKNOWN)
+                {
+                    struct stat s;
+                    if(lstat((this->root + path).c_str(), &s) != 0)
+                    {
+                        continue;
+                    }
+                    type = S_ISDIR(s.st_mode) ? DT_DIR : S_ISREG(s.st_mode) ? DT_REG : DT_UNKNOWN;
+                }
+                if(type == DT_DIR)
+                {
+                    dirs.push_back(std::move(path));
+                }
+                else if(type == DT_REG)
+                {
+                    out.push_back(std::move(path));
+                }
+            }
+            closedir(d);
+        }
+        return true;
+    }
+
+    static bool rootfs_read(int fd, uint64_t off, void *buf, size_t len)
+    {
+        uint8_t *p = (uint8_t*)buf;
+        while(len)
+        {
+            ssize_t r = pread(fd, p, len, (off_t)off);
+            if(r <= 0)
+            {
+                if(r < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            p += r;
+            off += (uint64_t)r;
+            len -= (size_t)r;
+        }
+        return true;
+    }
+
+    // Identity of the code signature. The real cdhash is a SHA of the CodeDirectory,
+    // so hashing the same bytes tells signatures apart just as well.
+    static uint64_t rootfs_cdhash(int fd, uint64_t off, uint32_t size)
+    {
+        cs_superblob sb;
+        if(size < sizeof(sb) || !rootfs_read(fd, off, &sb, sizeof(sb)) || __builtin_bswap32(sb.magic) != CSMAGIC_EMBEDDED_SIGNATURE)
+        {
+            return 0;
+        }
+        uint32_t count = __builtin_bswap32(sb.count);
+        if(count > (size - sizeof(sb)) / sizeof(cs_blob_index))
+        {
+            return 0;
+        }
+        std::vector<cs_blob_index> index(count);
+        if(!rootfs_read(fd, off + sizeof(sb), index.data(), count * sizeof(cs_blob_index)))
+        {
+            return 0;
+        }
+        for(const cs_blob_index &idx : index)
+        {
+            uint32_t boff = __builtin_bswap32(idx.offset);
+            uint32_t hdr[2];
+            if(__builtin_bswap32(idx.type) != CSSLOT_CODEDIRECTORY || boff > size - sizeof(hdr) || !rootfs_read(fd, off + boff, hdr, sizeof(hdr)) ||
+               __builtin_bswap32(hdr[0]) != CSMAGIC_CODEDIRECTORY)
+            {
+                continue;
+            }
+            uint32_t len = __builtin_bswap32(hdr[1]);
+            if(len < sizeof(hdr) || len > size - boff)
+            {
+                return 0;
+            }
+            std::vector<uint8_t> cd(len);
+            if(!rootfs_read(fd, off + boff, cd.data(), len))
+            {
+                return 0;
+            }
+            return hash64(cd.data(), cd.size());
+        }
+        return 0;
+    }
+
+    std::shared_ptr<const rootfs_macho_t> rootfs_t::parse(int fd, const struct stat &st) const
+    {
+        uint32_t magic;
+        if(!rootfs_read(fd, 0, &magic, sizeof(magic)))
+        {
+            return nullptr;
+        }
+        uint64_t slice = 0;
+        if(magic == __builtin_bswap32(FAT_MAGIC) || magic == __builtin_bswap32(FAT_MAGIC_64))
+        {
+            bool fat64 = magic == __builtin_bswap32(FAT_MAGIC_64);
+            fat_header fh;
+            if(!rootfs_read(fd, 0, &fh, sizeof(fh)))
+            {
+                return nullptr;
+            }
+            uint32_t n = __builtin_bswap32(fh.nfat_arch);
+            size_t entsize = fat64 ? sizeof(fat_arch_64) : sizeof(fat_arch);
+            if(n == 0 || n > 0x100)
+            {
+                return nullptr;
+            }
+            std::vector<uint8_t> arches(n * entsize);
+            if(!rootfs_read(fd, sizeof(fh), arches.data(), arches.size()))
+            {
+                return nullptr;
+            }
+            // Exact subtype first, any slice of the right CPU otherwise
+            bool found = false;
+            for(int pass = 0; pass < 2 && !found; ++pass)
+            {
+                for(uint32_t i = 0; i < n && !found; ++i)
+                {
+                    int32_t cpu, sub;
+                    uint64_t off;
+                    if(fat64)
+                    {
+                        const fat_arch_64 *fa = (const fat_arch_64*)(arches.data() + i * entsize);
+                        cpu = (int32_t)__builtin_bswap32((uint32_t)fa->cputype);
+                        sub = (int32_t)__builtin_bswap32((uint32_t)fa->cpusubtype);
+                        off = __builtin_bswap64(fa->offset);
+                    }
+                    else
+                    {
+                        const fat_arch *fa = (const fat_arch*)(arches.data() + i * entsize);
+                        cpu = (int32_t)__builtin_bswap32((uint32_t)fa->cputype);
+                        sub = (int32_t)__builtin_bswap32((uint32_t)fa->cpusubtype);
+                        off = __builtin_bswap32(fa->offset);
+                    }
+                    if(cpu == this->cputype && (pass == 1 || ((sub ^ this->cpusubtype) & ~CPU_SUBTYPE_MASK) == 0))
+                    {
+                        slice = off;
+                        found = true;
+                    }
+                }
+            }
+            if(!found)
+            {
+                return nullptr;
+            }
+        }
+
+        mach_header_64 mh;
+        if(!rootfs_read(fd, slice, &mh, sizeof(mh)) || (mh.magic != MH_MAGIC && mh.magic != MH_MAGIC_64) ||
+           mh.cputype != this->cputype || mh.sizeofcmds > ROOTFS_MAX_CMDS)
+        {
+            return nullptr;
+        }
+        std::vector<uint8_t> cmds(mh.sizeofcmds);
+        if(!rootfs_read(fd, slice + (mh.magic == MH_MAGIC_64 ? sizeof(mach_header_64) : sizeof(mach_header)), cmds.data(), cmds.size()))
+        {
+            return nullptr;
+        }
+        std::shared_ptr<rootfs_macho_t> mo(new rootfs_macho_t());
+        mo->filetype = mh.filetype;
+        mo->cputype = mh.cputype;
+        mo->cpusubtype = mh.cpusubtype;
+        mo->slice = slice;
+        mo->size = (uint64_t)st.st_size;
+        mo->mtime = (int64_t)st.st_mtime;
+        mo->cdhash = 0;
+        mo->has_uuid = false;
+        size_t off = 0;
+        for(uint32_t i = 0; i < mh.ncmds && cmds.size() - off >= sizeof(load_command); ++i)
+        {
+            const load_command *lc = (const load_command*)(cmds.data() + off);
+            if(lc->cmdsize < sizeof(load_command) || lc->cmdsize > cmds.size() - off)
+            {
+                break;
+            }
+            if(lc->cmd == LC_UUID && lc->cmdsize >= sizeof(load_command) + sizeof(mo->uuid))
+            {
+                memcpy(mo->uuid, lc + 1, sizeof(mo->uuid));
+                mo->has_uuid = true;
+            }
+            else if(lc->cmd == LC_CODE_SIGNATURE && lc->cmdsize >= sizeof(linkedit_data_command))
+            {
+                const linkedit_data_command *cs = (const linkedit_data_command*)lc;
+                mo->cdhash = rootfs_cdhash(fd, slice + cs->dataoff, cs->datasize);
+            }
+            else if((lc->cmd == LC_LOAD_DYLIB || lc->cmd == LC_LOAD_WEAK_DYLIB || lc->cmd == LC_REEXPORT_DYLIB || lc->cmd == LC_LOAD_UPWARD_DYLIB) && lc->cmdsize >= sizeof(dylib_command))
+            {
+                uint32_t name = ((const dylib_command*)lc)->name;
+                const char *s = (const char*)lc + name;
+                if(name < lc->cmdsize && memchr(s, '\0', lc->cmdsize - name))
+                {
+                    mo->deps.push_back(s);
+                }
+            }
+            off += lc->cmdsize;
+        }
+        return mo;
+    }
+
+    std::shared_ptr<const rootfs_macho_t> rootfs_t::get(const std::string &path)
+    {
+        int fd = open((this->root + path).c_str(), O_RDONLY);
+        if(fd == -1)
+        {
+            return nullptr;
+        }
+        struct stat s;
+        if(fstat(fd, &s) != 0 || !S_ISREG(s.st_mode))
+        {
+            close(fd);
+            return nullptr;
+        }
+        key_t key((uint64_t)s.st_dev, (uint64_t)s.st_ino);
+        shard_t &shard = this->shards[hash64(&key, sizeof(key)) % (sizeof(this->shards) / sizeof(this->shards[0]))];
+        {
+            std::lock_guard<std::mutex> guard(shard.lock);
+            auto it = shard.files.find(key);
+            if(it != shard.files.end())
+            {
+                close(fd);
+                return it->second;
+            }
+        }
+        // Parsed outside the lock; if two threads race on the same file, the first result is kept
+        std::shared_ptr<const rootfs_macho_t> mo = this->parse(fd, s);
+        close(fd);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        return shard.files.emplace(key, mo).first->second;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef DSC_ROOTFS_H
+#define DSC_ROOTFS_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+namespace dsc
+{
+    // Load commands of interest from a Mach-O on disk, taken from the slice
+    // matching the target architecture.
+    struct rootfs_macho_t
+    {
+        uint32_t filetype;
+        int32_t cputype;
+        int32_t cpusubtype;
+        uint64_t slice;                 // File offset of the slice
+        uint64_t size;                  // Of the whole file
+        int64_t mtime;
+        uint64_t cdhash;                // hash64 of the CodeDirectory, 0 if unsigned
+        bool has_uuid;
+        uint8_t uuid[16];
+        std::vector<std::string> deps;  // Install names of LC_LOAD_*DYLIB and LC_REEXPORT_DYLIB
+    };
+
+    // Files under a mounted root filesystem. Parsed headers are cached by device
+    // and inode, so hard links and dylibs shared by many executables are only
+    // read once, and the cache can be hit from any number of threads.
+    struct rootfs_t
+    {
+        std::string root;
+        int32_t cputype = 0;
+        int32_t cpusubtype = 0;
+
+        // Every regular file under the root, as absolute paths within it. Symlinks are not followed.
+        bool scan(std::vector<std::string> &out) const;
+
+        // Header of path (within the root), or NULL if it's not a Mach-O with a slice for the target architecture.
+        std::shared_ptr<const rootfs_macho_t> get(const std::string &path);
+
+    private:
+        typedef std::pair<uint64_t, uint64_t> key_t;    // Device, inode
+        struct shard_t
+        {
+            std::mutex lock;
+            std::map<key_t, std::shared_ptr<const rootfs_macho_t>> files;
+        };
+        shard_t shards[64];
+
+        std::shared_ptr<const rootfs_macho_t> parse(int fd, const struct stat &st) const;
+    };
+}
+
+#endif
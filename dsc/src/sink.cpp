@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <utility>
+
+#include "sink.h"
+
+namespace dsc
+{
+    sink_buf_t& sink_buf_t::operator=(sink_buf_t &&other) noexcept
+    {
+        if(this != &other)
+        {
+            this->release();
+            this->img = other.img;
+            this->pool = other.pool;
+            this->vec = std::move(other.vec);
+            other.pool = nullptr;
+        }
+        return *this;
+    }
+
+    void sink_buf_t::release(void)
+    {
+        if(this->pool)
+        {
+            this->pool->put(std::move(this->vec));
+            this->pool = nullptr;
+        }
+        this->vec = std::vector<uint8_t>();
+    }
+
+    sink_pool_t::sink_pool_t(size_t c) : allocated(0), reused(0), cap(c) {}
+
+    std::vector<uint8_t> sink_pool_t::get(size_t size)
+    {
+        std::vector<uint8_t> vec;
+        bool recycled = false;
+        {
+            std::unique_lock<std::mutex> guard(this->lock);
+            this->cond.wait(guard, [this] { return this->cap == 0 || this->out < this->cap; });
+            ++this->out;
+            if(!this->free.empty())
+            {
+                // Smallest one that fits without growing, else the largest, which grows the least
+                auto best = this->free.end();
+                for(auto it = this->free.begin(); it != this->free.end(); ++it)
+                {
+                    if(it->capacity() >= size && (best == this->free.end() || it->capacity() < best->capacity()))
+                    {
+                        best = it;
+                    }
+                }
+                if(best == this->free.end())
+                {
+                    best = std::max_element(this->free.begin(), this->free.end(), [](const std::vector<uint8_t> &a, const std::vector<uint8_t> &b)
+                    {
+                        return a.capacity() < b.capacity();
+                    });
+                }
+                std::swap(*best, this->free.back());
+                vec = std::move(this->free.back());
+                this->free.pop_back();
+                recycled = true;
+            }
+        }
+        if(recycled)
+        {
+            ++this->reused;
+        }
+        else
+        {
+            ++this->allocated;
+        }
+        vec.resize(size);
+        return vec;
+    }
+
+    void sink_pool_t::put(std::vector<uint8_t> &&vec)
+    {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            --this->out;
+            this->free.push_back(std::move(vec));
+        }
+        this->cond.notify_one();
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef DSC_SINK_H
+#define DSC_SINK_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "cache.h"
+#include "common.h"
+#include "extract.h"
+
+namespace dsc
+{
+    struct sink_pool_t;
+
+    // A rebuilt image on loan from a sink_pool_t. The memory goes back to the
+    // pool when this is destroyed, so a consumer can keep it, or move it to
+    // another thread, for as long as it needs to.
+    struct sink_buf_t
+    {
+        const image_t *img = nullptr;
+
+        sink_buf_t() = default;
+        sink_buf_t(sink_pool_t &pool, const image_t &img, std::vector<uint8_t> &&data) : img(&img), pool(&pool), vec(std::move(data)) {}
+        sink_buf_t(sink_buf_t &&other) noexcept { *this = std::move(other); }
+        sink_buf_t& operator=(sink_buf_t &&other) noexcept;
+        sink_buf_t(const sink_buf_t&) = delete;
+        sink_buf_t& operator=(const sink_buf_t&) = delete;
+        ~sink_buf_t() { this->release(); }
+
+        const char* name(void) const { return this->img->path; }
+        const uint8_t* data(void) const { return this->vec.data(); }
+        size_t size(void) const { return this->vec.size(); }
+
+        // Hands the memory back to the pool early.
+        void release(void);
+
+    private:
+        sink_pool_t *pool = nullptr;
+        std::vector<uint8_t> vec;
+    };
+
+    // Image buffers, recycled instead of allocated per image. With a cap, at
+    // most that many are out at once and get() waits for one to come back, so
+    // extraction can't run arbitrarily far ahead of a slower consumer. A
+    // consumer that holds on to buffers needs a cap above jobs() plus however
+    // many it holds, or workers will wait forever.
+    struct sink_pool_t
+    {
+        std::atomic<size_t> allocated;  // Buffers ever created
+        std::atomic<size_t> reused;     // get() calls served from a returned buffer
+
+        explicit sink_pool_t(size_t cap = 0);   // 0 for no cap
+        sink_pool_t(const sink_pool_t&) = delete;
+        sink_pool_t& operator=(const sink_pool_t&) = delete;
+
+        // A buffer of exactly size bytes, with unspecified contents.
+        std::vector<uint8_t> get(size_t size);
+        void put(std::vector<uint8_t> &&vec);
+
+    private:
+        size_t cap;
+        size_t out = 0;
+        std::mutex lock;
+        std::condition_variable cond;
+        std::vector<std::vector<uint8_t>> free;
+    };
+
+    // Rebuilds every image in todo on jobs() threads and calls fn(worker, buf)
+    // with each, on the thread that built it, as soon as it is ready. Nothing
+    // touches the filesystem. fn may move buf elsewhere to keep it, whatever
+    // it leaves behind goes back to the pool. Returns the number of images
+    // that couldn't be rebuilt, those are reported and fn never sees them.
+    template<typename F>
+    size_t extract_sink(const cache_t &cache, const std::vector<const image_t*> &todo, sink_pool_t &pool, F &&fn)
+    {
+        std::atomic<size_t> failed(0);
+        parallel_for(todo.size(), [&](size_t i, size_t worker)
+        {
+            const image_t &img = *todo[i];
+            extract_layout_t layout;
+            if(!extract_plan(cache, img, layout))
+            {
+                ERR("Failed to extract %s", img.path);
+                ++failed;
+                return;
+            }
+            std::vector<uint8_t> vec = pool.get(layout.size);
+            if(!extract_build(cache, layout, vec.data()))
+            {
+                ERR("Failed to extract %s", img.path);
+                pool.put(std::move(vec));
+                ++failed;
+                return;
+            }
+            fn(worker, sink_buf_t(pool, img, std::move(vec)));
+        });
+        return failed;
+    }
+}
+
+#endif
@@ -0,0 +1,557 @@
+#include <algorithm>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common.h"
+#include "headers.h"
+#include "index.h"
+#include "locals.h"
+#include "macho.h"
+#include "modes.h"
+#include "stubs.h"
+#include "trie.h"
+
+// Stubs are found by section type, so both __stubs and __auth_stubs are
+// covered, wherever the cache builder put them. Branch islands have no
+// section of their own in every cache layout, so they're found the other way
+// around: every b and bl in every image's code is decoded, and targets that
+// leave the image, land outside of any image's code and are shaped like an
+// island are kept. Decoding emulates just enough of adrp, add, ldr and the
+// br family to follow what stubs and islands are made of, in both their
+// optimized form (straight to the target) and through a pointer, which goes
+// through the slide info like any other pointer read.
+//
+// Index file, everything little endian and 8-byte aligned so it can be used straight from mmap:
+//
+//   stubs_index_header_t
+//   uint32_t               images[nimages]     install names, padded to an even count
+//   stubs_index_entry_t    entries[nentries]   sorted by addr
+//   char                   strings[strsize]
+//
+// Names are offsets into the string table: the target's export, else its
+// local symbol, else empty.
+#define STUB_MAX_INSNS      4       // adrp, add, ldr, br(aa)
+#define STUB_MAX_HOPS       4       // Islands and stubs followed to reach a final target
+#define STUBS_INDEX_MAGIC   0x54435344 // "DSCT"
+#define STUBS_INDEX_VERSION 1
+
+namespace dsc
+{
+    struct stubs_index_header_t
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t nimages;
+        uint32_t nentries;
+        uint32_t strsize;
+        uint32_t off_images;    // uint32_t name[nimages]
+        uint32_t off_entries;   // stubs_index_entry_t[nentries]
+        uint32_t off_str;
+    };
+
+    struct stubs_index_entry_t
+    {
+        uint64_t addr;
+        uint64_t target;        // 0 if it didn't decode
+        uint32_t image;         // STUB_NONE for islands outside of any image
+        uint32_t kind;          // STUB_*
+        uint32_t callee;        // Image holding the target, STUB_NONE if none does
+        uint32_t name;          // Of the target
+    };
+
+    static const char* stub_kind_name(uint32_t kind)
+    {
+        return kind == STUB_PLAIN ? "stub" : kind == STUB_AUTH ? "auth_stub" : "island";
+    }
+
+    struct stub_span_t
+    {
+        uint64_t lo;
+        uint64_t hi;
+        uint32_t image;
+    };
+
+    // Span holding addr in a sorted, non-overlapping list, or NULL.
+    static const stub_span_t* stub_span(const std::vector<stub_span_t> &spans, uint64_t addr)
+    {
+        auto it = std::upper_bound(spans.begin(), spans.end(), addr, [](uint64_t a, const stub_span_t &s)
+        {
+            return a < s.lo;
+        });
+        return it != spans.begin() && addr < (it - 1)->hi ? &*(it - 1) : nullptr;
+    }
+
+    // Where the stub or island at pc branches to, 0 if it's anything else. Sets *len to the bytes it takes up.
+    static uint64_t stub_decode(const cache_t &cache, uint64_t pc, uint64_t size, uint32_t *len)
+    {
+        uint64_t avail;
+        const uint8_t *p = cache.span(pc, &avail);
+        if(!p)
+        {
+            return 0;
+        }
+        size = std::min(size, avail);
+        uint64_t regs[32];
+        uint32_t known = 0;
+        for(uint32_t i = 0; i < STUB_MAX_INSNS && (i + 1) * 4 <= size; ++i)
+        {
+            uint32_t insn;
+            memcpy(&insn, p + i * 4, sizeof(insn));
+            uint64_t at = pc + i * 4,
+                     target;
+            uint32_t rd = insn & 31,
+                     rn = (insn >> 5) & 31;
+            *len = (i + 1) * 4;
+            if(stub_branch(insn, at, target))
+            {
+                // Only a lone b is an island
+                return i == 0 && !(insn & 0x80000000) ? target : 0;
+            }
+            if((insn & 0x9f000000) == 0x90000000)
+            {
+                // adrp
+                uint64_t imm = ((insn >> 5) & 0x7ffff) << 2 | ((insn >> 29) & 3);
+                regs[rd] = (at & ~0xfffULL) + (uint64_t)((int64_t)(imm << 43) >> 31);
+                known |= 1u << rd;
+            }
+            else if((insn & 0xff800000) == 0x91000000 && (known >> rn & 1))
+            {
+                // add xd, xn, #imm{, lsl #12}
+                uint64_t imm = (insn >> 10) & 0xfff;
+                regs[rd] = regs[rn] + (insn & (1u << 22) ? imm << 12 : imm);
+                known |= 1u << rd;
+            }
+            else if(((insn & 0xffc00000) == 0xf9400000 || (insn & 0xffc00000) == 0xb9400000) && (known >> rn & 1))
+            {
+                // ldr xd/wd, [xn, #imm]
+                uint64_t v;
+                if(!cache.read_ptr(regs[rn] + ((insn >> 10) & 0xfff) * (insn & 0x40000000 ? 8 : 4), v))
+                {
+                    return 0;
+                }
+                regs[rd] = v;
+                known |= 1u << rd;
+            }
+            else if((insn & 0xfffffc1f) == 0xd61f0000 || (insn & 0xfffff81f) == 0xd61f081f || (insn & 0xfffff800) == 0xd71f0800)
+            {
+                // br, braaz/brabz, braa/brab
+                return known >> rn & 1 ? regs[rn] : 0;
+            }
+            else
+            {
+                return 0;
+            }
+        }
+        return 0;
+    }
+
+    void stubs_t::build(const cache_t &cache)
+    {
+        const headers_t &hdrs = cache.headers();
+        std::vector<stub_span_t> texts,
+                                 code;
+        for(uint32_t i = 0; i < cache.images.size(); ++i)
+        {
+            const segment_t *seg = hdrs.segment(i, "__TEXT");
+            if(seg)
+            {
+                texts.push_back({ seg->vmaddr, seg->vmaddr + seg->vmsize, i });
+            }
+        }
+        // Aliases share their image's __TEXT
+        std::sort(texts.begin(), texts.end(), [](const stub_span_t &a, const stub_span_t &b)
+        {
+            return a.lo != b.lo ? a.lo < b.lo : a.image < b.image;
+        });
+        texts.erase(std::unique(texts.begin(), texts.end(), [](const stub_span_t &a, const stub_span_t &b) { return a.lo == b.lo; }), texts.end());
+        for(const stub_span_t &t : texts)
+        {
+            for(const section_t &sec : hdrs.sections(t.image))
+            {
+                if((sec.flags & S_ATTR_PURE_INSTRUCTIONS) && (sec.flags & SECTION_TYPE) != S_SYMBOL_STUBS)
+                {
+                    code.push_back({ sec.addr, sec.addr + sec.size, t.image });
+                }
+            }
+        }
+        std::sort(code.begin(), code.end(), [](const stub_span_t &a, const stub_span_t &b) { return a.lo < b.lo; });
+
+        std::vector<std::vector<entry_t>> found(jobs());
+        std::vector<std::vector<uint64_t>> calls(jobs());
+        parallel_for(texts.size(), [&](size_t t, size_t worker)
+        {
+            const stub_span_t &text = texts[t];
+            for(const section_t &sec : hdrs.sections(text.image))
+            {
+                if((sec.flags & SECTION_TYPE) == S_SYMBOL_STUBS)
+                {
+                    uint32_t kind = strcmp(sec.name, "__auth_stubs") == 0 ? STUB_AUTH : STUB_PLAIN;
+                    for(uint64_t pc = sec.addr; pc < sec.addr + sec.size; )
+                    {
+                        uint32_t len = 0;
+                        uint64_t size = sec.reserved2 ? sec.reserved2 : sec.addr + sec.size - pc;
+                        uint64_t target = stub_decode(cache, pc, size, &len);
+                        found[worker].push_back({ pc, target, text.image, kind, STUB_NONE });
+                        pc += sec.reserved2 ? sec.reserved2 : std::max<uint32_t>(len, 4);
+                    }
+                }
+                else if(sec.flags & S_ATTR_PURE_INSTRUCTIONS)
+                {
+                    const uint8_t *p = cache.ptr(sec.addr, sec.size);
+                    if(!p)
+                    {
+                        continue;
+                    }
+                    std::vector<uint64_t> &out = calls[worker];
+                    size_t first = out.size();
+                    for(uint64_t off = 0; off + 4 <= sec.size; off += 4)
+                    {
+                        uint32_t insn;
+                        uint64_t target;
+                        memcpy(&insn, p + off, sizeof(insn));
+                        if(stub_branch(insn, sec.addr + off, target) && (target < text.lo || target >= text.hi))
+                        {
+                            out.push_back(target);
+                        }
+                    }
+                    // Most images call the same few islands many times
+                    std::sort(out.begin() + first, out.end());
+                    out.erase(std::unique(out.begin() + first, out.end()), out.end());
+                }
+            }
+        });
+
+        for(std::vector<entry_t> &v : found)
+        {
+            this->entries.insert(this->entries.end(), v.begin(), v.end());
+            v = std::vector<entry_t>();
+        }
+        std::sort(this->entries.begin(), this->entries.end(), [](const entry_t &a, const entry_t &b) { return a.addr < b.addr; });
+        std::vector<uint64_t> islands;
+        for(std::vector<uint64_t> &v : calls)
+        {
+            islands.insert(islands.end(), v.begin(), v.end());
+            v = std::vector<uint64_t>();
+        }
+        std::sort(islands.begin(), islands.end());
+        islands.erase(std::unique(islands.begin(), islands.end()), islands.end());
+        // Calls straight into another image's code or stubs aren't islands
+        islands.erase(std::remove_if(islands.begin(), islands.end(), [&](uint64_t addr)
+        {
+            return stub_span(code, addr) || this->find(addr);
+        }), islands.end());
+
+        std::vector<entry_t> decoded(islands.size());
+        parallel_for(islands.size(), [&](size_t i, size_t)
+        {
+            uint32_t len;
+            const stub_span_t *text = stub_span(texts, islands[i]);
+            decoded[i] = { islands[i], stub_decode(cache, islands[i], STUB_MAX_INSNS * 4, &len), text ? text->image : STUB_NONE, STUB_ISLAND, STUB_NONE };
+        });
+        decoded.erase(std::remove_if(decoded.begin(), decoded.end(), [](const entry_t &e) { return e.target == 0; }), decoded.end());
+        size_t mid = this->entries.size();
+        this->entries.insert(this->entries.end(), decoded.begin(), decoded.end());
+        std::inplace_merge(this->entries.begin(), this->entries.begin() + mid, this->entries.end(), [](const entry_t &a, const entry_t &b) { return a.addr < b.addr; });
+
+        // Collapse chains (island to stub, stub to island) so every lookup is a single one
+        std::vector<uint64_t> targets(this->entries.size());
+        parallel_for(this->entries.size(), [&](size_t i, size_t)
+        {
+            uint64_t target = this->entries[i].target;
+            for(int hop = 0; hop < STUB_MAX_HOPS && target; ++hop)
+            {
+                const entry_t *next = this->find(target);
+                if(!next || !next->target || next == &this->entries[i])
+                {
+                    break;
+                }
+                target = next->target;
+            }
+            targets[i] = target;
+        });
+        for(size_t i = 0; i < targets.size(); ++i)
+        {
+            entry_t &e = this->entries[i];
+            const stub_span_t *text = targets[i] ? stub_span(texts, targets[i]) : nullptr;
+            e.target = targets[i];
+            e.callee = text ? text->image : STUB_NONE;
+        }
+    }
+
+    const stubs_t::entry_t* stubs_t::find(uint64_t addr) const
+    {
+        auto it = std::lower_bound(this->entries.begin(), this->entries.end(), addr, [](const entry_t &e, uint64_t a)
+        {
+            return e.addr < a;
+        });
+        return it != this->entries.end() && it->addr == addr ? &*it : nullptr;
+    }
+
+    std::pair<size_t, size_t> stubs_t::range(uint64_t lo, uint64_t hi) const
+    {
+        auto less = [](const entry_t &e, uint64_t a)
+        {
+            return e.addr < a;
+        };
+        return { (size_t)(std::lower_bound(this->entries.begin(), this->entries.end(), lo, less) - this->entries.begin()),
+                 (size_t)(std::lower_bound(this->entries.begin(), this->entries.end(), hi, less) - this->entries.begin()) };
+    }
+
+    const stubs_t& cache_t::stubs(void) const
+    {
+        std::call_once(this->stubs_once, [this]
+        {
+            this->stubs_data.reset(new stubs_t());
+            this->stubs_data->build(*this);
+        });
+        return *this->stubs_data;
+    }
+
+    // Names of the targets in one callee: exports first, local symbols for the rest.
+    template<typename F>
+    static void stub_names(const cache_t &cache, uint32_t img, trie_walker_t &walker, std::vector<std::pair<uint64_t, size_t>> &want, F &&found)
+    {
+        const image_t &image = cache.images[img];
+        std::sort(want.begin(), want.end());
+        std::vector<bool> done(want.size(), false);
+        auto hit = [&](uint64_t addr, const char *name, size_t len)
+        {
+            auto it = std::lower_bound(want.begin(), want.end(), std::make_pair(addr, (size_t)0));
+            for(; it != want.end() && it->first == addr; ++it)
+            {
+                if(!done[it - want.begin()])
+                {
+                    done[it - want.begin()] = true;
+                    found(it->second, name, len);
+                }
+            }
+        };
+        macho_t mo;
+        const uint8_t *trie;
+        size_t size;
+        if(mo.init(cache, image.addr) && mo.export_trie(cache, trie, size))
+        {
+            trie_each(walker, trie, size, [&](const export_t &e)
+            {
+                if(!(e.flags & EXPORT_SYMBOL_FLAGS_REEXPORT) && (e.flags & EXPORT_SYMBOL_FLAGS_KIND_MASK) == EXPORT_SYMBOL_FLAGS_KIND_REGULAR)
+                {
+                    hit(image.addr + e.addr, e.name, e.namelen);
+                }
+            });
+        }
+        if(std::find(done.begin(), done.end(), false) == done.end())
+        {
+            return;
+        }
+        const locals_t &locals = cache.locals();
+        const locals_t::entry_t *e = locals.find(image.addr);
+        if(!e)
+        {
+            return;
+        }
+        bool is64 = cache.ptrsize == 8;
+        for(uint32_t i = 0; i < e->count; ++i)
+        {
+            const uint8_t *nl = e->nlists + (uint64_t)i * (is64 ? sizeof(nlist_64) : sizeof(nlist));
+            uint32_t strx;
+            uint64_t value;
+            memcpy(&strx, nl, sizeof(strx));
+            if(is64)
+            {
+                value = ((const nlist_64*)nl)->n_value;
+            }
+            else
+            {
+                value = ((const nlist*)nl)->n_value;
+            }
+            if(strx < locals.strs_size)
+            {
+                const char *name = locals.strs + strx;
+                hit(value, name, strnlen(name, locals.strs_size - strx));
+            }
+        }
+    }
+
+    int mode_stubs_index(int argc, const char **argv)
+    {
+        if(argc != 3)
+        {
+            fprintf(stderr, "Usage: dsc_util stubs-index <path-to-cache> <index-file>\n");
+            return 1;
+        }
+        cache_t cache;
+        if(!cache.open(argv[1]))
+        {
+            return 1;
+        }
+        const stubs_t &stubs = cache.stubs();
+        size_t n = stubs.entries.size();
+
+        // Name lookups are grouped by callee, so each export trie is walked once
+        std::vector<std::vector<std::pair<uint64_t, size_t>>> want(cache.images.size());
+        for(size_t i = 0; i < n; ++i)
+        {
+            const stubs_t::entry_t &e = stubs.entries[i];
+            if(e.callee != STUB_NONE)
+            {
+                want[e.callee].push_back({ e.target, i });
+            }
+        }
+        std::vector<uint32_t> callees;
+        for(uint32_t i = 0; i < want.size(); ++i)
+        {
+            if(!want[i].empty())
+            {
+                callees.push_back(i);
+            }
+        }
+        std::vector<std::string> names(n);
+        std::vector<trie_walker_t> walkers(jobs());
+        parallel_for(callees.size(), [&](size_t c, size_t worker)
+        {
+            stub_names(cache, callees[c], walkers[worker], want[callees[c]], [&](size_t i, const char *name, size_t len)
+            {
+                names[i].assign(name, len);
+            });
+        });
+
+        strtab_t str;
+        str.add("");
+        std::vector<uint32_t> images;
+        for(const image_t &img : cache.images)
+        {
+            images.push_back(str.add(img.path));
+        }
+        if(images.size() % 2)
+        {
+            images.push_back(0);
+        }
+        std::vector<stubs_index_entry_t> entries(n);
+        size_t unresolved = 0,
+               islands = 0;
+        for(size_t i = 0; i < n; ++i)
+        {
+            const stubs_t::entry_t &e = stubs.entries[i];
+            entries[i] = { e.addr, e.target, e.image, e.kind, e.callee, str.add(names[i].c_str()) };
+            unresolved += e.target == 0;
+            islands += e.kind == STUB_ISLAND;
+        }
+        while(str.data.size() % 8)
+        {
+            str.data.push_back('\0');
+        }
+        stubs_index_header_t hdr = {};
+        hdr.magic = STUBS_INDEX_MAGIC;
+        hdr.version = STUBS_INDEX_VERSION;
+        hdr.nimages = (uint32_t)cache.images.size();
+        hdr.nentries = (uint32_t)n;
+        hdr.strsize = (uint32_t)str.data.size();
+        hdr.off_images = sizeof(hdr);
+        hdr.off_entries = hdr.off_images + (uint32_t)(images.size() * sizeof(uint32_t));
+        hdr.off_str = hdr.off_entries + hdr.nentries * sizeof(stubs_index_entry_t);
+
+        FILE *f = fopen(argv[2], "wb");
+        if(!f)
+        {
+            ERR("fopen(%s): %s", argv[2], strerror(errno));
+            return 1;
+        }
+        bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+                  fwrite(images.data(), sizeof(uint32_t), images.size(), f) == images.size() &&
+                  fwrite(entries.data(), sizeof(stubs_index_entry_t), entries.size(), f) == entries.size() &&
+                  fwrite(str.data.data(), 1, str.data.size(), f) == str.data.size();
+        if(fclose(f) != 0 || !ok)
+        {
+            ERR("Failed to write %s", argv[2]);
+            return 1;
+        }
+        LOG("%zu stubs, %zu branch islands, %zu unresolved", n - islands, islands, unresolved);
+        return 0;
+    }
+
+    struct stubs_index_t
+    {
+        mapped_file_t file;
+        const stubs_index_header_t *hdr = nullptr;
+        const uint32_t *images = nullptr;
+        const stubs_index_entry_t *entries = nullptr;
+
+        const char* str(uint32_t off) const
+        {
+            return off < this->hdr->strsize ? (const char*)this->file.base + this->hdr->off_str + off : "?";
+        }
+
+        const char* image(uint32_t idx) const
+        {
+            return idx < this->hdr->nimages ? this->str(this->images[idx]) : "-";
+        }
+
+        bool open(const char *path)
+        {
+            if(!this->file.open(path, sizeof(stubs_index_header_t)))
+            {
+                return false;
+            }
+            this->hdr = (const stubs_index_header_t*)this->file.base;
+            this->images = this->file.arr<uint32_t>(this->hdr->off_images, this->hdr->nimages);
+            this->entries = this->file.arr<stubs_index_entry_t>(this->hdr->off_entries, this->hdr->nentries);
+            if(this->hdr->magic != STUBS_INDEX_MAGIC || this->hdr->version != STUBS_INDEX_VERSION || !this->images || !this->entries ||
+               this->hdr->off_entries % 8 != 0 || !this->file.strtab(this->hdr->off_str, this->hdr->strsize))
+            {
+                ERR("%s: bad stubs index", path);
+                return false;
+            }
+            return true;
+        }
+    };
+
+    int mode_stubs_query(int argc, const char **argv)
+    {
+        if(argc != 3)
+        {
+            fprintf(stderr, "Usage: dsc_util stubs-query <index-file> <address>|<symbol>\n");
+            return 1;
+        }
+        stubs_index_t idx;
+        if(!idx.open(argv[1]))
+        {
+            return 1;
+        }
+        const stubs_index_entry_t *begin = idx.entries,
+                                  *end = idx.entries + idx.hdr->nentries;
+        auto print = [&](const stubs_index_entry_t &e)
+        {
+            printf("0x%llx\t%s\t%s\t-> 0x%llx\t%s\t%s\n", (unsigned long long)e.addr, stub_kind_name(e.kind), idx.image(e.image),
+                   (unsigned long long)e.target, idx.image(e.callee), idx.str(e.name));
+        };
+        size_t found = 0;
+        char *num;
+        unsigned long long addr = strtoull(argv[2], &num, 16);
+        if(*num == '\0')
+        {
+            const stubs_index_entry_t *e = std::lower_bound(begin, end, (uint64_t)addr, [](const stubs_index_entry_t &a, uint64_t v) { return a.addr < v; });
+            if(e != end && e->addr == addr)
+            {
+                print(*e);
+                ++found;
+            }
+        }
+        else
+        {
+            // Every stub and island that ends up at the symbol
+            for(const stubs_index_entry_t *e = begin; e != end; ++e)
+            {
+                if(strcmp(idx.str(e->name), argv[2]) == 0)
+                {
+                    print(*e);
+                    ++found;
+                }
+            }
+        }
+        return found ? 0 : 1;
+    }
+}
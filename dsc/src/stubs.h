@@ -0,0 +1,63 @@
+#ifndef DSC_STUBS_H
+#define DSC_STUBS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "cache.h"
+
+#define STUB_PLAIN      0       // Entry of an S_SYMBOL_STUBS section
+#define STUB_AUTH       1       // The same, in __auth_stubs
+#define STUB_ISLAND     2       // Branch island, found as the target of calls leaving their image
+#define STUB_NONE       0xffffffff
+
+namespace dsc
+{
+    // Every stub and branch island in the cache, decoded down to the address
+    // it finally jumps to. Built once (see cache_t::stubs) and only read
+    // afterwards, so it can be shared by any number of threads.
+    struct stubs_t
+    {
+        struct entry_t
+        {
+            uint64_t addr;
+            uint64_t target;    // After following islands and stubs that lead to other stubs, 0 if it didn't decode
+            uint32_t image;     // Whose __TEXT holds it, STUB_NONE for islands outside of any image
+            uint32_t kind;      // STUB_*
+            uint32_t callee;    // Whose __TEXT holds the target, STUB_NONE if none does
+        };
+
+        std::vector<entry_t> entries;   // Sorted by addr
+
+        void build(const cache_t &cache);
+
+        // Entry at addr, or NULL.
+        const entry_t* find(uint64_t addr) const;
+
+        // Where a branch to addr ends up: the final target if addr is a decoded stub or island, addr itself otherwise.
+        uint64_t resolve(uint64_t addr) const
+        {
+            const entry_t *e = this->find(addr);
+            return e && e->target ? e->target : addr;
+        }
+
+        // Index range [first, last) of the entries in [lo, hi).
+        std::pair<size_t, size_t> range(uint64_t lo, uint64_t hi) const;
+    };
+
+    // Where the branch (b or bl) at pc goes, false if insn isn't one.
+    static inline bool stub_branch(uint32_t insn, uint64_t pc, uint64_t &target)
+    {
+        if((insn & 0x7c000000) != 0x14000000)
+        {
+            return false;
+        }
+        int64_t imm = (int64_t)((uint64_t)(insn & 0x3ffffff) << 38) >> 36;
+        target = pc + imm;
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,685 @@
+#include <algorithm>
+#include <errno.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "cache.h"
+#include "common.h"
+#include "headers.h"
+#include "index.h"
+#include "modes.h"
+#include "objc.h"
+
+// Index file, same conventions as the objc index:
+//
+//   swift_index_header_t
+//   uint32_t             images[nimages]     install names
+//   swift_index_type_t   types[ntypes]       sorted by name, each a range in confs
+//   swift_index_proto_t  protos[nprotos]     sorted by name, each a range in byproto
+//   swift_index_conf_t   confs[nconfs]       grouped by type
+//   uint32_t             byproto[nconfs]     indices into confs, grouped by protocol
+//   char                 strings[strsize]
+//
+// Type and protocol names are fully qualified (Module.Outer.Inner), extension
+// and anonymous contexts don't add a component. Types that only appear as
+// conformance targets (like ObjC classes, as __C.Name) have image SWIFT_NONE.
+#define SWIFT_INDEX_MAGIC   0x53435344 // "DSCS"
+#define SWIFT_INDEX_VERSION 1
+#define SWIFT_NONE          0xffffffff
+
+// Context descriptor kinds
+#define SWIFT_KIND_MODULE       0
+#define SWIFT_KIND_EXTENSION    1
+#define SWIFT_KIND_ANONYMOUS    2
+#define SWIFT_KIND_PROTOCOL     3
+#define SWIFT_KIND_CLASS        16
+#define SWIFT_KIND_STRUCT       17
+#define SWIFT_KIND_ENUM         18
+
+// Type reference kinds, in __swift5_types entries and conformance flags
+#define SWIFT_TYPEREF_DIRECT        0
+#define SWIFT_TYPEREF_INDIRECT      1
+#define SWIFT_TYPEREF_OBJC_NAME     2
+#define SWIFT_TYPEREF_OBJC_CLASS    3
+
+namespace dsc
+{
+    struct swift_index_header_t
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t nimages;
+        uint32_t ntypes;
+        uint32_t nprotos;
+        uint32_t nconfs;
+        uint32_t strsize;
+        uint32_t off_images;
+        uint32_t off_types;
+        uint32_t off_protos;
+        uint32_t off_confs;
+        uint32_t off_byproto;
+        uint32_t off_str;
+    };
+
+    struct swift_index_type_t
+    {
+        uint32_t name;
+        uint32_t image;
+        uint32_t kind;      // SWIFT_KIND_*
+        uint32_t start;
+        uint32_t count;
+    };
+
+    struct swift_index_proto_t
+    {
+        uint32_t name;
+        uint32_t image;
+        uint32_t start;
+        uint32_t count;
+    };
+
+    struct swift_index_conf_t
+    {
+        uint32_t type;
+        uint32_t proto;
+        uint32_t image;     // Image the conformance record lives in
+    };
+
+    struct swift_desc_t
+    {
+        std::string name;
+        uint32_t kind;
+    };
+
+    struct swift_conf_t
+    {
+        std::string type;
+        std::string proto;
+        uint64_t addr;      // Conformance descriptor
+    };
+
+    struct swift_img_t
+    {
+        std::vector<std::pair<uint64_t, swift_desc_t>> types;   // (descriptor, name)
+        std::vector<std::pair<uint64_t, swift_desc_t>> protos;
+        std::vector<swift_conf_t> confs;
+    };
+
+    // Target of a 32-bit relative pointer at addr. If indirectable and the low
+    // bit is set, the target holds a pointer to the real target instead.
+    static bool swift_relptr(const cache_t &cache, uint64_t addr, bool indirectable, uint64_t &out)
+    {
+        const uint8_t *p = cache.ptr(addr, sizeof(int32_t));
+        if(!p)
+        {
+            return false;
+        }
+        int32_t off;
+        memcpy(&off, p, sizeof(off));
+        if(off == 0)
+        {
+            out = 0;
+            return true;
+        }
+        if(indirectable && (off & 1))
+        {
+            return cache.read_ptr(addr + (int64_t)(off & ~1), out);
+        }
+        out = addr + (int64_t)off;
+        return true;
+    }
+
+    // Fully qualified name of the context descriptor at addr, walking up the parents.
+    // Extensions and anonymous contexts contribute nothing, their own parent continues the chain.
+    static bool swift_context(const cache_t &cache, uint64_t addr, swift_desc_t &out)
+    {
+        out.name.clear();
+        out.kind = SWIFT_NONE;
+        for(size_t depth = 0; addr != 0 && depth < 64; ++depth)
+        {
+            const uint8_t *p = cache.ptr(addr, 3 * sizeof(uint32_t));
+            if(!p)
+            {
+                return false;
+            }
+            uint32_t flags;
+            memcpy(&flags, p, sizeof(flags));
+            uint32_t kind = flags & 0x1f;
+            if(out.kind == SWIFT_NONE)
+            {
+                out.kind = kind;
+            }
+            if(kind != SWIFT_KIND_EXTENSION && kind != SWIFT_KIND_ANONYMOUS)
+            {
+                uint64_t nameaddr;
+                const char *name = swift_relptr(cache, addr + 8, false, nameaddr) && nameaddr ? cache.str(nameaddr) : nullptr;
+                if(!name)
+                {
+                    return false;
+                }
+                out.name = out.name.empty() ? std::string(name) : std::string(name) + "." + out.name;
+            }
+            if(!swift_relptr(cache, addr + 4, true, addr))
+            {
+                return false;
+            }
+        }
+        return !out.name.empty();
+    }
+
+    // Name of the type a conformance or __swift5_types entry refers to.
+    static bool swift_typeref(const cache_t &cache, uint64_t field, uint32_t kind, swift_desc_t &out)
+    {
+        uint64_t target;
+        switch(kind)
+        {
+            case SWIFT_TYPEREF_DIRECT:
+            case SWIFT_TYPEREF_INDIRECT:
+                if(!swift_relptr(cache, field, false, target) || !target || (kind == SWIFT_TYPEREF_INDIRECT && !cache.read_ptr(target, target)))
+                {
+                    return false;
+                }
+                return swift_context(cache, target, out);
+            case SWIFT_TYPEREF_OBJC_NAME:
+            case SWIFT_TYPEREF_OBJC_CLASS:
+            {
+                const char *name = nullptr;
+                if(swift_relptr(cache, field, false, target) && target)
+                {
+                    if(kind == SWIFT_TYPEREF_OBJC_NAME)
+                    {
+                        name = cache.str(target);
+                    }
+                    else if(cache.read_ptr(target, target))
+                    {
+                        name = objc_class_name(cache, target, nullptr);
+                    }
+                }
+                if(!name)
+                {
+                    return false;
+                }
+                out.name = std::string("__C.") + name;
+                out.kind = SWIFT_KIND_CLASS;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // ProtocolConformanceDescriptor { protocol, typeRef, witnessTablePattern, flags }
+    static bool swift_conformance(const cache_t &cache, uint64_t addr, swift_conf_t &out)
+    {
+        const uint8_t *p = cache.ptr(addr, 4 * sizeof(uint32_t));
+        uint64_t proto;
+        if(!p || !swift_relptr(cache, addr, true, proto) || !proto)
+        {
+            return false;
+        }
+        uint32_t flags;
+        memcpy(&flags, p + 12, sizeof(flags));
+        swift_desc_t t, pr;
+        if(!swift_typeref(cache, addr + 4, (flags >> 3) & 7, t) || !swift_context(cache, proto, pr))
+        {
+            return false;
+        }
+        out.type = std::move(t.name);
+        out.proto = std::move(pr.name);
+        out.addr = addr;
+        return true;
+    }
+
+    static void swift_image(const cache_t &cache, uint32_t idx, swift_img_t &out)
+    {
+        for(const section_t &sec : cache.headers().sections(idx))
+        {
+            bool types = strcmp(sec.name, "__swift5_types") == 0 || strcmp(sec.name, "__swift5_types2") == 0,
+                 protos = strcmp(sec.name, "__swift5_protos") == 0,
+                 confs = strcmp(sec.name, "__swift5_proto") == 0;
+            for(uint64_t off = 0; (types || protos || confs) && off + sizeof(int32_t) <= sec.size; off += sizeof(int32_t))
+            {
+                uint64_t field = sec.addr + off;
+                if(confs)
+                {
+                    uint64_t addr;
+                    swift_conf_t c;
+                    if(swift_relptr(cache, field, false, addr) && addr && swift_conformance(cache, addr, c))
+                    {
+                        out.confs.push_back(std::move(c));
+                    }
+                    continue;
+                }
+                // __swift5_types entries carry the reference kind in the low bits,
+                // __swift5_protos ones are indirectable
+                const uint8_t *p = cache.ptr(field, sizeof(int32_t));
+                if(!p)
+                {
+                    break;
+                }
+                int32_t rel;
+                memcpy(&rel, p, sizeof(rel));
+                uint64_t addr = field + (int64_t)(rel & ~3);
+                if(types ? (rel & 3) == SWIFT_TYPEREF_INDIRECT : (rel & 1) != 0)
+                {
+                    if(!cache.read_ptr(addr, addr))
+                    {
+                        continue;
+                    }
+                }
+                else if(types && (rel & 3) != SWIFT_TYPEREF_DIRECT)
+                {
+                    continue;
+                }
+                swift_desc_t d;
+                if(rel != 0 && swift_context(cache, addr, d))
+                {
+                    (types ? out.types : out.protos).push_back({ addr, std::move(d) });
+                }
+            }
+        }
+    }
+
+    // dyld's precomputed type conformance table, keyed by (type descriptor, protocol).
+    // Same perfect hash header as the objc tables, but offsets are from the cache
+    // base and empty slots hold sentinelTarget.
+    static void swift_opt(const cache_t &cache, std::vector<swift_conf_t> &out)
+    {
+        const dyld_cache_header *hdr = cache.header();
+        if(!DSC_HAS_FIELD(hdr, swiftOptsSize) || hdr->swiftOptsOffset == 0)
+        {
+            return;
+        }
+        uint64_t base = cache.mappings[0].addr;
+        struct
+        {
+            uint32_t version;
+            uint32_t padding;
+            uint64_t typeConformanceHashTableCacheOffset;
+            uint64_t metadataConformanceHashTableCacheOffset;
+            uint64_t foreignTypeConformanceHashTableCacheOffset;
+        } opt;
+        const uint8_t *p = cache.ptr(base + hdr->swiftOptsOffset, sizeof(opt));
+        if(!p)
+        {
+            WRN("Swift optimization header out of bounds");
+            return;
+        }
+        memcpy(&opt, p, sizeof(opt));
+        if(opt.typeConformanceHashTableCacheOffset == 0)
+        {
+            return;
+        }
+        uint64_t addr = base + opt.typeConformanceHashTableCacheOffset;
+        struct
+        {
+            uint32_t capacity;
+            uint32_t occupied;
+            uint32_t shift;
+            uint32_t mask;
+            uint32_t sentinelTarget;
+            uint32_t roundedTabSize;
+            uint64_t salt;
+            uint32_t scramble[256];
+        } tab;
+        if(!(p = cache.ptr(addr, sizeof(tab))))
+        {
+            WRN("Swift conformance table out of bounds");
+            return;
+        }
+        memcpy(&tab, p, sizeof(tab));
+        const uint8_t *offs = cache.ptr(addr + sizeof(tab) + tab.roundedTabSize + tab.capacity, (uint64_t)tab.capacity * sizeof(uint32_t));
+        if(!offs)
+        {
+            WRN("Swift conformance table out of bounds");
+            return;
+        }
+        size_t bad = 0;
+        for(uint32_t i = 0; i < tab.capacity; ++i)
+        {
+            uint32_t off;
+            memcpy(&off, offs + i * sizeof(off), sizeof(off));
+            if(off == tab.sentinelTarget)
+            {
+                continue;
+            }
+            // { typeDescriptorCacheOffset, protocolCacheOffset, nextIsDuplicate:1 protocolConformanceCacheOffset:47 dylibObjCIndex:16 },
+            // duplicates follow their first entry directly
+            for(uint64_t ent = base + off; ; ent += 3 * sizeof(uint64_t))
+            {
+                uint64_t e[3];
+                const uint8_t *q = cache.ptr(ent, sizeof(e));
+                if(!q)
+                {
+                    ++bad;
+                    break;
+                }
+                memcpy(e, q, sizeof(e));
+                swift_conf_t c;
+                if(swift_conformance(cache, base + ((e[2] >> 1) & ((1ULL << 47) - 1)), c))
+                {
+                    out.push_back(std::move(c));
+                }
+                else
+                {
+                    ++bad;
+                }
+                if(!(e[2] & 1))
+                {
+                    break;
+                }
+            }
+        }
+        if(bad)
+        {
+            WRN("%zu unreadable entries in the Swift conformance table", bad);
+        }
+    }
+
+    int mode_swift_index(int argc, const char **argv)
+    {
+        if(argc != 3)
+        {
+            fprintf(stderr, "Usage: dsc_util swift-index <path-to-cache> <index-file>\n");
+            return 1;
+        }
+        cache_t cache;
+        if(!cache.open(argv[1]))
+        {
+            return 1;
+        }
+        std::vector<swift_img_t> imgs(cache.images.size());
+        parallel_for(cache.images.size(), [&](size_t i, size_t)
+        {
+            swift_image(cache, (uint32_t)i, imgs[i]);
+        });
+        std::vector<swift_conf_t> precomputed;
+        swift_opt(cache, precomputed);
+
+        // The image of a conformance is the one whose __TEXT contains its descriptor
+        std::vector<std::pair<uint64_t, uint32_t>> ranges; // (end, image), sorted
+        std::vector<uint64_t> starts(cache.images.size(), 0);
+        for(uint32_t i = 0; i < cache.images.size(); ++i)
+        {
+            const segment_t *seg = cache.headers().segment(i, "__TEXT");
+            if(seg)
+            {
+                starts[i] = seg->vmaddr;
+                ranges.push_back({ seg->vmaddr + seg->vmsize, i });
+            }
+        }
+        std::sort(ranges.begin(), ranges.end());
+        auto image_of = [&](uint64_t addr) -> uint32_t
+        {
+            auto it = std::upper_bound(ranges.begin(), ranges.end(), std::make_pair(addr, UINT32_MAX));
+            return it != ranges.end() && addr >= starts[it->second] ? it->second : SWIFT_NONE;
+        };
+
+        strtab_t str;
+        str.data.push_back('\0');
+        std::vector<uint32_t> images;
+        std::unordered_map<uint32_t, std::pair<uint32_t, uint32_t>> types;  // name -> (image, kind)
+        std::unordered_map<uint32_t, uint32_t> protos;                      // name -> image
+        std::vector<swift_index_conf_t> confs;
+        std::unordered_set<uint64_t> seen;  // Conformance descriptors already indexed
+        size_t extra = 0;
+        auto add_conf = [&](const swift_conf_t &c, uint32_t image)
+        {
+            if(!seen.insert(c.addr).second)
+            {
+                return false;
+            }
+            uint32_t type = str.add(c.type.c_str()),
+                     proto = str.add(c.proto.c_str());
+            types.emplace(type, std::make_pair(SWIFT_NONE, (uint32_t)SWIFT_KIND_CLASS));
+            protos.emplace(proto, SWIFT_NONE);
+            confs.push_back({ type, proto, image });
+            return true;
+        };
+        for(uint32_t i = 0; i < cache.images.size(); ++i)
+        {
+            images.push_back(str.add(cache.images[i].path));
+            for(const auto &t : imgs[i].types)
+            {
+                types[str.add(t.second.name.c_str())] = { i, t.second.kind };
+            }
+            for(const auto &p : imgs[i].protos)
+            {
+                protos[str.add(p.second.name.c_str())] = i;
+            }
+        }
+        for(uint32_t i = 0; i < cache.images.size(); ++i)
+        {
+            for(const swift_conf_t &c : imgs[i].confs)
+            {
+                add_conf(c, i);
+            }
+        }
+        for(const swift_conf_t &c : precomputed)
+        {
+            extra += add_conf(c, image_of(c.addr));
+        }
+        const char *strbase = str.data.c_str();
+
+        std::sort(confs.begin(), confs.end(), [&](const swift_index_conf_t &a, const swift_index_conf_t &b)
+        {
+            int r = strcmp(strbase + a.type, strbase + b.type);
+            if(r == 0)
+            {
+                r = strcmp(strbase + a.proto, strbase + b.proto);
+            }
+            return r != 0 ? r < 0 : a.image < b.image;
+        });
+        std::vector<uint32_t> byproto(confs.size());
+        for(uint32_t i = 0; i < confs.size(); ++i)
+        {
+            byproto[i] = i;
+        }
+        std::stable_sort(byproto.begin(), byproto.end(), [&](uint32_t a, uint32_t b)
+        {
+            return strcmp(strbase + confs[a].proto, strbase + confs[b].proto) < 0;
+        });
+
+        std::vector<swift_index_type_t> tarr;
+        tarr.reserve(types.size());
+        for(const auto &kv : types)
+        {
+            tarr.push_back({ kv.first, kv.second.first, kv.second.second, 0, 0 });
+        }
+        std::sort(tarr.begin(), tarr.end(), [&](const swift_index_type_t &a, const swift_index_type_t &b)
+        {
+            return strcmp(strbase + a.name, strbase + b.name) < 0;
+        });
+        for(uint32_t i = 0, j = 0; i < tarr.size(); ++i)
+        {
+            while(j < confs.size() && strcmp(strbase + confs[j].type, strbase + tarr[i].name) < 0)
+            {
+                ++j;
+            }
+            tarr[i].start = j;
+            while(j < confs.size() && confs[j].type == tarr[i].name)
+            {
+                ++j;
+            }
+            tarr[i].count = j - tarr[i].start;
+        }
+        std::vector<swift_index_proto_t> parr;
+        parr.reserve(protos.size());
+        for(const auto &kv : protos)
+        {
+            parr.push_back({ kv.first, kv.second, 0, 0 });
+        }
+        std::sort(parr.begin(), parr.end(), [&](const swift_index_proto_t &a, const swift_index_proto_t &b)
+        {
+            return strcmp(strbase + a.name, strbase + b.name) < 0;
+        });
+        for(uint32_t i = 0, j = 0; i < parr.size(); ++i)
+        {
+            while(j < byproto.size() && strcmp(strbase + confs[byproto[j]].proto, strbase + parr[i].name) < 0)
+            {
+                ++j;
+            }
+            parr[i].start = j;
+            while(j < byproto.size() && confs[byproto[j]].proto == parr[i].name)
+            {
+                ++j;
+            }
+            parr[i].count = j - parr[i].start;
+        }
+
+        while(str.data.size() % 4)
+        {
+            str.data.push_back('\0');
+        }
+        swift_index_header_t hdr = {};
+        hdr.magic = SWIFT_INDEX_MAGIC;
+        hdr.version = SWIFT_INDEX_VERSION;
+        hdr.nimages = (uint32_t)images.size();
+        hdr.ntypes = (uint32_t)tarr.size();
+        hdr.nprotos = (uint32_t)parr.size();
+        hdr.nconfs = (uint32_t)confs.size();
+        hdr.strsize = (uint32_t)str.data.size();
+        hdr.off_images = sizeof(hdr);
+        hdr.off_types = hdr.off_images + hdr.nimages * sizeof(uint32_t);
+        hdr.off_protos = hdr.off_types + hdr.ntypes * sizeof(swift_index_type_t);
+        hdr.off_confs = hdr.off_protos + hdr.nprotos * sizeof(swift_index_proto_t);
+        hdr.off_byproto = hdr.off_confs + hdr.nconfs * sizeof(swift_index_conf_t);
+        hdr.off_str = hdr.off_byproto + hdr.nconfs * sizeof(uint32_t);
+
+        FILE *f = fopen(argv[2], "wb");
+        if(!f)
+        {
+            ERR("fopen(%s): %s", argv[2], strerror(errno));
+            return 1;
+        }
+        bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+                  fwrite(images.data(), sizeof(uint32_t), images.size(), f) == images.size() &&
+                  fwrite(tarr.data(), sizeof(swift_index_type_t), tarr.size(), f) == tarr.size() &&
+                  fwrite(parr.data(), sizeof(swift_index_proto_t), parr.size(), f) == parr.size() &&
+                  fwrite(confs.data(), sizeof(swift_index_conf_t), confs.size(), f) == confs.size() &&
+                  fwrite(byproto.data(), sizeof(uint32_t), byproto.size(), f) == byproto.size() &&
+                  fwrite(str.data.data(), 1, str.data.size(), f) == str.data.size();
+        if(fclose(f) != 0 || !ok)
+        {
+            ERR("Failed to write %s", argv[2]);
+            return 1;
+        }
+        LOG("%u types, %u protocols, %u conformances (%zu only in the precomputed table)", hdr.ntypes, hdr.nprotos, hdr.nconfs, extra);
+        return 0;
+    }
+
+    struct swift_index_t
+    {
+        mapped_file_t file;
+        const swift_index_header_t *hdr = nullptr;
+
+        template<typename T>
+        const T* arr(uint32_t off, uint32_t count) const
+        {
+            return this->file.arr<T>(off, count);
+        }
+
+        const char* strs(void) const
+        {
+            return (const char*)this->file.base + this->hdr->off_str;
+        }
+
+        const char* str(uint32_t off) const
+        {
+            return off < this->hdr->strsize ? this->strs() + off : "?";
+        }
+
+        const char* image(uint32_t idx) const
+        {
+            return idx < this->hdr->nimages ? this->str(this->arr<uint32_t>(this->hdr->off_images, this->hdr->nimages)[idx]) : "?";
+        }
+
+        bool open(const char *path)
+        {
+            if(!this->file.open(path, sizeof(swift_index_header_t)))
+            {
+                return false;
+            }
+            this->hdr = (const swift_index_header_t*)this->file.base;
+            if(this->hdr->magic != SWIFT_INDEX_MAGIC || this->hdr->version != SWIFT_INDEX_VERSION ||
+               !this->arr<uint32_t>(this->hdr->off_images, this->hdr->nimages) ||
+               !this->arr<swift_index_type_t>(this->hdr->off_types, this->hdr->ntypes) ||
+               !this->arr<swift_index_proto_t>(this->hdr->off_protos, this->hdr->nprotos) ||
+               !this->arr<swift_index_conf_t>(this->hdr->off_confs, this->hdr->nconfs) ||
+               !this->arr<uint32_t>(this->hdr->off_byproto, this->hdr->nconfs) ||
+               !this->file.strtab(this->hdr->off_str, this->hdr->strsize))
+            {
+                ERR("%s: bad swift index", path);
+                return false;
+            }
+            return true;
+        }
+    };
+
+    static const char* swift_kind(uint32_t kind)
+    {
+        switch(kind)
+        {
+            case SWIFT_KIND_CLASS:  return "class";
+            case SWIFT_KIND_STRUCT: return "struct";
+            case SWIFT_KIND_ENUM:   return "enum";
+            default:                return "type";
+        }
+    }
+
+    int mode_swift_query(int argc, const char **argv)
+    {
+        if(argc != 4)
+        {
+            fprintf(stderr, "Usage: dsc_util swift-query <index-file> type|protocol <name>\n");
+            return 1;
+        }
+        swift_index_t idx;
+        if(!idx.open(argv[1]))
+        {
+            return 1;
+        }
+        const swift_index_header_t *hdr = idx.hdr;
+        const swift_index_conf_t *confs = idx.arr<swift_index_conf_t>(hdr->off_confs, hdr->nconfs);
+        const char *what = argv[2],
+                   *name = argv[3];
+        size_t found = 0;
+        if(strcmp(what, "type") == 0)
+        {
+            auto r = sorted_range(idx.arr<swift_index_type_t>(hdr->off_types, hdr->ntypes), hdr->ntypes, idx.strs(), name);
+            for(const swift_index_type_t *t = r.first; t != r.second; ++t, ++found)
+            {
+                printf("%s %s\t%s\n", swift_kind(t->kind), name, t->image == SWIFT_NONE ? "?" : idx.image(t->image));
+                for(uint32_t i = t->start; i < t->start + t->count && i < hdr->nconfs; ++i)
+                {
+                    printf("    : %s\t%s\n", idx.str(confs[i].proto), idx.image(confs[i].image));
+                }
+            }
+        }
+        else if(strcmp(what, "protocol") == 0)
+        {
+            const uint32_t *byproto = idx.arr<uint32_t>(hdr->off_byproto, hdr->nconfs);
+            auto r = sorted_range(idx.arr<swift_index_proto_t>(hdr->off_protos, hdr->nprotos), hdr->nprotos, idx.strs(), name);
+            for(const swift_index_proto_t *p = r.first; p != r.second; ++p, ++found)
+            {
+                printf("protocol %s\t%s\n", name, p->image == SWIFT_NONE ? "?" : idx.image(p->image));
+                for(uint32_t i = p->start; i < p->start + p->count && i < hdr->nconfs; ++i)
+                {
+                    if(byproto[i] < hdr->nconfs)
+                    {
+                        const swift_index_conf_t &c = confs[byproto[i]];
+                        printf("    %s\t%s\n", idx.str(c.type), idx.image(c.image));
+                    }
+                }
+            }
+        }
+        else
+        {
+            ERR("Unknown query: %s", what);
+            return 1;
+        }
+        return found ? 0 : 1;
+    }
+}
@@ -0,0 +1,1646 @@
+#include <algorithm>
+#include <errno.h>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "common.h"
+#include "format.h"
+#include "macho.h"
+#include "synth.h"
+
+// Layout of every generated file, main cache and subcaches alike:
+//
+//   header, mappings, mappings with slide info     main cache also: subcache table, image table, install names
+//   TEXT mapping       each image's header, load commands and __text, page aligned
+//   DATA mapping       each image's __data, page aligned
+//   LINKEDIT mapping   each image's export trie, function starts and nlists, then one string pool
+//   slide info for the DATA mapping, outside of any mapping
+//   main cache before v5: the local symbols region, when asked for
+//
+// v5 caches put the local symbols region in <cache>.symbols instead, behind a
+// header of its own that only has a UUID and the region's offset and size.
+// With stubs, the end of each image's __TEXT is a __stubs section of
+// optimized stubs (adrp, add, br straight to an export of a dependency), and
+// the code calls those exports directly with bl, as the cache builder leaves
+// calls it could bind within the cache. Every fourth call goes through a
+// branch island instead, of the same shape as the stubs, in an area after
+// the file's last image in the TEXT mapping. With binds, the first pointers
+// of each image's DATA go to exports of its dependencies instead of its own
+// code, and the patch table that lists them ends the last file's LINKEDIT.
+// From v3 on, every fourth of them is listed as a GOT use instead.
+//
+// With objc classes, image 1 is libobjc, whose __TEXT starts with an
+// __objc_opt_ro section holding a v16 objc_opt_t, the selector, class and
+// protocol hash tables it points to and the selector strings. Every other
+// image after the first gets one more DATA page at the end with its
+// __objc_classlist, __objc_protolist and the classes, metaclasses, class_ro_t,
+// relative method lists with direct selectors, protocol lists and names they
+// point to, in a chain of its own. The hash tables only list their strings,
+// lookups go through the offsets array, so there is no perfect hash to build.
+//
+// The header and tables sit at the start of the TEXT mapping as in real
+// caches, and files follow each other in VM without gaps. DATA pages hold a
+// chain of pointers into the image's own code at a fixed stride from a random
+// start, with filler in between, and every eighth page holds no pointers.
+#define SYNTH_PAGE          0x4000
+#define SYNTH_PAGE_V1       0x1000      // v1 bitmaps cover 4 KiB each
+#define SYNTH_BASE_64       0x180000000ULL
+#define SYNTH_BASE_32       0x1a000000ULL
+#define SYNTH_LIMIT_32      0x40000000ULL   // v4 pointers hold 30 bits
+#define SYNTH_FUNC_MIN      16          // Instructions per function
+#define SYNTH_FUNC_MAX      128
+#define SYNTH_DEPS_MAX      4           // Dependencies on earlier images, besides the first image
+#define SYNTH_STUB_SIZE     12
+#define SYNTH_REDACTED      "<redacted>"    // The one local the cache builder leaves in each image
+#define SYNTH_OBJC          1           // Index of libobjc, when there are classes
+#define SYNTH_OBJC_MAX      32          // Classes per image, so they fit in one page
+#define SYNTH_OBJC_SELS     16          // Selectors, the last two are in the table but implemented nowhere
+#define SYNTH_OBJC_OPT      48          // objc_opt_t v16
+#define SYNTH_OBJC_STRTAB   1056        // Header of a string hash table, scramble included
+#define SYNTH_OBJC_PROTO    72          // protocol_t, followed by its name
+#define SYNTH_OBJC_NAME     32          // Room for a class or protocol name
+#define SYNTH_OBJC_SMALL    0xc0000000  // Method list flags: relative entries with direct selectors
+
+// One class in its image's objc page, offsets from its class_t
+#define SYNTH_OBJC_META     40          // Metaclass
+#define SYNTH_OBJC_RO       80          // class_ro_t
+#define SYNTH_OBJC_META_RO  152
+#define SYNTH_OBJC_METHODS  224         // Two instance methods
+#define SYNTH_OBJC_CMETHODS 256         // One class method
+#define SYNTH_OBJC_CLSNAME  280
+#define SYNTH_OBJC_CLASS    312
+
+#define N_SECT                  0xe
+#define N_EXT                   0x1
+#define CPU_TYPE_ARM64          0x0100000c
+#define CPU_TYPE_ARM64_32       0x0200000c
+#define CPU_SUBTYPE_ARM64_ALL   0
+#define CPU_SUBTYPE_ARM64E      2
+#define CPU_SUBTYPE_ARM64_32_V8 1
+#define VM_PROT_READ            1
+#define VM_PROT_WRITE           2
+#define VM_PROT_EXECUTE         4
+
+namespace dsc
+{
+    // splitmix64, so output doesn't depend on the standard library's engines
+    struct synth_rng_t
+    {
+        uint64_t s;
+
+        uint64_t next(void)
+        {
+            uint64_t z = (this->s += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+        uint64_t below(uint64_t n) { return this->next() % n; }
+    };
+
+    struct synth_img_t
+    {
+        std::string path;
+        size_t file;
+        std::vector<size_t> deps;
+        std::vector<std::pair<std::string, uint64_t>> syms;  // Name and offset from the header, sorted by name
+        std::vector<uint64_t> funcs;    // Offsets of function starts from the header
+        std::vector<uint8_t> trie;
+        std::vector<uint8_t> fstarts;
+        uint8_t uuid[16];
+        synth_rng_t rng;                // Everything random about the image comes from here, so it's the same in any layout
+        uint64_t cmdsize = 0;
+        uint64_t sect = 0;              // Offset of __text from the header
+        uint32_t nstubs = 0;            // At the end of __TEXT
+        uint32_t island = 0;            // Index of the first of its islands in its file
+        uint32_t nbinds = 0;            // At the start of DATA
+        uint32_t nclasses = 0;          // In the last page of DATA
+        uint64_t opt = 0,               // libobjc only: __objc_opt_ro, offset from the header
+                 opt_size = 0;
+        uint64_t text_off = 0,          // File offsets, in the image's file
+                 text_size = 0,
+                 data_off = 0,
+                 data_size = 0,
+                 trie_off = 0,
+                 fstarts_off = 0,
+                 syms_off = 0;
+        uint32_t strx = 0;              // Offset of the first name in the file's string pool
+    };
+
+    struct synth_file_t
+    {
+        std::string path;
+        size_t first, last;             // Images
+        uint64_t vmbase = 0;
+        uint64_t islands = 0,           // File offset
+                 text_end = 0,
+                 data_end = 0,
+                 le_end = 0,
+                 str_off = 0,
+                 str_size = 0,
+                 patch_off = 0;             // Last file only, 0 without binds
+        uint8_t uuid[16];
+        std::vector<uint8_t> buf;
+    };
+
+    struct synth_t
+    {
+        synth_opts_t opts;
+        bool is64;
+        uint32_t hsize;                 // mappingOffset
+        uint64_t base;
+        uint32_t ptrsize;
+        uint32_t stride;                // Between pointers in DATA
+        std::vector<synth_img_t> imgs;
+        std::vector<synth_file_t> files;
+        std::vector<uint8_t> locals;    // Local symbols region
+        std::vector<uint8_t> patches;   // Patch table
+        uint8_t locals_uuid[16];        // Of the .symbols file
+    };
+
+    static inline uint64_t synth_align(uint64_t v, uint64_t a)
+    {
+        return (v + a - 1) & ~(a - 1);
+    }
+
+    static void synth_uleb(std::vector<uint8_t> &out, uint64_t v)
+    {
+        do
+        {
+            uint8_t b = v & 0x7f;
+            v >>= 7;
+            out.push_back(b | (v ? 0x80 : 0));
+        } while(v);
+    }
+
+    static size_t synth_uleb_size(uint64_t v)
+    {
+        size_t n = 1;
+        while(v >>= 7)
+        {
+            ++n;
+        }
+        return n;
+    }
+
+    struct synth_node_t
+    {
+        bool terminal = false;
+        uint64_t addr = 0;
+        std::vector<std::pair<std::string, size_t>> edges;
+        uint64_t off = 0;
+    };
+
+    // Compressed trie over syms[lo, hi), whose names share their first depth characters.
+    static size_t synth_trie_build(const std::vector<std::pair<std::string, uint64_t>> &syms, size_t lo, size_t hi, size_t depth, std::vector<synth_node_t> &nodes)
+    {
+        size_t idx = nodes.size();
+        nodes.emplace_back();
+        if(lo < hi && syms[lo].first.size() == depth)
+        {
+            nodes[idx].terminal = true;
+            nodes[idx].addr = syms[lo].second;
+            ++lo;
+        }
+        while(lo < hi)
+        {
+            char c = syms[lo].first[depth];
+            size_t end = lo;
+            while(end < hi && syms[end].first[depth] == c)
+            {
+                ++end;
+            }
+            // Sorted, so the group's common prefix is that of its first and last name
+            const std::string &a = syms[lo].first,
+                              &b = syms[end - 1].first;
+            size_t l = depth;
+            while(l < a.size() && l < b.size() && a[l] == b[l])
+            {
+                ++l;
+            }
+            size_t child = synth_trie_build(syms, lo, end, l, nodes);
+            nodes[idx].edges.push_back({ a.substr(depth, l - depth), child });
+            lo = end;
+        }
+        return idx;
+    }
+
+    static void synth_trie(synth_img_t &img)
+    {
+        std::vector<synth_node_t> nodes;
+        synth_trie_build(img.syms, 0, img.syms.size(), 0, nodes);
+        // Node sizes depend on child offsets and vice versa, iterate until they settle
+        for(bool changed = true; changed; )
+        {
+            changed = false;
+            uint64_t off = 0;
+            for(synth_node_t &n : nodes)
+            {
+                if(n.off != off)
+                {
+                    n.off = off;
+                    changed = true;
+                }
+                size_t term = n.terminal ? 1 + synth_uleb_size(n.addr) : 0;
+                off += synth_uleb_size(term) + term + 1;
+                for(const auto &e : n.edges)
+                {
+                    off += e.first.size() + 1 + synth_uleb_size(nodes[e.second].off);
+                }
+            }
+        }
+        std::vector<uint8_t> &out = img.trie;
+        for(const synth_node_t &n : nodes)
+        {
+            if(n.terminal)
+            {
+                synth_uleb(out, 1 + synth_uleb_size(n.addr));
+                out.push_back(EXPORT_SYMBOL_FLAGS_KIND_REGULAR);
+                synth_uleb(out, n.addr);
+            }
+            else
+            {
+                out.push_back(0);
+            }
+            out.push_back((uint8_t)n.edges.size());
+            for(const auto &e : n.edges)
+            {
+                out.insert(out.end(), e.first.begin(), e.first.end());
+                out.push_back(0);
+                synth_uleb(out, nodes[e.second].off);
+            }
+        }
+    }
+
+    static void synth_names(const synth_t &s, size_t i, synth_rng_t &rng, synth_img_t &img)
+    {
+        static const char *prefixes[] = { "_CF", "_NS", "_UI", "_os_", "_dispatch_", "_xpc_", "__ZN5Synth", "_objc_" };
+        static const char *verbs[] = { "Create", "Release", "Retain", "Copy", "Get", "Set", "Add", "Remove", "Lookup", "Register", "Invalidate", "Notify", "Perform", "Handle", "Update", "Configure" };
+        static const char *nouns[] = { "Value", "Object", "Queue", "Port", "String", "Array", "Dictionary", "Context", "Session", "Buffer", "Stream", "Image", "Cache", "Entry", "Record", "Observer" };
+        const char *prefix = prefixes[i % (sizeof(prefixes)/sizeof(prefixes[0]))];
+        for(uint32_t j = 0; j < s.opts.symbols; ++j)
+        {
+            std::string name = prefix;
+            name += "Synth" + std::to_string(i);
+            name += verbs[rng.below(sizeof(verbs)/sizeof(verbs[0]))];
+            name += nouns[rng.below(sizeof(nouns)/sizeof(nouns[0]))];
+            name += std::to_string(j);
+            img.syms.push_back({ name, img.funcs[j % img.funcs.size()] });
+        }
+        std::sort(img.syms.begin(), img.syms.end());
+    }
+
+    template<typename T>
+    static T* synth_put(std::vector<uint8_t> &out)
+    {
+        size_t off = out.size();
+        out.resize(off + sizeof(T));
+        return (T*)(out.data() + off);
+    }
+
+    // Appends a section to the segment command at offset at in out.
+    template<bool W64>
+    static void synth_section(std::vector<uint8_t> &out, size_t at, const char *name, uint64_t addr, uint64_t size, uint32_t flags)
+    {
+        typedef macho_fmt_t<W64> fmt;
+        typename fmt::section *sec = synth_put<typename fmt::section>(out);
+        typename fmt::segment *seg = (typename fmt::segment*)(out.data() + at);
+        memset(sec, 0, sizeof(*sec));
+        memcpy(sec->sectname, name, strlen(name));
+        memcpy(sec->segname, seg->segname, sizeof(sec->segname));
+        sec->addr = (typename fmt::uptr)addr;
+        sec->size = (typename fmt::uptr)size;
+        sec->offset = (uint32_t)(seg->fileoff + (addr - seg->vmaddr));
+        sec->align = 3;
+        sec->flags = flags;
+        seg->nsects += 1;
+        seg->cmdsize += sizeof(typename fmt::section);
+    }
+
+    // Names of objc metadata, the same in the images and in libobjc's tables.
+    static std::string synth_objc_sel(uint32_t k)
+    {
+        return "synthSelector" + std::to_string(k) + ":";
+    }
+
+    static std::string synth_objc_class(size_t i, uint32_t j)
+    {
+        return "SynthClass" + std::to_string(i) + "_" + std::to_string(j);
+    }
+
+    static std::string synth_objc_proto(size_t i)
+    {
+        return "SynthProto" + std::to_string(i);
+    }
+
+    // The image's objc page, and where its protocol and classes are in it, after the class and protocol lists.
+    static uint64_t synth_objc_page(const synth_t &s, const synth_img_t &img)
+    {
+        return s.files[img.file].vmbase + img.data_off + img.data_size - SYNTH_PAGE;
+    }
+
+    static uint64_t synth_objc_proto_off(const synth_img_t &img)
+    {
+        return 8 * (uint64_t)img.nclasses + 8;
+    }
+
+    static uint64_t synth_objc_class_off(const synth_img_t &img, uint32_t j)
+    {
+        return synth_objc_proto_off(img) + SYNTH_OBJC_PROTO + SYNTH_OBJC_NAME + (uint64_t)j * SYNTH_OBJC_CLASS;
+    }
+
+    // Protocols the image's classes conform to: their own image's, and libobjc's too outside of libobjc.
+    static uint32_t synth_objc_nprotos(const synth_t &s, const synth_img_t &img)
+    {
+        return &img - s.imgs.data() == SYNTH_OBJC ? 1 : 2;
+    }
+
+    // Protocol lists follow the classes back to back, as the linker tends to leave them.
+    static uint64_t synth_objc_list_off(const synth_t &s, const synth_img_t &img, uint32_t j)
+    {
+        return synth_objc_class_off(img, img.nclasses) + (uint64_t)j * 8 * (1 + synth_objc_nprotos(s, img));
+    }
+
+    // Bytes in a string hash table of n entries, and the size of its tab and check bytes.
+    static uint64_t synth_strtab_size(uint64_t n, uint32_t *tab = nullptr, uint32_t *chk = nullptr)
+    {
+        uint32_t t = 1;
+        while(t < n)
+        {
+            t <<= 1;
+        }
+        if(tab)
+        {
+            *tab = t;
+            *chk = (uint32_t)synth_align(n, 8);
+        }
+        return SYNTH_OBJC_STRTAB + t + synth_align(n, 8) + n * sizeof(int32_t);
+    }
+
+    // Writes a string hash table that will be at addr and lists the strings at targets. The tab and check bytes stay zero.
+    static void synth_strtab(uint8_t *out, uint64_t addr, const std::vector<uint64_t> &targets)
+    {
+        uint32_t n = (uint32_t)targets.size(),
+                 tab, chk;
+        synth_strtab_size(n, &tab, &chk);
+        // capacity, occupied, shift, mask, roundedTabSize, roundedCheckBytesSize
+        uint32_t hdr[6] = { n, n, 0, tab - 1, tab, chk };
+        memcpy(out, hdr, sizeof(hdr));
+        uint8_t *offs = out + SYNTH_OBJC_STRTAB + tab + chk;
+        for(uint32_t k = 0; k < n; ++k)
+        {
+            int32_t off = (int32_t)(targets[k] - addr);
+            memcpy(offs + k * sizeof(off), &off, sizeof(off));
+        }
+    }
+
+    // libobjc's __objc_opt_ro, offsets from its start.
+    struct synth_objc_opt_t
+    {
+        uint64_t sels, classes, protos;     // Hash tables
+        uint64_t strs;                      // Selector strings, the base for direct selectors
+        uint64_t size;
+    };
+
+    static synth_objc_opt_t synth_objc_opt(const synth_t &s)
+    {
+        uint64_t nclasses = 0,
+                 nprotos = 0;
+        for(const synth_img_t &img : s.imgs)
+        {
+            nclasses += img.nclasses;
+            nprotos += img.nclasses != 0;
+        }
+        synth_objc_opt_t o;
+        o.sels = SYNTH_OBJC_OPT;
+        o.classes = synth_align(o.sels + synth_strtab_size(SYNTH_OBJC_SELS), 8);
+        o.protos = synth_align(o.classes + synth_strtab_size(nclasses), 8);
+        o.strs = synth_align(o.protos + synth_strtab_size(nprotos), 8);
+        o.size = o.strs;
+        for(uint32_t k = 0; k < SYNTH_OBJC_SELS; ++k)
+        {
+            o.size += synth_objc_sel(k).size() + 1;
+        }
+        return o;
+    }
+
+    // Offset of the k-th selector from the selector strings.
+    static uint64_t synth_objc_sel_off(uint32_t k)
+    {
+        uint64_t off = 0;
+        for(uint32_t l = 0; l < k; ++l)
+        {
+            off += synth_objc_sel(l).size() + 1;
+        }
+        return off;
+    }
+
+    // Fills libobjc's __objc_opt_ro at out: a v16 objc_opt_t, whose old class and protocol table offsets stay zero, and what it points to.
+    static void synth_objc_opt_ro(const synth_t &s, const synth_img_t &img, uint8_t *out)
+    {
+        synth_objc_opt_t o = synth_objc_opt(s);
+        uint64_t addr = s.files[img.file].vmbase + img.text_off + img.opt;
+        int32_t f[10] = {};
+        f[0] = 16;
+        f[2] = (int32_t)o.sels;
+        f[8] = (int32_t)o.classes;
+        f[9] = (int32_t)o.protos;
+        int64_t rel = (int64_t)o.strs;
+        memcpy(out, f, sizeof(f));
+        memcpy(out + sizeof(f), &rel, sizeof(rel));
+
+        std::vector<uint64_t> sels, classes, protos;
+        for(uint32_t k = 0; k < SYNTH_OBJC_SELS; ++k)
+        {
+            std::string name = synth_objc_sel(k);
+            uint64_t off = o.strs + synth_objc_sel_off(k);
+            memcpy(out + off, name.c_str(), name.size() + 1);
+            sels.push_back(addr + off);
+        }
+        for(const synth_img_t &c : s.imgs)
+        {
+            uint64_t page = c.nclasses ? synth_objc_page(s, c) : 0;
+            for(uint32_t j = 0; j < c.nclasses; ++j)
+            {
+                classes.push_back(page + synth_objc_class_off(c, j) + SYNTH_OBJC_CLSNAME);
+            }
+            if(c.nclasses)
+            {
+                protos.push_back(page + synth_objc_proto_off(c) + SYNTH_OBJC_PROTO);
+            }
+        }
+        synth_strtab(out + o.sels, addr + o.sels, sels);
+        synth_strtab(out + o.classes, addr + o.classes, classes);
+        synth_strtab(out + o.protos, addr + o.protos, protos);
+    }
+
+    template<bool W64>
+    static void synth_segment(std::vector<uint8_t> &out, const char *name, uint64_t vmaddr, uint64_t size, uint64_t fileoff, uint32_t prot, const char *sect, uint64_t sectaddr, uint64_t sectsize, uint32_t nstubs = 0)
+    {
+        typedef macho_fmt_t<W64> fmt;
+        size_t at = out.size();
+        typename fmt::segment *seg = synth_put<typename fmt::segment>(out);
+        memset(seg, 0, sizeof(*seg));
+        seg->cmd = fmt::segment_cmd;
+        seg->cmdsize = sizeof(typename fmt::segment);
+        memcpy(seg->segname, name, strlen(name));
+        seg->vmaddr = (typename fmt::uptr)vmaddr;
+        seg->vmsize = (typename fmt::uptr)size;
+        seg->fileoff = (typename fmt::uptr)fileoff;
+        seg->filesize = (typename fmt::uptr)size;
+        seg->maxprot = prot;
+        seg->initprot = prot;
+        if(sect)
+        {
+            seg->nsects = 1;
+            seg->cmdsize += sizeof(typename fmt::section);
+            typename fmt::section *sec = synth_put<typename fmt::section>(out);
+            memset(sec, 0, sizeof(*sec));
+            memcpy(sec->sectname, sect, strlen(sect));
+            memcpy(sec->segname, name, strlen(name));
+            sec->addr = (typename fmt::uptr)sectaddr;
+            sec->size = (typename fmt::uptr)sectsize;
+            sec->offset = (uint32_t)(fileoff + (sectaddr - vmaddr));
+            sec->align = 2;
+            sec->flags = S_ATTR_PURE_INSTRUCTIONS | S_ATTR_SOME_INSTRUCTIONS;
+        }
+        if(sect && nstubs != 0)
+        {
+            // Carved out of the end of the first section
+            ((typename fmt::section*)(out.data() + at + sizeof(typename fmt::segment)))->size -= nstubs * SYNTH_STUB_SIZE;
+            typename fmt::section *sec = synth_put<typename fmt::section>(out);
+            seg = (typename fmt::segment*)(out.data() + at);
+            seg->nsects = 2;
+            seg->cmdsize += sizeof(typename fmt::section);
+            memset(sec, 0, sizeof(*sec));
+            memcpy(sec->sectname, "__stubs", strlen("__stubs"));
+            memcpy(sec->segname, name, strlen(name));
+            sec->addr = (typename fmt::uptr)(sectaddr + sectsize - nstubs * SYNTH_STUB_SIZE);
+            sec->size = (typename fmt::uptr)(nstubs * SYNTH_STUB_SIZE);
+            sec->offset = (uint32_t)(fileoff + (sec->addr - vmaddr));
+            sec->align = 2;
+            sec->flags = S_SYMBOL_STUBS | S_ATTR_PURE_INSTRUCTIONS | S_ATTR_SOME_INSTRUCTIONS;
+            sec->reserved2 = SYNTH_STUB_SIZE;
+        }
+    }
+
+    static void synth_dylib(std::vector<uint8_t> &out, uint32_t cmd, const std::string &path, uint32_t align)
+    {
+        size_t at = out.size();
+        dylib_command *dc = synth_put<dylib_command>(out);
+        memset(dc, 0, sizeof(*dc));
+        dc->cmd = cmd;
+        dc->name = sizeof(dylib_command);
+        dc->current_version = 0x10000;
+        dc->compatibility_version = 0x10000;
+        out.insert(out.end(), path.c_str(), path.c_str() + path.size() + 1);
+        out.resize(at + synth_align(out.size() - at, align));
+        ((dylib_command*)(out.data() + at))->cmdsize = (uint32_t)(out.size() - at);
+    }
+
+    // Load commands of an image. Sizes don't depend on the layout, so this is also how it's measured.
+    template<bool W64>
+    static void synth_cmds(const synth_t &s, const synth_img_t &img, std::vector<uint8_t> &out, uint32_t &ncmds)
+    {
+        const synth_file_t &f = s.files[img.file];
+        uint64_t vm = f.vmbase;
+        size_t at = out.size();
+        synth_segment<W64>(out, "__TEXT", vm + img.text_off, img.text_size, img.text_off, VM_PROT_READ | VM_PROT_EXECUTE, "__text", vm + img.text_off + img.sect, img.text_size - img.sect, img.nstubs);
+        if(img.opt_size != 0)
+        {
+            synth_section<W64>(out, at, "__objc_opt_ro", vm + img.text_off + img.opt, img.opt_size, 0);
+        }
+        at = out.size();
+        uint64_t objc = img.nclasses ? SYNTH_PAGE : 0;
+        synth_segment<W64>(out, "__DATA", vm + img.data_off, img.data_size, img.data_off, VM_PROT_READ | VM_PROT_WRITE, "__data", vm + img.data_off, img.data_size - objc);
+        if(objc != 0)
+        {
+            uint64_t page = vm + img.data_off + img.data_size - objc,
+                     protos = synth_objc_proto_off(img);
+            synth_section<W64>(out, at, "__objc_classlist", page, protos - 8, 0);
+            synth_section<W64>(out, at, "__objc_protolist", page + protos - 8, 8, 0);
+            synth_section<W64>(out, at, "__objc_const", page + protos, SYNTH_PAGE - protos, 0);
+        }
+        synth_segment<W64>(out, "__LINKEDIT", vm + f.data_end, f.le_end - f.data_end, f.data_end, VM_PROT_READ, nullptr, 0, 0);
+        ncmds = 3;
+        uint32_t align = W64 ? 8 : 4;
+        synth_dylib(out, LC_ID_DYLIB, img.path, align);
+        ++ncmds;
+        for(size_t d : img.deps)
+        {
+            synth_dylib(out, LC_LOAD_DYLIB, s.imgs[d].path, align);
+            ++ncmds;
+        }
+
+        uuid_command *uc = synth_put<uuid_command>(out);
+        uc->cmd = LC_UUID;
+        uc->cmdsize = sizeof(uuid_command);
+        memcpy(uc->uuid, img.uuid, sizeof(uc->uuid));
+
+        build_version_command *bv = synth_put<build_version_command>(out);
+        bv->cmd = LC_BUILD_VERSION;
+        bv->cmdsize = sizeof(build_version_command);
+        bv->ntools = 0;
+        bv->platform = W64 ? PLATFORM_IOS : PLATFORM_WATCHOS;
+        bv->minos = 0xf0000;
+        bv->sdk = 0xf0000;
+
+        // Newer caches moved the trie out of LC_DYLD_INFO
+        if(s.opts.slide == 5)
+        {
+            linkedit_data_command *ex = synth_put<linkedit_data_command>(out);
+            ex->cmd = LC_DYLD_EXPORTS_TRIE;
+            ex->cmdsize = sizeof(linkedit_data_command);
+            ex->dataoff = (uint32_t)img.trie_off;
+            ex->datasize = (uint32_t)img.trie.size();
+        }
+        else
+        {
+            dyld_info_command *di = synth_put<dyld_info_command>(out);
+            memset(di, 0, sizeof(*di));
+            di->cmd = LC_DYLD_INFO_ONLY;
+            di->cmdsize = sizeof(dyld_info_command);
+            di->export_off = (uint32_t)img.trie_off;
+            di->export_size = (uint32_t)img.trie.size();
+        }
+
+        linkedit_data_command *fs = synth_put<linkedit_data_command>(out);
+        fs->cmd = LC_FUNCTION_STARTS;
+        fs->cmdsize = sizeof(linkedit_data_command);
+        fs->dataoff = (uint32_t)img.fstarts_off;
+        fs->datasize = (uint32_t)img.fstarts.size();
+
+        symtab_command *st = synth_put<symtab_command>(out);
+        st->cmd = LC_SYMTAB;
+        st->cmdsize = sizeof(symtab_command);
+        st->symoff = (uint32_t)img.syms_off;
+        st->nsyms = (uint32_t)img.syms.size() + (s.opts.locals ? 1 : 0);
+        st->stroff = (uint32_t)f.str_off;
+        st->strsize = (uint32_t)f.str_size;
+
+        dysymtab_command *dt = synth_put<dysymtab_command>(out);
+        memset(dt, 0, sizeof(*dt));
+        dt->cmd = LC_DYSYMTAB;
+        dt->cmdsize = sizeof(dysymtab_command);
+        // What the cache builder leaves behind of the locals it takes out
+        dt->nlocalsym = s.opts.locals ? 1 : 0;
+        dt->iextdefsym = dt->nlocalsym;
+        dt->nextdefsym = (uint32_t)img.syms.size();
+        dt->iundefsym = dt->nlocalsym + (uint32_t)img.syms.size();
+        ncmds += 6;
+    }
+
+    // Export of a dependency that the image's j-th stub goes to.
+    static uint64_t synth_callee(const synth_t &s, const synth_img_t &img, uint32_t j)
+    {
+        size_t i = &img - s.imgs.data();
+        const synth_img_t &dep = s.imgs[img.deps[j % img.deps.size()]];
+        return s.files[dep.file].vmbase + dep.text_off + dep.syms[(i * 7 + j) % dep.syms.size()].second;
+    }
+
+    // An optimized stub or island at pc.
+    static void synth_jump(uint8_t *out, uint64_t pc, uint64_t target)
+    {
+        int64_t page = (int64_t)((target & ~0xfffULL) - (pc & ~0xfffULL)) >> 12;
+        uint32_t insns[3] =
+        {
+            0x90000010 | (uint32_t)((page & 3) << 29) | (uint32_t)(((page >> 2) & 0x7ffff) << 5),    // adrp x16, target@page
+            0x91000210 | (uint32_t)((target & 0xfff) << 10),                                        // add x16, x16, target@pageoff
+            0xd61f0200,                                                                             // br x16
+        };
+        memcpy(out, insns, sizeof(insns));
+    }
+
+    template<bool W64>
+    static void synth_text(const synth_t &s, const synth_img_t &img, uint8_t *out, synth_rng_t &rng)
+    {
+        typedef macho_fmt_t<W64> fmt;
+        std::vector<uint8_t> cmds;
+        uint32_t ncmds = 0;
+        synth_cmds<W64>(s, img, cmds, ncmds);
+        typename fmt::header *mh = (typename fmt::header*)out;
+        mh->magic = W64 ? MH_MAGIC_64 : MH_MAGIC;
+        mh->cputype = W64 ? CPU_TYPE_ARM64 : CPU_TYPE_ARM64_32;
+        mh->cpusubtype = !W64 ? CPU_SUBTYPE_ARM64_32_V8 : s.opts.slide == 3 || s.opts.slide == 5 ? CPU_SUBTYPE_ARM64E : CPU_SUBTYPE_ARM64_ALL;
+        mh->filetype = MH_DYLIB;
+        mh->ncmds = ncmds;
+        mh->sizeofcmds = (uint32_t)cmds.size();
+        mh->flags = MH_DYLIB_IN_CACHE;
+        memcpy(out + sizeof(typename fmt::header), cmds.data(), cmds.size());
+        if(img.opt_size != 0)
+        {
+            synth_objc_opt_ro(s, img, out + img.opt);
+        }
+
+        // Common instruction shapes with random registers and immediates, each function ending in ret
+        static const uint32_t ops[] = { 0xd503201f, 0xaa0003e0, 0x91000000, 0xf9400000, 0xf9000000, 0xb9400000, 0x94000000, 0x34000000, 0x52800000, 0xa9bf7bfd, 0xa8c17bfd, 0x910003fd, 0xeb00001f, 0x54000000 };
+        size_t f = 0;
+        uint64_t stubs = img.text_size - img.nstubs * SYNTH_STUB_SIZE;
+        for(uint64_t off = img.sect; off + 4 <= stubs; off += 4)
+        {
+            uint32_t insn;
+            if(f + 1 < img.funcs.size() && off + 4 == img.funcs[f + 1])
+            {
+                insn = 0xd65f03c0;
+                ++f;
+            }
+            else
+            {
+                uint64_t r = rng.next();
+                insn = ops[r % (sizeof(ops)/sizeof(ops[0]))] | (uint32_t)((r >> 32) & 0x3ff);
+            }
+            memcpy(out + off, &insn, sizeof(insn));
+        }
+
+        // Stubs go straight to their target, and the second instruction of a function calls it when in range
+        const synth_file_t &file = s.files[img.file];
+        uint64_t vmtext = file.vmbase + img.text_off;
+        for(uint32_t j = 0; j < img.nstubs; ++j)
+        {
+            uint64_t target = synth_callee(s, img, j);
+            synth_jump(out + stubs + j * SYNTH_STUB_SIZE, vmtext + stubs + j * SYNTH_STUB_SIZE, target);
+            if(j % 4 == 3)
+            {
+                target = file.vmbase + file.islands + (img.island + j / 4) * SYNTH_STUB_SIZE;
+            }
+            uint64_t call = j < img.funcs.size() ? img.funcs[j] + 4 : 0;
+            int64_t delta = (int64_t)(target - (vmtext + call));
+            if(call != 0 && call + 4 < stubs && delta >= -(1LL << 27) && delta < (1LL << 27))
+            {
+                uint32_t bl = 0x94000000 | (uint32_t)((delta >> 2) & 0x3ffffff);
+                memcpy(out + call, &bl, sizeof(bl));
+            }
+        }
+    }
+
+    // Encodes a pointer to target whose chain continues next bytes on (0 ends it).
+    static uint64_t synth_ptr(const synth_t &s, uint64_t target, uint64_t next, bool auth, uint64_t div)
+    {
+        switch(s.opts.slide)
+        {
+            case 2:
+                return target | ((next / 4) << 40);
+            case 3:
+                if(auth)
+                {
+                    return (1ULL << 63) | ((next / 8) << 51) | ((uint64_t)(div & 3) << 49) | (div << 32) | ((target - s.base) & 0xffffffff);
+                }
+                return ((next / 8) << 51) | (((target >> 56) & 0xff) << 43) | (target & 0x7ffffffffffULL);
+            case 4:
+                return target | ((next / 4) << 30);
+            case 5:
+                if(auth)
+                {
+                    return (1ULL << 63) | ((next / 8) << 52) | ((uint64_t)(div & 1) << 51) | (div << 34) | ((target - s.base) & 0x3ffffffffULL);
+                }
+                return ((next / 8) << 52) | ((target - s.base) & 0x3ffffffffULL);
+        }
+        return target;
+    }
+
+    // The same, signed at random.
+    static uint64_t synth_ptr(const synth_t &s, uint64_t target, uint64_t next, synth_rng_t &rng)
+    {
+        bool auth = (rng.next() & 3) == 0;
+        uint64_t div = rng.next() & 0xffff;
+        return synth_ptr(s, target, next, auth, div);
+    }
+
+    struct synth_bind_t
+    {
+        uint64_t addr;
+        uint64_t target;
+        size_t dep;
+        size_t sym;
+        bool auth;
+        uint16_t div;
+        uint8_t key;
+    };
+
+    // The image's k-th bound pointer, in the k-th chain slot of its first DATA page, to the export its k-th stub goes to.
+    static synth_bind_t synth_bind(const synth_t &s, const synth_img_t &img, uint32_t k)
+    {
+        size_t i = &img - s.imgs.data();
+        synth_bind_t b;
+        b.dep = img.deps[k % img.deps.size()];
+        const synth_img_t &dep = s.imgs[b.dep];
+        b.sym = (i * 7 + k) % dep.syms.size();
+        b.addr = s.files[img.file].vmbase + img.data_off + (uint64_t)k * s.stride;
+        b.target = s.files[dep.file].vmbase + dep.text_off + dep.syms[b.sym].second;
+        b.auth = (s.opts.slide == 3 || s.opts.slide == 5) && k % 2 == 0;
+        // Even, so the key comes out as IA or DA, which every location format can express
+        b.div = (uint16_t)((i * 31 + k) << 1);
+        b.key = s.opts.slide == 3 ? b.div & 3 : 0;
+        return b;
+    }
+
+    // Fills the image's objc page at out and appends where its chain starts. Only for 64-bit caches.
+    static void synth_objc(const synth_t &s, const synth_img_t &img, uint8_t *out, std::vector<uint16_t> &starts)
+    {
+        size_t i = &img - s.imgs.data();
+        const synth_img_t &objc = s.imgs[SYNTH_OBJC];
+        uint64_t page = synth_objc_page(s, img),
+                 vmtext = s.files[img.file].vmbase + img.text_off,
+                 proto = synth_objc_proto_off(img);
+        std::map<uint64_t, uint64_t> ptrs;  // Offset in the page, target
+        auto put32 = [&](uint64_t off, uint32_t v)
+        {
+            memcpy(out + off, &v, sizeof(v));
+        };
+        auto name = [&](uint64_t off, const std::string &v)
+        {
+            memcpy(out + off, v.c_str(), v.size() + 1);
+        };
+        // Small methods with direct selectors: name from the selector base, types and implementation from the field
+        auto methods = [&](uint64_t off, std::initializer_list<uint32_t> sels, uint64_t imp)
+        {
+            put32(off, SYNTH_OBJC_SMALL | 12);
+            put32(off + 4, (uint32_t)sels.size());
+            uint64_t ent = off + 8;
+            for(uint32_t k : sels)
+            {
+                put32(ent, (uint32_t)synth_objc_sel_off(k));
+                put32(ent + 8, (uint32_t)(int32_t)(imp - (page + ent + 8)));
+                ent += 12;
+            }
+        };
+
+        // protocol_t { isa, name, protocols, instanceMethods, classMethods, optionalInstanceMethods, optionalClassMethods, instanceProperties, size, flags }
+        ptrs[proto - 8] = page + proto;
+        ptrs[proto + 8] = page + proto + SYNTH_OBJC_PROTO;
+        put32(proto + 64, SYNTH_OBJC_PROTO);
+        name(proto + SYNTH_OBJC_PROTO, synth_objc_proto(i));
+        uint64_t objc_proto = synth_objc_page(s, objc) + synth_objc_proto_off(objc);
+        for(uint32_t j = 0; j < img.nclasses; ++j)
+        {
+            uint64_t c = synth_objc_class_off(img, j),
+                     a = page + c;
+            ptrs[8 * j] = a;
+            // class_t { isa, superclass, cache, vtable, data }, a chain of superclasses from the first class, which is a root
+            ptrs[c] = a + SYNTH_OBJC_META;
+            if(j != 0)
+            {
+                ptrs[c + 8] = page + synth_objc_class_off(img, j - 1);
+            }
+            ptrs[c + 32] = a + SYNTH_OBJC_RO;
+            ptrs[c + SYNTH_OBJC_META + 32] = a + SYNTH_OBJC_META_RO;
+            // class_ro_t { flags, instanceStart, instanceSize, reserved, ivarLayout, name, baseMethods, baseProtocols, ... }
+            put32(c + SYNTH_OBJC_RO + 4, 8);
+            put32(c + SYNTH_OBJC_RO + 8, 8);
+            ptrs[c + SYNTH_OBJC_RO + 24] = a + SYNTH_OBJC_CLSNAME;
+            ptrs[c + SYNTH_OBJC_RO + 32] = a + SYNTH_OBJC_METHODS;
+            ptrs[c + SYNTH_OBJC_RO + 40] = page + synth_objc_list_off(s, img, j);
+            put32(c + SYNTH_OBJC_META_RO, 1);   // RO_META
+            put32(c + SYNTH_OBJC_META_RO + 4, 40);
+            put32(c + SYNTH_OBJC_META_RO + 8, 40);
+            ptrs[c + SYNTH_OBJC_META_RO + 24] = a + SYNTH_OBJC_CLSNAME;
+            ptrs[c + SYNTH_OBJC_META_RO + 32] = a + SYNTH_OBJC_CMETHODS;
+            uint64_t imp = vmtext + img.funcs[j % img.funcs.size()];
+            methods(c + SYNTH_OBJC_METHODS, { (uint32_t)((i + j) % (SYNTH_OBJC_SELS - 4)), (uint32_t)((i + j + 5) % (SYNTH_OBJC_SELS - 4)) }, imp);
+            methods(c + SYNTH_OBJC_CMETHODS, { SYNTH_OBJC_SELS - 4 + j % 2 }, imp);
+            name(c + SYNTH_OBJC_CLSNAME, synth_objc_class(i, j));
+            // protocol_list_t { count, protocols[] }, the count a plain word in a pointer-sized slot
+            uint64_t l = synth_objc_list_off(s, img, j),
+                     count = synth_objc_nprotos(s, img);
+            memcpy(out + l, &count, sizeof(count));
+            ptrs[l + 8] = page + proto;
+            if(count == 2)
+            {
+                ptrs[l + 16] = objc_proto;
+            }
+        }
+
+        starts.push_back((uint16_t)ptrs.begin()->first);
+        for(auto it = ptrs.begin(); it != ptrs.end(); ++it)
+        {
+            auto next = std::next(it);
+            uint64_t raw = synth_ptr(s, it->second, next != ptrs.end() ? next->first - it->first : 0, false, 0);
+            memcpy(out + it->first, &raw, sizeof(raw));
+        }
+    }
+
+    // Fills the image's DATA and appends where the chain of each of its pages starts, 0xffff for none.
+    static void synth_data(const synth_t &s, const synth_img_t &img, uint8_t *out, std::vector<uint16_t> &starts, synth_rng_t &rng)
+    {
+        uint64_t vmtext = s.files[img.file].vmbase + img.text_off,
+                 objc = img.nclasses ? SYNTH_PAGE : 0;
+        for(uint64_t page = 0; page < img.data_size - objc; page += SYNTH_PAGE)
+        {
+            uint8_t *p = out + page;
+            for(uint64_t off = 0; off < SYNTH_PAGE; off += 8)
+            {
+                uint64_t filler = rng.next() & 0x00000000ffff00ffULL;
+                memcpy(p + off, &filler, sizeof(filler));
+            }
+            bool binds = page == 0 && img.nbinds != 0;
+            if(rng.below(8) == 0 && !binds)
+            {
+                starts.push_back(0xffff);
+                continue;
+            }
+            uint64_t first = binds ? 0 : rng.below(0x100 / s.stride) * s.stride;
+            starts.push_back((uint16_t)first);
+            for(uint64_t off = first; off + s.ptrsize <= SYNTH_PAGE; off += s.stride)
+            {
+                uint64_t next = off + s.stride + s.ptrsize <= SYNTH_PAGE ? s.stride : 0;
+                uint64_t raw;
+                if(binds && off / s.stride < img.nbinds)
+                {
+                    synth_bind_t b = synth_bind(s, img, (uint32_t)(off / s.stride));
+                    raw = synth_ptr(s, b.target, next, b.auth, b.div);
+                }
+                else
+                {
+                    raw = synth_ptr(s, vmtext + img.funcs[rng.below(img.funcs.size())], next, rng);
+                }
+                memcpy(p + off, &raw, s.ptrsize);
+            }
+        }
+        if(objc != 0)
+        {
+            synth_objc(s, img, out + img.data_size - objc, starts);
+        }
+    }
+
+    // Slide info for a DATA mapping whose pages start their chains at starts.
+    static void synth_slide(const synth_t &s, const std::vector<uint16_t> &starts, std::vector<uint8_t> &out)
+    {
+        uint32_t n = (uint32_t)starts.size();
+        if(s.opts.slide == 1)
+        {
+            // A bitmap of pointer words per 4 KiB page, each page its own entry
+            uint32_t count = n * (SYNTH_PAGE / SYNTH_PAGE_V1),
+                     esize = SYNTH_PAGE_V1 / 4 / 8,
+                     toc = 6 * sizeof(uint32_t),
+                     entries = (uint32_t)synth_align(toc + count * sizeof(uint16_t), 4);
+            uint32_t hdr[6] = { 1, toc, count, entries, count, esize };
+            out.assign(entries + (size_t)count * esize, 0);
+            memcpy(out.data(), hdr, sizeof(hdr));
+            for(uint32_t i = 0; i < count; ++i)
+            {
+                uint16_t e = (uint16_t)i;
+                memcpy(out.data() + toc + i * sizeof(uint16_t), &e, sizeof(e));
+            }
+            for(uint32_t p = 0; p < n; ++p)
+            {
+                if(starts[p] == 0xffff)
+                {
+                    continue;
+                }
+                for(uint64_t off = starts[p]; off + s.ptrsize <= SYNTH_PAGE; off += s.stride)
+                {
+                    uint64_t word = ((uint64_t)p * SYNTH_PAGE + off) / 4;
+                    out[entries + word / 8] |= (uint8_t)(1 << (word % 8));
+                }
+            }
+            return;
+        }
+        size_t hsize = s.opts.slide == 2 || s.opts.slide == 4 ? sizeof(dyld_cache_slide_info2) : sizeof(dyld_cache_slide_info3);
+        out.assign(hsize + n * sizeof(uint16_t), 0);
+        if(s.opts.slide == 2 || s.opts.slide == 4)
+        {
+            dyld_cache_slide_info2 *si = (dyld_cache_slide_info2*)out.data();
+            si->version = s.opts.slide;
+            si->page_size = SYNTH_PAGE;
+            si->page_starts_offset = (uint32_t)hsize;
+            si->page_starts_count = n;
+            si->page_extras_offset = (uint32_t)out.size();
+            si->page_extras_count = 0;
+            si->delta_mask = s.opts.slide == 2 ? 0x00ffff0000000000ULL : 0xc0000000ULL;
+            si->value_add = 0;
+        }
+        else
+        {
+            dyld_cache_slide_info3 *si = (dyld_cache_slide_info3*)out.data();
+            si->version = s.opts.slide;
+            si->page_size = SYNTH_PAGE;
+            si->page_starts_count = n;
+            si->auth_value_add = s.base;
+        }
+        for(uint32_t p = 0; p < n; ++p)
+        {
+            uint16_t v = starts[p];
+            if(s.opts.slide == 2 || s.opts.slide == 4)
+            {
+                v = v == 0xffff ? (s.opts.slide == 2 ? DYLD_CACHE_SLIDE_PAGE_ATTR_NO_REBASE : DYLD_CACHE_SLIDE4_PAGE_NO_REBASE) : v / 4;
+            }
+            memcpy(out.data() + hsize + p * sizeof(uint16_t), &v, sizeof(v));
+        }
+    }
+
+    // Location bits of a bound pointer in the given patch table version.
+    static uint32_t synth_loc_bits(uint32_t version, const synth_bind_t &b)
+    {
+        if(!b.auth)
+        {
+            return 0;
+        }
+        if(version >= 4)
+        {
+            return 1 | (b.key >= 2 ? 1u << 10 : 0) | (uint32_t)b.div << 11;
+        }
+        return 1u << 12 | (uint32_t)b.key << 14 | (uint32_t)b.div << 16;
+    }
+
+    // Patch table listing every bound pointer, to be placed at vm. Arrays follow the info struct in the order it lists them.
+    static void synth_patches(synth_t &s, uint64_t vm)
+    {
+        uint32_t version = s.opts.patches;
+        size_t n = s.imgs.size();
+        // Exporting image, export, client: binds
+        std::vector<std::map<size_t, std::map<size_t, std::vector<synth_bind_t>>>> uses(n),
+                                                                                  got(n);
+        for(size_t i = 0; i < n; ++i)
+        {
+            for(uint32_t k = 0; k < s.imgs[i].nbinds; ++k)
+            {
+                synth_bind_t b = synth_bind(s, s.imgs[i], k);
+                (version >= 3 && k % 4 == 3 ? got : uses)[b.dep][b.sym][i].push_back(b);
+            }
+        }
+        std::vector<uint8_t> &out = s.patches;
+        std::string names;
+        auto put = [&](const auto &arr, uint64_t &addr, uint64_t &count)
+        {
+            out.resize(synth_align(out.size(), 8));
+            addr = vm + out.size();
+            count = arr.size();
+            for(const auto &v : arr)
+            {
+                *synth_put<typename std::decay<decltype(v)>::type>(out) = v;
+            }
+        };
+        // Exports of image e that anything binds to, sorted
+        auto exported = [&](size_t e)
+        {
+            std::vector<size_t> syms;
+            for(const auto &u : uses[e])
+            {
+                syms.push_back(u.first);
+            }
+            for(const auto &u : got[e])
+            {
+                syms.push_back(u.first);
+            }
+            std::sort(syms.begin(), syms.end());
+            syms.erase(std::unique(syms.begin(), syms.end()), syms.end());
+            return syms;
+        };
+
+        if(version == 1)
+        {
+            out.resize(sizeof(dyld_cache_patch_info_v1));
+            dyld_cache_patch_info_v1 info = {};
+            std::vector<dyld_cache_image_patches_v1> images;
+            std::vector<dyld_cache_image_export_v1> exports;
+            std::vector<dyld_cache_patchable_location_v1> locs;
+            for(size_t e = 0; e < n; ++e)
+            {
+                const synth_img_t &img = s.imgs[e];
+                std::vector<size_t> syms = exported(e);
+                images.push_back({ (uint32_t)exports.size(), (uint32_t)syms.size() });
+                for(size_t sym : syms)
+                {
+                    uint64_t impl = s.files[img.file].vmbase + img.text_off + img.syms[sym].second;
+                    exports.push_back({ (uint32_t)(impl - s.base), (uint32_t)locs.size(), 0, (uint32_t)names.size() });
+                    names += img.syms[sym].first;
+                    names += '\0';
+                    for(const auto &client : uses[e][sym])
+                    {
+                        for(const synth_bind_t &b : client.second)
+                        {
+                            locs.push_back({ (b.addr - s.base) | (uint64_t)synth_loc_bits(1, b) << 32 });
+                        }
+                    }
+                    exports.back().patchLocationsCount = (uint32_t)locs.size() - exports.back().patchLocationsStartIndex;
+                }
+            }
+            put(images, info.patchTableArrayAddr, info.patchTableArrayCount);
+            put(exports, info.patchExportArrayAddr, info.patchExportArrayCount);
+            put(locs, info.patchLocationArrayAddr, info.patchLocationArrayCount);
+            put(names, info.patchExportNamesAddr, info.patchExportNamesSize);
+            memcpy(out.data(), &info, sizeof(info));
+        }
+        else
+        {
+            size_t isize = version >= 3 ? sizeof(dyld_cache_patch_info_v3) : offsetof(dyld_cache_patch_info_v3, gotClientsArrayAddr);
+            out.resize(isize);
+            dyld_cache_patch_info_v3 info = {};
+            info.patchTableVersion = version;
+            std::vector<dyld_cache_image_patches_v2> images;
+            std::vector<dyld_cache_image_export_v2> exports;
+            std::vector<dyld_cache_image_clients_v2> clients;
+            std::vector<dyld_cache_patchable_export_v2> cexports,
+                                                        gexports;
+            std::vector<dyld_cache_patchable_location_v2> locs;
+            std::vector<dyld_cache_image_got_clients_v3> gclients;
+            std::vector<dyld_cache_patchable_location_v3> glocs;
+            for(size_t e = 0; e < n; ++e)
+            {
+                const synth_img_t &img = s.imgs[e];
+                std::vector<size_t> syms = exported(e);
+                uint32_t start = (uint32_t)exports.size();
+                for(size_t sym : syms)
+                {
+                    exports.push_back({ (uint32_t)img.syms[sym].second, (uint32_t)names.size() });
+                    names += img.syms[sym].first;
+                    names += '\0';
+                }
+                auto index = [&](size_t sym)
+                {
+                    return start + (uint32_t)(std::lower_bound(syms.begin(), syms.end(), sym) - syms.begin());
+                };
+                // Client-major: for each client, the exports it uses and where
+                std::map<size_t, std::vector<std::pair<size_t, const std::vector<synth_bind_t>*>>> byclient;
+                for(const auto &u : uses[e])
+                {
+                    for(const auto &client : u.second)
+                    {
+                        byclient[client.first].push_back({ u.first, &client.second });
+                    }
+                }
+                images.push_back({ (uint32_t)clients.size(), (uint32_t)byclient.size(), start, (uint32_t)syms.size() });
+                for(const auto &client : byclient)
+                {
+                    uint64_t user = s.files[s.imgs[client.first].file].vmbase + s.imgs[client.first].text_off;
+                    clients.push_back({ (uint32_t)client.first, (uint32_t)cexports.size(), (uint32_t)client.second.size() });
+                    for(const auto &use : client.second)
+                    {
+                        cexports.push_back({ index(use.first), (uint32_t)locs.size(), (uint32_t)use.second->size() });
+                        for(const synth_bind_t &b : *use.second)
+                        {
+                            locs.push_back({ (uint32_t)(b.addr - user), synth_loc_bits(version, b) });
+                        }
+                    }
+                }
+                if(version >= 3)
+                {
+                    gclients.push_back({ (uint32_t)gexports.size(), (uint32_t)got[e].size() });
+                    for(const auto &u : got[e])
+                    {
+                        uint32_t first = (uint32_t)glocs.size();
+                        for(const auto &client : u.second)
+                        {
+                            for(const synth_bind_t &b : client.second)
+                            {
+                                glocs.push_back({ b.addr - s.base, synth_loc_bits(version, b), 0 });
+                            }
+                        }
+                        gexports.push_back({ index(u.first), first, (uint32_t)glocs.size() - first });
+                    }
+                }
+            }
+            put(images, info.patchTableArrayAddr, info.patchTableArrayCount);
+            put(exports, info.patchImageExportsArrayAddr, info.patchImageExportsArrayCount);
+            put(clients, info.patchClientsArrayAddr, info.patchClientsArrayCount);
+            put(cexports, info.patchClientExportsArrayAddr, info.patchClientExportsArrayCount);
+            put(locs, info.patchLocationArrayAddr, info.patchLocationArrayCount);
+            if(version >= 3)
+            {
+                put(gclients, info.gotClientsArrayAddr, info.gotClientsArrayCount);
+                put(gexports, info.gotClientExportsArrayAddr, info.gotClientExportsArrayCount);
+                put(glocs, info.gotLocationArrayAddr, info.gotLocationArrayCount);
+            }
+            put(names, info.patchExportNamesAddr, info.patchExportNamesSize);
+            memcpy(out.data(), &info, isize);
+        }
+        out.resize(synth_align(out.size(), 8));
+    }
+
+    // Local symbols region, with 64-bit entries as the headers written here all have symbolFileUUID.
+    // Names come from a pool half the size of the image's locals, so each one repeats, like the
+    // compiler-generated ones in real images.
+    template<bool W64>
+    static void synth_locals(synth_t &s)
+    {
+        typedef macho_fmt_t<W64> fmt;
+        size_t n = s.imgs.size();
+        uint64_t count = (uint64_t)n * s.opts.locals;
+        uint64_t entries = sizeof(dyld_cache_local_symbols_info),
+                 nlists = synth_align(entries + n * sizeof(dyld_cache_local_symbols_entry_64), 8),
+                 strs = nlists + count * sizeof(typename fmt::nlist);
+        s.locals.assign(strs + 1, 0);
+        std::string pool(1, '\0');
+        uint32_t names = std::max<uint32_t>(s.opts.locals / 2, 1);
+        for(size_t i = 0; i < n; ++i)
+        {
+            const synth_img_t &img = s.imgs[i];
+            uint64_t vmtext = s.files[img.file].vmbase + img.text_off;
+            dyld_cache_local_symbols_entry_64 ent;
+            ent.dylibOffset = vmtext - s.base;
+            ent.nlistStartIndex = (uint32_t)(i * s.opts.locals);
+            ent.nlistCount = s.opts.locals;
+            memcpy(s.locals.data() + entries + i * sizeof(ent), &ent, sizeof(ent));
+            for(uint32_t j = 0; j < s.opts.locals; ++j)
+            {
+                typename fmt::nlist nl;
+                memset(&nl, 0, sizeof(nl));
+                nl.n_strx = (uint32_t)pool.size();
+                nl.n_type = N_SECT;
+                nl.n_sect = 1;
+                nl.n_value = (typename fmt::uptr)(vmtext + img.funcs[j % img.funcs.size()]);
+                memcpy(s.locals.data() + nlists + (i * s.opts.locals + j) * sizeof(nl), &nl, sizeof(nl));
+                pool += "_synth" + std::to_string(i) + "_helper" + std::to_string(j % names);
+                pool += '\0';
+            }
+        }
+        s.locals.resize(strs);
+        s.locals.insert(s.locals.end(), pool.begin(), pool.end());
+        s.locals.resize(synth_align(s.locals.size(), 8));
+        dyld_cache_local_symbols_info info;
+        info.nlistOffset = (uint32_t)nlists;
+        info.nlistCount = (uint32_t)count;
+        info.stringsOffset = (uint32_t)strs;
+        info.stringsSize = (uint32_t)pool.size();
+        info.entriesOffset = (uint32_t)entries;
+        info.entriesCount = (uint32_t)n;
+        memcpy(s.locals.data(), &info, sizeof(info));
+    }
+
+    // Assigns every image its place, file by file. Nothing is written yet, but everything the load commands refer to is known afterwards.
+    template<bool W64>
+    static bool synth_layout(synth_t &s)
+    {
+        typedef macho_fmt_t<W64> fmt;
+        bool modern = s.opts.slide == 5;
+        size_t entsize = modern ? sizeof(dyld_subcache_entry) : sizeof(dyld_subcache_entry_v1);
+        uint64_t vm = s.base;
+        for(size_t fi = 0; fi < s.files.size(); ++fi)
+        {
+            synth_file_t &f = s.files[fi];
+            f.vmbase = vm;
+            uint64_t cur = s.hsize + 3 * sizeof(dyld_cache_mapping_info) + 3 * sizeof(dyld_cache_mapping_and_slide_info);
+            if(fi == 0)
+            {
+                cur += (s.files.size() - 1) * entsize + s.imgs.size() * sizeof(dyld_cache_image_info);
+                for(const synth_img_t &img : s.imgs)
+                {
+                    cur += img.path.size() + 1;
+                }
+            }
+            cur = synth_align(cur, SYNTH_PAGE);
+            for(size_t i = f.first; i < f.last; ++i)
+            {
+                synth_img_t &img = s.imgs[i];
+                std::vector<uint8_t> cmds;
+                uint32_t ncmds;
+                synth_cmds<W64>(s, img, cmds, ncmds);
+                img.cmdsize = cmds.size();
+                img.opt = synth_align(sizeof(typename fmt::header) + img.cmdsize, 16);
+                img.sect = synth_align(img.opt + img.opt_size, 16);
+                img.text_size = synth_align(std::max<uint64_t>(s.opts.text, img.sect + SYNTH_FUNC_MAX * 4 + img.nstubs * SYNTH_STUB_SIZE), SYNTH_PAGE);
+                img.text_off = cur;
+                cur += img.text_size;
+                for(uint64_t off = img.sect; off + SYNTH_FUNC_MAX * 4 + img.nstubs * SYNTH_STUB_SIZE <= img.text_size; off += 4 * (SYNTH_FUNC_MIN + img.rng.below(SYNTH_FUNC_MAX - SYNTH_FUNC_MIN)))
+                {
+                    img.funcs.push_back(off);
+                }
+            }
+            f.islands = cur;
+            uint32_t nislands = 0;
+            for(size_t i = f.first; i < f.last; ++i)
+            {
+                s.imgs[i].island = nislands;
+                nislands += s.imgs[i].nstubs / 4;
+            }
+            cur = synth_align(cur + nislands * SYNTH_STUB_SIZE, SYNTH_PAGE);
+            f.text_end = cur;
+            for(size_t i = f.first; i < f.last; ++i)
+            {
+                synth_img_t &img = s.imgs[i];
+                img.data_off = cur;
+                img.data_size = synth_align(std::max<uint64_t>(s.opts.data, 1), SYNTH_PAGE) + (img.nclasses ? SYNTH_PAGE : 0);
+                cur += img.data_size;
+            }
+            f.data_end = cur;
+            uint64_t strs = 1;
+            for(size_t i = f.first; i < f.last; ++i)
+            {
+                synth_img_t &img = s.imgs[i];
+                synth_names(s, i, img.rng, img);
+                synth_trie(img);
+                uint64_t prev = 0;
+                for(uint64_t fn : img.funcs)
+                {
+                    synth_uleb(img.fstarts, fn - prev);
+                    prev = fn;
+                }
+                img.fstarts.push_back(0);
+                img.fstarts.resize(synth_align(img.fstarts.size(), 8));
+                img.trie_off = cur;
+                cur = synth_align(cur + img.trie.size(), 8);
+                img.fstarts_off = cur;
+                cur += img.fstarts.size();
+                img.syms_off = cur;
+                cur += (img.syms.size() + (s.opts.locals ? 1 : 0)) * sizeof(typename fmt::nlist);
+                img.strx = (uint32_t)strs;
+                if(s.opts.locals)
+                {
+                    strs += sizeof(SYNTH_REDACTED);
+                }
+                for(const auto &sym : img.syms)
+                {
+                    strs += sym.first.size() + 1;
+                }
+            }
+            f.str_off = synth_align(cur, 8);
+            f.str_size = synth_align(strs, 8);
+            f.le_end = synth_align(f.str_off + f.str_size, SYNTH_PAGE);
+            // Every image has its place by now
+            if(fi + 1 == s.files.size() && s.opts.binds != 0)
+            {
+                f.patch_off = f.str_off + f.str_size;
+                synth_patches(s, f.vmbase + f.patch_off);
+                f.le_end = synth_align(f.patch_off + s.patches.size(), SYNTH_PAGE);
+            }
+            if(f.le_end > UINT32_MAX)
+            {
+                ERR("%s: more than 4 GiB in one file, use more subcaches", f.path.c_str());
+                return false;
+            }
+            vm += f.le_end;
+        }
+        if(!W64 && vm > SYNTH_LIMIT_32)
+        {
+            ERR("Cache too large for 32-bit pointers (%llu MiB)", (unsigned long long)((vm - s.base) >> 20));
+            return false;
+        }
+        return true;
+    }
+
+    template<bool W64>
+    static void synth_file(synth_t &s, size_t fi)
+    {
+        typedef macho_fmt_t<W64> fmt;
+        synth_file_t &f = s.files[fi];
+        bool modern = s.opts.slide == 5;
+
+        std::vector<uint16_t> starts;
+        std::vector<uint8_t> slide;
+        f.buf.assign(f.le_end, 0);
+        for(size_t i = f.first; i < f.last; ++i)
+        {
+            const synth_img_t &img = s.imgs[i];
+            synth_rng_t rng = img.rng;
+            synth_text<W64>(s, img, f.buf.data() + img.text_off, rng);
+            for(uint32_t j = 3; j < img.nstubs; j += 4)
+            {
+                uint64_t off = f.islands + (img.island + j / 4) * SYNTH_STUB_SIZE;
+                synth_jump(f.buf.data() + off, f.vmbase + off, synth_callee(s, img, j));
+            }
+            synth_data(s, img, f.buf.data() + img.data_off, starts, rng);
+            memcpy(f.buf.data() + img.trie_off, img.trie.data(), img.trie.size());
+            memcpy(f.buf.data() + img.fstarts_off, img.fstarts.data(), img.fstarts.size());
+            uint64_t vmtext = f.vmbase + img.text_off;
+            uint32_t strx = img.strx;
+            typename fmt::nlist *nls = (typename fmt::nlist*)(f.buf.data() + img.syms_off);
+            if(s.opts.locals)
+            {
+                nls->n_strx = strx;
+                nls->n_type = N_SECT;
+                nls->n_sect = 1;
+                nls->n_value = (typename fmt::uptr)vmtext;
+                memcpy(f.buf.data() + f.str_off + strx, SYNTH_REDACTED, sizeof(SYNTH_REDACTED));
+                strx += sizeof(SYNTH_REDACTED);
+                ++nls;
+            }
+            for(size_t j = 0; j < img.syms.size(); ++j)
+            {
+                typename fmt::nlist *nl = nls + j;
+                nl->n_strx = strx;
+                nl->n_type = N_SECT | N_EXT;
+                nl->n_sect = 1;
+                nl->n_value = (typename fmt::uptr)(vmtext + img.syms[j].second);
+                const std::string &name = img.syms[j].first;
+                memcpy(f.buf.data() + f.str_off + strx, name.c_str(), name.size() + 1);
+                strx += (uint32_t)name.size() + 1;
+            }
+        }
+        if(f.patch_off != 0)
+        {
+            memcpy(f.buf.data() + f.patch_off, s.patches.data(), s.patches.size());
+        }
+        uint64_t slide_off = f.buf.size();
+        if(s.opts.slide != 0)
+        {
+            synth_slide(s, starts, slide);
+            f.buf.insert(f.buf.end(), slide.begin(), slide.end());
+        }
+        uint64_t locals_off = synth_align(f.buf.size(), 8);
+        bool inline_locals = fi == 0 && !s.locals.empty() && !modern;
+        if(inline_locals)
+        {
+            f.buf.resize(locals_off);
+            f.buf.insert(f.buf.end(), s.locals.begin(), s.locals.end());
+        }
+
+        dyld_cache_header hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        snprintf(hdr.magic, sizeof(hdr.magic), "dyld_v1%8s", !W64 ? "arm64_32" : s.opts.slide == 3 || s.opts.slide == 5 ? "arm64e" : "arm64");
+        hdr.mappingOffset = s.hsize;
+        hdr.mappingCount = 3;
+        hdr.mappingWithSlideOffset = s.hsize + 3 * sizeof(dyld_cache_mapping_info);
+        hdr.mappingWithSlideCount = 3;
+        if(s.opts.slide != 0)
+        {
+            hdr.slideInfoOffsetUnused = slide_off;
+            hdr.slideInfoSizeUnused = slide.size();
+        }
+        memcpy(hdr.uuid, f.uuid, sizeof(hdr.uuid));
+        if(inline_locals)
+        {
+            hdr.localSymbolsOffset = locals_off;
+            hdr.localSymbolsSize = s.locals.size();
+        }
+        else if(fi == 0 && !s.locals.empty())
+        {
+            memcpy(hdr.symbolFileUUID, s.locals_uuid, sizeof(hdr.symbolFileUUID));
+        }
+        hdr.platform = W64 ? PLATFORM_IOS : PLATFORM_WATCHOS;
+        if(fi == 0 && !s.patches.empty())
+        {
+            hdr.patchInfoAddr = s.files.back().vmbase + s.files.back().patch_off;
+            hdr.patchInfoSize = s.patches.size();
+        }
+        hdr.sharedRegionStart = s.base;
+        hdr.sharedRegionSize = s.files.back().vmbase + s.files.back().le_end - s.base;
+
+        const dyld_cache_mapping_info maps[3] =
+        {
+            { f.vmbase,               f.text_end,              0,          VM_PROT_READ | VM_PROT_EXECUTE, VM_PROT_READ | VM_PROT_EXECUTE },
+            { f.vmbase + f.text_end,  f.data_end - f.text_end, f.text_end, VM_PROT_READ | VM_PROT_WRITE,   VM_PROT_READ | VM_PROT_WRITE   },
+            { f.vmbase + f.data_end,  f.le_end - f.data_end,   f.data_end, VM_PROT_READ,                   VM_PROT_READ                   },
+        };
+        uint8_t *p = f.buf.data() + s.hsize;
+        memcpy(p, maps, sizeof(maps));
+        p += sizeof(maps);
+        for(size_t m = 0; m < 3; ++m)
+        {
+            dyld_cache_mapping_and_slide_info sm;
+            memset(&sm, 0, sizeof(sm));
+            sm.address = maps[m].address;
+            sm.size = maps[m].size;
+            sm.fileOffset = maps[m].fileOffset;
+            sm.maxProt = maps[m].maxProt;
+            sm.initProt = maps[m].initProt;
+            if(m == 1 && s.opts.slide != 0)
+            {
+                sm.slideInfoFileOffset = slide_off;
+                sm.slideInfoFileSize = slide.size();
+            }
+            memcpy(p, &sm, sizeof(sm));
+            p += sizeof(sm);
+        }
+
+        if(fi == 0)
+        {
+            size_t nsub = s.files.size() - 1,
+                   entsize = modern ? sizeof(dyld_subcache_entry) : sizeof(dyld_subcache_entry_v1);
+            hdr.subCacheArrayOffset = (uint32_t)(p - f.buf.data());
+            hdr.subCacheArrayCount = (uint32_t)nsub;
+            for(size_t i = 1; i <= nsub; ++i)
+            {
+                dyld_subcache_entry ent;
+                memset(&ent, 0, sizeof(ent));
+                memcpy(ent.uuid, s.files[i].uuid, sizeof(ent.uuid));
+                ent.cacheVMOffset = s.files[i].vmbase - s.base;
+                snprintf(ent.fileSuffix, sizeof(ent.fileSuffix), ".%02zu", i);
+                memcpy(p, &ent, entsize);
+                p += entsize;
+            }
+            uint32_t imgoff = (uint32_t)(p - f.buf.data()),
+                     pathoff = imgoff + (uint32_t)(s.imgs.size() * sizeof(dyld_cache_image_info));
+            hdr.imagesOffsetOld = hdr.imagesOffset = imgoff;
+            hdr.imagesCountOld = hdr.imagesCount = (uint32_t)s.imgs.size();
+            for(const synth_img_t &img : s.imgs)
+            {
+                dyld_cache_image_info ii;
+                memset(&ii, 0, sizeof(ii));
+                ii.address = s.files[img.file].vmbase + img.text_off;
+                ii.pathFileOffset = pathoff;
+                memcpy(p, &ii, sizeof(ii));
+                p += sizeof(ii);
+                memcpy(f.buf.data() + pathoff, img.path.c_str(), img.path.size() + 1);
+                pathoff += (uint32_t)img.path.size() + 1;
+            }
+        }
+        memcpy(f.buf.data(), &hdr, s.hsize);
+    }
+
+    static bool synth_save(const std::string &path, const std::vector<uint8_t> &buf)
+    {
+        if(!mkdirs(path))
+        {
+            return false;
+        }
+        FILE *out = fopen(path.c_str(), "wb");
+        if(!out)
+        {
+            ERR("fopen(%s): %s", path.c_str(), strerror(errno));
+            return false;
+        }
+        bool ok = fwrite(buf.data(), 1, buf.size(), out) == buf.size();
+        if(fclose(out) != 0 || !ok)
+        {
+            ERR("Failed to write %s", path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool synth_write(const char *path, const synth_opts_t &opts)
+    {
+        if(opts.images == 0 || opts.slide > 5 || opts.subcaches >= opts.images || opts.patches > 4)
+        {
+            ERR("Need at least one image per file, a slide info version from 0 to 5 and a patch table version from 0 to 4");
+            return false;
+        }
+        if(opts.objc != 0 && (opts.images < 2 || (opts.slide != 3 && opts.slide != 5) || opts.objc > SYNTH_OBJC_MAX))
+        {
+            ERR("objc classes need at least two images, slide info v3 or v5 and at most %u classes per image", SYNTH_OBJC_MAX);
+            return false;
+        }
+        synth_t s;
+        s.opts = opts;
+        if(s.opts.patches == 0)
+        {
+            // v2 arrived with iOS 16, whose caches still had v3 slide info, and v4 some time after v5
+            s.opts.patches = opts.slide == 5 ? 4 : 1;
+        }
+        s.is64 = opts.slide != 4;
+        s.ptrsize = s.is64 ? 8 : 4;
+        s.stride = s.is64 ? 16 : 8;     // v4 chains can only skip 3 words
+        s.base = s.is64 ? SYNTH_BASE_64 : SYNTH_BASE_32;
+        // Split caches came with the layout that has file suffixes, which arrived with v5
+        s.hsize = opts.slide == 5 ? sizeof(dyld_cache_header) : offsetof(dyld_cache_header, cacheSubType);
+        synth_rng_t rng = { opts.seed };
+
+        size_t n = opts.images,
+               nfiles = opts.subcaches + 1;
+        s.files.resize(nfiles);
+        for(size_t fi = 0; fi < nfiles; ++fi)
+        {
+            synth_file_t &f = s.files[fi];
+            f.path = path;
+            if(fi != 0)
+            {
+                char suffix[16];
+                snprintf(suffix, sizeof(suffix), opts.slide == 5 ? ".%02zu" : ".%zu", fi);
+                f.path += suffix;
+            }
+            f.first = fi * n / nfiles;
+            f.last = (fi + 1) * n / nfiles;
+            for(uint8_t &b : f.uuid)
+            {
+                b = (uint8_t)rng.next();
+            }
+        }
+        s.imgs.resize(n);
+        for(size_t i = 0; i < n; ++i)
+        {
+            synth_img_t &img = s.imgs[i];
+            img.rng = { opts.seed ^ (0xd1b54a32d192ed03ULL * (i + 1)) };
+            switch(i % 3)
+            {
+                case 0:  img.path = "/System/Library/Frameworks/Synth" + std::to_string(i) + ".framework/Synth" + std::to_string(i); break;
+                case 1:  img.path = "/usr/lib/libsynth" + std::to_string(i) + ".dylib"; break;
+                default: img.path = "/System/Library/PrivateFrameworks/SynthCore" + std::to_string(i) + ".framework/SynthCore" + std::to_string(i); break;
+            }
+            if(i == 0)
+            {
+                img.path = "/usr/lib/libSystem.B.dylib";
+            }
+            else if(i == SYNTH_OBJC && opts.objc != 0)
+            {
+                img.path = "/usr/lib/libobjc.A.dylib";
+            }
+            img.file = nfiles * i / n;
+            while(s.files[img.file].last <= i)
+            {
+                ++img.file;
+            }
+            if(i > 0)
+            {
+                img.deps.push_back(0);
+                for(uint64_t k = img.rng.below(SYNTH_DEPS_MAX + 1); k > 0 && i > 1; --k)
+                {
+                    size_t d = 1 + img.rng.below(i - 1);
+                    if(std::find(img.deps.begin(), img.deps.end(), d) == img.deps.end())
+                    {
+                        img.deps.push_back(d);
+                    }
+                }
+            }
+            for(uint8_t &b : img.uuid)
+            {
+                b = (uint8_t)img.rng.next();
+            }
+            img.nstubs = img.deps.empty() ? 0 : opts.stubs;
+            img.nbinds = img.deps.empty() ? 0 : std::min<uint32_t>(opts.binds, SYNTH_PAGE / s.stride);
+            img.nclasses = i == 0 ? 0 : opts.objc;
+        }
+        if(opts.objc != 0)
+        {
+            s.imgs[SYNTH_OBJC].opt_size = synth_objc_opt(s).size;
+        }
+
+        if(!(s.is64 ? synth_layout<true>(s) : synth_layout<false>(s)))
+        {
+            return false;
+        }
+        if(opts.locals != 0)
+        {
+            if(s.is64)
+            {
+                synth_locals<true>(s);
+            }
+            else
+            {
+                synth_locals<false>(s);
+            }
+            for(uint8_t &b : s.locals_uuid)
+            {
+                b = (uint8_t)rng.next();
+            }
+            if(opts.slide == 5)
+            {
+                dyld_cache_header hdr;
+                memset(&hdr, 0, sizeof(hdr));
+                snprintf(hdr.magic, sizeof(hdr.magic), "dyld_v1%8s", "arm64e");
+                hdr.mappingOffset = s.hsize;
+                memcpy(hdr.uuid, s.locals_uuid, sizeof(hdr.uuid));
+                hdr.localSymbolsOffset = synth_align(s.hsize, SYNTH_PAGE);
+                hdr.localSymbolsSize = s.locals.size();
+                std::vector<uint8_t> buf(hdr.localSymbolsOffset, 0);
+                memcpy(buf.data(), &hdr, s.hsize);
+                buf.insert(buf.end(), s.locals.begin(), s.locals.end());
+                if(!synth_save(std::string(path) + ".symbols", buf))
+                {
+                    return false;
+                }
+            }
+        }
+        for(size_t fi = 0; fi < nfiles; ++fi)
+        {
+            synth_file_t &f = s.files[fi];
+            if(s.is64)
+            {
+                synth_file<true>(s, fi);
+            }
+            else
+            {
+                synth_file<false>(s, fi);
+            }
+            if(!synth_save(f.path, f.buf))
+            {
+                return false;
+            }
+            f.buf = std::vector<uint8_t>();
+        }
+        return true;
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef DSC_SYNTH_H
+#define DSC_SYNTH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace dsc
+{
+    // Shape of a synthetic cache. Everything else (install names, dependencies,
+    // code, symbol names, pointer targets) is derived from the seed, so the
+    // same options always give the same bytes.
+    struct synth_opts_t
+    {
+        size_t images = 100;
+        uint64_t text = 0x10000;    // __TEXT bytes per image, header and load commands included
+        uint64_t data = 0x4000;     // __DATA bytes per image, rounded up to whole pages
+        uint32_t symbols = 200;     // Exported per image, and listed in the symbol table
+        uint32_t slide = 3;         // Slide info version, 0 for none. 3 and 5 make an arm64e cache, 4 an arm64_32 one
+        uint32_t subcaches = 0;     // Files besides the main one, images are spread evenly over all of them
+        uint32_t stubs = 0;         // Calls per image into its dependencies, each with a __stubs entry
+        uint32_t locals = 0;        // Local symbols per image taken out into the local symbols region, in .symbols with v5
+        uint32_t binds = 0;         // Pointers per image to exports of its dependencies, listed in the patch table
+        uint32_t patches = 0;       // Patch table version 1-4, 0 for the one caches of the slide version came with
+        uint32_t objc = 0;          // Classes per image after the first, with libobjc's v16 objc_opt_t tables. Slide info v3 and v5 only
+        uint64_t seed = 1;
+    };
+
+    // Writes a cache at path, and its subcaches next to it, that the reader
+    // (and dyld's tools) can take apart like a real one: every image has a
+    // header, segments, an export trie, function starts and a symbol table in
+    // a shared LINKEDIT, and DATA is covered by slide info of the requested
+    // version. The code itself is filler that only looks plausible.
+    bool synth_write(const char *path, const synth_opts_t &opts);
+}
+
+#endif
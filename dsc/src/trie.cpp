@@ -0,0 +1,192 @@
+#include <string.h>
+
+#include "common.h"
+#include "format.h"
+#include "trie.h"
+
+// Deeper than any real trie, but bounded so that a cyclic one terminates.
+#define TRIE_MAX_DEPTH 4096
+
+namespace dsc
+{
+    // Flags, address and whatever follows them in a terminal node's payload.
+    static bool trie_terminal(const uint8_t *t, const uint8_t *tend, export_t &out)
+    {
+        out.resolver = 0;
+        out.import = "";
+        if(!read_uleb(t, tend, out.flags))
+        {
+            return false;
+        }
+        if(out.flags & EXPORT_SYMBOL_FLAGS_REEXPORT)
+        {
+            if(!read_uleb(t, tend, out.addr) || !memchr(t, '\0', tend - t))
+            {
+                return false;
+            }
+            out.import = (const char*)t;
+            return true;
+        }
+        if(!read_uleb(t, tend, out.addr))
+        {
+            return false;
+        }
+        return !(out.flags & EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER) || read_uleb(t, tend, out.resolver);
+    }
+
+    bool trie_find(const uint8_t *start, size_t size, const char *name, export_t &out)
+    {
+        const uint8_t *end = start + size;
+        const char *rest = name;
+        uint64_t node = 0;
+        for(size_t depth = 0; depth < TRIE_MAX_DEPTH && node < size; ++depth)
+        {
+            const uint8_t *p = start + node;
+            uint64_t tsize;
+            if(!read_uleb(p, end, tsize) || tsize >= (uint64_t)(end - p))
+            {
+                return false;
+            }
+            if(*rest == '\0')
+            {
+                out.name = name;
+                out.namelen = (size_t)(rest - name);
+                return tsize != 0 && trie_terminal(p, p + tsize, out);
+            }
+            p += tsize;
+            uint8_t children = *p++;
+            bool found = false;
+            while(children-- && !found)
+            {
+                const uint8_t *edge = p,
+                              *nul = (const uint8_t*)memchr(edge, '\0', end - edge);
+                if(!nul)
+                {
+                    return false;
+                }
+                size_t elen = nul - edge;
+                p = nul + 1;
+                if(!read_uleb(p, end, node))
+                {
+                    return false;
+                }
+                // Edges out of a node never share a first character, so the first match is the only one
+                if(strncmp(rest, (const char*)edge, elen) == 0)
+                {
+                    rest += elen;
+                    found = true;
+                }
+            }
+            if(!found)
+            {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    void trie_walker_t::reset(const uint8_t *start, size_t size)
+    {
+        this->start = start;
+        this->end = start + size;
+        this->root = size > 0;
+        this->bad = false;
+        this->stack.clear();
+        this->name.clear();
+    }
+
+    bool trie_walker_t::fail(void)
+    {
+        this->bad = true;
+        this->root = false;
+        this->stack.clear();
+        return false;
+    }
+
+    bool trie_walker_t::enter(uint64_t node, size_t namelen, export_t &out, bool &terminal)
+    {
+        if(node >= (uint64_t)(this->end - this->start) || this->stack.size() >= TRIE_MAX_DEPTH)
+        {
+            return this->fail();
+        }
+        const uint8_t *p = this->start + node;
+        uint64_t tsize;
+        if(!read_uleb(p, this->end, tsize) || tsize >= (uint64_t)(this->end - p))
+        {
+            return this->fail();
+        }
+        terminal = tsize != 0;
+        if(terminal)
+        {
+            out.name = this->name.data();
+            out.namelen = namelen;
+            if(!trie_terminal(p, p + tsize, out))
+            {
+                return this->fail();
+            }
+        }
+        p += tsize;
+        uint8_t children = *p++;
+        if(children)
+        {
+            this->stack.push_back({ (uint32_t)(p - this->start), children, (uint32_t)namelen });
+        }
+        return true;
+    }
+
+    bool trie_walker_t::next(export_t &out)
+    {
+        bool terminal;
+        if(this->root)
+        {
+            this->root = false;
+            this->name.assign(1, '\0');
+            if(!this->enter(0, 0, out, terminal))
+            {
+                return false;
+            }
+            if(terminal)
+            {
+                return true;
+            }
+        }
+        while(!this->stack.empty())
+        {
+            frame_t &f = this->stack.back();
+            if(f.left == 0)
+            {
+                this->stack.pop_back();
+                continue;
+            }
+            const uint8_t *edge = this->start + f.cursor;
+            const uint8_t *nul = (const uint8_t*)memchr(edge, '\0', this->end - edge);
+            if(!nul)
+            {
+                return this->fail();
+            }
+            const uint8_t *p = nul + 1;
+            uint64_t child;
+            if(!read_uleb(p, this->end, child))
+            {
+                return this->fail();
+            }
+            f.cursor = (uint32_t)(p - this->start);
+            --f.left;
+
+            size_t prefix = f.namelen,
+                   elen = nul - edge;
+            this->name.resize(prefix + elen + 1);
+            memcpy(this->name.data() + prefix, edge, elen);
+            this->name[prefix + elen] = '\0';
+            if(!this->enter(child, prefix + elen, out, terminal))
+            {
+                return false;
+            }
+            if(terminal)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
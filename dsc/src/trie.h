@@ -0,0 +1,70 @@
+#ifndef DSC_TRIE_H
+#define DSC_TRIE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace dsc
+{
+    struct export_t
+    {
+        const char *name;       // Owned by the walker, valid until the next call to next()
+        size_t namelen;
+        uint64_t flags;         // EXPORT_SYMBOL_FLAGS_*
+        uint64_t addr;          // Image offset, absolute value, or dylib ordinal for re-exports
+        uint64_t resolver;      // Resolver offset for EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER
+        const char *import;     // Re-exported name, empty if identical to name
+    };
+
+    // Iterative export trie walker. Uses an explicit stack and a single name buffer,
+    // both of which keep their capacity across reset(), so a walker that is reused
+    // for many tries stops allocating once it has seen the deepest one.
+    struct trie_walker_t
+    {
+        void reset(const uint8_t *start, size_t size);
+        bool next(export_t &out);
+        bool failed(void) const
+        {
+            return this->bad;
+        }
+
+    private:
+        struct frame_t
+        {
+            uint32_t cursor;    // Offset of the next child edge
+            uint32_t left;      // Child edges not yet visited
+            uint32_t namelen;   // Length of the prefix leading to this node
+        };
+
+        bool enter(uint64_t node, size_t namelen, export_t &out, bool &terminal);
+        bool fail(void);
+
+        const uint8_t *start = nullptr;
+        const uint8_t *end = nullptr;
+        bool root = false;
+        bool bad = false;
+        std::vector<frame_t> stack;
+        std::vector<char> name;
+    };
+
+    // Looks up a single export by following the edges that spell name, without
+    // walking anything else. out.name is name. False if it isn't there or the
+    // path to it is malformed.
+    bool trie_find(const uint8_t *start, size_t size, const char *name, export_t &out);
+
+    // Calls fn(const export_t&) for every export, returns false if the trie is malformed.
+    template<typename F>
+    bool trie_each(trie_walker_t &walker, const uint8_t *start, size_t size, F &&fn)
+    {
+        export_t e;
+        walker.reset(start, size);
+        while(walker.next(e))
+        {
+            fn(e);
+        }
+        return !walker.failed();
+    }
+}
+
+#endif
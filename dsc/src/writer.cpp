@@ -0,0 +1,881 @@
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "writer.h"
+
+// io_uring is driven through the raw syscalls, so there's no dependency on
+// liburing. Direct descriptors (Linux 5.15) are what let a whole file go out
+// as one chain, so kernels without them get the sync path.
+#ifdef __linux__
+#   include <linux/fs.h>
+#   include <sys/ioctl.h>
+#endif
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#   include <linux/io_uring.h>
+#   include <sys/syscall.h>
+#   ifdef IORING_FILE_INDEX_ALLOC
+#       define DSC_HAVE_URING 1
+#   endif
+#endif
+
+#define WRITER_SLOTS        8           // Images in flight per worker
+#define WRITER_BATCH        4           // Images queued before they're submitted
+#define WRITER_BUF_MIN      0x10000
+#define WRITER_URING_MAX    0x40000000  // Largest registered buffer and single write, larger images are written synchronously
+#define WRITER_PROBE_SIZE   0x1000
+#define WRITER_FD_SPARE     64          // Descriptors left over when raising the limit for a tree
+
+namespace dsc
+{
+    static bool writer_pwrite_all(int fd, const uint8_t *data, uint64_t off, uint64_t size, std::atomic<uint64_t> &syscalls)
+    {
+        while(size)
+        {
+            ssize_t r = pwrite(fd, data, size, (off_t)off);
+            ++syscalls;
+            if(r <= 0)
+            {
+                if(r < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if(r == 0)
+                {
+                    errno = EIO;
+                }
+                return false;
+            }
+            data += r;
+            off += (uint64_t)r;
+            size -= (uint64_t)r;
+        }
+        return true;
+    }
+
+    // Clone if we can, copy in the kernel if we can't, write from the mapping as a last resort.
+    // A subcache can sit on another filesystem than the one probed, so every step may still fail.
+    static bool writer_copy(writer_t &w, int fd, const extract_layout_t::copy_t &c)
+    {
+#ifdef __linux__
+        if(strcmp(w.copy, "reflink") == 0)
+        {
+            file_clone_range range = { c.fd, c.srcoff, c.size, c.fileoff };
+            ++w.syscalls;
+            if(ioctl(fd, FICLONERANGE, &range) == 0)
+            {
+                return true;
+            }
+        }
+        if(strcmp(w.copy, "none") != 0)
+        {
+            loff_t in = (loff_t)c.srcoff,
+                   out = (loff_t)c.fileoff;
+            uint64_t left = c.size;
+            while(left)
+            {
+                ssize_t r = copy_file_range(c.fd, &in, fd, &out, left, 0);
+                ++w.syscalls;
+                if(r <= 0)
+                {
+                    break;
+                }
+                left -= (uint64_t)r;
+            }
+            if(!left)
+            {
+                return true;
+            }
+            return writer_pwrite_all(fd, c.src + (c.size - left), c.fileoff + (c.size - left), left, w.syscalls);
+        }
+#endif
+        return writer_pwrite_all(fd, c.src, c.fileoff, c.size, w.syscalls);
+    }
+
+    // file is opened as its suffix from nameoff on, relative to dirfd.
+    static bool writer_pwrite(writer_t &w, int dirfd, const std::string &file, size_t nameoff, const uint8_t *data, size_t size, const std::vector<extract_layout_t::copy_t> *copies)
+    {
+        int fd = openat(dirfd, file.c_str() + nameoff, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        ++w.syscalls;
+        if(fd == -1)
+        {
+            ERR("open(%s): %s", file.c_str(), strerror(errno));
+            return false;
+        }
+        bool ok = true;
+        if(copies && !copies->empty())
+        {
+            // Gaps first: LINKEDIT comes last, so the file has its final size before anything is cloned into it
+            extract_gaps(*copies, 0, size, [&](uint64_t off, uint64_t len)
+            {
+                ok = ok && writer_pwrite_all(fd, data + off, off, len, w.syscalls);
+            });
+            for(size_t i = 0; ok && i < copies->size(); ++i)
+            {
+                ok = writer_copy(w, fd, (*copies)[i]);
+            }
+        }
+        else
+        {
+            ok = writer_pwrite_all(fd, data, 0, size, w.syscalls);
+        }
+        if(!ok)
+        {
+            ERR("write(%s): %s", file.c_str(), strerror(errno));
+            close(fd);
+            ++w.syscalls;
+            return false;
+        }
+        ++w.syscalls;
+        if(close(fd) != 0)
+        {
+            ERR("close(%s): %s", file.c_str(), strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+#ifdef DSC_HAVE_URING
+    enum
+    {
+        WRITER_OP_OPEN,
+        WRITER_OP_FALLOCATE,
+        WRITER_OP_WRITE,
+        WRITER_OP_CLOSE,
+    };
+    static const char * const writer_ops[] = { "openat", "fallocate", "write", "close" };
+
+    struct writer_slot_t
+    {
+        uint8_t *buf = nullptr;     // mmapped, so registration pins whole pages
+        size_t cap = 0;
+        bool fixed = false;         // Registered at the slot's index
+        uint32_t pending = 0;       // Operations not completed yet, free at 0
+        int err = 0;                // First failure of the chain
+        uint32_t errop = 0;
+        size_t size = 0;
+        std::string file;           // Read by the kernel until openat completes
+    };
+
+    struct writer_ring_t
+    {
+        int fd = -1;
+        void *sq = MAP_FAILED;
+        void *cq = MAP_FAILED;
+        size_t sqlen = 0;
+        size_t cqlen = 0;
+        io_uring_sqe *sqes = (io_uring_sqe*)MAP_FAILED;
+        size_t sqeslen = 0;
+        uint32_t *sq_head = nullptr;
+        uint32_t *sq_tail = nullptr;
+        uint32_t *sq_array = nullptr;
+        uint32_t sq_mask = 0;
+        uint32_t *cq_head = nullptr;
+        uint32_t *cq_tail = nullptr;
+        io_uring_cqe *cqes = nullptr;
+        uint32_t cq_mask = 0;
+        uint32_t tail = 0;          // Local copy of *sq_tail, we're the only producer
+        uint32_t queued = 0;        // SQEs not submitted yet
+        uint32_t queued_imgs = 0;
+        uint32_t cur = 0;           // Slot handed out by the last buffer()
+        bool fixed = false;         // Buffers could be registered at all
+        writer_slot_t slots[WRITER_SLOTS];
+
+        ~writer_ring_t()
+        {
+            for(writer_slot_t &s : this->slots)
+            {
+                if(s.buf)
+                {
+                    munmap(s.buf, s.cap);
+                }
+            }
+            if(this->sqes != MAP_FAILED)
+            {
+                munmap(this->sqes, this->sqeslen);
+            }
+            if(this->cq != MAP_FAILED && this->cq != this->sq)
+            {
+                munmap(this->cq, this->cqlen);
+            }
+            if(this->sq != MAP_FAILED)
+            {
+                munmap(this->sq, this->sqlen);
+            }
+            if(this->fd != -1)
+            {
+                close(this->fd);
+            }
+        }
+    };
+
+    static int ring_enter(writer_ring_t &r, uint32_t submit, uint32_t wait)
+    {
+        return (int)syscall(__NR_io_uring_enter, r.fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    }
+
+    static int ring_register(writer_ring_t &r, unsigned op, void *arg, unsigned n)
+    {
+        return (int)syscall(__NR_io_uring_register, r.fd, op, arg, n);
+    }
+
+    static io_uring_sqe* ring_sqe(writer_ring_t &r, uint8_t opcode, uint32_t slot, uint32_t op)
+    {
+        uint32_t idx = r.tail & r.sq_mask;
+        io_uring_sqe *sqe = &r.sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->user_data = ((uint64_t)op << 32) | slot;
+        r.sq_array[idx] = idx;
+        ++r.tail;
+        ++r.queued;
+        return sqe;
+    }
+
+    static bool ring_map_buf(writer_ring_t &r, uint32_t idx, size_t size)
+    {
+        writer_slot_t &s = r.slots[idx];
+        size_t cap = s.cap ? s.cap : WRITER_BUF_MIN;
+        while(cap < size)
+        {
+            cap *= 2;
+        }
+        void *mem = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(mem == MAP_FAILED)
+        {
+            ERR("mmap(0x%zx): %s", cap, strerror(errno));
+            return false;
+        }
+        if(s.buf)
+        {
+            munmap(s.buf, s.cap);
+        }
+        s.buf = (uint8_t*)mem;
+        s.cap = cap;
+        return true;
+    }
+
+    // Publishes queued SQEs and optionally waits for one completion, then processes whatever completed.
+    static bool ring_submit(writer_t &w, writer_ring_t &r, bool wait)
+    {
+        __atomic_store_n(r.sq_tail, r.tail, __ATOMIC_RELEASE);
+        while(r.queued || wait)
+        {
+            int n = ring_enter(r, r.queued, wait ? 1 : 0);
+            ++w.syscalls;
+            if(n < 0)
+            {
+                if(errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                {
+                    continue;
+                }
+                ERR("io_uring_enter: %s", strerror(errno));
+                return false;
+            }
+            r.queued -= (uint32_t)n;
+            wait = false;
+        }
+
+        uint32_t head = *r.cq_head,
+                 tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+        for(; head != tail; ++head)
+        {
+            const io_uring_cqe &cqe = r.cqes[head & r.cq_mask];
+            writer_slot_t &s = r.slots[(uint32_t)cqe.user_data];
+            uint32_t op = (uint32_t)(cqe.user_data >> 32);
+            int err = 0;
+            if(op == WRITER_OP_WRITE && cqe.res >= 0 && (size_t)cqe.res != s.size)
+            {
+                err = EIO;
+            }
+            // Not every filesystem preallocates, the write still goes through
+            else if(cqe.res < 0 && !(op == WRITER_OP_FALLOCATE && cqe.res == -EOPNOTSUPP))
+            {
+                err = -cqe.res;
+            }
+            if(err && !s.err)
+            {
+                s.err = err;
+                s.errop = op;
+            }
+            if(--s.pending == 0 && s.err)
+            {
+                ERR("%s(%s): %s", writer_ops[s.errop], s.file.c_str(), s.err == EIO && s.errop == WRITER_OP_WRITE ? "short write" : strerror(s.err));
+                ++w.failed;
+            }
+        }
+        __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    static bool ring_setup(writer_ring_t &r)
+    {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        r.fd = (int)syscall(__NR_io_uring_setup, WRITER_SLOTS * 4, &p);
+        if(r.fd < 0)
+        {
+            r.fd = -1;
+            return false;
+        }
+        r.sqlen = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+        r.cqlen = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if(p.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            r.sqlen = r.cqlen = std::max(r.sqlen, r.cqlen);
+        }
+        r.sq = mmap(NULL, r.sqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_SQ_RING);
+        if(r.sq == MAP_FAILED)
+        {
+            return false;
+        }
+        r.cq = (p.features & IORING_FEAT_SINGLE_MMAP) ? r.sq : mmap(NULL, r.cqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_CQ_RING);
+        if(r.cq == MAP_FAILED)
+        {
+            return false;
+        }
+        r.sqeslen = p.sq_entries * sizeof(io_uring_sqe);
+        r.sqes = (io_uring_sqe*)mmap(NULL, r.sqeslen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_SQES);
+        if(r.sqes == MAP_FAILED)
+        {
+            return false;
+        }
+        uint8_t *sq = (uint8_t*)r.sq,
+                *cq = (uint8_t*)r.cq;
+        r.sq_head = (uint32_t*)(sq + p.sq_off.head);
+        r.sq_tail = (uint32_t*)(sq + p.sq_off.tail);
+        r.sq_array = (uint32_t*)(sq + p.sq_off.array);
+        r.sq_mask = *(uint32_t*)(sq + p.sq_off.ring_mask);
+        r.cq_head = (uint32_t*)(cq + p.cq_off.head);
+        r.cq_tail = (uint32_t*)(cq + p.cq_off.tail);
+        r.cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        r.cq_mask = *(uint32_t*)(cq + p.cq_off.ring_mask);
+        r.tail = *r.sq_tail;
+
+        std::vector<uint8_t> probe(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+        io_uring_probe *pr = (io_uring_probe*)probe.data();
+        if(ring_register(r, IORING_REGISTER_PROBE, pr, 256) != 0)
+        {
+            return false;
+        }
+        for(uint8_t op : { IORING_OP_OPENAT, IORING_OP_FALLOCATE, IORING_OP_WRITE, IORING_OP_WRITE_FIXED, IORING_OP_CLOSE })
+        {
+            if(op > pr->last_op || !(pr->ops[op].flags & IO_URING_OP_SUPPORTED))
+            {
+                return false;
+            }
+        }
+        int32_t files[WRITER_SLOTS];
+        memset(files, 0xff, sizeof(files));
+        if(ring_register(r, IORING_REGISTER_FILES, files, WRITER_SLOTS) != 0)
+        {
+            return false;
+        }
+
+        // Kernels that predate direct descriptors hand back a regular fd instead of installing into the slot
+        io_uring_sqe *sqe = ring_sqe(r, IORING_OP_OPENAT, 0, WRITER_OP_OPEN);
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uint64_t)(uintptr_t)"/dev/null";
+        sqe->open_flags = O_RDONLY;
+        sqe->file_index = 1;
+        sqe->flags = IOSQE_IO_HARDLINK;
+        sqe = ring_sqe(r, IORING_OP_CLOSE, 0, WRITER_OP_CLOSE);
+        sqe->file_index = 1;
+        __atomic_store_n(r.sq_tail, r.tail, __ATOMIC_RELEASE);
+        int n;
+        while((n = ring_enter(r, 2, 2)) < 0 && errno == EINTR) {}
+        if(n != 2)
+        {
+            return false;
+        }
+        r.queued = 0;
+        int res[2] = { -1, -1 };
+        uint32_t head = *r.cq_head,
+                 tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+        for(; head != tail; ++head)
+        {
+            const io_uring_cqe &cqe = r.cqes[head & r.cq_mask];
+            res[(cqe.user_data >> 32) == WRITER_OP_CLOSE] = cqe.res;
+        }
+        __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+        if(res[0] > 0)
+        {
+            close(res[0]);
+        }
+        if(res[0] != 0 || res[1] != 0)
+        {
+            return false;
+        }
+
+        iovec iov[WRITER_SLOTS];
+        for(uint32_t i = 0; i < WRITER_SLOTS; ++i)
+        {
+            if(!ring_map_buf(r, i, WRITER_BUF_MIN))
+            {
+                return false;
+            }
+            iov[i].iov_base = r.slots[i].buf;
+            iov[i].iov_len = r.slots[i].cap;
+        }
+        // Pinned memory counts against RLIMIT_MEMLOCK; plain writes still work without it
+        r.fixed = ring_register(r, IORING_REGISTER_BUFFERS, iov, WRITER_SLOTS) == 0;
+        for(writer_slot_t &s : r.slots)
+        {
+            s.fixed = r.fixed;
+        }
+        return true;
+    }
+
+    static uint8_t* ring_buffer(writer_t &w, writer_ring_t &r, size_t size)
+    {
+        while(true)
+        {
+            // Smallest free buffer that fits, else the largest free one to grow
+            uint32_t best = WRITER_SLOTS;
+            for(uint32_t i = 0; i < WRITER_SLOTS; ++i)
+            {
+                const writer_slot_t &s = r.slots[i];
+                if(s.pending != 0)
+                {
+                    continue;
+                }
+                if(best == WRITER_SLOTS)
+                {
+                    best = i;
+                    continue;
+                }
+                const writer_slot_t &b = r.slots[best];
+                if(b.cap >= size ? (s.cap >= size && s.cap < b.cap) : s.cap > b.cap)
+                {
+                    best = i;
+                }
+            }
+            if(best == WRITER_SLOTS)
+            {
+                if(!ring_submit(w, r, true))
+                {
+                    return nullptr;
+                }
+                continue;
+            }
+            writer_slot_t &s = r.slots[best];
+            if(s.cap < size)
+            {
+                if(!ring_map_buf(r, best, size))
+                {
+                    return nullptr;
+                }
+                s.fixed = false;
+                if(r.fixed && s.cap <= WRITER_URING_MAX)
+                {
+                    iovec iov = { s.buf, s.cap };
+                    io_uring_rsrc_update2 up;
+                    memset(&up, 0, sizeof(up));
+                    up.offset = best;
+                    up.data = (uint64_t)(uintptr_t)&iov;
+                    up.nr = 1;
+                    s.fixed = ring_register(r, IORING_REGISTER_BUFFERS_UPDATE, &up, sizeof(up)) == 1;
+                    ++w.syscalls;
+                }
+            }
+            r.cur = best;
+            return s.buf;
+        }
+    }
+
+    static bool ring_write(writer_t &w, writer_ring_t &r, int dirfd, std::string &&file, size_t nameoff, size_t size, const std::vector<extract_layout_t::copy_t> *copies)
+    {
+        uint32_t idx = r.cur;
+        writer_slot_t &s = r.slots[idx];
+        if(size > WRITER_URING_MAX || (copies && !copies->empty()))
+        {
+            if(!writer_pwrite(w, dirfd, file, nameoff, s.buf, size, copies))
+            {
+                ++w.failed;
+                return false;
+            }
+            return true;
+        }
+        s.file = std::move(file);
+        s.size = size;
+        s.err = 0;
+        s.pending = 0;
+
+        // Hard links, so the descriptor slot is closed whatever happened before
+        io_uring_sqe *sqe = ring_sqe(r, IORING_OP_OPENAT, idx, WRITER_OP_OPEN);
+        sqe->fd = dirfd;
+        sqe->addr = (uint64_t)(uintptr_t)(s.file.c_str() + nameoff);
+        sqe->len = 0644;
+        sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;   // Direct descriptors don't take O_CLOEXEC
+        sqe->file_index = idx + 1;
+        sqe->flags = IOSQE_IO_HARDLINK;
+        ++s.pending;
+        if(size)
+        {
+            sqe = ring_sqe(r, IORING_OP_FALLOCATE, idx, WRITER_OP_FALLOCATE);
+            sqe->fd = (int32_t)idx;
+            sqe->addr = size;   // Length
+            sqe->len = 0;       // Mode
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+            ++s.pending;
+
+            sqe = ring_sqe(r, s.fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE, idx, WRITER_OP_WRITE);
+            sqe->fd = (int32_t)idx;
+            sqe->addr = (uint64_t)(uintptr_t)s.buf;
+            sqe->len = (uint32_t)size;
+            sqe->off = 0;
+            sqe->buf_index = s.fixed ? (uint16_t)idx : 0;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+            ++s.pending;
+        }
+        sqe = ring_sqe(r, IORING_OP_CLOSE, idx, WRITER_OP_CLOSE);
+        sqe->file_index = idx + 1;
+        ++s.pending;
+
+        if(++r.queued_imgs >= WRITER_BATCH)
+        {
+            r.queued_imgs = 0;
+            return ring_submit(w, r, false);
+        }
+        return true;
+    }
+
+    static bool ring_finish(writer_t &w, writer_ring_t &r)
+    {
+        r.queued_imgs = 0;
+        while(true)
+        {
+            bool busy = false;
+            for(const writer_slot_t &s : r.slots)
+            {
+                busy |= s.pending != 0;
+            }
+            if(!busy)
+            {
+                return true;
+            }
+            if(!ring_submit(w, r, true))
+            {
+                return false;
+            }
+        }
+    }
+#else
+    struct writer_ring_t {};
+#endif
+
+    writer_tree_t::writer_tree_t() : syscalls(0) {}
+
+    writer_tree_t::~writer_tree_t()
+    {
+        for(int fd : this->fds)
+        {
+            if(fd >= 0)
+            {
+                close(fd);
+            }
+        }
+    }
+
+    bool writer_tree_t::build(const std::string &root, const std::vector<const char*> &paths)
+    {
+        this->root = root;
+        this->dirs.clear();
+        this->index.clear();
+        for(int fd : this->fds)
+        {
+            if(fd >= 0)
+            {
+                close(fd);
+            }
+        }
+        this->fds.clear();
+
+        // Every proper prefix of every path. Sorted, parents come before their children.
+        std::vector<std::string_view> all = { std::string_view() };
+        for(const char *path : paths)
+        {
+            while(*path == '/')
+            {
+                ++path;
+            }
+            for(const char *slash = strchr(path, '/'); slash; slash = strchr(slash + 1, '/'))
+            {
+                all.emplace_back(path, slash - path);
+            }
+        }
+        std::sort(all.begin(), all.end());
+        all.erase(std::unique(all.begin(), all.end()), all.end());
+        // Anything mkdirs() would treat differently from a plain component is left to it
+        all.erase(std::remove_if(all.begin(), all.end(), [](std::string_view d)
+        {
+            std::string padded = "/" + std::string(d) + "/";
+            return !d.empty() && (padded.find("//") != std::string::npos || padded.find("/./") != std::string::npos || padded.find("/../") != std::string::npos);
+        }), all.end());
+        this->dirs.assign(all.begin(), all.end());
+        for(size_t i = 0; i < this->dirs.size(); ++i)
+        {
+            this->index.emplace(this->dirs[i], i);
+        }
+        this->fds.assign(this->dirs.size(), -1);
+
+        // One descriptor per directory on top of whatever is open already
+        struct rlimit rl;
+        rlim_t need = (rlim_t)this->dirs.size() + WRITER_FD_SPARE * 2;
+        if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < need)
+        {
+            rl.rlim_cur = rl.rlim_max == RLIM_INFINITY ? need : std::min(need, rl.rlim_max);
+            setrlimit(RLIMIT_NOFILE, &rl);
+        }
+
+        if(!mkdirs(root + "/"))
+        {
+            return false;
+        }
+        this->fds[0] = open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        ++this->syscalls;
+        if(this->fds[0] == -1)
+        {
+            ERR("open(%s): %s", root.c_str(), strerror(errno));
+            return false;
+        }
+
+        std::vector<std::vector<size_t>> levels;
+        std::vector<size_t> parents(this->dirs.size(), 0);
+        for(size_t i = 1; i < this->dirs.size(); ++i)
+        {
+            const std::string &d = this->dirs[i];
+            size_t slash = d.rfind('/'),
+                   depth = (size_t)std::count(d.begin(), d.end(), '/');
+            if(slash != std::string::npos)
+            {
+                auto it = this->index.find(std::string_view(d).substr(0, slash));
+                parents[i] = it != this->index.end() ? it->second : SIZE_MAX;
+            }
+            if(levels.size() <= depth)
+            {
+                levels.resize(depth + 1);
+            }
+            levels[depth].push_back(i);
+        }
+        std::atomic<size_t> failed(0);
+        for(const std::vector<size_t> &level : levels)
+        {
+            parallel_for(level.size(), [&](size_t j, size_t)
+            {
+                size_t i = level[j];
+                const std::string &d = this->dirs[i];
+                if(parents[i] == SIZE_MAX || this->fds[parents[i]] == -1)
+                {
+                    return;     // Its parent failed and was reported
+                }
+                // Relative to the parent if that is open, else by full path
+                int pfd = this->fds[parents[i]];
+                std::string full;
+                const char *name = d.c_str() + (d.rfind('/') == std::string::npos ? 0 : d.rfind('/') + 1);
+                if(pfd == AT_FDCWD)
+                {
+                    full = this->root + "/" + d;
+                    name = full.c_str();
+                }
+                ++this->syscalls;
+                if(mkdirat(pfd, name, 0755) != 0 && errno != EEXIST)
+                {
+                    ERR("mkdir(%s/%s): %s", this->root.c_str(), d.c_str(), strerror(errno));
+                    ++failed;
+                    return;
+                }
+                int fd = openat(pfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                ++this->syscalls;
+                if(fd == -1 && errno != EMFILE && errno != ENFILE)
+                {
+                    ERR("open(%s/%s): %s", this->root.c_str(), d.c_str(), strerror(errno));
+                    ++failed;
+                    return;
+                }
+                this->fds[i] = fd == -1 ? AT_FDCWD : fd;
+            });
+        }
+        return failed == 0;
+    }
+
+    int writer_tree_t::find(const char *path, const char **name) const
+    {
+        while(*path == '/')
+        {
+            ++path;
+        }
+        const char *slash = strrchr(path, '/');
+        auto it = this->index.find(slash ? std::string_view(path, slash - path) : std::string_view());
+        if(it == this->index.end())
+        {
+            return -1;
+        }
+        *name = slash ? slash + 1 : path;
+        return this->fds[it->second];
+    }
+
+    writer_t::writer_t() : syscalls(0), failed(0) {}
+
+    writer_t::~writer_t() = default;
+
+    bool writer_t::init(const char *dir, size_t workers, const char *want)
+    {
+        this->dir = dir;
+        this->backend = "sync";
+        this->bufs.clear();
+        this->rings.clear();
+        bool uring;
+        if(!want || strcmp(want, "auto") == 0 || strcmp(want, "uring") == 0 || strcmp(want, "io_uring") == 0)
+        {
+            uring = true;
+        }
+        else if(strcmp(want, "sync") == 0)
+        {
+            uring = false;
+        }
+        else
+        {
+            ERR("Unknown writer backend: %s", want);
+            return false;
+        }
+#ifdef DSC_HAVE_URING
+        for(size_t i = 0; uring && i < workers; ++i)
+        {
+            std::unique_ptr<writer_ring_t> r(new writer_ring_t());
+            if(!ring_setup(*r))
+            {
+                if(want && strcmp(want, "auto") != 0)
+                {
+                    WRN("io_uring not usable, falling back to synchronous writes");
+                }
+                this->rings.clear();
+                uring = false;
+                break;
+            }
+            this->rings.push_back(std::move(r));
+        }
+        if(uring)
+        {
+            this->backend = "io_uring";
+            return true;
+        }
+#else
+        if(uring && want && strcmp(want, "auto") != 0)
+        {
+            WRN("io_uring not supported by this build, falling back to synchronous writes");
+        }
+#endif
+        this->bufs.resize(workers);
+        return true;
+    }
+
+    bool writer_t::prepare(const std::vector<const char*> &paths)
+    {
+        bool ok = this->tree.build(this->dir, paths);
+        this->syscalls += this->tree.syscalls;
+        return ok;
+    }
+
+    uint8_t* writer_t::buffer(size_t worker, size_t size)
+    {
+#ifdef DSC_HAVE_URING
+        if(!this->rings.empty())
+        {
+            return ring_buffer(*this, *this->rings[worker], size);
+        }
+#endif
+        std::vector<uint8_t> &buf = this->bufs[worker];
+        buf.resize(size);
+        return buf.data();
+    }
+
+    void writer_t::probe(int srcfd)
+    {
+        this->copy = "none";
+#ifdef __linux__
+        std::string file = this->dir + "/.dsc_probe." + std::to_string(getpid());
+        if(srcfd == -1 || !mkdirs(file))
+        {
+            return;
+        }
+        int fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if(fd == -1)
+        {
+            return;
+        }
+        file_clone_range range = { srcfd, 0, WRITER_PROBE_SIZE, 0 };
+        loff_t in = 0,
+               out = 0;
+        if(ioctl(fd, FICLONERANGE, &range) == 0)
+        {
+            this->copy = "reflink";
+        }
+        else if(copy_file_range(srcfd, &in, fd, &out, WRITER_PROBE_SIZE, 0) == WRITER_PROBE_SIZE)
+        {
+            this->copy = "copy_file_range";
+        }
+        close(fd);
+        unlink(file.c_str());
+#else
+        (void)srcfd;
+#endif
+    }
+
+    bool writer_t::use_copies(void) const
+    {
+        return strcmp(this->copy, "reflink") == 0 || (strcmp(this->copy, "copy_file_range") == 0 && this->rings.empty());
+    }
+
+    bool writer_t::write(size_t worker, const char *path, size_t size, const std::vector<extract_layout_t::copy_t> *copies)
+    {
+        std::string file = this->dir + "/" + path;
+        const char *name;
+        int dirfd = this->tree.find(path, &name);
+        size_t nameoff = 0;
+        if(dirfd == -1)
+        {
+            if(!mkdirs(file))
+            {
+                ++this->failed;
+                return false;
+            }
+            dirfd = AT_FDCWD;
+        }
+        else if(dirfd != AT_FDCWD)
+        {
+            nameoff = file.size() - strlen(name);
+        }
+#ifdef DSC_HAVE_URING
+        if(!this->rings.empty())
+        {
+            return ring_write(*this, *this->rings[worker], dirfd, std::move(file), nameoff, size, copies);
+        }
+#endif
+        if(!writer_pwrite(*this, dirfd, file, nameoff, this->bufs[worker].data(), size, copies))
+        {
+            ++this->failed;
+            return false;
+        }
+        return true;
+    }
+
+    void writer_t::flush(size_t worker)
+    {
+#ifdef DSC_HAVE_URING
+        if(!this->rings.empty() && !ring_finish(*this, *this->rings[worker]))
+        {
+            ++this->failed;
+        }
+#else
+        (void)worker;
+#endif
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef DSC_WRITER_H
+#define DSC_WRITER_H
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "extract.h"
+
+namespace dsc
+{
+    struct writer_ring_t;
+
+    // The directories of an output tree, created once up front and kept open.
+    // Images share far fewer directories than there are images, so making
+    // them per file mostly costs syscalls that find them already there.
+    struct writer_tree_t
+    {
+        std::atomic<uint64_t> syscalls; // mkdirat and openat issued on directories
+
+        writer_tree_t();
+        writer_tree_t(const writer_tree_t&) = delete;
+        writer_tree_t& operator=(const writer_tree_t&) = delete;
+        ~writer_tree_t();
+
+        // Creates root and the parent directories of every path under it. Each
+        // depth level is made on jobs() threads, relative to the already open
+        // parents. Returns false if any of them couldn't be created.
+        bool build(const std::string &root, const std::vector<const char*> &paths);
+
+        // Descriptor of the directory path goes into, and path's last component in *name.
+        // AT_FDCWD if the directory exists but couldn't be kept open (out of descriptors),
+        // -1 if it isn't part of the tree.
+        int find(const char *path, const char **name) const;
+
+    private:
+        std::string root;
+        std::vector<std::string> dirs;  // Relative to root, which is ""
+        std::vector<int> fds;
+        std::unordered_map<std::string_view, size_t> index;
+    };
+
+    // Output files of an extraction. Each worker asks for a buffer, builds an
+    // image into it and hands it back with the path to write it to.
+    //
+    // With io_uring, creating the file, preallocating it, writing it and closing
+    // it go out as one linked chain on a ring owned by the worker, into a
+    // registered buffer and a direct descriptor slot, and several images are
+    // batched per submission. The worker carries on building the next image
+    // while the previous ones are written. Without io_uring (not Linux, too old a
+    // kernel, or disabled), every file is written synchronously with pwrite.
+    //
+    // Verbatim ranges of an image (extract_layout_t::copies) can be left out of
+    // the buffer and moved from the cache file in the kernel instead: cloned
+    // where the filesystem shares extents (btrfs, XFS), copied with
+    // copy_file_range otherwise. Files with such ranges are written
+    // synchronously, since the bulk of their data no longer goes through us.
+    struct writer_t
+    {
+        const char *backend = "sync";   // "sync" or "io_uring", once init() returned
+        const char *copy = "none";      // "reflink", "copy_file_range" or "none", once probe() returned
+        std::atomic<uint64_t> syscalls; // Issued for output files and the directories prepared for them
+        std::atomic<size_t> failed;     // Files that couldn't be written
+
+        writer_t();
+        writer_t(const writer_t&) = delete;
+        writer_t& operator=(const writer_t&) = delete;
+        ~writer_t();
+
+        // Sets up state for workers [0, n) writing under dir. want is "sync", "uring",
+        // or NULL/"auto" for io_uring where available. Asking for io_uring falls back to
+        // sync with a warning if it can't be used.
+        bool init(const char *dir, size_t workers, const char *want);
+
+        // Creates the directories of every path up front (see writer_tree_t), so that write() creates
+        // files relative to them with one openat and one close. Paths that weren't given here still
+        // work, with their directories made one by one as they come.
+        bool prepare(const std::vector<const char*> &paths);
+
+        // Finds out how ranges of srcfd can be moved into files under dir in the kernel, by trying on a scratch file.
+        void probe(int srcfd);
+
+        // Whether extraction should leave copies to the writer. Cloning always pays off; an in-kernel copy only
+        // does against synchronous writes, with io_uring it's cheaper to write the buffer asynchronously.
+        bool use_copies(void) const;
+
+        // Buffer of at least size bytes for the worker's next image, or NULL on allocation failure.
+        // Only valid until the worker's next call to write().
+        uint8_t* buffer(size_t worker, size_t size);
+
+        // Writes the first size bytes of the worker's buffer to dir/path, with the ranges in copies (if any)
+        // taken from the cache file instead. With io_uring this only queues the write, and failures are
+        // reported and counted later.
+        bool write(size_t worker, const char *path, size_t size, const std::vector<extract_layout_t::copy_t> *copies = nullptr);
+
+        // Waits for everything the worker queued. io_uring cancels whatever a thread still has in flight
+        // when it exits, so workers must call this on their own thread (see parallel_for's done) before exiting.
+        void flush(size_t worker);
+
+    private:
+        std::string dir;
+        writer_tree_t tree;
+        std::vector<std::vector<uint8_t>> bufs;             // sync
+        std::vector<std::unique_ptr<writer_ring_t>> rings;  // io_uring
+    };
+}
+
+#endif
@@ -0,0 +1,1811 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <ftw.h>
+#include <map>
+#include <netinet/in.h>
+#include <poll.h>
+#include <random>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "../src/cache.h"
+#include "../src/common.h"
+#include "../src/extract.h"
+#include "../src/locals.h"
+#include "../src/macho.h"
+#include "../src/pack.h"
+#include "../src/patches.h"
+#include "../src/pointer.h"
+#include "../src/sink.h"
+#include "../src/synth.h"
+#include "../src/trie.h"
+#include "../src/writer.h"
+
+#ifdef __linux__
+#   include <linux/perf_event.h>
+#   include <sys/ioctl.h>
+#   include <sys/ptrace.h>
+#   include <sys/syscall.h>
+#endif
+
+// Microbenchmarks for the cache reader. Each runs its workload a few times
+// and reports the best run, so page cache warmup doesn't skew the numbers.
+
+#define BENCH_RUNS      5
+#define BENCH_LOOKUPS   0x40000     // Symbols looked up per pass by the paging bench
+
+template<typename F>
+static double bench_best(F &&fn)
+{
+    double best = 0;
+    for(int i = 0; i < BENCH_RUNS; ++i)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if(i == 0 || secs < best)
+        {
+            best = secs;
+        }
+    }
+    return best;
+}
+
+// The reader's pointer decoding from before pointer.h: a switch on the slide
+// info version for every pointer.
+static uint64_t bench_generic_decode(const dsc::cache_t &cache, uint64_t raw)
+{
+    switch(cache.slide_version)
+    {
+        case 2:
+        {
+            uint64_t v = raw & ~cache.slide_mask;
+            return v ? v + cache.slide_add : 0;
+        }
+        case 3:
+            if(raw >> 63)
+            {
+                return (raw & 0xffffffffULL) + cache.slide_add;
+            }
+            return ((raw & 0x0007f80000000000ULL) << 13) | (raw & 0x000007ffffffffffULL);
+        case 4:
+        {
+            uint32_t v = (uint32_t)(raw & ~cache.slide_mask);
+            if((v & 0xffff8000) == 0)
+            {
+                return v;
+            }
+            if((v & 0x3fff8000) == 0x3fff8000)
+            {
+                return v | 0xc0000000;
+            }
+            return (uint32_t)(v + cache.slide_add);
+        }
+        case 5:
+        {
+            uint64_t v = (raw & 0x3ffffffffULL) + cache.slide_add;
+            if(!(raw >> 63))
+            {
+                v |= ((raw >> 34) & 0xff) << 56;
+            }
+            return v;
+        }
+        default:
+            return raw;
+    }
+}
+
+// And its chain walk, which loads each pointer at the cache's width and picks
+// the chain step by version, calling fn(raw) for every pointer in [lo, hi).
+template<typename F>
+static bool bench_generic_walk(const dsc::cache_t &cache, uint64_t lo, uint64_t hi, F &&fn)
+{
+    for(const dsc::mapping_t &m : cache.mappings)
+    {
+        if(hi <= m.addr || lo >= m.addr + m.size || !m.slide)
+        {
+            continue;
+        }
+        const dsc::dyld_cache_slide_info2 *si = (const dsc::dyld_cache_slide_info2*)m.slide;
+        uint32_t version = si->version;
+        uint64_t pagesize,
+                 npages,
+                 nextras = 0;
+        const uint16_t *starts,
+                       *extras = nullptr;
+        if((version == 2 || version == 4) && m.slide_size >= sizeof(*si))
+        {
+            pagesize = si->page_size;
+            npages = si->page_starts_count;
+            if(si->page_starts_offset > m.slide_size || (m.slide_size - si->page_starts_offset) / sizeof(uint16_t) < npages ||
+               si->page_extras_offset > m.slide_size || (m.slide_size - si->page_extras_offset) / sizeof(uint16_t) < si->page_extras_count)
+            {
+                return false;
+            }
+            starts = (const uint16_t*)(m.slide + si->page_starts_offset);
+            extras = (const uint16_t*)(m.slide + si->page_extras_offset);
+            nextras = si->page_extras_count;
+        }
+        else if((version == 3 || version == 5) && m.slide_size >= sizeof(dsc::dyld_cache_slide_info3))
+        {
+            const dsc::dyld_cache_slide_info3 *si3 = (const dsc::dyld_cache_slide_info3*)m.slide;
+            pagesize = si3->page_size;
+            npages = si3->page_starts_count;
+            if((m.slide_size - sizeof(*si3)) / sizeof(uint16_t) < npages)
+            {
+                return false;
+            }
+            starts = (const uint16_t*)(si3 + 1);
+        }
+        else
+        {
+            return false;
+        }
+        if(pagesize == 0 || ((version == 2 || version == 4) && cache.slide_mask == 0))
+        {
+            return false;
+        }
+
+        uint64_t first = lo > m.addr ? (lo - m.addr) / pagesize : 0,
+                 last = std::min<uint64_t>((std::min(hi, m.addr + m.size) - m.addr + pagesize - 1) / pagesize, npages);
+        unsigned shift = version == 2 || version == 4 ? __builtin_ctzll(cache.slide_mask) - 2 : 0;
+        auto chain = [&](uint64_t page, uint64_t off)
+        {
+            while(off + cache.ptrsize <= pagesize && page + off < m.size)
+            {
+                uint64_t raw;
+                if(cache.ptrsize == 8)
+                {
+                    memcpy(&raw, m.data + page + off, sizeof(raw));
+                }
+                else
+                {
+                    uint32_t v;
+                    memcpy(&v, m.data + page + off, sizeof(v));
+                    raw = v;
+                }
+                uint64_t addr = m.addr + page + off;
+                if(addr >= lo && addr < hi)
+                {
+                    fn(raw);
+                }
+                uint64_t delta;
+                switch(version)
+                {
+                    case 2:
+                    case 4:  delta = (raw & cache.slide_mask) >> shift;  break;
+                    case 3:  delta = ((raw >> 51) & 0x7ff) * 8;         break;
+                    default: delta = ((raw >> 52) & 0x7ff) * 8;         break;
+                }
+                if(delta == 0)
+                {
+                    break;
+                }
+                off += delta;
+            }
+        };
+        for(uint64_t i = first; i < last; ++i)
+        {
+            uint16_t st = starts[i];
+            uint64_t page = i * pagesize;
+            if(version == 2 || version == 4)
+            {
+                bool v4 = version == 4;
+                if(v4 ? st == DYLD_CACHE_SLIDE4_PAGE_NO_REBASE : (st & DYLD_CACHE_SLIDE_PAGE_ATTR_NO_REBASE) != 0)
+                {
+                    continue;
+                }
+                if(st & (v4 ? DYLD_CACHE_SLIDE4_PAGE_USE_EXTRA : DYLD_CACHE_SLIDE_PAGE_ATTR_EXTRA))
+                {
+                    for(uint64_t j = st & (v4 ? 0x7fff : 0x3fff); j < nextras; ++j)
+                    {
+                        chain(page, (uint64_t)(extras[j] & (v4 ? 0x7fff : 0x3fff)) * 4);
+                        if(extras[j] & (v4 ? DYLD_CACHE_SLIDE4_PAGE_EXTRA_END : DYLD_CACHE_SLIDE_PAGE_ATTR_END))
+                        {
+                            break;
+                        }
+                    }
+                }
+                else
+                {
+                    chain(page, (uint64_t)st * 4);
+                }
+            }
+            else if(st != DYLD_CACHE_SLIDE_V3_PAGE_ATTR_NO_REBASE)
+            {
+                chain(page, st);
+            }
+        }
+    }
+    return true;
+}
+
+// Decodes every slid pointer in the cache, once with the walk and decoding the
+// reader had before pointer.h (format switches per pointer, see above) and
+// once through the walk specialized for the cache's pointer format.
+static int bench_pointers(int argc, const char **argv)
+{
+    if(argc != 2)
+    {
+        fprintf(stderr, "Usage: dsc_bench pointers <path-to-cache>\n");
+        return 1;
+    }
+    dsc::cache_t cache;
+    if(!cache.open(argv[1]))
+    {
+        return 1;
+    }
+    LOG("%s", cache.describe().c_str());
+
+    uint64_t lo = cache.mappings.front().addr,
+             hi = cache.mappings.back().addr + cache.mappings.back().size;
+    size_t count = 0;
+    uint64_t sum_generic = 0,
+             sum_fast = 0;
+    bool ok = true;
+    double generic = bench_best([&]
+    {
+        sum_generic = 0;
+        count = 0;
+        ok = bench_generic_walk(cache, lo, hi, [&](uint64_t raw)
+        {
+            sum_generic += bench_generic_decode(cache, raw);
+            ++count;
+        });
+    });
+    if(!ok)
+    {
+        ERR("Slide info can't be walked");
+        return 1;
+    }
+    double fast = bench_best([&]
+    {
+        sum_fast = dsc::ptr_dispatch(cache, [&](const auto &fmt)
+        {
+            uint64_t sum = 0;
+            dsc::ptr_walk(cache, fmt, lo, hi, [&](uint64_t, auto raw)
+            {
+                sum += fmt.decode(raw);
+            });
+            return sum;
+        });
+    });
+    if(sum_generic != sum_fast)
+    {
+        ERR("Checksum mismatch: 0x%llx vs 0x%llx", (unsigned long long)sum_generic, (unsigned long long)sum_fast);
+        return 1;
+    }
+    printf("%zu pointers\n", count);
+    printf("generic:     %8.3f ms  %6.2f ns/ptr\n", generic * 1e3, count ? generic * 1e9 / count : 0.0);
+    printf("specialized: %8.3f ms  %6.2f ns/ptr  (%.2fx)\n", fast * 1e3, count ? fast * 1e9 / count : 0.0, fast > 0 ? generic / fast : 0.0);
+    return 0;
+}
+
+static int bench_rmtree_one(const char *path, const struct stat*, int, struct FTW*)
+{
+    return remove(path);
+}
+
+// Extracts every image to a directory, once per output backend, with and
+// without moving verbatim ranges in the kernel, and with the build-only time
+// as a baseline. Syscalls count what the writer issues for files and for
+// creating their directories up front. Creating those directories on their own
+// is also timed, against making each image's parents as it comes.
+static int bench_write(int argc, const char **argv)
+{
+    if(argc != 3)
+    {
+        fprintf(stderr, "Usage: dsc_bench write <path-to-cache> <path-to-dir>\n");
+        return 1;
+    }
+    dsc::cache_t cache;
+    if(!cache.open(argv[1]))
+    {
+        return 1;
+    }
+    LOG("%s", cache.describe().c_str());
+    size_t n = cache.images.size();
+    uint64_t bytes = 0;
+
+    std::vector<std::vector<uint8_t>> bufs(dsc::jobs());
+    std::atomic<uint64_t> verbatim(0);
+    double build = bench_best([&]
+    {
+        std::atomic<uint64_t> total(0);
+        verbatim = 0;
+        dsc::parallel_for(n, [&](size_t i, size_t worker)
+        {
+            dsc::extract_layout_t layout;
+            if(dsc::extract_plan(cache, cache.images[i], layout))
+            {
+                bufs[worker].resize(layout.size);
+                dsc::extract_build(cache, layout, bufs[worker].data());
+                total += layout.size;
+                for(const dsc::extract_layout_t::copy_t &c : layout.copies)
+                {
+                    verbatim += c.size;
+                }
+            }
+        });
+        bytes = total;
+    });
+    printf("%zu images, %.1f MiB, %.1f MiB of it verbatim\n", n, bytes / 1048576.0, verbatim / 1048576.0);
+    printf("%-26s: %8.1f ms\n", "build only", build * 1e3);
+
+    std::vector<const char*> paths;
+    for(const dsc::image_t &img : cache.images)
+    {
+        paths.push_back(img.path);
+    }
+    std::string scratch = std::string(argv[2]) + "/.dsc_dirs.";
+    int round = 0;
+    uint64_t per_image_syscalls = 0,
+             tree_syscalls = 0;
+    double per_image = bench_best([&]
+    {
+        std::string root = scratch + std::to_string(round++);
+        per_image_syscalls = 0;
+        for(const char *path : paths)
+        {
+            std::string file = root + "/" + path;
+            dsc::mkdirs(file);
+            per_image_syscalls += (uint64_t)std::count(file.begin() + 1, file.end(), '/');
+        }
+    });
+    double tree = bench_best([&]
+    {
+        dsc::writer_tree_t t;
+        t.build(scratch + std::to_string(round++), paths);
+        tree_syscalls = t.syscalls;
+    });
+    for(int i = 0; i < round; ++i)
+    {
+        nftw((scratch + std::to_string(i)).c_str(), bench_rmtree_one, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    printf("%-26s: %8.1f ms  %5.2f syscalls/image\n", "dirs per image", per_image * 1e3, n ? (double)per_image_syscalls / n : 0.0);
+    printf("%-26s: %8.1f ms  %5.2f syscalls/image  (%.2fx)\n", "dirs up front", tree * 1e3, n ? (double)tree_syscalls / n : 0.0, tree > 0 ? per_image / tree : 0.0);
+
+    static const struct
+    {
+        const char *want;
+        bool copies;
+    } runs[] =
+    {
+        { "sync",  false },
+        { "uring", false },
+        { "sync",  true  },
+        { "uring", true  },
+    };
+    double sync = 0;
+    for(const auto &run : runs)
+    {
+        std::string label;
+        uint64_t syscalls = 0;
+        size_t failed = 0;
+        bool skip = false;
+        double secs = bench_best([&]
+        {
+            dsc::writer_t out;
+            if(!out.init(argv[2], dsc::jobs(), run.want) || !out.prepare(paths))
+            {
+                ++failed;
+                return;
+            }
+            label = out.backend;
+            if(run.copies)
+            {
+                out.probe(cache.fd);
+                if(strcmp(out.copy, "none") == 0)
+                {
+                    skip = true;
+                    return;
+                }
+                label = label + " + " + out.copy;
+            }
+            dsc::parallel_for(n, [&](size_t i, size_t worker)
+            {
+                dsc::extract_layout_t layout;
+                uint8_t *buf;
+                if(dsc::extract_plan(cache, cache.images[i], layout) && (buf = out.buffer(worker, layout.size)) && dsc::extract_build(cache, layout, buf, run.copies))
+                {
+                    out.write(worker, cache.images[i].path, layout.size, run.copies ? &layout.copies : nullptr);
+                }
+            },
+            [&](size_t worker)
+            {
+                out.flush(worker);
+            });
+            syscalls = out.syscalls;
+            failed += out.failed;
+        });
+        if(failed)
+        {
+            ERR("%zu files failed", failed);
+            return 1;
+        }
+        if(skip)
+        {
+            printf("%-26s: no in-kernel copies into %s\n", (std::string(run.want) + " + copies").c_str(), argv[2]);
+            continue;
+        }
+        if(!run.copies && strcmp(run.want, "sync") == 0)
+        {
+            sync = secs;
+        }
+        printf("%-26s: %8.1f ms  %5.2f syscalls/image  (%.2fx)\n", label.c_str(), secs * 1e3, n ? (double)syscalls / n : 0.0, secs > 0 ? sync / secs : 0.0);
+    }
+    return 0;
+}
+
+// What a consumer that analyzes every image pays to get at them: extracting
+// to a directory and reading the files back, versus taking them straight from
+// an in-memory sink. Hashing each image stands in for the analysis, and both
+// must agree on the result.
+static int bench_sink(int argc, const char **argv)
+{
+    if(argc != 3)
+    {
+        fprintf(stderr, "Usage: dsc_bench sink <path-to-cache> <path-to-dir>\n");
+        return 1;
+    }
+    dsc::cache_t cache;
+    if(!cache.open(argv[1]))
+    {
+        return 1;
+    }
+    LOG("%s", cache.describe().c_str());
+    size_t n = cache.images.size();
+    std::vector<const dsc::image_t*> todo;
+    for(const dsc::image_t &img : cache.images)
+    {
+        todo.push_back(&img);
+    }
+
+    std::atomic<uint64_t> sum_disk(0),
+                          sum_mem(0);
+    std::atomic<size_t> failed(0);
+    std::vector<std::vector<uint8_t>> bufs(dsc::jobs());
+    double disk = bench_best([&]
+    {
+        dsc::writer_t out;
+        if(!out.init(argv[2], dsc::jobs(), "sync"))
+        {
+            ++failed;
+            return;
+        }
+        dsc::parallel_for(n, [&](size_t i, size_t worker)
+        {
+            dsc::extract_layout_t layout;
+            uint8_t *buf;
+            if(dsc::extract_plan(cache, cache.images[i], layout) && (buf = out.buffer(worker, layout.size)) && dsc::extract_build(cache, layout, buf))
+            {
+                out.write(worker, cache.images[i].path, layout.size);
+            }
+        });
+        failed += out.failed;
+        sum_disk = 0;
+        dsc::parallel_for(n, [&](size_t i, size_t worker)
+        {
+            std::string path = std::string(argv[2]) + "/" + cache.images[i].path;
+            std::vector<uint8_t> &buf = bufs[worker];
+            struct stat st;
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd == -1)
+            {
+                ++failed;
+                return;
+            }
+            bool ok = fstat(fd, &st) == 0;
+            if(ok)
+            {
+                buf.resize((size_t)st.st_size);
+                ok = read(fd, buf.data(), buf.size()) == (ssize_t)buf.size();
+            }
+            close(fd);
+            if(!ok)
+            {
+                ++failed;
+                return;
+            }
+            sum_disk += dsc::hash64(buf.data(), buf.size());
+        });
+    });
+    size_t allocated = 0,
+           reused = 0;
+    double mem = bench_best([&]
+    {
+        dsc::sink_pool_t pool(2 * dsc::jobs());
+        sum_mem = 0;
+        failed += dsc::extract_sink(cache, todo, pool, [&](size_t, dsc::sink_buf_t buf)
+        {
+            sum_mem += dsc::hash64(buf.data(), buf.size());
+        });
+        allocated = pool.allocated;
+        reused = pool.reused;
+    });
+    if(failed)
+    {
+        ERR("%zu images failed", failed.load());
+        return 1;
+    }
+    if(sum_disk != sum_mem)
+    {
+        ERR("Checksum mismatch: 0x%llx vs 0x%llx", (unsigned long long)sum_disk.load(), (unsigned long long)sum_mem.load());
+        return 1;
+    }
+    printf("%zu images\n", n);
+    printf("write + read back: %8.1f ms\n", disk * 1e3);
+    printf("in-memory sink:    %8.1f ms  (%.2fx)  %zu buffers allocated, %zu reused\n", mem * 1e3, mem > 0 ? disk / mem : 0.0, allocated, reused);
+    return 0;
+}
+
+// Packs every image at a few zstd levels, reporting time, ratio and what
+// reading single images back in random order costs. Images are built once up
+// front, so only compression and pack I/O are timed.
+static int bench_pack(int argc, const char **argv)
+{
+    if(argc != 3)
+    {
+        fprintf(stderr, "Usage: dsc_bench pack <path-to-cache> <path-to-pack>\n");
+        return 1;
+    }
+    dsc::cache_t cache;
+    if(!cache.open(argv[1]))
+    {
+        return 1;
+    }
+    LOG("%s", cache.describe().c_str());
+    size_t n = cache.images.size();
+    std::vector<std::vector<uint8_t>> images(n);
+    uint64_t bytes = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        if(!dsc::extract_image(cache, cache.images[i], images[i]))
+        {
+            ERR("Failed to extract %s", cache.images[i].path);
+            return 1;
+        }
+        bytes += images[i].size();
+    }
+    printf("%zu images, %.1f MiB\n", n, bytes / 1048576.0);
+
+    static const int levels[] = { 1, 3, 9, 19 };
+    for(int level : levels)
+    {
+        uint64_t size = 0;
+        bool ok = true;
+        double secs = bench_best([&]
+        {
+            dsc::pack_writer_t pack;
+            if(!pack.open(argv[2], dsc::jobs(), level))
+            {
+                ok = false;
+                return;
+            }
+            dsc::parallel_for(n, [&](size_t i, size_t worker)
+            {
+                if(!pack.add(worker, i, cache.images[i].path, images[i].data(), images[i].size()))
+                {
+                    ok = false;
+                }
+            });
+            ok = pack.finish() && ok;
+            size = pack.out;
+        });
+        if(!ok)
+        {
+            return 1;
+        }
+
+        dsc::pack_t pack;
+        if(!pack.open(argv[2]))
+        {
+            return 1;
+        }
+        std::vector<const dsc::pack_t::entry_t*> order;
+        for(const dsc::pack_t::entry_t &e : pack.entries)
+        {
+            order.push_back(&e);
+        }
+        std::shuffle(order.begin(), order.end(), std::mt19937(level));
+        std::vector<uint8_t> buf;
+        double read = bench_best([&]
+        {
+            for(const dsc::pack_t::entry_t *e : order)
+            {
+                ok = pack.read(*e, buf) && ok;
+            }
+        });
+        if(!ok || order.size() != n)
+        {
+            ERR("Reading the pack back failed");
+            return 1;
+        }
+        printf("level %2d: %8.1f ms  %7.1f MiB/s  %5.2fx  %7.1f us/image random read\n", level, secs * 1e3, secs > 0 ? bytes / 1048576.0 / secs : 0.0, size ? (double)bytes / size : 0.0, n ? read * 1e6 / n : 0.0);
+    }
+    return 0;
+}
+
+// What merging local symbols back in costs: building the table of them, and
+// planning and building every image in memory with and without them, which
+// is everything extraction does besides the writes. Also reports how much the
+// per-image string deduplication saves over copying each local's name.
+static int bench_locals(int argc, const char **argv)
+{
+    if(argc != 2)
+    {
+        fprintf(stderr, "Usage: dsc_bench locals <path-to-cache>\n");
+        return 1;
+    }
+    dsc::cache_t cache;
+    if(!cache.open(argv[1]))
+    {
+        return 1;
+    }
+    LOG("%s", cache.describe().c_str());
+    size_t n = cache.images.size();
+    size_t entries = 0;
+    double table = bench_best([&]
+    {
+        dsc::locals_t locals;
+        locals.build(cache);
+        entries = locals.entries.size();
+    });
+    if(entries == 0)
+    {
+        ERR("No local symbols in this cache");
+        return 1;
+    }
+
+    std::vector<std::vector<uint8_t>> bufs(dsc::jobs());
+    std::atomic<size_t> failed(0);
+    std::atomic<uint64_t> bytes(0),
+                          nlocals(0),
+                          strs(0),
+                          raw(0);
+    auto run = [&](bool locals)
+    {
+        bytes = nlocals = strs = raw = 0;
+        dsc::parallel_for(n, [&](size_t i, size_t worker)
+        {
+            dsc::extract_layout_t layout;
+            std::vector<uint8_t> &buf = bufs[worker];
+            if(!dsc::extract_plan(cache, cache.images[i], layout, locals ? EXTRACT_LOCALS : 0))
+            {
+                ++failed;
+                return;
+            }
+            buf.resize(layout.size);
+            if(!dsc::extract_build(cache, layout, buf.data()))
+            {
+                ++failed;
+                return;
+            }
+            bytes += layout.size;
+            nlocals += layout.nlocals;
+            strs += layout.strsize;
+            uint64_t size = 0;
+            for(uint32_t j = 0; j < layout.nlocals; ++j)
+            {
+                const uint8_t *nl = layout.locals + (uint64_t)j * (cache.ptrsize == 8 ? sizeof(dsc::nlist_64) : sizeof(dsc::nlist));
+                uint32_t strx;
+                memcpy(&strx, nl, sizeof(strx));
+                if(strx < layout.locals_strs_size)
+                {
+                    size += strnlen(layout.locals_strs + strx, layout.locals_strs_size - strx) + 1;
+                }
+            }
+            raw += size;
+        });
+    };
+    double plain = bench_best([&] { run(false); });
+    uint64_t plain_bytes = bytes,
+             plain_strs = strs;
+    double merged = bench_best([&] { run(true); });
+    if(failed)
+    {
+        ERR("%zu images failed", failed.load());
+        return 1;
+    }
+    printf("%zu images, %zu with local symbols, %llu locals merged\n", n, entries, (unsigned long long)nlocals.load());
+    printf("table:           %8.3f ms\n", table * 1e3);
+    printf("without locals:  %8.1f ms  %7.1f MiB\n", plain * 1e3, plain_bytes / 1048576.0);
+    printf("with locals:     %8.1f ms  %7.1f MiB  (+%.1f%%)\n", merged * 1e3, bytes / 1048576.0, plain > 0 ? (merged / plain - 1) * 100 : 0.0);
+    printf("locals' strings: %7.1f MiB as stored, %.1f MiB deduplicated per image\n", raw / 1048576.0, (strs - plain_strs) / 1048576.0);
+    return 0;
+}
+
+// Decodes the patch table and writes its inverted index, then looks up every
+// exported name in the index in random order, walking each one's uses the way
+// patches-query does. Lookup latency is the mean over all of them, from a
+// best-of run, so it's what a warm index costs per query.
+static int bench_patches(int argc, const char **argv)
+{
+    if(argc != 3)
+    {
+        fprintf(stderr, "Usage: dsc_bench patches <path-to-cache> <index-file>\n");
+        return 1;
+    }
+    dsc::cache_t cache;
+    if(!cache.open(argv[1]))
+    {
+        return 1;
+    }
+    LOG("%s", cache.describe().c_str());
+    cache.headers();
+    dsc::patches_t patches;
+    bool ok = true;
+    double decode = bench_best([&]
+    {
+        patches = dsc::patches_t();
+        ok = ok && patches.build(cache);
+    });
+    if(!ok || patches.version == 0)
+    {
+        ERR("No usable patch table in this cache");
+        return 1;
+    }
+    // Signed uses must match the key, discriminator and diversity of the arm64e pointer they list
+    size_t signed_uses = 0;
+    for(const dsc::patches_t::use_t &u : patches.uses)
+    {
+        uint64_t raw;
+        const uint8_t *p = (u.flags & PATCH_AUTH) && (cache.slide_version == 3 || cache.slide_version == 5) ? cache.ptr(u.addr, sizeof(raw)) : nullptr;
+        if(!p)
+        {
+            continue;
+        }
+        memcpy(&raw, p, sizeof(raw));
+        if(!(raw >> 63))
+        {
+            continue;
+        }
+        bool v3 = cache.slide_version == 3;
+        uint8_t key = v3 ? (raw >> 49) & 3 : ((raw >> 51) & 1) ? 2 : 0;
+        uint16_t disc = (uint16_t)(raw >> (v3 ? 32 : 34));
+        bool div = ((raw >> (v3 ? 48 : 50)) & 1) != 0;
+        if(u.key != key || u.disc != disc || ((u.flags & PATCH_DIVERSITY) != 0) != div)
+        {
+            ERR("Use at 0x%llx decoded as key %u disc 0x%04x%s, the pointer has key %u disc 0x%04x%s", (unsigned long long)u.addr,
+                u.key, u.disc, (u.flags & PATCH_DIVERSITY) ? " addr" : "", key, disc, div ? " addr" : "");
+            return 1;
+        }
+        ++signed_uses;
+    }
+    double write = bench_best([&]
+    {
+        ok = ok && dsc::patches_index_write(cache, patches, argv[2]);
+    });
+    if(!ok)
+    {
+        return 1;
+    }
+
+    std::vector<const char*> names;
+    for(const dsc::patches_t::export_t &e : patches.exports)
+    {
+        names.push_back(e.name);
+    }
+    std::shuffle(names.begin(), names.end(), std::mt19937_64(1));
+    uint64_t seen = 0;
+    double open = 0;
+    double query = bench_best([&]
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        dsc::patches_index_t idx;
+        if(!idx.open(argv[2]))
+        {
+            ok = false;
+            return;
+        }
+        double o = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        open = open == 0 ? o : std::min(open, o);
+        seen = 0;
+        for(const char *name : names)
+        {
+            auto range = idx.find(name);
+            for(const dsc::patches_index_export_t *e = range.first; e != range.second; ++e)
+            {
+                auto uses = idx.uses_of(*e);
+                for(const dsc::patches_t::use_t *u = uses.first; u != uses.second; ++u)
+                {
+                    seen += u->image != PATCH_NONE;
+                }
+            }
+        }
+    });
+    if(!ok)
+    {
+        return 1;
+    }
+    struct stat st;
+    uint64_t size = stat(argv[2], &st) == 0 ? (uint64_t)st.st_size : 0;
+    printf("patch table v%u: %zu exports, %zu uses (%zu signed, matching their pointers), index %.1f MiB\n", patches.version, patches.exports.size(), patches.uses.size(), signed_uses, size / 1048576.0);
+    printf("decode:          %8.3f ms\n", decode * 1e3);
+    printf("write index:     %8.3f ms\n", write * 1e3);
+    printf("open index:      %8.3f ms\n", open * 1e3);
+    printf("query:           %8.3f us per name, %zu names, %llu uses in images\n", names.empty() ? 0.0 : query / names.size() * 1e6, names.size(), (unsigned long long)seen);
+    return 0;
+}
+
+// Counter of user space dTLB load misses on the calling thread, disabled, or
+// -1 where there's none (not Linux, no PMU in the VM, perf_event_paranoid).
+static int bench_dtlb_open(void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+// Memory of this process in huge pages of any kind, in KiB, -1 where there's no smaps_rollup.
+static long bench_huge_kib(void)
+{
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    if(!f)
+    {
+        return -1;
+    }
+    static const char *const fields[] = { "AnonHugePages:", "FilePmdMapped:", "Shared_Hugetlb:", "Private_Hugetlb:" };
+    long total = 0;
+    char line[256];
+    while(fgets(line, sizeof(line), f))
+    {
+        for(const char *field : fields)
+        {
+            size_t len = strlen(field);
+            if(strncmp(line, field, len) == 0)
+            {
+                total += strtol(line + len, nullptr, 10);
+            }
+        }
+    }
+    fclose(f);
+    return total;
+}
+
+// Symbol lookups in export tries under each paging policy (see src/paging.h),
+// or the ones given. The lookups are the same for every policy: random
+// exports of random images, each found by descending its image's trie, which
+// is about the worst access pattern a cache sees. Per policy: time to open the
+// cache (which includes copying and populating), the first pass with its page
+// faults, the best of 5 passes with dTLB misses per lookup where the PMU is
+// available, and how much more of the process is in huge pages. The cache
+// stays in the page cache throughout, so faults are all minor.
+static int bench_paging(int argc, const char **argv)
+{
+    if(argc < 2)
+    {
+        fprintf(stderr, "Usage: dsc_bench paging <path-to-cache> [policy...]\n");
+        return 1;
+    }
+    static const char *const defaults[] = { "none", "random", "willneed", "populate", "thp", "thp,populate", "hot", "hugetlb", "thp,hot,populate" };
+    std::vector<dsc::paging_t> policies;
+    for(int i = 2; i < argc; ++i)
+    {
+        dsc::paging_t p;
+        if(!dsc::paging_parse(argv[i], p))
+        {
+            return 1;
+        }
+        policies.push_back(p);
+    }
+    if(policies.empty())
+    {
+        for(const char *spec : defaults)
+        {
+            policies.emplace_back();
+            dsc::paging_parse(spec, policies.back());
+        }
+    }
+
+    // Every export's name in one pool, then a random sample of them to look up
+    std::vector<char> pool;
+    std::vector<std::pair<uint32_t, size_t>> all;    // Image, offset in pool
+    size_t nimages;
+    {
+        dsc::cache_t cache;
+        if(!cache.open(argv[1], dsc::paging_t()))
+        {
+            return 1;
+        }
+        LOG("%s", cache.describe().c_str());
+        nimages = cache.images.size();
+        dsc::trie_walker_t walker;
+        for(size_t i = 0; i < nimages; ++i)
+        {
+            dsc::macho_t mo;
+            const uint8_t *trie;
+            size_t size;
+            if(!mo.init(cache, cache.images[i].addr) || !mo.export_trie(cache, trie, size) || !trie)
+            {
+                continue;
+            }
+            dsc::trie_each(walker, trie, size, [&](const dsc::export_t &e)
+            {
+                all.push_back({ (uint32_t)i, pool.size() });
+                pool.insert(pool.end(), e.name, e.name + e.namelen + 1);
+            });
+        }
+    }
+    std::shuffle(all.begin(), all.end(), std::mt19937_64(1));
+    all.resize(std::min(all.size(), (size_t)BENCH_LOOKUPS));
+    if(all.empty())
+    {
+        ERR("No exports to look up");
+        return 1;
+    }
+    size_t n = all.size();
+    printf("%zu lookups over %zu images\n", n, nimages);
+    printf("%-20s %9s %10s %9s %10s %11s %9s %9s\n", "policy", "open ms", "first ns", "faults", "best ns", "dtlb/lookup", "copied", "huge MiB");
+
+    int dtlb = bench_dtlb_open();
+    for(const dsc::paging_t &policy : policies)
+    {
+        long huge0 = bench_huge_kib();
+        dsc::cache_t cache;
+        auto t0 = std::chrono::steady_clock::now();
+        if(!cache.open(argv[1], policy))
+        {
+            return 1;
+        }
+        double open = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        std::vector<std::pair<const uint8_t*, size_t>> tries(nimages, { nullptr, 0 });
+        for(size_t i = 0; i < nimages; ++i)
+        {
+            dsc::macho_t mo;
+            if(mo.init(cache, cache.images[i].addr))
+            {
+                mo.export_trie(cache, tries[i].first, tries[i].second);
+            }
+        }
+        size_t found = 0;
+        auto pass = [&]
+        {
+            found = 0;
+            for(const std::pair<uint32_t, size_t> &l : all)
+            {
+                dsc::export_t e;
+                found += dsc::trie_find(tries[l.first].first, tries[l.first].second, &pool[l.second], e);
+            }
+        };
+        struct rusage r0, r1;
+        getrusage(RUSAGE_SELF, &r0);
+        t0 = std::chrono::steady_clock::now();
+        pass();
+        double first = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        getrusage(RUSAGE_SELF, &r1);
+        if(found != n)
+        {
+            ERR("%s: found %zu of %zu exports", dsc::paging_describe(policy).c_str(), found, n);
+            return 1;
+        }
+        if(dtlb >= 0)
+        {
+            ioctl(dtlb, PERF_EVENT_IOC_RESET, 0);
+            ioctl(dtlb, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        double best = bench_best(pass);
+        uint64_t misses = 0;
+        bool counted = dtlb >= 0 && ioctl(dtlb, PERF_EVENT_IOC_DISABLE, 0) == 0 && read(dtlb, &misses, sizeof(misses)) == (ssize_t)sizeof(misses);
+        long huge = bench_huge_kib();
+
+        printf("%-20s %9.2f %10.1f %9ld %10.1f ", dsc::paging_describe(policy).c_str(), open * 1e3, first * 1e9 / n, (r1.ru_minflt - r0.ru_minflt) + (r1.ru_majflt - r0.ru_majflt), best * 1e9 / n);
+        if(counted)
+        {
+            printf("%11.3f ", (double)misses / ((double)n * BENCH_RUNS));
+        }
+        else
+        {
+            printf("%11s ", "-");
+        }
+        printf("%8.1fM ", cache.hot_bytes / 1048576.0);
+        if(huge >= 0 && huge0 >= 0)
+        {
+            printf("%9.1f\n", (huge - huge0) / 1024.0);
+        }
+        else
+        {
+            printf("%9s\n", "-");
+        }
+        fflush(stdout);
+    }
+    if(dtlb >= 0)
+    {
+        close(dtlb);
+    }
+    return 0;
+}
+
+// Runs args[0] with output discarded. Wall time always, peak RSS of the
+// process (ru_maxrss, KiB on Linux, bytes on macOS) when rss isn't null, and
+// syscalls across all its threads when syscalls isn't null, which needs
+// ptrace and so only works on Linux. Returns the exit status, -1 if it
+// couldn't be run or was killed.
+static int bench_spawn(const std::vector<std::string> &args, double &secs, long *rss, uint64_t *syscalls)
+{
+    std::vector<char*> argv;
+    for(const std::string &a : args)
+    {
+        argv.push_back((char*)a.c_str());
+    }
+    argv.push_back(nullptr);
+#ifndef __linux__
+    if(syscalls)
+    {
+        return -1;
+    }
+#endif
+    auto t0 = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if(pid < 0)
+    {
+        ERR("fork: %s", strerror(errno));
+        return -1;
+    }
+    if(pid == 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        if(null >= 0)
+        {
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+#ifdef __linux__
+        if(syscalls)
+        {
+            ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+            raise(SIGSTOP);
+        }
+#endif
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage ru;
+    memset(&ru, 0, sizeof(ru));
+#ifdef __linux__
+    if(syscalls)
+    {
+        // Every syscall stops its thread twice, on entry and on exit
+        uint64_t stops = 0;
+        bool first = true;
+        for(;;)
+        {
+            pid_t tid = wait4(-1, &status, __WALL, &ru);
+            if(tid < 0)
+            {
+                break;
+            }
+            if(WIFEXITED(status) || WIFSIGNALED(status))
+            {
+                if(tid == pid)
+                {
+                    break;
+                }
+                continue;
+            }
+            int sig = WSTOPSIG(status),
+                deliver = 0;
+            if(first && tid == pid && sig == SIGSTOP)
+            {
+                ptrace(PTRACE_SETOPTIONS, pid, nullptr, (void*)(long)(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK | PTRACE_O_EXITKILL));
+                first = false;
+            }
+            else if(sig == (SIGTRAP | 0x80))
+            {
+                ++stops;
+            }
+            else if(sig != SIGTRAP && !(sig == SIGSTOP && (status >> 16) == 0 && tid != pid))
+            {
+                // Anything but our own events and the stop new threads start with
+                deliver = sig;
+            }
+            ptrace(PTRACE_SYSCALL, tid, nullptr, (void*)(long)deliver);
+        }
+        *syscalls = (stops + 1) / 2;
+    }
+    else
+#endif
+    if(wait4(pid, &status, 0, &ru) < 0)
+    {
+        ERR("wait4: %s", strerror(errno));
+        return -1;
+    }
+    secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if(rss)
+    {
+        *rss = ru.ru_maxrss;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// End-to-end runs of the command line tools on synthetic caches of varying
+// shape, one knob turned per case, for tracking regressions across commits.
+// Caches are generated into <work-dir> from fixed seeds, so the same build on
+// the same machine measures the same input every time. Tools are taken from
+// [tool-dir] (default: next to dsc_bench) and skipped when not built. Output
+// is tab-separated with a header line and fixed columns, one row per case and
+// tool: best wall time of 5 runs, throughput in images and extracted MiB per
+// second, the highest peak RSS seen, and syscalls from one extra traced run
+// ("-" where that isn't possible).
+static int bench_suite(int argc, const char **argv)
+{
+    if(argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "Usage: dsc_bench suite <work-dir> [tool-dir]\n");
+        return 1;
+    }
+    std::string work = argv[1],
+                tools;
+    if(argc > 2)
+    {
+        tools = argv[2];
+    }
+    else
+    {
+        // argv[-1] is dsc_bench itself
+        const char *slash = strrchr(argv[-1], '/');
+        tools = slash ? std::string(argv[-1], slash - argv[-1]) : ".";
+    }
+
+    static const struct
+    {
+        const char *name;
+        size_t images;
+        uint64_t text, data;
+        uint32_t symbols, slide, subcaches;
+    } cases[] =
+    {
+        { "base",         100, 0x10000, 0x4000,  200, 3, 0 },
+        { "images-400",   400, 0x10000, 0x4000,  200, 3, 0 },
+        { "text-256k",    100, 0x40000, 0x4000,  200, 3, 0 },
+        { "data-64k",     100, 0x10000, 0x10000, 200, 3, 0 },
+        { "symbols-2000", 100, 0x10000, 0x4000, 2000, 3, 0 },
+        { "slide-2",      100, 0x10000, 0x4000,  200, 2, 0 },
+        { "slide-4",      100, 0x10000, 0x4000,  200, 4, 0 },
+        { "slide-5",      100, 0x10000, 0x4000,  200, 5, 0 },
+        { "subcaches-4",  100, 0x10000, 0x4000,  200, 5, 4 },
+    };
+    static const struct
+    {
+        const char *name;
+        const char *tool;
+        const char *args[4];    // "@cache" and "@out" are substituted
+    } runs[] =
+    {
+        { "extract",   "dsc_extract",   { "@cache", "@out" } },
+        { "extractor", "dsc_extractor", { "@cache", "@out" } },
+        { "exports",   "dsc_util",      { "exports", "@cache" } },
+        { "graph",     "dsc_util",      { "graph", "@cache", "topo" } },
+    };
+
+    printf("case\ttool\timages\tMiB\tseconds\timages/s\tMiB/s\tpeak_rss_kib\tsyscalls\tstatus\n");
+    for(const auto &c : cases)
+    {
+        std::string dir = work + "/" + c.name,
+                    path = dir + "/cache",
+                    out = dir + "/out";
+        dsc::synth_opts_t opts;
+        opts.images = c.images;
+        opts.text = c.text;
+        opts.data = c.data;
+        opts.symbols = c.symbols;
+        opts.slide = c.slide;
+        opts.subcaches = c.subcaches;
+        // Generated in a child, so the buffers don't stay in this process's
+        // heap and inflate the RSS every tool starts out with
+        pid_t pid = fork();
+        if(pid == 0)
+        {
+            _exit(dsc::synth_write(path.c_str(), opts) ? 0 : 1);
+        }
+        int status = -1;
+        if(pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            ERR("Failed to generate %s", path.c_str());
+            return 1;
+        }
+        // Closed again before any tool runs for the same reason, Linux
+        // carries a forked child's peak RSS across exec
+        uint64_t bytes = 0;
+        size_t n;
+        {
+            dsc::cache_t cache;
+            if(!cache.open(path.c_str()))
+            {
+                return 1;
+            }
+            for(const dsc::image_t &img : cache.images)
+            {
+                dsc::extract_layout_t layout;
+                if(dsc::extract_plan(cache, img, layout))
+                {
+                    bytes += layout.size;
+                }
+            }
+            n = cache.images.size();
+        }
+        double mib = bytes / 1048576.0;
+
+        for(const auto &run : runs)
+        {
+            std::string exe = tools + "/" + run.tool;
+            if(access(exe.c_str(), X_OK) != 0)
+            {
+                continue;
+            }
+            std::vector<std::string> args = { exe };
+            for(const char *a : run.args)
+            {
+                if(a)
+                {
+                    args.push_back(strcmp(a, "@cache") == 0 ? path : strcmp(a, "@out") == 0 ? out : a);
+                }
+            }
+            long rss = 0;
+            int status = 0;
+            double secs = bench_best([&]
+            {
+                nftw(out.c_str(), bench_rmtree_one, 16, FTW_DEPTH | FTW_PHYS);
+                long r = 0;
+                double s;
+                int st = bench_spawn(args, s, &r, nullptr);
+                rss = std::max(rss, r);
+                if(st != 0)
+                {
+                    status = st;
+                }
+            });
+            uint64_t syscalls = 0;
+            nftw(out.c_str(), bench_rmtree_one, 16, FTW_DEPTH | FTW_PHYS);
+            double traced;
+            bool counted = bench_spawn(args, traced, nullptr, &syscalls) >= 0;
+            nftw(out.c_str(), bench_rmtree_one, 16, FTW_DEPTH | FTW_PHYS);
+
+            printf("%s\t%s\t%zu\t%.1f\t%.4f\t%.1f\t%.1f\t%ld\t", c.name, run.name, n, mib, secs, secs > 0 ? n / secs : 0.0, secs > 0 ? mib / secs : 0.0, rss);
+            if(counted)
+            {
+                printf("%llu", (unsigned long long)syscalls);
+            }
+            else
+            {
+                printf("-");
+            }
+            printf("\t%d\n", status);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
+
+static std::vector<std::string> bench_tree;
+
+static int bench_tree_one(const char *path, const struct stat *st, int type, struct FTW*)
+{
+    if(type == FTW_F && S_ISREG(st->st_mode))
+    {
+        bench_tree.push_back(path);
+    }
+    return 0;
+}
+
+// Hash of every regular file under root (or of root itself if it's a file):
+// names relative to root in sorted order, each followed by its contents.
+static bool bench_tree_hash(const std::string &root, uint64_t &hash)
+{
+    bench_tree.clear();
+    if(nftw(root.c_str(), bench_tree_one, 16, FTW_PHYS) != 0)
+    {
+        ERR("%s: %s", root.c_str(), strerror(errno));
+        return false;
+    }
+    std::sort(bench_tree.begin(), bench_tree.end());
+    hash = 0;
+    std::vector<uint8_t> buf;
+    for(const std::string &path : bench_tree)
+    {
+        const char *rel = path.c_str() + std::min(root.size(), path.size());
+        hash = dsc::hash64(rel, strlen(rel), hash);
+        FILE *f = fopen(path.c_str(), "rb");
+        if(!f)
+        {
+            ERR("%s: %s", path.c_str(), strerror(errno));
+            return false;
+        }
+        buf.resize(1 << 20);
+        size_t n;
+        while((n = fread(buf.data(), 1, buf.size(), f)) > 0)
+        {
+            hash = dsc::hash64(buf.data(), n, hash);
+        }
+        fclose(f);
+    }
+    return true;
+}
+
+// Checks that extraction output depends only on the cache and the options:
+// each variant is extracted once on a single thread and once on many, and
+// the two outputs hashed. Any difference means something about scheduling
+// leaked into the bytes. Exits non-zero if any variant differs.
+static int bench_repro(int argc, const char **argv)
+{
+    if(argc < 3 || argc > 4)
+    {
+        fprintf(stderr, "Usage: dsc_bench repro <path-to-cache> <work-dir> [tool-dir]\n");
+        return 1;
+    }
+    std::string work = argv[2],
+                tools;
+    if(argc > 3)
+    {
+        tools = argv[3];
+    }
+    else
+    {
+        const char *slash = strrchr(argv[-1], '/');
+        tools = slash ? std::string(argv[-1], slash - argv[-1]) : ".";
+    }
+    std::string exe = tools + "/dsc_extract";
+    if(access(exe.c_str(), X_OK) != 0)
+    {
+        ERR("%s: not built", exe.c_str());
+        return 1;
+    }
+
+    static const struct
+    {
+        const char *name;
+        const char *args[3];
+    } variants[] =
+    {
+        { "plain",        {} },
+        { "locals-stubs", { "--locals", "--stubs" } },
+        { "pack-3",       { "--pack", "3" } },
+    };
+    // One thread, then more workers than images are likely to finish in order on
+    static const char *const jobs[] = { "1", "16" };
+
+    bool same = true;
+    for(const auto &v : variants)
+    {
+        uint64_t hashes[2];
+        for(size_t j = 0; j < 2; ++j)
+        {
+            std::string out = work + "/" + v.name + "-" + jobs[j];
+            nftw(out.c_str(), bench_rmtree_one, 16, FTW_DEPTH | FTW_PHYS);
+            std::vector<std::string> args = { exe };
+            for(const char *a : v.args)
+            {
+                if(a)
+                {
+                    args.push_back(a);
+                }
+            }
+            args.push_back(argv[1]);
+            args.push_back(out);
+            setenv("DSC_JOBS", jobs[j], 1);
+            double secs;
+            int status = bench_spawn(args, secs, nullptr, nullptr);
+            if(status != 0)
+            {
+                ERR("%s with DSC_JOBS=%s: exit status %d", v.name, jobs[j], status);
+                return 1;
+            }
+            if(!bench_tree_hash(out, hashes[j]))
+            {
+                return 1;
+            }
+            nftw(out.c_str(), bench_rmtree_one, 16, FTW_DEPTH | FTW_PHYS);
+        }
+        printf("%-14s %016llx %016llx %s\n", v.name, (unsigned long long)hashes[0], (unsigned long long)hashes[1], hashes[0] == hashes[1] ? "same" : "DIFFERENT");
+        same = same && hashes[0] == hashes[1];
+    }
+    return same ? 0 : 1;
+}
+
+// Just enough of an HTTP/1.1 server for dsc_util remote: HEAD and GET with a
+// single byte range, on 127.0.0.1, for a fixed set of files. Connections are
+// answered one request at a time and closed.
+struct bench_http_t
+{
+    int fd = -1;
+    uint16_t port = 0;
+    std::map<std::string, std::string> files;  // URL path -> local path
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> requests{0};
+    std::atomic<uint64_t> bytes{0};
+    std::thread thread;
+
+    ~bench_http_t()
+    {
+        this->stop = true;
+        if(this->thread.joinable())
+        {
+            this->thread.join();
+        }
+        if(this->fd != -1)
+        {
+            close(this->fd);
+        }
+    }
+
+    bool start(void)
+    {
+        this->fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in sa = {};
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(sa);
+        if(this->fd == -1 || bind(this->fd, (sockaddr*)&sa, sizeof(sa)) != 0 || listen(this->fd, 64) != 0 || getsockname(this->fd, (sockaddr*)&sa, &len) != 0)
+        {
+            ERR("Can't listen on 127.0.0.1: %s", strerror(errno));
+            return false;
+        }
+        this->port = ntohs(sa.sin_port);
+        this->thread = std::thread([this]
+        {
+            while(!this->stop)
+            {
+                pollfd p = { this->fd, POLLIN, 0 };
+                if(poll(&p, 1, 100) == 1)
+                {
+                    int c = accept(this->fd, NULL, NULL);
+                    if(c != -1)
+                    {
+                        this->serve(c);
+                        close(c);
+                    }
+                }
+            }
+        });
+        return true;
+    }
+
+    static bool send_all(int c, const char *buf, size_t len)
+    {
+        while(len > 0)
+        {
+            ssize_t n = send(c, buf, len, MSG_NOSIGNAL);
+            if(n <= 0)
+            {
+                return false;
+            }
+            buf += n;
+            len -= (size_t)n;
+        }
+        return true;
+    }
+
+    void serve(int c)
+    {
+        std::string req;
+        char buf[0x1000];
+        while(req.find("\r\n\r\n") == std::string::npos)
+        {
+            ssize_t n = recv(c, buf, sizeof(buf), 0);
+            if(n <= 0)
+            {
+                return;
+            }
+            req.append(buf, (size_t)n);
+        }
+        ++this->requests;
+        size_t sp1 = req.find(' '),
+               sp2 = req.find(' ', sp1 + 1);
+        std::string method = req.substr(0, sp1),
+                    path = sp1 == std::string::npos ? "" : req.substr(sp1 + 1, sp2 - sp1 - 1);
+        auto it = this->files.find(path);
+        int f = it == this->files.end() ? -1 : open(it->second.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if(f == -1 || fstat(f, &st) != 0)
+        {
+            const char *nf = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            send_all(c, nf, strlen(nf));
+            if(f != -1)
+            {
+                close(f);
+            }
+            return;
+        }
+        uint64_t size = (uint64_t)st.st_size,
+                 from = 0,
+                 to = size ? size - 1 : 0;
+        bool ranged = false;
+        for(size_t at = req.find("\r\n"); at != std::string::npos && at + 2 < req.size(); at = req.find("\r\n", at + 2))
+        {
+            unsigned long long a, b;
+            if(strncasecmp(req.c_str() + at + 2, "Range: bytes=", 13) == 0 && sscanf(req.c_str() + at + 15, "%llu-%llu", &a, &b) == 2 && a <= b && b < size)
+            {
+                from = a;
+                to = b;
+                ranged = true;
+            }
+        }
+        char hdr[256];
+        uint64_t len = size ? to - from + 1 : 0;
+        int n = ranged ? snprintf(hdr, sizeof(hdr), "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes %llu-%llu/%llu\r\nContent-Length: %llu\r\nConnection: close\r\n\r\n",
+                                  (unsigned long long)from, (unsigned long long)to, (unsigned long long)size, (unsigned long long)len)
+                       : snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Length: %llu\r\nConnection: close\r\n\r\n", (unsigned long long)len);
+        bool ok = send_all(c, hdr, (size_t)n);
+        for(uint64_t off = from; ok && method == "GET" && off < from + len; )
+        {
+            ssize_t r = pread(f, buf, (size_t)std::min<uint64_t>(sizeof(buf), from + len - off), (off_t)off);
+            ok = r > 0 && send_all(c, buf, (size_t)r);
+            off += r > 0 ? (uint64_t)r : 0;
+            this->bytes += r > 0 ? (uint64_t)r : 0;
+        }
+        close(f);
+    }
+};
+
+static uint32_t bench_crc32(const uint8_t *p, size_t len, uint32_t crc)
+{
+    static uint32_t table[256];
+    static std::once_flag once;
+    std::call_once(once, []
+    {
+        for(uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for(int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            table[i] = c;
+        }
+    });
+    crc = ~crc;
+    for(size_t i = 0; i < len; ++i)
+    {
+        crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Writes files (member name, local path) into a zip as stored members, the
+// way dsc_util remote needs them. No zip64, so everything must stay under 4 GiB.
+static bool bench_zip(const std::string &out, const std::vector<std::pair<std::string, std::string>> &files)
+{
+    FILE *z = fopen(out.c_str(), "wb");
+    if(!z)
+    {
+        ERR("fopen(%s): %s", out.c_str(), strerror(errno));
+        return false;
+    }
+    auto put16 = [](std::string &s, uint16_t v) { s.append((const char*)&v, 2); };
+    auto put32 = [](std::string &s, uint32_t v) { s.append((const char*)&v, 4); };
+    std::string cd;
+    uint64_t off = 0;
+    bool ok = true;
+    std::vector<uint8_t> data;
+    for(const auto &f : files)
+    {
+        FILE *in = fopen(f.second.c_str(), "rb");
+        if(!in)
+        {
+            ERR("fopen(%s): %s", f.second.c_str(), strerror(errno));
+            ok = false;
+            break;
+        }
+        data.clear();
+        uint8_t buf[0x10000];
+        for(size_t n; (n = fread(buf, 1, sizeof(buf), in)) > 0; )
+        {
+            data.insert(data.end(), buf, buf + n);
+        }
+        fclose(in);
+        if(off + data.size() + 30 + f.first.size() > 0xffffffff)
+        {
+            ERR("%s: too big for a zip without zip64", out.c_str());
+            ok = false;
+            break;
+        }
+        uint32_t crc = bench_crc32(data.data(), data.size(), 0);
+        std::string lh;
+        put32(lh, 0x04034b50); put16(lh, 10); put16(lh, 0); put16(lh, 0); put16(lh, 0); put16(lh, 0);
+        put32(lh, crc); put32(lh, (uint32_t)data.size()); put32(lh, (uint32_t)data.size());
+        put16(lh, (uint16_t)f.first.size()); put16(lh, 0);
+        lh += f.first;
+        put32(cd, 0x02014b50); put16(cd, 10); put16(cd, 10); put16(cd, 0); put16(cd, 0); put16(cd, 0); put16(cd, 0);
+        put32(cd, crc); put32(cd, (uint32_t)data.size()); put32(cd, (uint32_t)data.size());
+        put16(cd, (uint16_t)f.first.size()); put16(cd, 0); put16(cd, 0); put16(cd, 0); put16(cd, 0); put32(cd, 0); put32(cd, (uint32_t)off);
+        cd += f.first;
+        ok = fwrite(lh.data(), 1, lh.size(), z) == lh.size() && fwrite(data.data(), 1, data.size(), z) == data.size();
+        off += lh.size() + data.size();
+        if(!ok)
+        {
+            break;
+        }
+    }
+    if(ok)
+    {
+        std::string eocd;
+        put32(eocd, 0x06054b50); put16(eocd, 0); put16(eocd, 0); put16(eocd, (uint16_t)files.size()); put16(eocd, (uint16_t)files.size());
+        put32(eocd, (uint32_t)cd.size()); put32(eocd, (uint32_t)off); put16(eocd, 0);
+        ok = fwrite(cd.data(), 1, cd.size(), z) == cd.size() && fwrite(eocd.data(), 1, eocd.size(), z) == eocd.size();
+    }
+    if(fclose(z) != 0 || !ok)
+    {
+        ERR("Failed to write %s", out.c_str());
+        unlink(out.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Local fixture for dsc_util remote: serves the cache and its subcaches over
+// HTTP on 127.0.0.1, once as plain files and once stored in a zip next to a
+// decoy, extracts the matching images from both with range requests, and
+// compares them to what dsc_extract makes of the local files. Exits non-zero
+// if either differs.
+static int bench_remote(int argc, const char **argv)
+{
+    if(argc < 3 || argc > 5)
+    {
+        fprintf(stderr, "Usage: dsc_bench remote <path-to-cache> <work-dir> [library-name] [tool-dir]\n");
+        return 1;
+    }
+    std::string work = argv[2],
+                filter = argc > 3 ? argv[3] : "/",
+                tools;
+    if(argc > 4)
+    {
+        tools = argv[4];
+    }
+    else
+    {
+        const char *slash = strrchr(argv[-1], '/');
+        tools = slash ? std::string(argv[-1], slash - argv[-1]) : ".";
+    }
+    std::string extract = tools + "/dsc_extract",
+                util = tools + "/dsc_util";
+    for(const std::string &exe : { extract, util })
+    {
+        if(access(exe.c_str(), X_OK) != 0)
+        {
+            ERR("%s: not built", exe.c_str());
+            return 1;
+        }
+    }
+    dsc::cache_t cache;
+    if(!cache.open(argv[1]) || !dsc::mkdirs(work + "/"))
+    {
+        return 1;
+    }
+
+    // Every file under its own name, and in the zip where a system volume has it, so the default member is found
+    const char *slash = strrchr(argv[1], '/');
+    std::string base = slash ? slash + 1 : argv[1];
+    bench_http_t http;
+    std::vector<std::pair<std::string, std::string>> members = { { "Restore.plist", "/dev/null" } };
+    http.files["/" + base] = argv[1];
+    std::string member = "System/Library/Caches/com.apple.dyld/dyld_shared_cache_fixture";
+    members.push_back({ member, argv[1] });
+    for(const dsc::subcache_t &sc : cache.subcaches)
+    {
+        std::string name = base + sc.path.substr(strlen(argv[1]));
+        http.files["/" + name] = sc.path;
+        members.push_back({ member + sc.path.substr(strlen(argv[1])), sc.path });
+    }
+    std::string zip = work + "/cache.zip";
+    if(!bench_zip(zip, members))
+    {
+        return 1;
+    }
+    http.files["/cache.zip"] = zip;
+    if(!http.start())
+    {
+        return 1;
+    }
+
+    std::string ref = work + "/local";
+    nftw(ref.c_str(), bench_rmtree_one, 16, FTW_DEPTH | FTW_PHYS);
+    double secs;
+    uint64_t want;
+    if(bench_spawn({ extract, argv[1], ref, filter }, secs, nullptr, nullptr) != 0 || !bench_tree_hash(ref, want))
+    {
+        ERR("dsc_extract failed");
+        return 1;
+    }
+    nftw(ref.c_str(), bench_rmtree_one, 16, FTW_DEPTH | FTW_PHYS);
+
+    std::string host = "http://127.0.0.1:" + std::to_string(http.port);
+    const struct
+    {
+        const char *name;
+        std::string url;
+    } variants[] =
+    {
+        { "http", host + "/" + base },
+        { "zip",  host + "/cache.zip" },
+    };
+    bool same = true;
+    printf("%-6s %9s %12s %6s %16s\n", "", "requests", "bytes", "secs", "hash");
+    for(const auto &v : variants)
+    {
+        std::string out = work + "/" + v.name;
+        nftw(out.c_str(), bench_rmtree_one, 16, FTW_DEPTH | FTW_PHYS);
+        size_t requests = http.requests;
+        uint64_t bytes = http.bytes,
+                 hash;
+        int status = bench_spawn({ util, "remote", v.url, out, filter }, secs, nullptr, nullptr);
+        if(status != 0)
+        {
+            ERR("%s: exit status %d", v.name, status);
+            return 1;
+        }
+        if(!bench_tree_hash(out, hash))
+        {
+            return 1;
+        }
+        nftw(out.c_str(), bench_rmtree_one, 16, FTW_DEPTH | FTW_PHYS);
+        printf("%-6s %9zu %12llu %6.2f %016llx %s\n", v.name, http.requests - requests, (unsigned long long)(http.bytes - bytes), secs,
+               (unsigned long long)hash, hash == want ? "same" : "DIFFERENT");
+        same = same && hash == want;
+    }
+    unlink(zip.c_str());
+    return same ? 0 : 1;
+}
+
+static const struct
+{
+    const char *name;
+    const char *args;
+    int (*fn)(int, const char**);
+} benches[] =
+{
+    { "pointers",     "<path-to-cache>", bench_pointers },
+    { "write",        "<path-to-cache> <path-to-dir>", bench_write },
+    { "sink",         "<path-to-cache> <path-to-dir>", bench_sink },
+    { "pack",         "<path-to-cache> <path-to-pack>", bench_pack },
+    { "locals",       "<path-to-cache>", bench_locals },
+    { "patches",      "<path-to-cache> <index-file>", bench_patches },
+    { "paging",       "<path-to-cache> [policy...]", bench_paging },
+    { "suite",        "<work-dir> [tool-dir]", bench_suite },
+    { "repro",        "<path-to-cache> <work-dir> [tool-dir]", bench_repro },
+    { "remote",       "<path-to-cache> <work-dir> [library-name] [tool-dir]", bench_remote },
+};
+
+int main(int argc, const char **argv)
+{
+    if(argc >= 2)
+    {
+        for(size_t i = 0; i < sizeof(benches)/sizeof(benches[0]); ++i)
+        {
+            if(strcmp(argv[1], benches[i].name) == 0)
+            {
+                return benches[i].fn(argc - 1, argv + 1);
+            }
+        }
+    }
+    fprintf(stderr, "Usage:\n");
+    for(size_t i = 0; i < sizeof(benches)/sizeof(benches[0]); ++i)
+    {
+        fprintf(stderr, "    dsc_bench %s %s\n", benches[i].name, benches[i].args);
+    }
+    return 1;
+}
@@ -0,0 +1,26 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/modes.h"
+
+// dyld's dyld_closure_util main(), renamed by build.sh
+extern int siguza_dsc_closure_main(int argc, const char *argv[]);
+
+int main(int argc, const char **argv)
+{
+    if(argc >= 2 && strcmp(argv[1], "rootfs") == 0)
+    {
+        return dsc::mode_rootfs(argv[0], argc - 1, argv + 1);
+    }
+    if(argc >= 2 && strcmp(argv[1], "rootfs-worker") == 0)
+    {
+        return dsc::mode_rootfs_worker(siguza_dsc_closure_main, argv[0], argc - 1, argv + 1);
+    }
+    if(argc < 2)
+    {
+        fprintf(stderr, "Additional modes:\n");
+        fprintf(stderr, "    dsc_closure rootfs <path-to-root> <path-to-cache> <path-to-dir> [-- dsc_closure-args...]\n");
+        fprintf(stderr, "\n");
+    }
+    return siguza_dsc_closure_main(argc, argv);
+}
@@ -0,0 +1,218 @@
+#include <atomic>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../src/cache.h"
+#include "../src/common.h"
+#include "../src/extract.h"
+#include "../src/locals.h"
+#include "../src/pack.h"
+#include "../src/profile.h"
+#include "../src/stubs.h"
+#include "../src/writer.h"
+
+// Version-independent counterpart to dsc_extractor. The cache format is
+// detected when the cache is opened, so one build handles every cache rather
+// than one build per dyld source drop. Images are rebuilt on DSC_JOBS threads
+// and written out through writer_t, with io_uring where available and verbatim
+// ranges cloned from the cache file where the filesystem allows. The output
+// directories are all created before the first image, so each file costs one
+// create and one close relative to its directory. With --pack, images are
+// compressed on the same threads into one pack file instead. With --locals,
+// local symbols are merged back into each image's symbol table on the same
+// threads, so symbolication gets them at little cost over plain extraction.
+// With --stubs, calls are retargeted at the image's own stubs the same way.
+// With DSC_PROFILE=<n>, allocations and peak RSS are reported per phase on
+// exit, along with the n images whose extraction took the most heap.
+
+// Every image into a pack at path. Images are built into per-worker buffers
+// and compressed right there, the pack only puts the frames in todo order.
+static int extract_pack(const dsc::cache_t &cache, const std::vector<const dsc::image_t*> &todo, const char *path, int level, uint32_t flags)
+{
+    dsc::pack_writer_t pack;
+    if(!pack.open(path, dsc::jobs(), level))
+    {
+        return 1;
+    }
+    std::vector<std::vector<uint8_t>> bufs(dsc::jobs());
+    std::atomic<size_t> done(0),
+                        failed(0);
+    dsc::profile_phase("extract");
+    dsc::parallel_for(todo.size(), [&](size_t i, size_t worker)
+    {
+        dsc::profile_image_t scope(i);
+        const dsc::image_t &img = *todo[i];
+        dsc::extract_layout_t layout;
+        std::vector<uint8_t> &buf = bufs[worker];
+        bool ok = dsc::extract_plan(cache, img, layout, flags);
+        if(ok)
+        {
+            buf.resize(layout.size);
+            ok = dsc::extract_build(cache, layout, buf.data());
+        }
+        if(!ok)
+        {
+            pack.skip(i);
+        }
+        ok = ok && pack.add(worker, i, img.path, buf.data(), buf.size());
+        if(!ok)
+        {
+            ERR("Failed to extract %s", img.path);
+            ++failed;
+            return;
+        }
+        printf("%zu/%zu\n", ++done, todo.size());
+    });
+    dsc::profile_phase("finish");
+    if(!pack.finish())
+    {
+        return 1;
+    }
+    LOG("%zu extracted, %zu failed, %.1f MiB packed into %.1f MiB (%.2fx)", todo.size() - failed, failed.load(), pack.in / 1048576.0, pack.out / 1048576.0, pack.out ? (double)pack.in / pack.out : 0.0);
+    return failed != 0;
+}
+
+static int extract_main(int argc, const char **argv)
+{
+    int level = 0;
+    uint32_t flags = 0;
+    int arg = 1;
+    while(arg < argc)
+    {
+        if(arg + 1 < argc && strcmp(argv[arg], "--pack") == 0)
+        {
+            char *end;
+            level = (int)strtol(argv[arg + 1], &end, 0);
+            if(*end != '\0' || level == 0)
+            {
+                ERR("Bad --pack level: %s", argv[arg + 1]);
+                return 1;
+            }
+            arg += 2;
+        }
+        else if(strcmp(argv[arg], "--locals") == 0)
+        {
+            flags |= EXTRACT_LOCALS;
+            ++arg;
+        }
+        else if(strcmp(argv[arg], "--stubs") == 0)
+        {
+            flags |= EXTRACT_STUBS;
+            ++arg;
+        }
+        else
+        {
+            break;
+        }
+    }
+    if(argc - arg < 2 || argc - arg > 3)
+    {
+        fprintf(stderr, "Usage: %s [--pack <level>] [--locals] [--stubs] <path-to-cache> <path-to-dir> [library-name]\n", argv[0]);
+        fprintf(stderr, "    --pack    Write a seekable zstd pack at <path-to-dir> instead, compressed at <level>\n");
+        fprintf(stderr, "    --locals  Merge local symbols back in, from the cache or its .symbols file\n");
+        fprintf(stderr, "    --stubs   Point calls into other images at the image's own stubs\n");
+        return 1;
+    }
+    const char *dir = argv[arg + 1],
+               *filter = argc - arg > 2 ? argv[arg + 2] : nullptr;
+    dsc::cache_t cache;
+    if(!cache.open(argv[arg]))
+    {
+        return 1;
+    }
+    LOG("%s: %s", argv[arg], cache.describe().c_str());
+    if(flags & EXTRACT_LOCALS)
+    {
+        const dsc::locals_t &all = cache.locals();
+        if(all.source.empty())
+        {
+            WRN("No local symbols in this cache");
+        }
+        else
+        {
+            LOG("Local symbols: %zu images, from %s", all.entries.size(), all.source.c_str());
+        }
+    }
+    if(flags & EXTRACT_STUBS)
+    {
+        // Decoded up front, so the workers don't all wait on the first one to need them
+        LOG("Stubs and branch islands: %zu", cache.stubs().entries.size());
+    }
+
+    std::vector<const dsc::image_t*> todo;
+    for(const dsc::image_t &img : cache.images)
+    {
+        if(!filter || strstr(img.path, filter))
+        {
+            todo.push_back(&img);
+        }
+    }
+    if(todo.empty())
+    {
+        ERR("No image matching %s", filter);
+        return 1;
+    }
+    std::vector<const char*> paths;
+    for(const dsc::image_t *img : todo)
+    {
+        paths.push_back(img->path);
+    }
+    dsc::profile_images(paths);
+    if(level != 0)
+    {
+        return extract_pack(cache, todo, dir, level, flags);
+    }
+
+    dsc::profile_phase("prepare");
+    dsc::writer_t out;
+    if(!out.init(dir, dsc::jobs(), getenv("DSC_WRITER")))
+    {
+        return 1;
+    }
+    if(!out.prepare(paths))
+    {
+        return 1;
+    }
+    out.probe(cache.fd);
+    bool copies = out.use_copies();
+    LOG("Output: %s writes, in-kernel copies: %s", out.backend, copies ? out.copy : "none");
+    std::atomic<size_t> done(0),
+                        failed(0);
+    dsc::profile_phase("extract");
+    dsc::parallel_for(todo.size(), [&](size_t i, size_t worker)
+    {
+        dsc::profile_image_t scope(i);
+        const dsc::image_t &img = *todo[i];
+        dsc::extract_layout_t layout;
+        uint8_t *buf = nullptr;
+        if(!dsc::extract_plan(cache, img, layout, flags) || !(buf = out.buffer(worker, layout.size)) || !dsc::extract_build(cache, layout, buf, copies))
+        {
+            ERR("Failed to extract %s", img.path);
+            ++failed;
+            return;
+        }
+        if(!out.write(worker, img.path, layout.size, copies ? &layout.copies : nullptr))
+        {
+            return;
+        }
+        printf("%zu/%zu\n", ++done, todo.size());
+    },
+    [&](size_t worker)
+    {
+        out.flush(worker);
+    });
+    // Queued writes that failed were counted as done
+    failed += out.failed;
+    LOG("%zu extracted, %zu failed", todo.size() - failed, failed.load());
+    return failed != 0;
+}
+
+int main(int argc, const char **argv)
+{
+    dsc::profile_init("open");
+    int ret = extract_main(argc, argv);
+    dsc::profile_report();
+    return ret;
+}
@@ -0,0 +1,375 @@
+#define FUSE_USE_VERSION 31
+
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <fuse.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+#include "../src/cache.h"
+#include "../src/common.h"
+#include "../src/extract.h"
+
+// Read-only view of a cache with every image at its install name. Images are
+// rebuilt on first read and kept in an LRU capped at --mem MiB. Open files
+// hold a reference to their buffer, so eviction never pulls data out from
+// under a reader, it only stops the cache from accounting for it.
+
+#define MOUNT_NONE          UINT32_MAX
+#define MOUNT_DEFAULT_MEM   512
+
+typedef std::shared_ptr<const std::vector<uint8_t>> buf_t;
+
+struct node_t
+{
+    std::map<std::string, uint32_t> children;
+    uint32_t image = MOUNT_NONE;    // Index into cache.images for files
+
+    std::mutex lock;                // Serializes planning and building
+    uint64_t size = UINT64_MAX;     // Output size, once planned
+
+    // Protected by mount_t::lock
+    buf_t data;
+    std::list<uint32_t>::iterator lru;
+};
+
+struct mount_t
+{
+    dsc::cache_t cache;
+    std::vector<std::unique_ptr<node_t>> nodes;     // nodes[0] is the root
+    size_t cap = 0;
+
+    std::mutex lock;
+    std::list<uint32_t> lru;                        // Most recently used first
+    size_t used = 0;
+    size_t hits = 0,
+           misses = 0;
+};
+
+struct handle_t
+{
+    uint32_t node;
+    std::mutex lock;
+    buf_t data;
+};
+
+static mount_t mnt;
+
+static uint32_t node_add(uint32_t parent, const std::string &name)
+{
+    node_t &p = *mnt.nodes[parent];
+    auto it = p.children.find(name);
+    if(it != p.children.end())
+    {
+        return it->second;
+    }
+    uint32_t idx = (uint32_t)mnt.nodes.size();
+    mnt.nodes.emplace_back(new node_t());
+    p.children.emplace(name, idx);
+    return idx;
+}
+
+static bool tree_build(void)
+{
+    mnt.nodes.emplace_back(new node_t());
+    for(uint32_t i = 0; i < mnt.cache.images.size(); ++i)
+    {
+        const char *path = mnt.cache.images[i].path;
+        uint32_t n = 0;
+        while(*path)
+        {
+            while(*path == '/')
+            {
+                ++path;
+            }
+            const char *end = strchr(path, '/');
+            if(!end)
+            {
+                end = path + strlen(path);
+            }
+            if(end == path)
+            {
+                break;
+            }
+            std::string name(path, end);
+            // A file can't also be a directory, first image wins
+            if(mnt.nodes[n]->image != MOUNT_NONE)
+            {
+                n = MOUNT_NONE;
+                break;
+            }
+            n = node_add(n, name);
+            path = end;
+        }
+        if(n == MOUNT_NONE || n == 0 || mnt.nodes[n]->image != MOUNT_NONE || !mnt.nodes[n]->children.empty())
+        {
+            WRN("Skipping %s, path clashes with another image", mnt.cache.images[i].path);
+            continue;
+        }
+        mnt.nodes[n]->image = i;
+    }
+    return true;
+}
+
+static uint32_t node_lookup(const char *path)
+{
+    uint32_t n = 0;
+    while(*path)
+    {
+        while(*path == '/')
+        {
+            ++path;
+        }
+        const char *end = strchr(path, '/');
+        if(!end)
+        {
+            end = path + strlen(path);
+        }
+        if(end == path)
+        {
+            break;
+        }
+        const node_t &node = *mnt.nodes[n];
+        auto it = node.children.find(std::string(path, end));
+        if(it == node.children.end())
+        {
+            return MOUNT_NONE;
+        }
+        n = it->second;
+        path = end;
+    }
+    return n;
+}
+
+// Planned output size, or 0 if the image can't be rebuilt.
+static uint64_t node_size(node_t &node)
+{
+    std::lock_guard<std::mutex> guard(node.lock);
+    if(node.size == UINT64_MAX)
+    {
+        dsc::extract_layout_t layout;
+        node.size = dsc::extract_plan(mnt.cache, mnt.cache.images[node.image], layout) ? layout.size : 0;
+    }
+    return node.size;
+}
+
+static buf_t node_data(uint32_t idx)
+{
+    node_t &node = *mnt.nodes[idx];
+    {
+        std::lock_guard<std::mutex> guard(mnt.lock);
+        if(node.data)
+        {
+            mnt.lru.splice(mnt.lru.begin(), mnt.lru, node.lru);
+            ++mnt.hits;
+            return node.data;
+        }
+    }
+
+    // Only one thread builds a given image, others wait for it here
+    std::lock_guard<std::mutex> build(node.lock);
+    {
+        std::lock_guard<std::mutex> guard(mnt.lock);
+        if(node.data)
+        {
+            mnt.lru.splice(mnt.lru.begin(), mnt.lru, node.lru);
+            ++mnt.hits;
+            return node.data;
+        }
+        ++mnt.misses;
+    }
+    std::shared_ptr<std::vector<uint8_t>> data(new std::vector<uint8_t>());
+    if(!dsc::extract_image(mnt.cache, mnt.cache.images[node.image], *data))
+    {
+        return nullptr;
+    }
+    node.size = data->size();
+
+    std::lock_guard<std::mutex> guard(mnt.lock);
+    node.data = data;
+    mnt.lru.push_front(idx);
+    node.lru = mnt.lru.begin();
+    mnt.used += data->size();
+    // An image bigger than the cap still gets served, it just evicts everything else
+    while(mnt.used > mnt.cap && mnt.lru.back() != idx)
+    {
+        node_t &victim = *mnt.nodes[mnt.lru.back()];
+        mnt.used -= victim.data->size();
+        victim.data.reset();
+        mnt.lru.pop_back();
+    }
+    return data;
+}
+
+static int mnt_getattr(const char *path, struct stat *st, struct fuse_file_info *fi)
+{
+    (void)fi;
+    uint32_t idx = node_lookup(path);
+    if(idx == MOUNT_NONE)
+    {
+        return -ENOENT;
+    }
+    node_t &node = *mnt.nodes[idx];
+    memset(st, 0, sizeof(*st));
+    if(node.image == MOUNT_NONE)
+    {
+        st->st_mode = S_IFDIR | 0555;
+        st->st_nlink = 2;
+        return 0;
+    }
+    uint64_t size = node_size(node);
+    if(size == 0)
+    {
+        return -EIO;
+    }
+    st->st_mode = S_IFREG | 0444;
+    st->st_nlink = 1;
+    st->st_size = (off_t)size;
+    return 0;
+}
+
+static int mnt_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t off, struct fuse_file_info *fi, enum fuse_readdir_flags flags)
+{
+    (void)off;
+    (void)fi;
+    (void)flags;
+    uint32_t idx = node_lookup(path);
+    if(idx == MOUNT_NONE)
+    {
+        return -ENOENT;
+    }
+    const node_t &node = *mnt.nodes[idx];
+    if(node.image != MOUNT_NONE)
+    {
+        return -ENOTDIR;
+    }
+    filler(buf, ".", NULL, 0, (enum fuse_fill_dir_flags)0);
+    filler(buf, "..", NULL, 0, (enum fuse_fill_dir_flags)0);
+    for(const auto &kv : node.children)
+    {
+        if(filler(buf, kv.first.c_str(), NULL, 0, (enum fuse_fill_dir_flags)0) != 0)
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+static int mnt_open(const char *path, struct fuse_file_info *fi)
+{
+    uint32_t idx = node_lookup(path);
+    if(idx == MOUNT_NONE)
+    {
+        return -ENOENT;
+    }
+    if(mnt.nodes[idx]->image == MOUNT_NONE)
+    {
+        return -EISDIR;
+    }
+    if((fi->flags & O_ACCMODE) != O_RDONLY)
+    {
+        return -EROFS;
+    }
+    handle_t *h = new handle_t();
+    h->node = idx;
+    fi->fh = (uint64_t)(uintptr_t)h;
+    fi->keep_cache = 1;
+    return 0;
+}
+
+static int mnt_read(const char *path, char *buf, size_t size, off_t off, struct fuse_file_info *fi)
+{
+    (void)path;
+    handle_t *h = (handle_t*)(uintptr_t)fi->fh;
+    buf_t data;
+    {
+        std::lock_guard<std::mutex> guard(h->lock);
+        if(!h->data)
+        {
+            h->data = node_data(h->node);
+        }
+        data = h->data;
+    }
+    if(!data)
+    {
+        return -EIO;
+    }
+    if(off < 0 || (uint64_t)off >= data->size())
+    {
+        return 0;
+    }
+    size_t len = std::min<size_t>(size, data->size() - (size_t)off);
+    memcpy(buf, data->data() + off, len);
+    return (int)len;
+}
+
+static int mnt_release(const char *path, struct fuse_file_info *fi)
+{
+    (void)path;
+    delete (handle_t*)(uintptr_t)fi->fh;
+    return 0;
+}
+
+static void mnt_destroy(void *priv)
+{
+    (void)priv;
+    LOG("%zu builds, %zu cache hits, %zu MiB cached", mnt.misses, mnt.hits, mnt.used >> 20);
+}
+
+int main(int argc, const char **argv)
+{
+    size_t mem = MOUNT_DEFAULT_MEM;
+    int arg = 1;
+    if(arg + 1 < argc && strcmp(argv[arg], "--mem") == 0)
+    {
+        char *end;
+        mem = strtoull(argv[arg + 1], &end, 0);
+        if(*end != '\0' || mem == 0)
+        {
+            ERR("Bad --mem value: %s", argv[arg + 1]);
+            return 1;
+        }
+        arg += 2;
+    }
+    if(argc - arg < 2)
+    {
+        fprintf(stderr, "Usage: %s [--mem <MiB>] <path-to-cache> <mountpoint> [fuse-options...]\n", argv[0]);
+        fprintf(stderr, "    --mem    Memory cap for rebuilt images (default %u MiB)\n", MOUNT_DEFAULT_MEM);
+        return 1;
+    }
+    mnt.cap = mem << 20;
+    if(!mnt.cache.open(argv[arg]) || !tree_build())
+    {
+        return 1;
+    }
+
+    struct fuse_operations ops;
+    memset(&ops, 0, sizeof(ops));
+    ops.getattr = mnt_getattr;
+    ops.readdir = mnt_readdir;
+    ops.open = mnt_open;
+    ops.read = mnt_read;
+    ops.release = mnt_release;
+    ops.destroy = mnt_destroy;
+
+    std::vector<char*> fargs;
+    fargs.push_back((char*)argv[0]);
+    for(int i = arg + 1; i < argc; ++i)
+    {
+        fargs.push_back((char*)argv[i]);
+    }
+    fargs.push_back((char*)"-o");
+    fargs.push_back((char*)"ro,fsname=dsc");
+    fargs.push_back(NULL);
+    return fuse_main((int)fargs.size() - 1, fargs.data(), &ops, NULL);
+}
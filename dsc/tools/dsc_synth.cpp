@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/common.h"
+#include "../src/synth.h"
+
+// Writes synthetic caches of a chosen shape, for benchmarking and for
+// exercising format variants without needing a device image of each. The
+// same options and seed always give the same files.
+
+int main(int argc, const char **argv)
+{
+    dsc::synth_opts_t opts;
+    static const struct
+    {
+        const char *name;
+        int kind;               // 0 size_t, 1 uint64_t, 2 uint32_t
+        void *field;
+    } flags[] =
+    {
+        { "--images",    0, &opts.images    },
+        { "--text",      1, &opts.text      },
+        { "--data",      1, &opts.data      },
+        { "--symbols",   2, &opts.symbols   },
+        { "--slide",     2, &opts.slide     },
+        { "--subcaches", 2, &opts.subcaches },
+        { "--stubs",     2, &opts.stubs     },
+        { "--locals",    2, &opts.locals    },
+        { "--binds",     2, &opts.binds     },
+        { "--patches",   2, &opts.patches   },
+        { "--objc",      2, &opts.objc      },
+        { "--seed",      1, &opts.seed      },
+    };
+    int arg = 1;
+    while(arg + 1 < argc && strncmp(argv[arg], "--", 2) == 0)
+    {
+        size_t i = 0;
+        while(i < sizeof(flags)/sizeof(flags[0]) && strcmp(argv[arg], flags[i].name) != 0)
+        {
+            ++i;
+        }
+        char *end;
+        unsigned long long v = strtoull(argv[arg + 1], &end, 0);
+        if(i == sizeof(flags)/sizeof(flags[0]) || *end != '\0')
+        {
+            ERR("Bad option: %s %s", argv[arg], argv[arg + 1]);
+            return 1;
+        }
+        switch(flags[i].kind)
+        {
+            case 0:  *(size_t*)flags[i].field = (size_t)v; break;
+            case 1:  *(uint64_t*)flags[i].field = (uint64_t)v; break;
+            default: *(uint32_t*)flags[i].field = (uint32_t)v; break;
+        }
+        arg += 2;
+    }
+    if(argc - arg != 1)
+    {
+        fprintf(stderr, "Usage: %s [options] <path-to-cache>\n", argv[0]);
+        fprintf(stderr, "    --images <n>       Number of images (%zu)\n", opts.images);
+        fprintf(stderr, "    --text <bytes>     __TEXT per image (0x%llx)\n", (unsigned long long)opts.text);
+        fprintf(stderr, "    --data <bytes>     __DATA per image (0x%llx)\n", (unsigned long long)opts.data);
+        fprintf(stderr, "    --symbols <n>      Exports per image (%u)\n", opts.symbols);
+        fprintf(stderr, "    --slide <v>        Slide info version 0-5 (%u), 3 and 5 are arm64e, 4 is arm64_32\n", opts.slide);
+        fprintf(stderr, "    --subcaches <n>    Files besides the main one (%u)\n", opts.subcaches);
+        fprintf(stderr, "    --stubs <n>        Calls per image into its dependencies, through __stubs and direct (%u)\n", opts.stubs);
+        fprintf(stderr, "    --locals <n>       Local symbols per image, in the local symbols region (%u)\n", opts.locals);
+        fprintf(stderr, "    --binds <n>        Pointers per image to exports of its dependencies, in the patch table (%u)\n", opts.binds);
+        fprintf(stderr, "    --patches <v>      Patch table version 1-4, 0 for the one that came with the slide version (%u)\n", opts.patches);
+        fprintf(stderr, "    --objc <n>         Objective-C classes per image, listed in libobjc's v16 tables, v3 and v5 only (%u)\n", opts.objc);
+        fprintf(stderr, "    --seed <n>         (%llu)\n", (unsigned long long)opts.seed);
+        return 1;
+    }
+    if(!dsc::synth_write(argv[arg], opts))
+    {
+        return 1;
+    }
+    LOG("Wrote %s: %zu images, slide info v%u, %u subcaches", argv[arg], opts.images, opts.slide, opts.subcaches);
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "../src/common.h"
+#include "../src/extract.h"
+#include "../src/pack.h"
+
+// Reads packs written by dsc_extract --pack. Listing only touches the index,
+// and each image that is extracted is decompressed on its own, so pulling a
+// single library out of a large pack costs about as much as that library.
+
+int main(int argc, const char **argv)
+{
+    if(argc < 2 || argc > 4)
+    {
+        fprintf(stderr, "Usage: %s <path-to-pack> [<path-to-dir> [library-name]]\n", argv[0]);
+        fprintf(stderr, "    Without a directory, lists the images in the pack.\n");
+        return 1;
+    }
+    dsc::pack_t pack;
+    if(!pack.open(argv[1]))
+    {
+        return 1;
+    }
+    if(argc == 2)
+    {
+        uint64_t size = 0,
+                 csize = 0;
+        for(const dsc::pack_t::entry_t &e : pack.entries)
+        {
+            printf("%10u %10u %s\n", e.size, e.csize, e.name);
+            size += e.size;
+            csize += e.csize;
+        }
+        LOG("%zu images, %.1f MiB in %.1f MiB", pack.entries.size(), size / 1048576.0, csize / 1048576.0);
+        return 0;
+    }
+
+    const char *dir = argv[2],
+               *filter = argc > 3 ? argv[3] : nullptr;
+    std::vector<const dsc::pack_t::entry_t*> todo;
+    for(const dsc::pack_t::entry_t &e : pack.entries)
+    {
+        if(!filter || strstr(e.name, filter))
+        {
+            todo.push_back(&e);
+        }
+    }
+    if(todo.empty())
+    {
+        ERR("No image matching %s", filter);
+        return 1;
+    }
+    std::vector<std::vector<uint8_t>> bufs(dsc::jobs());
+    std::atomic<size_t> done(0),
+                        failed(0);
+    dsc::parallel_for(todo.size(), [&](size_t i, size_t worker)
+    {
+        const dsc::pack_t::entry_t &e = *todo[i];
+        std::vector<uint8_t> &buf = bufs[worker];
+        if(!pack.read(e, buf) || !dsc::extract_write(dir, e.name, buf.data(), buf.size()))
+        {
+            ++failed;
+            return;
+        }
+        printf("%zu/%zu\n", ++done, todo.size());
+    });
+    LOG("%zu extracted, %zu failed", todo.size() - failed, failed.load());
+    return failed != 0;
+}
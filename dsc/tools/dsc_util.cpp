@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/modes.h"
+#include "../src/profile.h"
+
+// dyld's dyld_shared_cache_util main(), renamed by build.sh
+extern int siguza_dsc_util_main(int argc, const char *argv[]);
+
+static const struct
+{
+    const char *name;
+    const char *args;
+    int (*fn)(int, const char**);
+} modes[] =
+{
+    { "exports",       "<path-to-cache> [library-name]", dsc::mode_exports },
+    { "diff",          "<path-to-cache-a> <path-to-cache-b>", dsc::mode_diff },
+    { "graph",         "<path-to-cache> dot|json|bin|topo|scc|closure [library-name]", dsc::mode_graph },
+    { "objc-index",    "<path-to-cache> <index-file>", dsc::mode_objc_index },
+    { "objc-query",    "<index-file> class|selector|protocol <name>", dsc::mode_objc_query },
+    { "swift-index",   "<path-to-cache> <index-file>", dsc::mode_swift_index },
+    { "swift-query",   "<index-file> type|protocol <name>", dsc::mode_swift_query },
+    { "stubs-index",   "<path-to-cache> <index-file>", dsc::mode_stubs_index },
+    { "stubs-query",   "<index-file> <address>|<symbol>", dsc::mode_stubs_query },
+    { "patches-index", "<path-to-cache> <index-file>", dsc::mode_patches_index },
+    { "patches-query", "<index-file> <symbol>|<install-name>", dsc::mode_patches_query },
+    { "remote",        "<url> <path-to-dir> <library-name> [zip-member]", dsc::mode_remote },
+};
+
+int main(int argc, const char **argv)
+{
+    if(argc >= 2)
+    {
+        for(size_t i = 0; i < sizeof(modes)/sizeof(modes[0]); ++i)
+        {
+            if(strcmp(argv[1], modes[i].name) == 0)
+            {
+                dsc::profile_init(modes[i].name);
+                int ret = modes[i].fn(argc - 1, argv + 1);
+                dsc::profile_report();
+                return ret;
+            }
+        }
+    }
+    else
+    {
+        fprintf(stderr, "Additional modes:\n");
+        for(size_t i = 0; i < sizeof(modes)/sizeof(modes[0]); ++i)
+        {
+            fprintf(stderr, "    dsc_util %s %s\n", modes[i].name, modes[i].args);
+        }
+        fprintf(stderr, "\n");
+    }
+    dsc::profile_init("dsc_util");
+    int ret = siguza_dsc_util_main(argc, argv);
+    dsc::profile_report();
+    return ret;
+}